@@ -3,14 +3,58 @@
 #include "settings.h"
 #include "assets/lang_config.h"
 #include "base64_utils.h"
+#include "sse_parser.h"
+#include "latency_trace.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <cJSON.h>
 #include <cstring>
 #include <algorithm>
 
 #define TAG "AIModelAdapter"
 
+// Time to first token of a streamed completion, from sending the request to the first text delta
+class FirstTokenTimer {
+public:
+    explicit FirstTokenTimer(const char* provider) : provider_(provider), start_us_(esp_timer_get_time()) {
+        LATENCY_TRACE(kTraceLlmRequest, 0);
+    }
+
+    void OnToken() {
+        if (first_token_) {
+            return;
+        }
+        first_token_ = true;
+        int ms = (esp_timer_get_time() - start_us_) / 1000;
+        LATENCY_TRACE(kTraceLlmFirstToken, ms);
+        ESP_LOGI(TAG, "%s first token after %d ms", provider_, ms);
+    }
+
+private:
+    const char* provider_;
+    int64_t start_us_;
+    bool first_token_ = false;
+};
+
+// Feeds a text/event-stream response to the parser as it comes off the socket, the body is never held in full
+static bool ReadEventStream(Http* http, SseParser& parser) {
+    char buffer[512];
+    while (true) {
+        int ret = http->Read(buffer, sizeof(buffer));
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Failed to read event stream");
+            return false;
+        }
+        if (ret == 0) {
+            break;
+        }
+        parser.Feed(buffer, ret);
+    }
+    parser.Finish();
+    return true;
+}
+
 // 静态工厂方法
 std::unique_ptr<AIModelAdapter> AIModelAdapter::CreateAdapter(AIModelProvider provider) {
     switch (provider) {
@@ -142,6 +186,16 @@ bool OpenAIAdapter::Initialize(const AIModelConfig& config) {
         config_.model_name = "gpt-4o-realtime-preview";
     }
     
+    // Realtime audio is pcm16 at 24 kHz or G.711 at 8 kHz, other formats fall back to G.711 μ-law
+    if (config_.audio_format == "pcm16") {
+        config_.sample_rate = 24000;
+    } else if (config_.audio_format == "g711_ulaw" || config_.audio_format == "g711_alaw") {
+        config_.sample_rate = 8000;
+    } else {
+        config_.audio_format = "g711_ulaw";
+        config_.sample_rate = 8000;
+    }
+    
     return true;
 }
 
@@ -179,14 +233,16 @@ bool OpenAIAdapter::Connect() {
     }
     
     // 设置消息处理回调
-    websocket_->OnMessage([this](const std::string& message) {
-        HandleWebSocketMessage(message);
+    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+        if (!binary) {
+            HandleWebSocketMessage(data, len);
+        }
     });
     
-    websocket_->OnError([this](const std::string& error) {
-        ESP_LOGE(TAG, "WebSocket error: %s", error.c_str());
-        if (error_callback_) {
-            error_callback_(error);
+    websocket_->OnDisconnected([this]() {
+        ESP_LOGE(TAG, "WebSocket disconnected");
+        if (connected_ && error_callback_) {
+            error_callback_("Disconnected from OpenAI");
         }
         connected_ = false;
     });
@@ -205,11 +261,9 @@ bool OpenAIAdapter::Connect() {
 }
 
 void OpenAIAdapter::Disconnect() {
-    if (websocket_) {
-        websocket_->Close();
-        websocket_.reset();
-    }
+    // Closing on purpose is not reported as an error
     connected_ = false;
+    websocket_.reset();
     session_id_.clear();
 }
 
@@ -233,8 +287,7 @@ bool OpenAIAdapter::SendAudioData(const std::vector<uint8_t>& audio_data) {
         return false;
     }
     
-    std::string json_message = CreateAudioMessage(audio_data);
-    return websocket_->Send(json_message);
+    return websocket_->Send(CreateAudioMessage(audio_data));
 }
 
 bool OpenAIAdapter::StartVoiceSession() {
@@ -255,7 +308,7 @@ void OpenAIAdapter::SetTextResponseCallback(std::function<void(const std::string
     text_callback_ = callback;
 }
 
-void OpenAIAdapter::SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) {
+void OpenAIAdapter::SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) {
     audio_callback_ = callback;
 }
 
@@ -267,23 +320,58 @@ void OpenAIAdapter::SetStatusCallback(std::function<void(const std::string&)> ca
     status_callback_ = callback;
 }
 
-void OpenAIAdapter::HandleWebSocketMessage(const std::string& message) {
-    cJSON* json = cJSON_Parse(message.c_str());
-    if (!json) {
-        ESP_LOGE(TAG, "Failed to parse JSON message");
+// Realtime events put their type first, so audio deltas are recognized without scanning the message
+static constexpr std::string_view kAudioDeltaPrefix = "{\"type\":\"response.audio.delta\"";
+static constexpr std::string_view kDeltaKey = "\"delta\":\"";
+
+// Audio deltas are most of the realtime traffic, the base64 is decoded straight from the receive buffer
+bool OpenAIAdapter::HandleAudioDelta(const char* data, size_t length) {
+    std::string_view text(data, length);
+    if (!text.starts_with(kAudioDeltaPrefix)) {
+        return false;
+    }
+    auto start = text.find(kDeltaKey, kAudioDeltaPrefix.size());
+    if (start == std::string_view::npos) {
+        return false;
+    }
+    start += kDeltaKey.size();
+    // Base64 has no escape sequences, the next quote ends the string
+    auto end = text.find('"', start);
+    if (end == std::string_view::npos) {
+        return false;
+    }
+    DeliverAudio(text.substr(start, end - start));
+    return true;
+}
+
+void OpenAIAdapter::DeliverAudio(std::string_view base64_audio) {
+    if (!audio_callback_) {
         return;
     }
-    
-    cJSON* type = cJSON_GetObjectItem(json, "type");
-    if (!cJSON_IsString(type)) {
-        cJSON_Delete(json);
+    // The receiver swaps a free buffer into the packet, so steady-state deltas do not allocate
+    auto& payload = incoming_packet_.payload;
+    payload.resize(Base64Utils::DecodedSize(base64_audio.size()));
+    payload.resize(Base64Utils::Decode(base64_audio.data(), base64_audio.size(), payload.data()));
+    incoming_packet_.headroom = 0;
+    incoming_packet_.timestamp = 0;
+    audio_callback_(std::move(incoming_packet_));
+}
+
+void OpenAIAdapter::HandleWebSocketMessage(const char* data, size_t length) {
+    if (HandleAudioDelta(data, length)) {
         return;
     }
-    
-    std::string type_str = type->valuestring;
-    
-    if (type_str == "session.created") {
-        cJSON* session = cJSON_GetObjectItem(json, "session");
+
+    // Other events are rare, only the routing fields are scanned and nested objects are parsed on demand
+    JsonMessage message(data, length);
+    if (!message.valid()) {
+        ESP_LOGE(TAG, "Failed to parse JSON message");
+        return;
+    }
+
+    auto type = message.type();
+    if (type == "session.created") {
+        cJSON* session = cJSON_GetObjectItem(message.root(), "session");
         if (session) {
             cJSON* id = cJSON_GetObjectItem(session, "id");
             if (cJSON_IsString(id)) {
@@ -291,21 +379,25 @@ void OpenAIAdapter::HandleWebSocketMessage(const std::string& message) {
                 ESP_LOGI(TAG, "Session created: %s", session_id_.c_str());
             }
         }
-    } else if (type_str == "response.audio.delta") {
-        cJSON* delta = cJSON_GetObjectItem(json, "delta");
-        if (cJSON_IsString(delta) && audio_callback_) {
-            // Base64 解码音频数据
-            std::string base64_audio = delta->valuestring;
-            std::vector<uint8_t> audio_data = Base64Utils::Decode(base64_audio);
-            audio_callback_(audio_data);
+    } else if (type == "response.audio.delta") {
+        std::string_view delta;
+        if (message.GetString("delta", delta)) {
+            DeliverAudio(delta);
+        }
+    } else if (type == "response.audio.done") {
+        if (status_callback_) {
+            status_callback_(AI_MODEL_STATUS_AUDIO_DONE);
         }
-    } else if (type_str == "response.text.delta") {
-        cJSON* delta = cJSON_GetObjectItem(json, "delta");
-        if (cJSON_IsString(delta) && text_callback_) {
-            text_callback_(delta->valuestring);
+    } else if (type == "response.text.delta") {
+        if (text_callback_) {
+            text_callback_(message.GetText("delta"));
         }
-    } else if (type_str == "error") {
-        cJSON* error = cJSON_GetObjectItem(json, "error");
+    } else if (type == "response.text.done") {
+        if (status_callback_) {
+            status_callback_(AI_MODEL_STATUS_TEXT_DONE);
+        }
+    } else if (type == "error") {
+        cJSON* error = cJSON_GetObjectItem(message.root(), "error");
         if (error) {
             cJSON* message_obj = cJSON_GetObjectItem(error, "message");
             if (cJSON_IsString(message_obj) && error_callback_) {
@@ -313,8 +405,6 @@ void OpenAIAdapter::HandleWebSocketMessage(const std::string& message) {
             }
         }
     }
-    
-    cJSON_Delete(json);
 }
 
 std::string OpenAIAdapter::CreateSessionConfig() {
@@ -329,15 +419,9 @@ std::string OpenAIAdapter::CreateSessionConfig() {
     cJSON_AddStringToObject(voice, "voice", config_.voice_name.c_str());
     cJSON_AddItemToObject(session, "voice", voice);
 
-    cJSON* input_audio_format = cJSON_CreateObject();
-    cJSON_AddStringToObject(input_audio_format, "type", "g711_ulaw");
-    cJSON_AddNumberToObject(input_audio_format, "sample_rate", 8000);
-    cJSON_AddItemToObject(session, "input_audio_format", input_audio_format);
-
-    cJSON* output_audio_format = cJSON_CreateObject();
-    cJSON_AddStringToObject(output_audio_format, "type", "g711_ulaw");
-    cJSON_AddNumberToObject(output_audio_format, "sample_rate", 8000);
-    cJSON_AddItemToObject(session, "output_audio_format", output_audio_format);
+    // The sample rate is implied by the format
+    cJSON_AddStringToObject(session, "input_audio_format", config_.audio_format.c_str());
+    cJSON_AddStringToObject(session, "output_audio_format", config_.audio_format.c_str());
 
     cJSON_AddItemToObject(root, "session", session);
 
@@ -374,20 +458,13 @@ std::string OpenAIAdapter::CreateTextMessage(const std::string& text) {
     return result;
 }
 
-std::string OpenAIAdapter::CreateAudioMessage(const std::vector<uint8_t>& audio_data) {
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "input_audio_buffer.append");
-
-    // Base64编码音频数据
-    std::string base64_audio = Base64Utils::Encode(audio_data);
-    cJSON_AddStringToObject(root, "audio", base64_audio.c_str());
-
-    char* json_string = cJSON_PrintUnformatted(root);
-    std::string result(json_string);
-    cJSON_free(json_string);
-    cJSON_Delete(root);
-
-    return result;
+// Base64 needs no escaping, so the audio is encoded straight into the reused message buffer
+const std::string& OpenAIAdapter::CreateAudioMessage(const std::vector<uint8_t>& audio_data) {
+    static constexpr std::string_view kPrefix = "{\"type\":\"input_audio_buffer.append\",\"audio\":\"";
+    audio_message_.assign(kPrefix);
+    Base64Utils::Encode(audio_data.data(), audio_data.size(), audio_message_);
+    audio_message_.append("\"}");
+    return audio_message_;
 }
 
 // Google 适配器实现
@@ -454,10 +531,12 @@ bool GoogleAdapter::SendTextMessage(const std::string& message) {
     }
 
     std::string request_body = CreateChatRequest(message);
-    std::string url = config_.base_url + "/" + config_.model_name + ":generateContent?key=" + config_.api_key;
+    // alt=sse streams the answer as one GenerateContentResponse per event
+    std::string url = config_.base_url + "/" + config_.model_name + ":streamGenerateContent?alt=sse&key=" + config_.api_key;
 
     http_->SetContent(request_body);
 
+    FirstTokenTimer timer("Google");
     if (!http_->Open("POST", url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
@@ -465,14 +544,21 @@ bool GoogleAdapter::SendTextMessage(const std::string& message) {
 
     if (http_->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "HTTP request failed with status: %d", http_->GetStatusCode());
+        http_->Close();
         return false;
     }
 
-    std::string response = http_->ReadAll();
+    SseParser parser;
+    parser.OnEvent([this, &timer](std::string_view event, std::string_view data) {
+        ProcessChatChunk(data, timer);
+    });
+    bool completed = ReadEventStream(http_.get(), parser);
     http_->Close();
-
-    ProcessChatResponse(response);
-    return true;
+    // Text cut short by a read error is shown all the same
+    if (status_callback_) {
+        status_callback_(AI_MODEL_STATUS_TEXT_DONE);
+    }
+    return completed;
 }
 
 bool GoogleAdapter::SendAudioData(const std::vector<uint8_t>& audio_data) {
@@ -494,7 +580,7 @@ void GoogleAdapter::SetTextResponseCallback(std::function<void(const std::string
     text_callback_ = callback;
 }
 
-void GoogleAdapter::SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) {
+void GoogleAdapter::SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) {
     audio_callback_ = callback;
 }
 
@@ -540,8 +626,8 @@ std::string GoogleAdapter::CreateChatRequest(const std::string& message) {
     return result;
 }
 
-void GoogleAdapter::ProcessChatResponse(const std::string& response) {
-    cJSON* root = cJSON_Parse(response.c_str());
+void GoogleAdapter::ProcessChatChunk(std::string_view data, FirstTokenTimer& timer) {
+    cJSON* root = cJSON_ParseWithLength(data.data(), data.size());
     if (!root) {
         ESP_LOGE(TAG, "Failed to parse Google response");
         if (error_callback_) {
@@ -554,12 +640,13 @@ void GoogleAdapter::ProcessChatResponse(const std::string& response) {
     if (cJSON_IsArray(candidates) && cJSON_GetArraySize(candidates) > 0) {
         cJSON* candidate = cJSON_GetArrayItem(candidates, 0);
         cJSON* content = cJSON_GetObjectItem(candidate, "content");
-        if (content) {
-            cJSON* parts = cJSON_GetObjectItem(content, "parts");
-            if (cJSON_IsArray(parts) && cJSON_GetArraySize(parts) > 0) {
-                cJSON* part = cJSON_GetArrayItem(parts, 0);
-                cJSON* text = cJSON_GetObjectItem(part, "text");
-                if (cJSON_IsString(text) && text_callback_) {
+        cJSON* parts = content ? cJSON_GetObjectItem(content, "parts") : nullptr;
+        cJSON* part;
+        cJSON_ArrayForEach(part, parts) {
+            cJSON* text = cJSON_GetObjectItem(part, "text");
+            if (cJSON_IsString(text) && text->valuestring[0] != '\0') {
+                timer.OnToken();
+                if (text_callback_) {
                     text_callback_(text->valuestring);
                 }
             }
@@ -646,6 +733,7 @@ bool AnthropicAdapter::SendTextMessage(const std::string& message) {
 
     http_->SetContent(request_body);
 
+    FirstTokenTimer timer("Anthropic");
     if (!http_->Open("POST", config_.base_url)) {
         ESP_LOGE(TAG, "Failed to open HTTP connection");
         return false;
@@ -653,14 +741,20 @@ bool AnthropicAdapter::SendTextMessage(const std::string& message) {
 
     if (http_->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "HTTP request failed with status: %d", http_->GetStatusCode());
+        http_->Close();
         return false;
     }
 
-    std::string response = http_->ReadAll();
+    SseParser parser;
+    parser.OnEvent([this, &timer](std::string_view event, std::string_view data) {
+        ProcessMessageEvent(event, data, timer);
+    });
+    bool completed = ReadEventStream(http_.get(), parser);
     http_->Close();
-
-    ProcessMessageResponse(response);
-    return true;
+    if (status_callback_) {
+        status_callback_(AI_MODEL_STATUS_TEXT_DONE);
+    }
+    return completed;
 }
 
 bool AnthropicAdapter::SendAudioData(const std::vector<uint8_t>& audio_data) {
@@ -681,7 +775,7 @@ void AnthropicAdapter::SetTextResponseCallback(std::function<void(const std::str
     text_callback_ = callback;
 }
 
-void AnthropicAdapter::SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) {
+void AnthropicAdapter::SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) {
     audio_callback_ = callback;
 }
 
@@ -698,6 +792,7 @@ std::string AnthropicAdapter::CreateMessageRequest(const std::string& message) {
 
     cJSON_AddStringToObject(root, "model", config_.model_name.c_str());
     cJSON_AddNumberToObject(root, "max_tokens", 1024);
+    cJSON_AddBoolToObject(root, "stream", true);
 
     if (!config_.system_prompt.empty()) {
         cJSON_AddStringToObject(root, "system", config_.system_prompt.c_str());
@@ -718,8 +813,13 @@ std::string AnthropicAdapter::CreateMessageRequest(const std::string& message) {
     return result;
 }
 
-void AnthropicAdapter::ProcessMessageResponse(const std::string& response) {
-    cJSON* root = cJSON_Parse(response.c_str());
+// Only text deltas and errors matter here, message_start, ping, content_block_start/stop and message_delta/stop are skipped
+void AnthropicAdapter::ProcessMessageEvent(std::string_view event, std::string_view data, FirstTokenTimer& timer) {
+    if (event != "content_block_delta" && event != "error") {
+        return;
+    }
+
+    cJSON* root = cJSON_ParseWithLength(data.data(), data.size());
     if (!root) {
         ESP_LOGE(TAG, "Failed to parse Anthropic response");
         if (error_callback_) {
@@ -728,12 +828,14 @@ void AnthropicAdapter::ProcessMessageResponse(const std::string& response) {
         return;
     }
 
-    cJSON* content = cJSON_GetObjectItem(root, "content");
-    if (cJSON_IsArray(content) && cJSON_GetArraySize(content) > 0) {
-        cJSON* content_item = cJSON_GetArrayItem(content, 0);
-        cJSON* text = cJSON_GetObjectItem(content_item, "text");
-        if (cJSON_IsString(text) && text_callback_) {
-            text_callback_(text->valuestring);
+    if (event == "content_block_delta") {
+        cJSON* delta = cJSON_GetObjectItem(root, "delta");
+        cJSON* text = delta ? cJSON_GetObjectItem(delta, "text") : nullptr;
+        if (cJSON_IsString(text)) {
+            timer.OnToken();
+            if (text_callback_) {
+                text_callback_(text->valuestring);
+            }
         }
     } else {
         cJSON* error = cJSON_GetObjectItem(root, "error");
@@ -839,7 +941,7 @@ void CustomAdapter::SetTextResponseCallback(std::function<void(const std::string
     text_callback_ = callback;
 }
 
-void CustomAdapter::SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) {
+void CustomAdapter::SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) {
     audio_callback_ = callback;
 }
 
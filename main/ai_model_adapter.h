@@ -2,6 +2,7 @@
 #define AI_MODEL_ADAPTER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
 #include <memory>
@@ -10,6 +11,13 @@
 #include <cJSON.h>
 #include "protocol.h"
 
+// Reported through the status callback when the audio of a response is complete
+#define AI_MODEL_STATUS_AUDIO_DONE "audio_done"
+// Reported through the status callback after the last text delta of a response
+#define AI_MODEL_STATUS_TEXT_DONE "text_done"
+
+class FirstTokenTimer;
+
 enum class AIModelProvider {
     kXiaozhi,
     kOpenAI,
@@ -71,7 +79,7 @@ public:
     
     // 设置回调函数
     virtual void SetTextResponseCallback(std::function<void(const std::string&)> callback) = 0;
-    virtual void SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) = 0;
+    virtual void SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) = 0;
     virtual void SetErrorCallback(std::function<void(const std::string&)> callback) = 0;
     virtual void SetStatusCallback(std::function<void(const std::string&)> callback) = 0;
     
@@ -106,7 +114,7 @@ public:
     bool StopVoiceSession() override;
     
     void SetTextResponseCallback(std::function<void(const std::string&)> callback) override;
-    void SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) override;
+    void SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) override;
     void SetErrorCallback(std::function<void(const std::string&)> callback) override;
     void SetStatusCallback(std::function<void(const std::string&)> callback) override;
     
@@ -119,14 +127,20 @@ private:
     std::string session_id_;
     
     std::function<void(const std::string&)> text_callback_;
-    std::function<void(const std::vector<uint8_t>&)> audio_callback_;
+    std::function<void(AudioStreamPacket&& packet)> audio_callback_;
     std::function<void(const std::string&)> error_callback_;
     std::function<void(const std::string&)> status_callback_;
-    
-    void HandleWebSocketMessage(const std::string& message);
+    // Downlink packet reused for every audio delta, only touched by the websocket receive task
+    AudioStreamPacket incoming_packet_;
+    // Uplink message reused across frames, built by the sender
+    std::string audio_message_;
+    
+    void HandleWebSocketMessage(const char* data, size_t length);
+    bool HandleAudioDelta(const char* data, size_t length);
+    void DeliverAudio(std::string_view base64_audio);
     std::string CreateSessionConfig();
     std::string CreateTextMessage(const std::string& text);
-    std::string CreateAudioMessage(const std::vector<uint8_t>& audio_data);
+    const std::string& CreateAudioMessage(const std::vector<uint8_t>& audio_data);
 };
 
 // Google Gemini 适配器
@@ -150,7 +164,7 @@ public:
     bool StopVoiceSession() override;
     
     void SetTextResponseCallback(std::function<void(const std::string&)> callback) override;
-    void SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) override;
+    void SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) override;
     void SetErrorCallback(std::function<void(const std::string&)> callback) override;
     void SetStatusCallback(std::function<void(const std::string&)> callback) override;
     
@@ -162,12 +176,12 @@ private:
     bool connected_ = false;
     
     std::function<void(const std::string&)> text_callback_;
-    std::function<void(const std::vector<uint8_t>&)> audio_callback_;
+    std::function<void(AudioStreamPacket&& packet)> audio_callback_;
     std::function<void(const std::string&)> error_callback_;
     std::function<void(const std::string&)> status_callback_;
     
     std::string CreateChatRequest(const std::string& message);
-    void ProcessChatResponse(const std::string& response);
+    void ProcessChatChunk(std::string_view data, FirstTokenTimer& timer);
 };
 
 // Anthropic Claude 适配器
@@ -191,7 +205,7 @@ public:
     bool StopVoiceSession() override;
     
     void SetTextResponseCallback(std::function<void(const std::string&)> callback) override;
-    void SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) override;
+    void SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) override;
     void SetErrorCallback(std::function<void(const std::string&)> callback) override;
     void SetStatusCallback(std::function<void(const std::string&)> callback) override;
     
@@ -203,12 +217,12 @@ private:
     bool connected_ = false;
     
     std::function<void(const std::string&)> text_callback_;
-    std::function<void(const std::vector<uint8_t>&)> audio_callback_;
+    std::function<void(AudioStreamPacket&& packet)> audio_callback_;
     std::function<void(const std::string&)> error_callback_;
     std::function<void(const std::string&)> status_callback_;
     
     std::string CreateMessageRequest(const std::string& message);
-    void ProcessMessageResponse(const std::string& response);
+    void ProcessMessageEvent(std::string_view event, std::string_view data, FirstTokenTimer& timer);
 };
 
 // 自定义服务器适配器
@@ -232,7 +246,7 @@ public:
     bool StopVoiceSession() override;
     
     void SetTextResponseCallback(std::function<void(const std::string&)> callback) override;
-    void SetAudioResponseCallback(std::function<void(const std::vector<uint8_t>&)> callback) override;
+    void SetAudioResponseCallback(std::function<void(AudioStreamPacket&& packet)> callback) override;
     void SetErrorCallback(std::function<void(const std::string&)> callback) override;
     void SetStatusCallback(std::function<void(const std::string&)> callback) override;
     
@@ -244,7 +258,7 @@ private:
     bool connected_ = false;
     
     std::function<void(const std::string&)> text_callback_;
-    std::function<void(const std::vector<uint8_t>&)> audio_callback_;
+    std::function<void(AudioStreamPacket&& packet)> audio_callback_;
     std::function<void(const std::string&)> error_callback_;
     std::function<void(const std::string&)> status_callback_;
 };
@@ -13,6 +13,7 @@
 #include "mcp_server.h"
 #include "ai_model_tools.h"
 #include "audio_debugger.h"
+#include "latency_trace.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "afe_audio_processor.h"
@@ -29,6 +30,7 @@
 #endif
 
 #include <cstring>
+#include <array>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
@@ -54,7 +56,8 @@ static const char* const STATE_STRINGS[] = {
 
 Application::Application() {
     event_group_ = xEventGroupCreate();
-    background_task_ = new BackgroundTask(4096 * 7);
+    background_task_ = new BackgroundTask(AUDIO_ENCODE_WORKER_STACK_SIZE, AUDIO_DECODE_WORKER_STACK_SIZE);
+    main_tasks_.reserve(MAIN_TASK_RESERVE);
 
 #if CONFIG_USE_DEVICE_AEC
     aec_mode_ = kAecOnDeviceSide;
@@ -154,10 +157,9 @@ void Application::CheckNewVersion(Ota& ota) {
             auto codec = board.GetAudioCodec();
             codec->EnableInput(false);
             codec->EnableOutput(false);
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                audio_decode_queue_.clear();
-            }
+            audio_decode_queue_.Clear();
+            xEventGroupSetBits(event_group_, AUDIO_DECODE_QUEUE_POP_EVENT);
+            audio_jitter_buffer_.Reset();
             background_task_->WaitForCompletion();
             delete background_task_;
             background_task_ = nullptr;
@@ -262,47 +264,47 @@ void Application::DismissAlert() {
 }
 
 void Application::PlaySound(const std::string_view& sound) {
+    std::lock_guard<std::mutex> lock(audio_decode_producer_mutex_);
+    // Cleared before every check of the queue, so a pop between the check and the wait is not missed
+    xEventGroupClearBits(event_group_, AUDIO_DECODE_QUEUE_POP_EVENT);
     // Wait for the previous sound to finish
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        audio_decode_cv_.wait(lock, [this]() {
-            return audio_decode_queue_.empty();
-        });
+    while (!audio_decode_queue_.Empty()) {
+        xEventGroupWaitBits(event_group_, AUDIO_DECODE_QUEUE_POP_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
     }
-    background_task_->WaitForCompletion();
+    background_task_->WaitForCompletion(kBackgroundTaskLaneRealtime);
 
     const char* data = sound.data();
     size_t size = sound.size();
+    auto& packet = sound_packet_;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = 0;
     for (const char* p = data; p < data + size; ) {
         auto p3 = (BinaryProtocol3*)p;
         p += sizeof(BinaryProtocol3);
 
         auto payload_size = ntohs(p3->payload_size);
-        AudioStreamPacket packet;
-        packet.sample_rate = 16000;
-        packet.frame_duration = 60;
-        packet.payload.resize(payload_size);
-        memcpy(packet.payload.data(), p3->payload, payload_size);
+        packet.payload.assign(p3->payload, p3->payload + payload_size);
         p += payload_size;
 
-        std::lock_guard<std::mutex> lock(mutex_);
-        audio_decode_queue_.emplace_back(std::move(packet));
+        // Sounds can be longer than the queue, wait for the audio loop to make room
+        while (!audio_decode_queue_.Push(packet)) {
+            xEventGroupWaitBits(event_group_, AUDIO_DECODE_QUEUE_POP_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
     }
 }
 
 void Application::EnterAudioTestingMode() {
     ESP_LOGI(TAG, "Entering audio testing mode");
     ResetDecoder();
+    audio_testing_queue_.Clear();
     SetDeviceState(kDeviceStateAudioTesting);
 }
 
 void Application::ExitAudioTestingMode() {
     ESP_LOGI(TAG, "Exiting audio testing mode");
+    // The recorded packets in audio_testing_queue_ are played back by OnAudioOutput
     SetDeviceState(kDeviceStateWifiConfiguring);
-    // Copy audio_testing_queue_ to audio_decode_queue_
-    std::lock_guard<std::mutex> lock(mutex_);
-    audio_decode_queue_ = std::move(audio_testing_queue_);
-    audio_decode_cv_.notify_all();
 }
 
 void Application::ToggleChatState() {
@@ -326,6 +328,7 @@ void Application::ToggleChatState() {
         Schedule([this]() {
             if (!protocol_->IsAudioChannelOpened()) {
                 SetDeviceState(kDeviceStateConnecting);
+                ApplyUplinkAudioParams();
                 if (!protocol_->OpenAudioChannel()) {
                     return;
                 }
@@ -362,6 +365,7 @@ void Application::StartListening() {
         Schedule([this]() {
             if (!protocol_->IsAudioChannelOpened()) {
                 SetDeviceState(kDeviceStateConnecting);
+                ApplyUplinkAudioParams();
                 if (!protocol_->OpenAudioChannel()) {
                     return;
                 }
@@ -411,7 +415,9 @@ void Application::Start() {
     /* Setup the audio codec */
     auto codec = board.GetAudioCodec();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    opus_encoder_ = std::make_unique<UplinkOpusEncoder>(16000, 1, OPUS_FRAME_DURATION_MS);
+    // Protocols write their header in front of the Opus data instead of copying it
+    opus_encoder_->SetHeadroom(AUDIO_PACKET_HEADROOM);
     opus_encoder_->SetComplexity(0);
     if (aec_mode_ != kAecOff) {
         ESP_LOGI(TAG, "AEC mode: %d, setting opus encoder complexity to 0", aec_mode_);
@@ -426,12 +432,17 @@ void Application::Start() {
 #endif
     }
 
-    if (codec->input_sample_rate() != 16000) {
-        input_resampler_.Configure(codec->input_sample_rate(), 16000);
-        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
-    }
+    audio_input_.Initialize(codec, 16000, OPUS_FRAME_DURATION_MS);
     codec->Start();
 
+    audio_playback_.Start(codec, [this](uint32_t timestamp) {
+#ifdef CONFIG_USE_SERVER_AEC
+        std::lock_guard<std::mutex> lock(timestamp_mutex_);
+        timestamp_queue_.push_back(timestamp);
+#endif
+        last_output_time_ = std::chrono::steady_clock::now();
+    });
+
 #if CONFIG_USE_AUDIO_PROCESSOR
     xTaskCreatePinnedToCore([](void* arg) {
         Application* app = (Application*)arg;
@@ -482,15 +493,16 @@ void Application::Start() {
         ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
         protocol_ = std::make_unique<MqttProtocol>();
     }
+    ApplyUplinkAudioParams();
 
     protocol_->OnNetworkError([this](const std::string& message) {
         SetDeviceState(kDeviceStateIdle);
         Alert(Lang::Strings::ERROR, message.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
     });
     protocol_->OnIncomingAudio([this](AudioStreamPacket&& packet) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (device_state_ == kDeviceStateSpeaking && audio_decode_queue_.size() < MAX_AUDIO_PACKETS_IN_QUEUE) {
-            audio_decode_queue_.emplace_back(std::move(packet));
+        if (device_state_ == kDeviceStateSpeaking) {
+            // The packet gets a free jitter buffer slot back, the protocol reuses it for the next frame
+            audio_jitter_buffer_.Put(packet);
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
@@ -517,113 +529,29 @@ void Application::Start() {
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
-                        SetDeviceState(kDeviceStateSpeaking);
-                    }
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    background_task_->WaitForCompletion();
-                    if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
-                }
-            }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
-            }
-#if CONFIG_IOT_PROTOCOL_MCP
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
-            auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
-                McpServer::GetInstance().ParseMessage(payload);
-            }
-#endif
-#if CONFIG_IOT_PROTOCOL_XIAOZHI
-        } else if (strcmp(type->valuestring, "iot") == 0) {
-            auto commands = cJSON_GetObjectItem(root, "commands");
-            if (cJSON_IsArray(commands)) {
-                auto& thing_manager = iot::ThingManager::GetInstance();
-                for (int i = 0; i < cJSON_GetArraySize(commands); ++i) {
-                    auto command = cJSON_GetArrayItem(commands, i);
-                    thing_manager.Invoke(command);
-                }
-            }
-#endif
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
-                    // Do a reboot if user requests a OTA update
-                    Schedule([this]() {
-                        Reboot();
-                    });
-                } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
-                }
-            }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::P3_VIBRATION);
-            } else {
-                ESP_LOGW(TAG, "Alert command requires status, message and emotion");
-            }
-        } else {
-            ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
+    RegisterMessageHandlers();
+    protocol_->OnIncomingJson([this](const JsonMessage& message) {
+        if (!message_router_.Dispatch(message)) {
+            ESP_LOGW(TAG, "Unknown message type: %.*s", (int)message.type().size(), message.type().data());
         }
     });
     bool protocol_started = protocol_->Start();
+    // Reconnect in the background while idle, so a dropped connection is back before the next wake word
+    connection_supervisor_ = std::make_unique<ConnectionSupervisor>(*protocol_, [this]() {
+        return device_state_ == kDeviceStateIdle;
+    });
 
     audio_debugger_ = std::make_unique<AudioDebugger>();
     audio_processor_->Initialize(codec);
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (audio_send_queue_.size() >= MAX_AUDIO_PACKETS_IN_QUEUE) {
-                ESP_LOGW(TAG, "Too many audio packets in queue, drop the newest packet");
-                return;
-            }
+        if (audio_send_queue_.Full()) {
+            ESP_LOGW(TAG, "Too many audio packets in queue, drop the newest packet");
+            uplink_rate_controller_.OnEncoderDrop();
+            return;
         }
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                AudioStreamPacket packet;
-                packet.payload = std::move(opus);
+        auto encode = [this, data = std::move(data)]() mutable {
+            // The ring copies the packet into a preallocated slot, the encoder keeps its buffer
+            opus_encoder_->Encode(std::move(data), [this](AudioStreamPacket& packet) {
 #ifdef CONFIG_USE_SERVER_AEC
                 {
                     std::lock_guard<std::mutex> lock(timestamp_mutex_);
@@ -640,15 +568,19 @@ void Application::Start() {
                     }
                 }
 #endif
-                std::lock_guard<std::mutex> lock(mutex_);
-                if (audio_send_queue_.size() >= MAX_AUDIO_PACKETS_IN_QUEUE) {
+                if (audio_send_queue_.Full()) {
                     ESP_LOGW(TAG, "Too many audio packets in queue, drop the oldest packet");
-                    audio_send_queue_.pop_front();
+                    uplink_rate_controller_.OnEncoderDrop();
                 }
-                audio_send_queue_.emplace_back(std::move(packet));
+                audio_send_queue_.Push(packet, kAudioPacketDropOldest);
                 xEventGroupSetBits(event_group_, SEND_AUDIO_EVENT);
             });
-        });
+        };
+        static_assert(BackgroundTask::Task::fits_inline<decltype(encode)>, "Encode job must be stored inline");
+        if (!background_task_->Schedule(std::move(encode), kBackgroundTaskLaneRealtime, AUDIO_ENCODE_STRAND)) {
+            ESP_LOGW(TAG, "Encode job rejected, drop the frame");
+            uplink_rate_controller_.OnEncoderDrop();
+        }
     });
     audio_processor_->OnVadStateChange([this](bool speaking) {
         if (device_state_ == kDeviceStateListening) {
@@ -657,6 +589,7 @@ void Application::Start() {
                     voice_detected_ = true;
                 } else {
                     voice_detected_ = false;
+                    uplink_flush_pending_ = true;
                 }
                 auto led = Board::GetInstance().GetLed();
                 led->OnStateChanged();
@@ -666,6 +599,7 @@ void Application::Start() {
 
     wake_word_->Initialize(codec);
     wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+        LATENCY_TRACE(kTraceWakeWord, 0);
         Schedule([this, &wake_word]() {
             if (!protocol_) {
                 return;
@@ -676,6 +610,7 @@ void Application::Start() {
 
                 if (!protocol_->IsAudioChannelOpened()) {
                     SetDeviceState(kDeviceStateConnecting);
+                    ApplyUplinkAudioParams();
                     if (!protocol_->OpenAudioChannel()) {
                         wake_word_->StartDetection();
                         return;
@@ -706,6 +641,13 @@ void Application::Start() {
             }
         });
     });
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    wake_word_->OnVoiceActivity([this]() {
+        if (device_state_ == kDeviceStateIdle && protocol_) {
+            protocol_->PrepareAudioChannel();
+        }
+    });
+#endif
     wake_word_->StartDetection();
 
     // Wait for the new version check to finish
@@ -757,7 +699,7 @@ void Application::OnClockTimer() {
 }
 
 // Add a async task to MainLoop
-void Application::Schedule(std::function<void()> callback) {
+void Application::Schedule(MainTask callback) {
     {
         std::lock_guard<std::mutex> lock(mutex_);
         main_tasks_.push_back(std::move(callback));
@@ -772,27 +714,68 @@ void Application::MainEventLoop() {
     // Raise the priority of the main event loop to avoid being interrupted by background tasks (which has priority 2)
     vTaskPrioritySet(NULL, 3);
 
+    // Reused for every outgoing message so sending does not allocate
+    std::array<AudioStreamPacket, AUDIO_BATCH_MAX_FRAMES> batch;
+    std::vector<MainTask> tasks;
+    tasks.reserve(MAIN_TASK_RESERVE);
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, SCHEDULE_EVENT | SEND_AUDIO_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
 
-        if (bits & SEND_AUDIO_EVENT) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto packets = std::move(audio_send_queue_);
-            lock.unlock();
-            for (auto& packet : packets) {
-                if (!protocol_->SendAudio(packet)) {
+        // A held frame goes out before the scheduled tasks, which may send control messages
+        if ((bits & SEND_AUDIO_EVENT) || uplink_rate_controller_.holding()) {
+            uplink_rate_controller_.OnQueueDepth(audio_send_queue_.Size());
+            bool can_hold = !(bits & SCHEDULE_EVENT) && voice_detected_ && device_state_ == kDeviceStateListening;
+            int max_frames = protocol_->audio_batch_frames();
+            size_t count;
+            while ((count = uplink_rate_controller_.NextBatchSize(audio_send_queue_.Size(), max_frames,
+                    protocol_->health().rtt_ms(), can_hold)) > 0) {
+                size_t popped = 0;
+                while (popped < count && audio_send_queue_.Pop(batch[popped])) {
+                    popped++;
+                }
+                if (popped == 0) {
                     break;
                 }
+                int64_t start_time = esp_timer_get_time();
+                bool sent;
+                if (popped == 1) {
+                    sent = protocol_->SendAudio(batch[0]);
+                } else {
+                    sent = protocol_->SendAudioBatch(std::span<AudioStreamPacket>(batch.data(), popped));
+                }
+                int64_t send_time = esp_timer_get_time() - start_time;
+                for (size_t i = 0; i < popped; i++) {
+                    uplink_rate_controller_.OnSendResult(sent, send_time / popped);
+                }
+                if (!sent) {
+                    uplink_rate_controller_.OnEncoderDrop(audio_send_queue_.Size());
+                    audio_send_queue_.Clear();
+                    break;
+                }
+                if (popped > 1) {
+                    int saved = (int)((popped - 1) * protocol_->audio_message_overhead()) - (int)popped * AUDIO_BATCH_ENTRY_HEADER_SIZE;
+                    uplink_rate_controller_.OnBatchSent(popped, saved);
+                    LATENCY_TRACE(kTraceUplinkBatch, popped);
+                }
+            }
+            if (uplink_flush_pending_ && audio_send_queue_.Empty()) {
+                // The speech before the VAD end has left the device
+                uplink_flush_pending_ = false;
+                LATENCY_TRACE(kTraceUplinkFlushed, 0);
+            }
+            if (uplink_rate_controller_.Update(esp_timer_get_time())) {
+                ApplyUplinkAudioParams();
             }
         }
 
         if (bits & SCHEDULE_EVENT) {
             std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
+            tasks.swap(main_tasks_);
             lock.unlock();
             for (auto& task : tasks) {
                 task();
             }
+            tasks.clear();
         }
     }
 }
@@ -809,7 +792,8 @@ void Application::AudioLoop() {
 }
 
 void Application::OnAudioOutput() {
-    if (busy_decoding_audio_) {
+    // Decode at most one frame at a time, and only as far ahead as the playback ring allows
+    if (busy_decoding_audio_.load(std::memory_order_acquire) || audio_playback_.Full()) {
         return;
     }
 
@@ -817,95 +801,101 @@ void Application::OnAudioOutput() {
     auto codec = Board::GetInstance().GetAudioCodec();
     const int max_silence_seconds = 10;
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (audio_decode_queue_.empty()) {
-        // Disable the output if there is no audio data for a long time
-        if (device_state_ == kDeviceStateIdle) {
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
-            if (duration > max_silence_seconds) {
-                codec->EnableOutput(false);
+    // No decode is in flight, so decode_packet_ is ours until the next one is scheduled
+    auto& packet = decode_packet_;
+    bool popped = audio_decode_queue_.Pop(packet);
+    if (popped) {
+        xEventGroupSetBits(event_group_, AUDIO_DECODE_QUEUE_POP_EVENT);
+    }
+    if (!popped && audio_jitter_buffer_.Get(packet) == kJitterBufferEmpty) {
+        // Play back the recorded audio after leaving the audio testing mode
+        if (device_state_ == kDeviceStateAudioTesting || !audio_testing_queue_.Pop(packet)) {
+            // Disable the output if there is no audio data for a long time
+            if (device_state_ == kDeviceStateIdle) {
+                auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
+                if (duration > max_silence_seconds) {
+                    codec->EnableOutput(false);
+                }
             }
+            return;
         }
-        return;
     }
 
-    auto packet = std::move(audio_decode_queue_.front());
-    audio_decode_queue_.pop_front();
-    lock.unlock();
-    audio_decode_cv_.notify_all();
-
     // Synchronize the sample rate and frame duration
     SetDecodeSampleRate(packet.sample_rate, packet.frame_duration);
 
-    busy_decoding_audio_ = true;
-    if (!background_task_->Schedule([this, codec, packet = std::move(packet)]() mutable {
-        busy_decoding_audio_ = false;
+    busy_decoding_audio_.store(true, std::memory_order_relaxed);
+    auto decode = [this, codec, scheduled_at = esp_timer_get_time()]() {
+        audio_playback_.RecordScheduleLatency(esp_timer_get_time() - scheduled_at);
         if (aborted_) {
+            busy_decoding_audio_.store(false, std::memory_order_release);
             return;
         }
 
-        std::vector<int16_t> pcm;
-        if (!opus_decoder_->Decode(std::move(packet.payload), pcm)) {
-            return;
-        }
-        // Resample if the sample rate is different
-        if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-            int target_size = output_resampler_.GetOutputSamples(pcm.size());
-            std::vector<int16_t> resampled(target_size);
-            output_resampler_.Process(pcm.data(), pcm.size(), resampled.data());
-            pcm = std::move(resampled);
+        // An empty payload marks a frame lost by the jitter buffer, the decoder conceals it (PLC).
+        // Decode() only reads the payload, the buffer stays in decode_packet_ for the next Pop()
+        auto& packet = decode_packet_;
+        if (opus_decoder_->Decode(std::move(packet.payload), decoded_pcm_)) {
+            // Resample if the sample rate is different
+            if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
+                resampled_pcm_.resize(output_resampler_.GetOutputSamples(decoded_pcm_.size()));
+                output_resampler_.Process(decoded_pcm_.data(), decoded_pcm_.size(), resampled_pcm_.data());
+                audio_playback_.Push(resampled_pcm_, packet.timestamp);
+            } else {
+                audio_playback_.Push(decoded_pcm_, packet.timestamp);
+            }
         }
-        codec->OutputData(pcm);
-#ifdef CONFIG_USE_SERVER_AEC
-        std::lock_guard<std::mutex> lock(timestamp_mutex_);
-        timestamp_queue_.push_back(packet.timestamp);
-#endif
-        last_output_time_ = std::chrono::steady_clock::now();
-    })) {
-        busy_decoding_audio_ = false;
+        // Clear only after the frame is queued, so OnAudioOutput sees the ring occupancy it caused
+        busy_decoding_audio_.store(false, std::memory_order_release);
+    };
+    static_assert(BackgroundTask::Task::fits_inline<decltype(decode)>, "Decode job must be stored inline");
+    if (!background_task_->Schedule(std::move(decode), kBackgroundTaskLaneRealtime, AUDIO_DECODE_STRAND)) {
+        busy_decoding_audio_.store(false, std::memory_order_relaxed);
     }
 }
 
 void Application::OnAudioInput() {
     if (device_state_ == kDeviceStateAudioTesting) {
-        if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+        if (audio_testing_queue_.Full()) {
             ExitAudioTestingMode();
             return;
         }
-        std::vector<int16_t> data;
+        std::span<const int16_t> frame;
         int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
-        if (ReadAudio(data, 16000, samples)) {
-            background_task_->Schedule([this, data = std::move(data)]() mutable {
-                opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                    AudioStreamPacket packet;
-                    packet.payload = std::move(opus);
-                    packet.frame_duration = OPUS_FRAME_DURATION_MS;
-                    packet.sample_rate = 16000;
-                    std::lock_guard<std::mutex> lock(mutex_);
-                    audio_testing_queue_.push_back(std::move(packet));
+        if (ReadAudio(frame, samples)) {
+            auto encode = [this, data = std::vector<int16_t>(frame.begin(), frame.end())]() mutable {
+                opus_encoder_->Encode(std::move(data), [this](AudioStreamPacket& packet) {
+                    // Played back through the decoder, which expects bare Opus data
+                    packet.payload.erase(packet.payload.begin(), packet.payload.begin() + packet.headroom);
+                    packet.headroom = 0;
+                    audio_testing_queue_.Push(packet);
                 });
-            });
+            };
+            static_assert(BackgroundTask::Task::fits_inline<decltype(encode)>, "Encode job must be stored inline");
+            if (!background_task_->Schedule(std::move(encode), kBackgroundTaskLaneRealtime, AUDIO_ENCODE_STRAND)) {
+                ESP_LOGW(TAG, "Encode job rejected, the recording misses a frame");
+            }
             return;
         }
     }
 
     if (wake_word_->IsDetectionRunning()) {
-        std::vector<int16_t> data;
+        std::span<const int16_t> frame;
         int samples = wake_word_->GetFeedSize();
         if (samples > 0) {
-            if (ReadAudio(data, 16000, samples)) {
-                wake_word_->Feed(data);
+            if (ReadAudio(frame, samples)) {
+                wake_word_->Feed(frame);
                 return;
             }
         }
     }
 
     if (audio_processor_->IsRunning()) {
-        std::vector<int16_t> data;
+        std::span<const int16_t> frame;
         int samples = audio_processor_->GetFeedSize();
         if (samples > 0) {
-            if (ReadAudio(data, 16000, samples)) {
-                audio_processor_->Feed(data);
+            if (ReadAudio(frame, samples)) {
+                audio_processor_->Feed(frame);
                 return;
             }
         }
@@ -914,43 +904,14 @@ void Application::OnAudioInput() {
     vTaskDelay(pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS / 2));
 }
 
-bool Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
+bool Application::ReadAudio(std::span<const int16_t>& data, int samples) {
     auto codec = Board::GetInstance().GetAudioCodec();
     if (!codec->input_enabled()) {
         return false;
     }
 
-    if (codec->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec->input_sample_rate() / sample_rate);
-        if (!codec->InputData(data)) {
-            return false;
-        }
-        if (codec->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
-        } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
-        }
-    } else {
-        data.resize(samples);
-        if (!codec->InputData(data)) {
-            return false;
-        }
+    if (!audio_input_.Read(samples, data)) {
+        return false;
     }
     
     // 音频调试：发送原始音频数据
@@ -964,6 +925,7 @@ bool Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int sam
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
+    audio_playback_.Clear();
     protocol_->SendAbortSpeaking(reason);
 }
 
@@ -981,8 +943,9 @@ void Application::SetDeviceState(DeviceState state) {
     auto previous_state = device_state_;
     device_state_ = state;
     ESP_LOGI(TAG, "STATE: %s", STATE_STRINGS[device_state_]);
-    // The state is changed, wait for all background tasks to finish
-    background_task_->WaitForCompletion();
+    LATENCY_TRACE(kTraceDeviceState, state);
+    // The state is changed, wait for the audio jobs to finish
+    background_task_->WaitForCompletion(kBackgroundTaskLaneRealtime);
 
     auto& board = Board::GetInstance();
     auto display = board.GetDisplay();
@@ -995,6 +958,9 @@ void Application::SetDeviceState(DeviceState state) {
             display->SetEmotion("neutral");
             audio_processor_->Stop();
             wake_word_->StartDetection();
+#if CONFIG_USE_LATENCY_TRACE
+            DumpLatencyTrace();
+#endif
             break;
         case kDeviceStateConnecting:
             display->SetStatus(Lang::Strings::CONNECTING);
@@ -1015,8 +981,10 @@ void Application::SetDeviceState(DeviceState state) {
                 // Send the start listening command
                 protocol_->SendStartListening(listening_mode_);
                 if (previous_state == kDeviceStateSpeaking) {
-                    audio_decode_queue_.clear();
-                    audio_decode_cv_.notify_all();
+                    audio_decode_queue_.Clear();
+                    xEventGroupSetBits(event_group_, AUDIO_DECODE_QUEUE_POP_EVENT);
+                    audio_jitter_buffer_.Reset();
+                    audio_playback_.Clear();
                     // FIXME: Wait for the speaker to empty the buffer
                     vTaskDelay(pdMS_TO_TICKS(120));
                 }
@@ -1045,11 +1013,153 @@ void Application::SetDeviceState(DeviceState state) {
     }
 }
 
+// Push the rate controller's choice to the encoder, and to the protocol for the next hello
+void Application::ApplyUplinkAudioParams() {
+    auto params = uplink_rate_controller_.params();
+    opus_encoder_->SetBitrate(params.bitrate);
+    opus_encoder_->SetInbandFec(params.fec, params.packet_loss);
+    // The server learns the frame duration from the hello, so a new one waits for the next channel open
+    if (protocol_->IsAudioChannelOpened()) {
+        params.frame_duration = opus_encoder_->duration_ms();
+    } else {
+        opus_encoder_->SetFrameDuration(params.frame_duration);
+    }
+    protocol_->SetUplinkAudioParams(params);
+}
+
+// Handlers run on the protocol's receive task. Only mcp and iot need the full cJSON tree,
+// the others read their string fields straight from the message text.
+void Application::RegisterMessageHandlers() {
+    auto display = Board::GetInstance().GetDisplay();
+    message_router_.On("tts", [this, display](const JsonMessage& message) {
+        auto state = message.state();
+        if (state == "start") {
+            LATENCY_TRACE(kTraceTtsStart, 0);
+            audio_playback_.MarkStreamStart();
+            Schedule([this]() {
+                aborted_ = false;
+                if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
+                    SetDeviceState(kDeviceStateSpeaking);
+                }
+            });
+        } else if (state == "stop") {
+            LATENCY_TRACE(kTraceTtsStop, 0);
+            Schedule([this]() {
+                background_task_->WaitForCompletion(kBackgroundTaskLaneRealtime);
+                if (device_state_ == kDeviceStateSpeaking) {
+                    if (listening_mode_ == kListeningModeManualStop) {
+                        SetDeviceState(kDeviceStateIdle);
+                    } else {
+                        SetDeviceState(kDeviceStateListening);
+                    }
+                }
+            });
+        } else if (state == "sentence_start") {
+            std::string_view raw;
+            if (message.GetString("text", raw)) {
+                auto text = message.GetText("text");
+                ESP_LOGI(TAG, "<< %s", text.c_str());
+                Schedule([this, display, text = std::move(text)]() {
+                    display->SetChatMessage("assistant", text.c_str());
+                });
+            }
+        }
+    });
+    message_router_.On("stt", [this, display](const JsonMessage& message) {
+        LATENCY_TRACE(kTraceStt, 0);
+        std::string_view raw;
+        if (message.GetString("text", raw)) {
+            auto text = message.GetText("text");
+            ESP_LOGI(TAG, ">> %s", text.c_str());
+            Schedule([this, display, text = std::move(text)]() {
+                display->SetChatMessage("user", text.c_str());
+            });
+        }
+    });
+    message_router_.On("llm", [this, display](const JsonMessage& message) {
+        std::string_view raw;
+        if (message.GetString("emotion", raw)) {
+            Schedule([this, display, emotion = std::string(raw)]() {
+                display->SetEmotion(emotion.c_str());
+            });
+        }
+    });
+#if CONFIG_IOT_PROTOCOL_MCP
+    message_router_.On("mcp", [](const JsonMessage& message) {
+        auto payload = cJSON_GetObjectItem(message.root(), "payload");
+        if (cJSON_IsObject(payload)) {
+            McpServer::GetInstance().ParseMessage(payload);
+        }
+    });
+#endif
+#if CONFIG_IOT_PROTOCOL_XIAOZHI
+    message_router_.On("iot", [](const JsonMessage& message) {
+        auto commands = cJSON_GetObjectItem(message.root(), "commands");
+        if (cJSON_IsArray(commands)) {
+            auto& thing_manager = iot::ThingManager::GetInstance();
+            for (int i = 0; i < cJSON_GetArraySize(commands); ++i) {
+                auto command = cJSON_GetArrayItem(commands, i);
+                thing_manager.Invoke(command);
+            }
+        }
+    });
+#endif
+    message_router_.On("system", [this](const JsonMessage& message) {
+        std::string_view command;
+        if (message.GetString("command", command)) {
+            ESP_LOGI(TAG, "System command: %.*s", (int)command.size(), command.data());
+            if (command == "reboot") {
+                // Do a reboot if user requests a OTA update
+                Schedule([this]() {
+                    Reboot();
+                });
+            } else {
+                ESP_LOGW(TAG, "Unknown system command: %.*s", (int)command.size(), command.data());
+            }
+        }
+    });
+    message_router_.On("alert", [this](const JsonMessage& message) {
+        std::string_view raw;
+        if (message.GetString("status", raw) && message.GetString("message", raw) && message.GetString("emotion", raw)) {
+            Alert(message.GetText("status").c_str(), message.GetText("message").c_str(),
+                message.GetText("emotion").c_str(), Lang::Sounds::P3_VIBRATION);
+        } else {
+            ESP_LOGW(TAG, "Alert command requires status, message and emotion");
+        }
+    });
+}
+
+#if CONFIG_USE_LATENCY_TRACE
+// Flush the events of the finished conversation to the host, off the main loop
+void Application::DumpLatencyTrace() {
+    background_task_->Schedule([this]() {
+#if CONFIG_LATENCY_TRACE_OUTPUT_UDP
+        LatencyTrace::Writer writer = [this](const char* data, size_t size) {
+            audio_debugger_->SendTrace(data, size);
+        };
+#else
+        LatencyTrace::Writer writer = [](const char* data, size_t size) {
+            // Whole event lines only, the host script picks them out of the monitor log
+            printf("%.*s", (int)size, data);
+        };
+#endif
+        LatencyTrace::GetInstance().Dump(writer);
+    });
+}
+#endif
+
 void Application::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(mutex_);
     opus_decoder_->ResetState();
-    audio_decode_queue_.clear();
-    audio_decode_cv_.notify_all();
+    audio_decode_queue_.Clear();
+    xEventGroupSetBits(event_group_, AUDIO_DECODE_QUEUE_POP_EVENT);
+    audio_jitter_buffer_.Reset();
+    audio_playback_.Clear();
+
+    auto stats = audio_jitter_buffer_.GetStats();
+    if (stats.received > 0) {
+        ESP_LOGI(TAG, "Jitter buffer: target %d frames, jitter %d ms, received %lu, lost %lu, late %lu, duplicate %lu, overflow %lu, underruns %lu",
+            stats.target_depth, stats.jitter_ms, stats.received, stats.lost, stats.late, stats.duplicate, stats.overflow, stats.underruns);
+    }
     last_output_time_ = std::chrono::steady_clock::now();
     auto codec = Board::GetInstance().GetAudioCodec();
     codec->EnableOutput(true);
@@ -1119,6 +1229,13 @@ bool Application::CanEnterSleepMode() {
     return true;
 }
 
+cJSON* Application::GetConnectionStatusJson() const {
+    if (!connection_supervisor_) {
+        return nullptr;
+    }
+    return connection_supervisor_->GetStatusJson();
+}
+
 void Application::SendMcpMessage(const std::string& payload) {
     Schedule([this, payload]() {
         if (protocol_) {
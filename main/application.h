@@ -8,6 +8,7 @@
 
 #include <string>
 #include <mutex>
+#include <atomic>
 #include <list>
 #include <vector>
 #include <condition_variable>
@@ -18,15 +19,26 @@
 #include <opus_resampler.h>
 
 #include "protocol.h"
+#include "connection_supervisor.h"
+#include "message_router.h"
 #include "ota.h"
 #include "background_task.h"
+#include "inplace_task.h"
 #include "audio_processor.h"
 #include "wake_word.h"
 #include "audio_debugger.h"
+#include "audio_packet_ring.h"
+#include "audio_jitter_buffer.h"
+#include "audio_playback_pipeline.h"
+#include "uplink_opus_encoder.h"
+#include "uplink_rate_controller.h"
+#include "audio_input_pipeline.h"
 
 #define SCHEDULE_EVENT (1 << 0)
 #define SEND_AUDIO_EVENT (1 << 1)
 #define CHECK_NEW_VERSION_DONE_EVENT (1 << 2)
+// The audio loop took packets out of audio_decode_queue_, PlaySound waits on it for room
+#define AUDIO_DECODE_QUEUE_POP_EVENT (1 << 3)
 
 enum AecMode {
     kAecOff,
@@ -51,6 +63,15 @@ enum DeviceState {
 #define OPUS_FRAME_DURATION_MS 60
 #define MAX_AUDIO_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
+// Background task strands, keep the Opus encoder and decoder each on their own worker
+#define AUDIO_ENCODE_STRAND 0
+#define AUDIO_DECODE_STRAND 1
+// The encoder worker also runs the unbound jobs, the Opus encoder needs the larger stack
+#define AUDIO_ENCODE_WORKER_STACK_SIZE (4096 * 7)
+#define AUDIO_DECODE_WORKER_STACK_SIZE (4096 * 3)
+// Inline capture budget for Application::Schedule callbacks
+#define MAIN_TASK_INLINE_SIZE 48
+#define MAIN_TASK_RESERVE 16
 
 class Application {
 public:
@@ -65,7 +86,9 @@ public:
     void Start();
     DeviceState GetDeviceState() const { return device_state_; }
     bool IsVoiceDetected() const { return voice_detected_; }
-    void Schedule(std::function<void()> callback);
+    using MainTask = InplaceTask<MAIN_TASK_INLINE_SIZE>;
+
+    void Schedule(MainTask callback);
     void SetDeviceState(DeviceState state);
     void Alert(const char* status, const char* message, const char* emotion = "", const std::string_view& sound = "");
     void DismissAlert();
@@ -79,6 +102,8 @@ public:
     void PlaySound(const std::string_view& sound);
     bool CanEnterSleepMode();
     void SendMcpMessage(const std::string& payload);
+    // Control connection state and health for the device status, nullptr before the protocol starts
+    cJSON* GetConnectionStatusJson() const;
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
     BackgroundTask* GetBackgroundTask() const { return background_task_; }
@@ -91,8 +116,11 @@ private:
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
     std::mutex mutex_;
-    std::list<std::function<void()>> main_tasks_;
+    // Swapped with the main loop's run list, so both keep their capacity and scheduling does not allocate
+    std::vector<MainTask> main_tasks_;
     std::unique_ptr<Protocol> protocol_;
+    std::unique_ptr<ConnectionSupervisor> connection_supervisor_;
+    MessageRouter message_router_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
     volatile DeviceState device_state_ = kDeviceStateUnknown;
@@ -102,7 +130,10 @@ private:
     bool has_server_time_ = false;
     bool aborted_ = false;
     bool voice_detected_ = false;
-    bool busy_decoding_audio_ = false;
+    // Set on VAD speech end, cleared by the main loop once the send queue has drained
+    bool uplink_flush_pending_ = false;
+    // Set by the audio loop when it schedules a decode, cleared by the decode strand when it is done
+    std::atomic<bool> busy_decoding_audio_{false};
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
@@ -110,27 +141,47 @@ private:
     TaskHandle_t audio_loop_task_handle_ = nullptr;
     BackgroundTask* background_task_ = nullptr;
     std::chrono::steady_clock::time_point last_output_time_;
-    std::list<AudioStreamPacket> audio_send_queue_;
-    std::list<AudioStreamPacket> audio_decode_queue_;
-    std::condition_variable audio_decode_cv_;
-    std::list<AudioStreamPacket> audio_testing_queue_;
+    AudioPacketRing audio_send_queue_{MAX_AUDIO_PACKETS_IN_QUEUE};
+    // Local sounds from PlaySound, played before any downlink audio
+    AudioPacketRing audio_decode_queue_{MAX_AUDIO_PACKETS_IN_QUEUE};
+    // PlaySound runs on the main loop, the receive task (network error alerts), the display's
+    // low battery check and the version check task, serialize them as the ring has a single producer
+    std::mutex audio_decode_producer_mutex_;
+    // PlaySound's staging packet, guarded by audio_decode_producer_mutex_
+    AudioStreamPacket sound_packet_;
+    // Downlink audio from the server, reordered by sequence
+    AudioJitterBuffer audio_jitter_buffer_{MAX_AUDIO_PACKETS_IN_QUEUE};
+    AudioPlaybackPipeline audio_playback_;
+    // The frame being decoded. The audio loop pops into it while no decode is in flight and the
+    // decode strand reads it, so its payload buffer goes back and forth with the queue slots
+    AudioStreamPacket decode_packet_;
+    // Decode stage scratch buffers, only touched by the decode strand
+    std::vector<int16_t> decoded_pcm_;
+    std::vector<int16_t> resampled_pcm_;
+    // Only filled in audio testing mode, so the slots are not preallocated
+    AudioPacketRing audio_testing_queue_{AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS, 0};
 
     // 新增：用于维护音频包的timestamp队列
     std::list<uint32_t> timestamp_queue_;
     std::mutex timestamp_mutex_;
 
-    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
+    std::unique_ptr<UplinkOpusEncoder> opus_encoder_;
+    UplinkRateController uplink_rate_controller_{OPUS_FRAME_DURATION_MS};
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
 
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
+    AudioInputPipeline audio_input_;
     OpusResampler output_resampler_;
 
     void MainEventLoop();
     void OnAudioInput();
     void OnAudioOutput();
-    bool ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
+    bool ReadAudio(std::span<const int16_t>& data, int samples);
     void ResetDecoder();
+    void ApplyUplinkAudioParams();
+    void RegisterMessageHandlers();
+#if CONFIG_USE_LATENCY_TRACE
+    void DumpLatencyTrace();
+#endif
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckNewVersion(Ota& ota);
     void ShowActivationCode(const std::string& code, const std::string& message);
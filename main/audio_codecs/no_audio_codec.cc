@@ -1,11 +1,16 @@
 #include "no_audio_codec.h"
+#include "audio_kernels.h"
 
 #include <esp_log.h>
-#include <cmath>
-#include <cstring>
+#include <esp_heap_caps.h>
+#include <algorithm>
 
 #define TAG "NoAudioCodec"
 
+NoAudioCodec::NoAudioCodec() {
+    UpdateVolumeFactor();
+}
+
 NoAudioCodec::~NoAudioCodec() {
     if (rx_handle_ != nullptr) {
         ESP_ERROR_CHECK(i2s_channel_disable(rx_handle_));
@@ -13,6 +18,37 @@ NoAudioCodec::~NoAudioCodec() {
     if (tx_handle_ != nullptr) {
         ESP_ERROR_CHECK(i2s_channel_disable(tx_handle_));
     }
+    heap_caps_free(write_buffer_);
+    heap_caps_free(read_buffer_);
+}
+
+void NoAudioCodec::AllocateStagingBuffers(bool input, bool output) {
+    if (input) {
+        read_buffer_ = (int32_t*)heap_caps_malloc(NO_AUDIO_CODEC_STAGING_SAMPLES * sizeof(int32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        assert(read_buffer_ != nullptr);
+    }
+    if (output) {
+        write_buffer_ = (int32_t*)heap_caps_malloc(NO_AUDIO_CODEC_STAGING_SAMPLES * sizeof(int32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        assert(write_buffer_ != nullptr);
+    }
+}
+
+void NoAudioCodec::UpdateVolumeFactor() {
+    // output_volume_: 0-100
+    // volume_factor_: 0-65536, square law so the perceived loudness scales evenly
+    int volume = std::clamp(output_volume_, 0, 100);
+    volume_factor_ = volume * volume * 65536 / 10000;
+}
+
+void NoAudioCodec::SetOutputVolume(int volume) {
+    AudioCodec::SetOutputVolume(volume);
+    UpdateVolumeFactor();
+}
+
+void NoAudioCodec::Start() {
+    // Start() restores output_volume_ from settings
+    AudioCodec::Start();
+    UpdateVolumeFactor();
 }
 
 NoAudioCodecDuplex::NoAudioCodecDuplex(int input_sample_rate, int output_sample_rate, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din) {
@@ -71,6 +107,7 @@ NoAudioCodecDuplex::NoAudioCodecDuplex(int input_sample_rate, int output_sample_
     };
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle_, &std_cfg));
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_handle_, &std_cfg));
+    AllocateStagingBuffers(true, true);
     ESP_LOGI(TAG, "Duplex channels created");
 }
 
@@ -128,6 +165,7 @@ ATK_NoAudioCodecDuplex::ATK_NoAudioCodecDuplex(int input_sample_rate, int output
     };
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle_, &std_cfg));
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_handle_, &std_cfg));
+    AllocateStagingBuffers(true, true);
     ESP_LOGI(TAG, "Duplex channels created");
 }
 
@@ -198,6 +236,7 @@ NoAudioCodecSimplex::NoAudioCodecSimplex(int input_sample_rate, int output_sampl
     std_cfg.gpio_cfg.dout = I2S_GPIO_UNUSED;
     std_cfg.gpio_cfg.din = mic_din;
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_handle_, &std_cfg));
+    AllocateStagingBuffers(true, true);
     ESP_LOGI(TAG, "Simplex channels created");
 }
 
@@ -268,6 +307,7 @@ NoAudioCodecSimplex::NoAudioCodecSimplex(int input_sample_rate, int output_sampl
     std_cfg.gpio_cfg.dout = I2S_GPIO_UNUSED;
     std_cfg.gpio_cfg.din = mic_din;
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_handle_, &std_cfg));
+    AllocateStagingBuffers(true, true);
     ESP_LOGI(TAG, "Simplex channels created");
 }
 
@@ -332,63 +372,57 @@ NoAudioCodecSimplexPdm::NoAudioCodecSimplexPdm(int input_sample_rate, int output
 #else
     ESP_LOGE(TAG, "PDM is not supported");
 #endif
+    // PDM input is already 16 bit and read straight into the caller's buffer
+    AllocateStagingBuffers(false, true);
     ESP_LOGI(TAG, "Simplex channels created");
 }
 
 int NoAudioCodec::Write(const int16_t* data, int samples) {
-    std::vector<int32_t> buffer(samples);
-
-    // output_volume_: 0-100
-    // volume_factor_: 0-65536
-    int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-    for (int i = 0; i < samples; i++) {
-        int64_t temp = int64_t(data[i]) * volume_factor; // 使用 int64_t 进行乘法运算
-        if (temp > INT32_MAX) {
-            buffer[i] = INT32_MAX;
-        } else if (temp < INT32_MIN) {
-            buffer[i] = INT32_MIN;
-        } else {
-            buffer[i] = static_cast<int32_t>(temp);
+    int written = 0;
+    while (written < samples) {
+        size_t chunk = std::min<size_t>(samples - written, NO_AUDIO_CODEC_STAGING_SAMPLES);
+        // volume_factor_ <= 65536, so the product always fits in int32 and needs no clamping
+        audio_kernels::ApplyGain(data + written, write_buffer_, chunk, volume_factor_);
+
+        size_t bytes_written;
+        ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, write_buffer_, chunk * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+        written += bytes_written / sizeof(int32_t);
+        if (bytes_written < chunk * sizeof(int32_t)) {
+            break;
         }
     }
-
-    size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
-    return bytes_written / sizeof(int32_t);
+    return written;
 }
 
 int NoAudioCodec::Read(int16_t* dest, int samples) {
-    size_t bytes_read;
-
-    std::vector<int32_t> bit32_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit32_buffer.data(), samples * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
-        ESP_LOGE(TAG, "Read Failed!");
-        return 0;
-    }
+    int read = 0;
+    while (read < samples) {
+        size_t chunk = std::min<size_t>(samples - read, NO_AUDIO_CODEC_STAGING_SAMPLES);
+        size_t bytes_read;
+        if (i2s_channel_read(rx_handle_, read_buffer_, chunk * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+            ESP_LOGE(TAG, "Read Failed!");
+            return read;
+        }
 
-    samples = bytes_read / sizeof(int32_t);
-    for (int i = 0; i < samples; i++) {
-        int32_t value = bit32_buffer[i] >> 12;
-        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+        size_t chunk_read = bytes_read / sizeof(int32_t);
+        audio_kernels::ShiftSaturate(read_buffer_, dest + read, chunk_read, 12);
+        read += chunk_read;
+        if (chunk_read < chunk) {
+            break;
+        }
     }
-    return samples;
+    return read;
 }
 
 int NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
-    // PDM 解调后的数据位宽为 16 位
-    std::vector<int16_t> bit16_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit16_buffer.data(), samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+    // PDM 解调后的数据位宽为 16 位，直接读入目标缓冲区
+    if (i2s_channel_read(rx_handle_, dest, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
         ESP_LOGE(TAG, "Read Failed!");
         return 0;
     }
 
     // 计算实际读取的样本数
-    samples = bytes_read / sizeof(int16_t);
-
-    // 将 16 位数据直接复制到目标缓冲区
-    memcpy(dest, bit16_buffer.data(), samples * sizeof(int16_t));
-
-    return samples;
+    return bytes_read / sizeof(int16_t);
 }
@@ -6,13 +6,31 @@
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
 
+// Samples staged per i2s_channel_read/write call, longer frames are processed in chunks
+#define NO_AUDIO_CODEC_STAGING_SAMPLES (AUDIO_CODEC_DMA_FRAME_NUM * 4)
+
 class NoAudioCodec : public AudioCodec {
 private:
+    // Q16 gain derived from output_volume_, only recomputed when the volume changes
+    int32_t volume_factor_ = 0;
+    // 32-bit I2S staging buffers in DMA-capable internal RAM, owned for the codec's lifetime.
+    // Only the directions that go through Read()/Write() below get one
+    int32_t* write_buffer_ = nullptr;
+    int32_t* read_buffer_ = nullptr;
+
+    void UpdateVolumeFactor();
     virtual int Write(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
 
+protected:
+    void AllocateStagingBuffers(bool input, bool output);
+
 public:
+    NoAudioCodec();
     virtual ~NoAudioCodec();
+
+    virtual void SetOutputVolume(int volume) override;
+    virtual void Start() override;
 };
 
 class NoAudioCodecDuplex : public NoAudioCodec {
@@ -0,0 +1,204 @@
+#include "audio_jitter_buffer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <utility>
+
+#define TAG "AudioJitterBuffer"
+
+AudioJitterBuffer::AudioJitterBuffer(size_t capacity, size_t payload_reserve) : slots_(capacity) {
+    for (auto& slot : slots_) {
+        slot.packet.payload.reserve(payload_reserve);
+    }
+}
+
+void AudioJitterBuffer::StartStream(uint32_t sequence, int64_t now) {
+    for (auto& slot : slots_) {
+        slot.filled = false;
+    }
+    depth_ = 0;
+    started_ = true;
+    playing_ = false;
+    starved_ = false;
+    concealed_run_ = 0;
+    next_sequence_ = sequence;
+    buffering_since_us_ = now;
+    last_arrival_us_ = 0;
+}
+
+void AudioJitterBuffer::UpdateJitter(uint32_t sequence, int64_t now) {
+    if (last_arrival_us_ != 0 && (int32_t)(sequence - last_arrival_sequence_) > 0) {
+        // Only arrivals later than the frame spacing hurt playback, bursts from the server are fine
+        int64_t expected = int64_t(sequence - last_arrival_sequence_) * frame_duration_ * 1000;
+        int64_t deviation = std::max<int64_t>(0, (now - last_arrival_us_) - expected);
+        jitter_us_ += (deviation - jitter_us_) / 16;
+    }
+    if (last_arrival_us_ == 0 || (int32_t)(sequence - last_arrival_sequence_) > 0) {
+        last_arrival_us_ = now;
+        last_arrival_sequence_ = sequence;
+    }
+}
+
+void AudioJitterBuffer::UpdateTargetDepth() {
+    int frame_us = frame_duration_ * 1000;
+    int jitter_frames = (int)((2 * jitter_us_ + frame_us - 1) / frame_us);
+    target_depth_ = std::clamp(AUDIO_JITTER_BUFFER_MIN_DEPTH + jitter_frames + underrun_bias_,
+        AUDIO_JITTER_BUFFER_MIN_DEPTH, std::min<int>(AUDIO_JITTER_BUFFER_MAX_DEPTH, slots_.size()));
+}
+
+bool AudioJitterBuffer::SkipToNextFilled() {
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (slots_[(next_sequence_ + i) % slots_.size()].filled) {
+            next_sequence_ += i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AudioJitterBuffer::Put(AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = esp_timer_get_time();
+    received_++;
+    if (packet.frame_duration > 0) {
+        frame_duration_ = packet.frame_duration;
+    }
+    sample_rate_ = packet.sample_rate;
+
+    if (!started_) {
+        StartStream(packet.sequence, now);
+    }
+
+    int32_t offset = (int32_t)(packet.sequence - next_sequence_);
+    if (offset < 0) {
+        if (offset > -(int32_t)slots_.size()) {
+            late_++;
+            return false;
+        }
+        // Far behind the playout point, the server restarted its sequence numbers
+        ESP_LOGW(TAG, "Sequence jumped from %lu to %lu, restart stream", (unsigned long)next_sequence_, (unsigned long)packet.sequence);
+        StartStream(packet.sequence, now);
+        offset = 0;
+    }
+    if (offset >= (int32_t)slots_.size()) {
+        overflow_++;
+        return false;
+    }
+
+    auto& slot = slots_[packet.sequence % slots_.size()];
+    if (slot.filled) {
+        duplicate_++;
+        return false;
+    }
+    slot.packet.sample_rate = packet.sample_rate;
+    slot.packet.frame_duration = packet.frame_duration;
+    slot.packet.timestamp = packet.timestamp;
+    slot.packet.sequence = packet.sequence;
+    std::swap(slot.packet.payload, packet.payload);
+    slot.filled = true;
+    depth_++;
+
+    UpdateJitter(packet.sequence, now);
+    if (starved_) {
+        starved_ = false;
+        // Refilled shortly after running dry: the network was late, not the stream finished
+        if (now - starved_at_us_ < AUDIO_JITTER_BUFFER_UNDERRUN_WINDOW_MS * 1000) {
+            underruns_++;
+            underrun_bias_ = std::min(underrun_bias_ + 1, AUDIO_JITTER_BUFFER_MAX_DEPTH);
+            smooth_frames_ = 0;
+        }
+    }
+    UpdateTargetDepth();
+    return true;
+}
+
+AudioJitterBufferResult AudioJitterBuffer::Get(AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_ || depth_ == 0) {
+        if (playing_) {
+            playing_ = false;
+            starved_ = true;
+            starved_at_us_ = esp_timer_get_time();
+            buffering_since_us_ = starved_at_us_;
+        }
+        return kJitterBufferEmpty;
+    }
+
+    if (!playing_) {
+        int64_t waited = esp_timer_get_time() - buffering_since_us_;
+        if ((int)depth_ < target_depth_ && waited < int64_t(target_depth_) * frame_duration_ * 1000) {
+            return kJitterBufferEmpty;
+        }
+        // Start from the oldest received frame, whatever is missing before it was never played
+        SkipToNextFilled();
+        playing_ = true;
+        concealed_run_ = 0;
+    }
+
+    auto& slot = slots_[next_sequence_ % slots_.size()];
+    if (!slot.filled) {
+        // Newer frames are waiting, so this one missed its playout point
+        lost_++;
+        next_sequence_++;
+        if (++concealed_run_ > AUDIO_JITTER_BUFFER_MAX_CONCEAL) {
+            uint32_t from = next_sequence_;
+            SkipToNextFilled();
+            lost_ += next_sequence_ - from;
+        }
+        packet.sample_rate = sample_rate_;
+        packet.frame_duration = frame_duration_;
+        packet.timestamp = 0;
+        packet.sequence = next_sequence_ - 1;
+        packet.payload.clear();
+        return kJitterBufferLost;
+    }
+
+    packet.sample_rate = slot.packet.sample_rate;
+    packet.frame_duration = slot.packet.frame_duration;
+    packet.timestamp = slot.packet.timestamp;
+    packet.sequence = slot.packet.sequence;
+    std::swap(packet.payload, slot.packet.payload);
+    slot.filled = false;
+    depth_--;
+    next_sequence_++;
+    concealed_run_ = 0;
+
+    if (underrun_bias_ > 0 && ++smooth_frames_ >= AUDIO_JITTER_BUFFER_RELAX_FRAMES) {
+        underrun_bias_--;
+        smooth_frames_ = 0;
+        UpdateTargetDepth();
+    }
+    return kJitterBufferPacket;
+}
+
+void AudioJitterBuffer::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& slot : slots_) {
+        slot.filled = false;
+    }
+    depth_ = 0;
+    started_ = false;
+    playing_ = false;
+    starved_ = false;
+}
+
+size_t AudioJitterBuffer::Depth() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return depth_;
+}
+
+AudioJitterBufferStats AudioJitterBuffer::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return AudioJitterBufferStats{
+        .depth = depth_,
+        .target_depth = target_depth_,
+        .jitter_ms = (int)(jitter_us_ / 1000),
+        .received = received_,
+        .lost = lost_,
+        .late = late_,
+        .duplicate = duplicate_,
+        .overflow = overflow_,
+        .underruns = underruns_,
+    };
+}
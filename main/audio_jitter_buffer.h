@@ -0,0 +1,108 @@
+#ifndef AUDIO_JITTER_BUFFER_H
+#define AUDIO_JITTER_BUFFER_H
+
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+#include "audio_packet_ring.h"
+
+// Frames buffered before playback starts, adapted between these bounds
+#define AUDIO_JITTER_BUFFER_MIN_DEPTH 1
+#define AUDIO_JITTER_BUFFER_MAX_DEPTH 8
+// Consecutive missing frames concealed with PLC before skipping ahead to the next received frame
+#define AUDIO_JITTER_BUFFER_MAX_CONCEAL 3
+// A starved buffer that is refilled within this window counts as an underrun rather than the end of a stream
+#define AUDIO_JITTER_BUFFER_UNDERRUN_WINDOW_MS 500
+// Frames played without underrun before the underrun bias is relaxed by one frame
+#define AUDIO_JITTER_BUFFER_RELAX_FRAMES 100
+
+enum AudioJitterBufferResult {
+    kJitterBufferEmpty,     // Nothing to play yet, still buffering or starved
+    kJitterBufferPacket,    // The next frame in sequence order
+    kJitterBufferLost,      // The next frame is missing, decode an empty payload to run PLC
+};
+
+struct AudioJitterBufferStats {
+    size_t depth;
+    int target_depth;
+    int jitter_ms;
+    uint32_t received;
+    uint32_t lost;
+    uint32_t late;
+    uint32_t duplicate;
+    uint32_t overflow;
+    uint32_t underruns;
+};
+
+/*
+ * Reorders downlink packets by AudioStreamPacket::sequence and releases them to the decoder.
+ *
+ * Playback of a stream starts once target depth frames are buffered (or the first frame has
+ * waited that long). The target follows the measured inter-arrival jitter plus a bias that grows
+ * on underruns and decays while playback is smooth. Packets that arrive after their playout
+ * point are counted as late and dropped, gaps are reported as kJitterBufferLost.
+ *
+ * Put() and Get() may be called from different tasks.
+ */
+class AudioJitterBuffer {
+public:
+    AudioJitterBuffer(size_t capacity, size_t payload_reserve = AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+    AudioJitterBuffer(const AudioJitterBuffer&) = delete;
+    AudioJitterBuffer& operator=(const AudioJitterBuffer&) = delete;
+
+    // Swaps the payload into a slot and hands back that slot's old buffer in `packet`.
+    // Returns false if the packet was late, duplicated or did not fit, `packet` is untouched then.
+    bool Put(AudioStreamPacket& packet);
+    // Swaps the payload with `packet`, so both sides keep their buffers
+    AudioJitterBufferResult Get(AudioStreamPacket& packet);
+    // Forget the current stream, the next packet starts a new one
+    void Reset();
+
+    size_t Depth() const;
+    AudioJitterBufferStats GetStats() const;
+
+private:
+    struct Slot {
+        AudioStreamPacket packet;
+        bool filled = false;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Slot> slots_;
+    size_t depth_ = 0;
+
+    bool started_ = false;
+    bool playing_ = false;
+    bool starved_ = false;
+    uint32_t next_sequence_ = 0;
+    int sample_rate_ = 0;
+    int frame_duration_ = 60;
+    int concealed_run_ = 0;
+    int smooth_frames_ = 0;
+    int64_t buffering_since_us_ = 0;
+    int64_t starved_at_us_ = 0;
+
+    // Smoothed positive inter-arrival deviation (RFC 3550 style), in microseconds
+    int64_t jitter_us_ = 0;
+    int64_t last_arrival_us_ = 0;
+    uint32_t last_arrival_sequence_ = 0;
+    int underrun_bias_ = 0;
+    int target_depth_ = AUDIO_JITTER_BUFFER_MIN_DEPTH;
+
+    uint32_t received_ = 0;
+    uint32_t lost_ = 0;
+    uint32_t late_ = 0;
+    uint32_t duplicate_ = 0;
+    uint32_t overflow_ = 0;
+    uint32_t underruns_ = 0;
+
+    void StartStream(uint32_t sequence, int64_t now);
+    void UpdateJitter(uint32_t sequence, int64_t now);
+    void UpdateTargetDepth();
+    bool SkipToNextFilled();
+};
+
+#endif // AUDIO_JITTER_BUFFER_H
@@ -0,0 +1,71 @@
+#include "audio_packet_ring.h"
+
+AudioPacketRing::AudioPacketRing(size_t capacity, size_t payload_reserve)
+    : slots_(capacity + 1), capacity_(capacity) {
+    for (auto& slot : slots_) {
+        slot.payload.reserve(payload_reserve);
+    }
+}
+
+bool AudioPacketRing::Push(const AudioStreamPacket& packet, AudioPacketDropPolicy policy) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t tail = tail_.load();
+    if (head - tail >= capacity_) {
+        if (policy == kAudioPacketDropNewest) {
+            return false;
+        }
+        // If the consumer or Clear() wins the race, a slot has been freed anyway
+        tail_.compare_exchange_strong(tail, tail + 1);
+    }
+
+    // After dropping the oldest packet the producer may lap the slot the consumer is still copying
+    size_t index = head % slots_.size();
+    if (reading_slot_.load() == index + 1) {
+        return false;
+    }
+
+    auto& slot = slots_[index];
+    slot.sample_rate = packet.sample_rate;
+    slot.frame_duration = packet.frame_duration;
+    slot.timestamp = packet.timestamp;
+    slot.sequence = packet.sequence;
+    slot.headroom = packet.headroom;
+    slot.payload.assign(packet.payload.begin(), packet.payload.end());
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool AudioPacketRing::Pop(AudioStreamPacket& packet) {
+    uint32_t tail = tail_.load();
+    size_t index;
+    do {
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        index = tail % slots_.size();
+        reading_slot_.store(index + 1);
+    } while (!tail_.compare_exchange_weak(tail, tail + 1));
+
+    auto& slot = slots_[index];
+    packet.sample_rate = slot.sample_rate;
+    packet.frame_duration = slot.frame_duration;
+    packet.timestamp = slot.timestamp;
+    packet.sequence = slot.sequence;
+    packet.headroom = slot.headroom;
+    // The consumer's previous buffer becomes the slot buffer, both keep their capacity
+    std::swap(packet.payload, slot.payload);
+    reading_slot_.store(0, std::memory_order_release);
+    return true;
+}
+
+void AudioPacketRing::Clear() {
+    uint32_t tail = tail_.load();
+    while (!tail_.compare_exchange_weak(tail, head_.load(std::memory_order_acquire))) {
+    }
+}
+
+size_t AudioPacketRing::Size() const {
+    // Load tail first so a concurrent Pop() can never make the result wrap around
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    return head_.load(std::memory_order_acquire) - tail;
+}
@@ -0,0 +1,55 @@
+#ifndef AUDIO_PACKET_RING_H
+#define AUDIO_PACKET_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+// Payload bytes reserved per slot, enough for a 60ms Opus frame at the bitrates we use.
+// A slot grows once if a larger packet arrives and keeps that capacity afterwards.
+#define AUDIO_PACKET_RING_PAYLOAD_RESERVE 512
+
+enum AudioPacketDropPolicy {
+    kAudioPacketDropNewest,
+    kAudioPacketDropOldest,
+};
+
+/*
+ * Fixed-capacity single-producer / single-consumer queue of AudioStreamPacket.
+ * All slots are allocated up front, packets are copied in and swapped out, so a
+ * consumer that keeps reusing the same packet never touches the heap and never takes a lock.
+ *
+ * Push() must only be called from one task at a time, Pop() from one task at a time.
+ * Clear(), Size(), Empty() and Full() are safe from any task.
+ */
+class AudioPacketRing {
+public:
+    AudioPacketRing(size_t capacity, size_t payload_reserve = AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+    AudioPacketRing(const AudioPacketRing&) = delete;
+    AudioPacketRing& operator=(const AudioPacketRing&) = delete;
+
+    // Returns false if the packet was dropped
+    bool Push(const AudioStreamPacket& packet, AudioPacketDropPolicy policy = kAudioPacketDropNewest);
+    // Moves the oldest packet into `packet`, its old payload buffer goes back to the ring
+    bool Pop(AudioStreamPacket& packet);
+    void Clear();
+
+    size_t Size() const;
+    inline bool Empty() const { return Size() == 0; }
+    inline bool Full() const { return Size() >= capacity_; }
+    inline size_t capacity() const { return capacity_; }
+
+private:
+    // One spare slot so the producer never writes the slot the consumer is copying out
+    std::vector<AudioStreamPacket> slots_;
+    size_t capacity_;
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    // Slot index + 1 currently being copied out by the consumer, 0 if none
+    std::atomic<size_t> reading_slot_{0};
+};
+
+#endif // AUDIO_PACKET_RING_H
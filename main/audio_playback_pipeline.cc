@@ -0,0 +1,135 @@
+#include "audio_playback_pipeline.h"
+#include "latency_trace.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <utility>
+
+#define TAG "AudioPlaybackPipeline"
+
+AudioPlaybackPipeline::AudioPlaybackPipeline(size_t lookahead_frames) : frames_(lookahead_frames) {
+}
+
+AudioPlaybackPipeline::~AudioPlaybackPipeline() {
+    if (sink_task_handle_ != nullptr) {
+        vTaskDelete(sink_task_handle_);
+    }
+}
+
+void AudioPlaybackPipeline::Start(AudioCodec* codec, FramePlayedCallback on_frame_played) {
+    codec_ = codec;
+    on_frame_played_ = std::move(on_frame_played);
+
+    // Reserve the largest frame we expect (60ms at the codec rate) so pushes never grow the ring buffers
+    size_t frame_samples = codec_->output_sample_rate() * 60 / 1000;
+    for (auto& frame : frames_) {
+        frame.pcm.reserve(frame_samples);
+    }
+
+    xTaskCreate([](void* arg) {
+        AudioPlaybackPipeline* pipeline = (AudioPlaybackPipeline*)arg;
+        pipeline->SinkTask();
+    }, "audio_sink", AUDIO_PLAYBACK_SINK_STACK_SIZE, this, 8, &sink_task_handle_);
+}
+
+bool AudioPlaybackPipeline::Full() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_ == frames_.size();
+}
+
+bool AudioPlaybackPipeline::Push(std::vector<int16_t>& pcm, uint32_t timestamp) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == frames_.size()) {
+            return false;
+        }
+        auto& frame = frames_[(head_ + count_) % frames_.size()];
+        std::swap(frame.pcm, pcm);
+        frame.timestamp = timestamp;
+        count_++;
+    }
+    pcm.clear();
+    condition_variable_.notify_one();
+    return true;
+}
+
+void AudioPlaybackPipeline::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    head_ = 0;
+    count_ = 0;
+    last_played_us_ = 0;
+}
+
+void AudioPlaybackPipeline::MarkStreamStart() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stream_start_us_ = esp_timer_get_time();
+}
+
+void AudioPlaybackPipeline::RecordScheduleLatency(int64_t latency_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    schedule_total_us_ += latency_us;
+    schedule_count_++;
+    max_schedule_us_ = std::max(max_schedule_us_, (int)latency_us);
+}
+
+AudioPlaybackStats AudioPlaybackPipeline::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return AudioPlaybackStats{
+        .last_first_audio_ms = last_first_audio_ms_,
+        .max_first_audio_ms = max_first_audio_ms_,
+        .streams = streams_,
+        .frames = frames_played_,
+        .underruns = underruns_,
+        .avg_schedule_us = schedule_count_ > 0 ? (int)(schedule_total_us_ / schedule_count_) : 0,
+        .max_schedule_us = max_schedule_us_,
+    };
+}
+
+void AudioPlaybackPipeline::SinkTask() {
+    std::vector<int16_t> pcm;
+    uint32_t timestamp;
+    int64_t last_frame_us = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            bool starved = count_ == 0;
+            condition_variable_.wait(lock, [this]() { return count_ > 0; });
+            std::swap(pcm, frames_[head_].pcm);
+            timestamp = frames_[head_].timestamp;
+            head_ = (head_ + 1) % frames_.size();
+            count_--;
+
+            // Waited longer than the audio still queued in DMA, but not long enough to be a pause
+            if (starved && last_played_us_ != 0) {
+                int64_t gap = esp_timer_get_time() - last_played_us_;
+                if (gap > last_frame_us && gap < AUDIO_PLAYBACK_UNDERRUN_WINDOW_MS * 1000) {
+                    underruns_++;
+                }
+            }
+        }
+
+        codec_->OutputData(pcm);
+
+        int64_t now = esp_timer_get_time();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frames_played_++;
+            last_played_us_ = now;
+            if (stream_start_us_ != 0) {
+                LATENCY_TRACE(kTraceFirstAudio, 0);
+                last_first_audio_ms_ = (int)((now - stream_start_us_) / 1000);
+                max_first_audio_ms_ = std::max(max_first_audio_ms_, last_first_audio_ms_);
+                streams_++;
+                stream_start_us_ = 0;
+                ESP_LOGI(TAG, "First audio %d ms after tts start", last_first_audio_ms_);
+            }
+        }
+        // Decoded frames are mono at the codec output rate
+        last_frame_us = int64_t(pcm.size()) * 1000000 / codec_->output_sample_rate();
+
+        if (on_frame_played_) {
+            on_frame_played_(timestamp);
+        }
+    }
+}
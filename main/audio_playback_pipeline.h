@@ -0,0 +1,89 @@
+#ifndef AUDIO_PLAYBACK_PIPELINE_H
+#define AUDIO_PLAYBACK_PIPELINE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdint>
+
+#include "audio_codec.h"
+#include "inplace_task.h"
+
+// Decoded frames the decode stage may run ahead of the I2S sink
+#define AUDIO_PLAYBACK_LOOKAHEAD_FRAMES 2
+// A sink stall shorter than this after a played frame is an underrun, longer is a pause in the stream
+#define AUDIO_PLAYBACK_UNDERRUN_WINDOW_MS 1000
+// The sink task calls the board codec's OutputData(), which used to run on the 28 KB background
+// task. It keeps that budget until the board codecs have a measured high-water mark.
+#define AUDIO_PLAYBACK_SINK_STACK_SIZE (4096 * 7)
+
+struct AudioPlaybackStats {
+    int last_first_audio_ms;    // tts start to first PCM written, -1 until measured
+    int max_first_audio_ms;
+    uint32_t streams;
+    uint32_t frames;
+    uint32_t underruns;
+    int avg_schedule_us;        // Delay between scheduling a decode and the decode starting
+    int max_schedule_us;
+};
+
+/*
+ * Two-stage downlink playback. The decode stage (a background task job) pushes PCM frames
+ * into a small ring, the sink task drains the ring into the codec. Decode of the next frames
+ * overlaps with the blocking I2S write of the current one, so a busy background worker no
+ * longer starves the speaker.
+ */
+class AudioPlaybackPipeline {
+public:
+    using FramePlayedCallback = InplaceTask<16, void(uint32_t timestamp)>;
+
+    AudioPlaybackPipeline(size_t lookahead_frames = AUDIO_PLAYBACK_LOOKAHEAD_FRAMES);
+    ~AudioPlaybackPipeline();
+
+    void Start(AudioCodec* codec, FramePlayedCallback on_frame_played);
+
+    // Decode stage: true when no more frames should be decoded ahead
+    bool Full() const;
+    // Swaps `pcm` into the ring, `pcm` gets back a spare buffer that keeps its capacity
+    bool Push(std::vector<int16_t>& pcm, uint32_t timestamp);
+    // Drop frames not yet handed to the codec
+    void Clear();
+
+    // Called on tts start, the next frame written to the codec closes the time-to-first-audio measurement
+    void MarkStreamStart();
+    void RecordScheduleLatency(int64_t latency_us);
+    AudioPlaybackStats GetStats() const;
+
+private:
+    struct Frame {
+        std::vector<int16_t> pcm;
+        uint32_t timestamp = 0;
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::vector<Frame> frames_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    AudioCodec* codec_ = nullptr;
+    FramePlayedCallback on_frame_played_;
+    TaskHandle_t sink_task_handle_ = nullptr;
+
+    int64_t stream_start_us_ = 0;
+    int64_t last_played_us_ = 0;
+    int last_first_audio_ms_ = -1;
+    int max_first_audio_ms_ = 0;
+    uint32_t streams_ = 0;
+    uint32_t frames_played_ = 0;
+    uint32_t underruns_ = 0;
+    int64_t schedule_total_us_ = 0;
+    uint32_t schedule_count_ = 0;
+    int max_schedule_us_ = 0;
+
+    void SinkTask();
+};
+
+#endif // AUDIO_PLAYBACK_PIPELINE_H
@@ -1,4 +1,5 @@
 #include "afe_audio_processor.h"
+#include "latency_trace.h"
 #include <esp_log.h>
 
 #define PROCESSOR_RUNNING 0x01
@@ -79,7 +80,7 @@ size_t AfeAudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
 }
 
-void AfeAudioProcessor::Feed(const std::vector<int16_t>& data) {
+void AfeAudioProcessor::Feed(std::span<const int16_t> data) {
     if (afe_data_ == nullptr) {
         return;
     }
@@ -133,9 +134,11 @@ void AfeAudioProcessor::AudioProcessorTask() {
         if (vad_state_change_callback_) {
             if (res->vad_state == VAD_SPEECH && !is_speaking_) {
                 is_speaking_ = true;
+                LATENCY_TRACE(kTraceVadSpeechStart, 0);
                 vad_state_change_callback_(true);
             } else if (res->vad_state == VAD_SILENCE && is_speaking_) {
                 is_speaking_ = false;
+                LATENCY_TRACE(kTraceVadSpeechEnd, 0);
                 vad_state_change_callback_(false);
             }
         }
@@ -8,6 +8,7 @@
 
 #include <string>
 #include <vector>
+#include <span>
 #include <functional>
 
 #include "audio_processor.h"
@@ -19,7 +20,7 @@ public:
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec) override;
-    void Feed(const std::vector<int16_t>& data) override;
+    void Feed(std::span<const int16_t> data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
@@ -81,6 +81,10 @@ void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_
     wake_word_detected_callback_ = callback;
 }
 
+void AfeWakeWord::OnVoiceActivity(std::function<void()> callback) {
+    voice_activity_callback_ = callback;
+}
+
 void AfeWakeWord::StartDetection() {
     xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
 }
@@ -96,7 +100,7 @@ bool AfeWakeWord::IsDetectionRunning() {
     return xEventGroupGetBits(event_group_) & DETECTION_RUNNING_EVENT;
 }
 
-void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
+void AfeWakeWord::Feed(std::span<const int16_t> data) {
     if (afe_data_ == nullptr) {
         return;
     }
@@ -127,6 +131,13 @@ void AfeWakeWord::AudioDetectionTask() {
         // Store the wake word data for voice recognition, like who is speaking
         StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
 
+        // Speech usually comes a second before the wake word is recognized, enough to get the network ready
+        bool voice_active = res->vad_state == VAD_SPEECH;
+        if (voice_active && !voice_active_ && voice_activity_callback_) {
+            voice_activity_callback_();
+        }
+        voice_active_ = voice_active;
+
         if (res->wakeup_state == WAKENET_DETECTED) {
             StopDetection();
             last_detected_wake_word_ = wake_words_[res->wake_word_index - 1];
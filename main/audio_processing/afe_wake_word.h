@@ -11,6 +11,7 @@
 #include <list>
 #include <string>
 #include <vector>
+#include <span>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
@@ -24,7 +25,7 @@ public:
     ~AfeWakeWord();
 
     void Initialize(AudioCodec* codec);
-    void Feed(const std::vector<int16_t>& data);
+    void Feed(std::span<const int16_t> data);
     void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback);
     void StartDetection();
     void StopDetection();
@@ -33,6 +34,7 @@ public:
     void EncodeWakeWordData();
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
+    void OnVoiceActivity(std::function<void()> callback);
 
 private:
     esp_afe_sr_iface_t* afe_iface_ = nullptr;
@@ -41,6 +43,8 @@ private:
     std::vector<std::string> wake_words_;
     EventGroupHandle_t event_group_;
     std::function<void(const std::string& wake_word)> wake_word_detected_callback_;
+    std::function<void()> voice_activity_callback_;
+    bool voice_active_ = false;
     AudioCodec* codec_ = nullptr;
     std::string last_detected_wake_word_;
 
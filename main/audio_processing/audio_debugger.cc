@@ -51,7 +51,7 @@ AudioDebugger::~AudioDebugger() {
 #endif
 }
 
-void AudioDebugger::Feed(const std::vector<int16_t>& data) {
+void AudioDebugger::Feed(std::span<const int16_t> data) {
 #if CONFIG_USE_AUDIO_DEBUGGER
     if (udp_sockfd_ >= 0) {
         ssize_t sent = sendto(udp_sockfd_, data.data(), data.size() * sizeof(int16_t), 0,
@@ -65,4 +65,18 @@ void AudioDebugger::Feed(const std::vector<int16_t>& data) {
 #endif
 }
 
- 
\ No newline at end of file
+ 
+
+void AudioDebugger::SendTrace(const char* data, size_t size) {
+#if CONFIG_USE_AUDIO_DEBUGGER
+    if (udp_sockfd_ >= 0) {
+        std::string datagram = AUDIO_DEBUGGER_TRACE_MAGIC;
+        datagram.append(data, size);
+        ssize_t sent = sendto(udp_sockfd_, datagram.data(), datagram.size(), 0,
+                             (struct sockaddr*)&udp_server_addr_, sizeof(udp_server_addr_));
+        if (sent < 0) {
+            ESP_LOGW(TAG, "Failed to send trace to %s: %d", CONFIG_AUDIO_DEBUG_UDP_SERVER, errno);
+        }
+    }
+#endif
+}
@@ -2,17 +2,22 @@
 #define AUDIO_DEBUGGER_H
 
 #include <vector>
+#include <span>
 #include <cstdint>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+#define AUDIO_DEBUGGER_TRACE_MAGIC "TRACE\n"
+
 class AudioDebugger {
 public:
     AudioDebugger();
     ~AudioDebugger();
 
-    void Feed(const std::vector<int16_t>& data);
+    void Feed(std::span<const int16_t> data);
+    // Text datagram prefixed with AUDIO_DEBUGGER_TRACE_MAGIC so the server can tell it from audio
+    void SendTrace(const char* data, size_t size);
 
 private:
     int udp_sockfd_ = -1;
@@ -0,0 +1,68 @@
+#include "audio_input_pipeline.h"
+#include "audio_kernels.h"
+
+#include <esp_log.h>
+
+#define TAG "AudioInputPipeline"
+
+void AudioInputPipeline::Initialize(AudioCodec* codec, int sample_rate, int frame_duration_ms) {
+    codec_ = codec;
+    sample_rate_ = sample_rate;
+
+    int input_rate = codec_->input_sample_rate();
+    int channels = codec_->input_channels();
+    if (input_rate != sample_rate_) {
+        mic_resampler_.Configure(input_rate, sample_rate_);
+        reference_resampler_.Configure(input_rate, sample_rate_);
+    }
+
+    // Size every buffer for the longest frame we read, so steady-state reads never grow them
+    size_t input_samples = input_rate * frame_duration_ms / 1000;
+    size_t output_samples = sample_rate_ * frame_duration_ms / 1000;
+    input_.reserve(input_samples * channels);
+    output_.reserve(output_samples * channels);
+    if (input_rate != sample_rate_ && channels == 2) {
+        mic_.reserve(input_samples);
+        reference_.reserve(input_samples);
+        resampled_mic_.reserve(output_samples);
+        resampled_reference_.reserve(output_samples);
+    }
+    ESP_LOGI(TAG, "Input %d Hz x %d -> %d Hz, frame %d ms", input_rate, channels, sample_rate_, frame_duration_ms);
+}
+
+bool AudioInputPipeline::Read(int samples, std::span<const int16_t>& frame) {
+    if (codec_->input_sample_rate() == sample_rate_) {
+        output_.resize(samples);
+        if (!codec_->InputData(output_)) {
+            return false;
+        }
+        frame = output_;
+        return true;
+    }
+
+    input_.resize(samples * codec_->input_sample_rate() / sample_rate_);
+    if (!codec_->InputData(input_)) {
+        return false;
+    }
+
+    if (codec_->input_channels() == 2) {
+        size_t frames = input_.size() / 2;
+        mic_.resize(frames);
+        reference_.resize(frames);
+        audio_kernels::Deinterleave(input_.data(), mic_.data(), reference_.data(), frames);
+        resampled_mic_.resize(mic_resampler_.GetOutputSamples(frames));
+        resampled_reference_.resize(reference_resampler_.GetOutputSamples(frames));
+        mic_resampler_.Process(mic_.data(), frames, resampled_mic_.data());
+        reference_resampler_.Process(reference_.data(), frames, resampled_reference_.data());
+
+        size_t output_frames = resampled_mic_.size();
+        output_.resize(output_frames * 2);
+        audio_kernels::Interleave(resampled_mic_.data(), resampled_reference_.data(), output_.data(), output_frames);
+    } else {
+        output_.resize(mic_resampler_.GetOutputSamples(input_.size()));
+        mic_resampler_.Process(input_.data(), input_.size(), output_.data());
+    }
+
+    frame = output_;
+    return true;
+}
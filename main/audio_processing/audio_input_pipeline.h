@@ -0,0 +1,45 @@
+#ifndef AUDIO_INPUT_PIPELINE_H
+#define AUDIO_INPUT_PIPELINE_H
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include <opus_resampler.h>
+
+#include "audio_codec.h"
+
+/*
+ * Reads microphone frames from the codec and converts them to the sample rate
+ * expected by the wake word and the audio processor.
+ * All scratch buffers are owned by the pipeline and reused across frames,
+ * so reading a frame does not allocate once the pipeline is warmed up.
+ */
+class AudioInputPipeline {
+public:
+    AudioInputPipeline() = default;
+    AudioInputPipeline(const AudioInputPipeline&) = delete;
+    AudioInputPipeline& operator=(const AudioInputPipeline&) = delete;
+
+    void Initialize(AudioCodec* codec, int sample_rate, int frame_duration_ms);
+    // Read `samples` interleaved samples at the output sample rate.
+    // The returned frame stays valid until the next call to Read.
+    bool Read(int samples, std::span<const int16_t>& frame);
+
+    inline int sample_rate() const { return sample_rate_; }
+
+private:
+    AudioCodec* codec_ = nullptr;
+    int sample_rate_ = 16000;
+    OpusResampler mic_resampler_;
+    OpusResampler reference_resampler_;
+
+    std::vector<int16_t> input_;
+    std::vector<int16_t> mic_;
+    std::vector<int16_t> reference_;
+    std::vector<int16_t> resampled_mic_;
+    std::vector<int16_t> resampled_reference_;
+    std::vector<int16_t> output_;
+};
+
+#endif // AUDIO_INPUT_PIPELINE_H
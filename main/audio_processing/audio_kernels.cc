@@ -0,0 +1,257 @@
+#include "audio_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+namespace audio_kernels {
+
+namespace scalar {
+
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        left[i] = input[2 * i];
+        right[i] = input[2 * i + 1];
+    }
+}
+
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        output[2 * i] = left[i];
+        output[2 * i + 1] = right[i];
+    }
+}
+
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t value = input[i] >> shift;
+        output[i] = (int16_t)std::min<int32_t>(std::max<int32_t>(value, -INT16_MAX), INT16_MAX);
+    }
+}
+
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain) {
+    for (size_t i = 0; i < samples; i++) {
+        output[i] = int32_t(input[i]) * gain;
+    }
+}
+
+} // namespace scalar
+
+namespace swar {
+
+// Xtensa only allows aligned 32-bit loads, fall back to the reference for odd offsets
+static inline bool IsWordAligned(const void* p) {
+    return ((uintptr_t)p & 3) == 0;
+}
+
+// memcpy keeps the int16 buffers free of aliasing, on aligned pointers it compiles to a single l32i/s32i
+static inline uint32_t LoadWord(const int16_t* p) {
+    uint32_t word;
+    memcpy(&word, __builtin_assume_aligned(p, 4), sizeof(word));
+    return word;
+}
+
+static inline void StoreWord(int16_t* p, uint32_t word) {
+    memcpy(__builtin_assume_aligned(p, 4), &word, sizeof(word));
+}
+
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    if (!IsWordAligned(input) || !IsWordAligned(left) || !IsWordAligned(right)) {
+        scalar::Deinterleave(input, left, right, frames);
+        return;
+    }
+    size_t pairs = frames / 2;
+    for (size_t i = 0; i < pairs; i++) {
+        // Little endian: each word holds one frame as (right << 16) | left
+        uint32_t w0 = LoadWord(input + 4 * i);
+        uint32_t w1 = LoadWord(input + 4 * i + 2);
+        StoreWord(left + 2 * i, (w0 & 0xFFFF) | (w1 << 16));
+        StoreWord(right + 2 * i, (w0 >> 16) | (w1 & 0xFFFF0000));
+    }
+    scalar::Deinterleave(input + pairs * 4, left + pairs * 2, right + pairs * 2, frames - pairs * 2);
+}
+
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    if (!IsWordAligned(output) || !IsWordAligned(left) || !IsWordAligned(right)) {
+        scalar::Interleave(left, right, output, frames);
+        return;
+    }
+    size_t pairs = frames / 2;
+    for (size_t i = 0; i < pairs; i++) {
+        uint32_t lw = LoadWord(left + 2 * i);
+        uint32_t rw = LoadWord(right + 2 * i);
+        StoreWord(output + 4 * i, (lw & 0xFFFF) | (rw << 16));
+        StoreWord(output + 4 * i + 2, (lw >> 16) | (rw & 0xFFFF0000));
+    }
+    scalar::Interleave(left + pairs * 2, right + pairs * 2, output + pairs * 4, frames - pairs * 2);
+}
+
+} // namespace swar
+
+#if defined(__ARM_NEON)
+namespace neon {
+
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v = vld2q_s16(input + 2 * i);
+        vst1q_s16(left + i, v.val[0]);
+        vst1q_s16(right + i, v.val[1]);
+    }
+    scalar::Deinterleave(input + 2 * i, left + i, right + i, frames - i);
+}
+
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v;
+        v.val[0] = vld1q_s16(left + i);
+        v.val[1] = vld1q_s16(right + i);
+        vst2q_s16(output + 2 * i, v);
+    }
+    scalar::Interleave(left + i, right + i, output + 2 * i, frames - i);
+}
+
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift) {
+    const int32x4_t shift_v = vdupq_n_s32(-shift);
+    const int16x8_t min_v = vdupq_n_s16(-INT16_MAX);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        int32x4_t a = vshlq_s32(vld1q_s32(input + i), shift_v);
+        int32x4_t b = vshlq_s32(vld1q_s32(input + i + 4), shift_v);
+        int16x8_t packed = vcombine_s16(vqmovn_s32(a), vqmovn_s32(b));
+        vst1q_s16(output + i, vmaxq_s16(packed, min_v));
+    }
+    scalar::ShiftSaturate(input + i, output + i, samples - i, shift);
+}
+
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t v = vld1q_s16(input + i);
+        vst1q_s32(output + i, vmulq_n_s32(vmovl_s16(vget_low_s16(v)), gain));
+        vst1q_s32(output + i + 4, vmulq_n_s32(vmovl_s16(vget_high_s16(v)), gain));
+    }
+    scalar::ApplyGain(input + i, output + i, samples - i, gain);
+}
+
+} // namespace neon
+#endif
+
+#if defined(__SSE2__)
+namespace sse2 {
+
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(input + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(input + 2 * i + 8));
+        // Sign-extend each half of the 32-bit frames, values stay in range so packing is exact
+        __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        __m128i r = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+        _mm_storeu_si128((__m128i*)(left + i), l);
+        _mm_storeu_si128((__m128i*)(right + i), r);
+    }
+    scalar::Deinterleave(input + 2 * i, left + i, right + i, frames - i);
+}
+
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+        __m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+        _mm_storeu_si128((__m128i*)(output + 2 * i), _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i*)(output + 2 * i + 8), _mm_unpackhi_epi16(l, r));
+    }
+    scalar::Interleave(left + i, right + i, output + 2 * i, frames - i);
+}
+
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift) {
+    const __m128i shift_v = _mm_cvtsi32_si128(shift);
+    const __m128i min_v = _mm_set1_epi16(-INT16_MAX);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i a = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(input + i)), shift_v);
+        __m128i b = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(input + i + 4)), shift_v);
+        _mm_storeu_si128((__m128i*)(output + i), _mm_max_epi16(_mm_packs_epi32(a, b), min_v));
+    }
+    scalar::ShiftSaturate(input + i, output + i, samples - i, shift);
+}
+
+} // namespace sse2
+#endif
+
+#if defined(__SSE4_1__)
+namespace sse41 {
+
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain) {
+    const __m128i gain_v = _mm_set1_epi32(gain);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(input + i));
+        __m128i lo = _mm_cvtepi16_epi32(v);
+        __m128i hi = _mm_cvtepi16_epi32(_mm_srli_si128(v, 8));
+        _mm_storeu_si128((__m128i*)(output + i), _mm_mullo_epi32(lo, gain_v));
+        _mm_storeu_si128((__m128i*)(output + i + 4), _mm_mullo_epi32(hi, gain_v));
+    }
+    scalar::ApplyGain(input + i, output + i, samples - i, gain);
+}
+
+} // namespace sse41
+#endif
+
+// Compile time dispatch, the reference loops already compile to MIN/MAX and MULL on Xtensa.
+// The SWAR de/interleave lost to the reference in the host benchmark (deinterleave 1259 vs 1108 ns,
+// interleave 681 vs 469 ns), so Xtensa stays on the reference until on-device numbers show otherwise.
+#if defined(__XTENSA__)
+namespace deinterleave_impl = scalar;
+namespace interleave_impl = scalar;
+namespace shift_impl = scalar;
+namespace gain_impl = scalar;
+#elif defined(__ARM_NEON)
+namespace deinterleave_impl = neon;
+namespace interleave_impl = neon;
+namespace shift_impl = neon;
+namespace gain_impl = neon;
+#elif defined(__SSE2__)
+namespace deinterleave_impl = sse2;
+namespace interleave_impl = sse2;
+namespace shift_impl = sse2;
+#if defined(__SSE4_1__)
+namespace gain_impl = sse41;
+#else
+namespace gain_impl = scalar;
+#endif
+#else
+namespace deinterleave_impl = scalar;
+namespace interleave_impl = scalar;
+namespace shift_impl = scalar;
+namespace gain_impl = scalar;
+#endif
+
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    deinterleave_impl::Deinterleave(input, left, right, frames);
+}
+
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    interleave_impl::Interleave(left, right, output, frames);
+}
+
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift) {
+    shift_impl::ShiftSaturate(input, output, samples, shift);
+}
+
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain) {
+    gain_impl::ApplyGain(input, output, samples, gain);
+}
+
+} // namespace audio_kernels
@@ -0,0 +1,68 @@
+#ifndef AUDIO_KERNELS_H
+#define AUDIO_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample-format kernels used on every captured and played frame.
+ *
+ * The functions in audio_kernels:: pick the fastest variant for the target at compile time:
+ *   - Xtensa (ESP32 / ESP32-S3): the scalar reference, see the dispatch in audio_kernels.cc
+ *   - Host x86: SSE2 (SSE4.1 for the gain kernel)
+ *   - Host ARM: NEON
+ * The audio_kernels::scalar:: functions are the portable reference; every variant is bit-exact with it.
+ * The variants are declared below whenever the target can run them, so the host tests can compare each
+ * one against the reference.
+ */
+namespace audio_kernels {
+
+// Split interleaved stereo [L R L R ...] into two mono buffers
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames);
+// Merge two mono buffers into interleaved stereo
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames);
+// output[i] = clamp(input[i] >> shift, -INT16_MAX, INT16_MAX)
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift);
+// output[i] = input[i] * gain, gain is Q16 in [0, 65536] so the product always fits in int32
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain);
+
+namespace scalar {
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames);
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames);
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift);
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain);
+} // namespace scalar
+
+// Portable 32-bit SWAR, two int16 samples per load/store. Not dispatched anywhere yet, it is kept
+// benchmarked against the reference for Xtensa. Falls back to scalar for buffers that are not word aligned
+namespace swar {
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames);
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames);
+} // namespace swar
+
+#if defined(__ARM_NEON)
+namespace neon {
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames);
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames);
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift);
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain);
+} // namespace neon
+#endif
+
+#if defined(__SSE2__)
+namespace sse2 {
+void Deinterleave(const int16_t* input, int16_t* left, int16_t* right, size_t frames);
+void Interleave(const int16_t* left, const int16_t* right, int16_t* output, size_t frames);
+void ShiftSaturate(const int32_t* input, int16_t* output, size_t samples, int shift);
+} // namespace sse2
+#endif
+
+#if defined(__SSE4_1__)
+namespace sse41 {
+void ApplyGain(const int16_t* input, int32_t* output, size_t samples, int32_t gain);
+} // namespace sse41
+#endif
+
+} // namespace audio_kernels
+
+#endif // AUDIO_KERNELS_H
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <span>
 #include <functional>
 
 #include "audio_codec.h"
@@ -12,7 +13,7 @@ public:
     virtual ~AudioProcessor() = default;
     
     virtual void Initialize(AudioCodec* codec) = 0;
-    virtual void Feed(const std::vector<int16_t>& data) = 0;
+    virtual void Feed(std::span<const int16_t> data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual bool IsRunning() = 0;
@@ -12,6 +12,7 @@
 #include <list>
 #include <string>
 #include <vector>
+#include <span>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
@@ -25,7 +26,7 @@ public:
     ~EspWakeWord();
 
     void Initialize(AudioCodec* codec);
-    void Feed(const std::vector<int16_t>& data);
+    void Feed(std::span<const int16_t> data);
     void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback);
     void StartDetection();
     void StopDetection();
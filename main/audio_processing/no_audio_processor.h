@@ -2,6 +2,7 @@
 #define DUMMY_AUDIO_PROCESSOR_H
 
 #include <vector>
+#include <span>
 #include <functional>
 
 #include "audio_processor.h"
@@ -13,7 +14,7 @@ public:
     ~NoAudioProcessor() = default;
 
     void Initialize(AudioCodec* codec) override;
-    void Feed(const std::vector<int16_t>& data) override;
+    void Feed(std::span<const int16_t> data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
@@ -2,6 +2,7 @@
 #define NO_WAKE_WORD_H
 
 #include <vector>
+#include <span>
 #include <functional>
 #include <string>
 
@@ -14,7 +15,7 @@ public:
     ~NoWakeWord() = default;
 
     void Initialize(AudioCodec* codec) override;
-    void Feed(const std::vector<int16_t>& data) override;
+    void Feed(std::span<const int16_t> data) override;
     void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) override;
     void StartDetection() override;
     void StopDetection() override;
@@ -0,0 +1,120 @@
+#include "uplink_opus_encoder.h"
+
+#include <esp_log.h>
+
+#define TAG "UplinkOpusEncoder"
+
+UplinkOpusEncoder::UplinkOpusEncoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), channels_(channels), duration_ms_(duration_ms) {
+    int error;
+    encoder_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &error);
+    if (encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", error);
+        return;
+    }
+
+    // Same defaults as OpusEncoderWrapper
+    SetDtx(true);
+    SetComplexity(5);
+
+    frame_size_ = sample_rate_ / 1000 * channels_ * duration_ms_;
+    in_buffer_.reserve(frame_size_ * 2);
+    packet_.payload.reserve(UPLINK_OPUS_MAX_PACKET_SIZE);
+}
+
+UplinkOpusEncoder::~UplinkOpusEncoder() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_destroy(encoder_);
+    }
+}
+
+void UplinkOpusEncoder::Encode(std::vector<int16_t>&& pcm, std::function<void(AudioStreamPacket& packet)> handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Audio encoder is not configured");
+        return;
+    }
+
+    in_buffer_.insert(in_buffer_.end(), pcm.begin(), pcm.end());
+
+    size_t offset = 0;
+    while (in_buffer_.size() - offset >= frame_size_) {
+        // Shrinking keeps the capacity, so growing back to the full size does not reallocate
+        packet_.payload.resize(headroom_ + UPLINK_OPUS_MAX_PACKET_SIZE);
+        auto ret = opus_encode(encoder_, in_buffer_.data() + offset, frame_size_ / channels_,
+            packet_.payload.data() + headroom_, UPLINK_OPUS_MAX_PACKET_SIZE);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+            break;
+        }
+        offset += frame_size_;
+        if (handler != nullptr) {
+            packet_.payload.resize(headroom_ + ret);
+            packet_.headroom = headroom_;
+            packet_.sample_rate = sample_rate_;
+            packet_.frame_duration = duration_ms_;
+            packet_.timestamp = 0;
+            handler(packet_);
+        }
+    }
+    in_buffer_.erase(in_buffer_.begin(), in_buffer_.begin() + offset);
+}
+
+void UplinkOpusEncoder::ResetState() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_RESET_STATE);
+    }
+    in_buffer_.clear();
+}
+
+void UplinkOpusEncoder::SetComplexity(int complexity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_COMPLEXITY(complexity));
+    }
+}
+
+void UplinkOpusEncoder::SetDtx(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_DTX(enable ? 1 : 0));
+    }
+}
+
+void UplinkOpusEncoder::SetBitrate(int bitrate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(bitrate > 0 ? bitrate : OPUS_AUTO));
+    }
+}
+
+void UplinkOpusEncoder::SetInbandFec(bool enable, int packet_loss_perc) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encoder_ != nullptr) {
+        opus_encoder_ctl(encoder_, OPUS_SET_INBAND_FEC(enable ? 1 : 0));
+        opus_encoder_ctl(encoder_, OPUS_SET_PACKET_LOSS_PERC(packet_loss_perc));
+    }
+}
+
+void UplinkOpusEncoder::SetHeadroom(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    headroom_ = bytes;
+    packet_.payload.reserve(headroom_ + UPLINK_OPUS_MAX_PACKET_SIZE);
+}
+
+bool UplinkOpusEncoder::SetFrameDuration(int duration_ms) {
+    switch (duration_ms) {
+        case 10: case 20: case 40: case 60: case 80: case 100: case 120:
+            break;
+        default:
+            ESP_LOGE(TAG, "Invalid frame duration: %d", duration_ms);
+            return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Opus takes the frame size per call, so the next frame simply uses the new size
+    duration_ms_ = duration_ms;
+    frame_size_ = sample_rate_ / 1000 * channels_ * duration_ms_;
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef UPLINK_OPUS_ENCODER_H
+#define UPLINK_OPUS_ENCODER_H
+
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include <opus.h>
+
+#include "protocol.h"
+
+#define UPLINK_OPUS_MAX_PACKET_SIZE 1500
+
+/*
+ * Opus encoder for the uplink with the knobs the rate controller needs: bitrate, in-band FEC,
+ * expected loss and frame duration, all adjustable while a session is running.
+ * Frames are encoded straight into one packet owned by the encoder, so after the first frame
+ * encoding does not touch the heap.
+ */
+class UplinkOpusEncoder {
+public:
+    UplinkOpusEncoder(int sample_rate, int channels, int duration_ms);
+    ~UplinkOpusEncoder();
+
+    // Buffers `pcm` and calls `handler` once per complete frame. The packet is reused for the
+    // next frame, so the handler has to copy it out (e.g. AudioPacketRing::Push) before returning.
+    void Encode(std::vector<int16_t>&& pcm, std::function<void(AudioStreamPacket& packet)> handler);
+    void ResetState();
+
+    void SetComplexity(int complexity);
+    void SetDtx(bool enable);
+    // 0 lets the encoder pick the bitrate
+    void SetBitrate(int bitrate);
+    void SetInbandFec(bool enable, int packet_loss_perc);
+    // Each output frame starts with `bytes` of unused space for the transport header
+    void SetHeadroom(size_t bytes);
+    // Valid Opus durations only (10, 20, 40, 60, 80, 100, 120), takes effect from the next frame
+    bool SetFrameDuration(int duration_ms);
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+private:
+    std::mutex mutex_;
+    OpusEncoder* encoder_ = nullptr;
+    int sample_rate_;
+    int channels_;
+    int duration_ms_;
+    size_t frame_size_;
+    size_t headroom_ = 0;
+    std::vector<int16_t> in_buffer_;
+    AudioStreamPacket packet_;
+};
+
+#endif // UPLINK_OPUS_ENCODER_H
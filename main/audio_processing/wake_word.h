@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <span>
 #include <functional>
 
 #include "audio_codec.h"
@@ -12,7 +13,7 @@ public:
     virtual ~WakeWord() = default;
     
     virtual void Initialize(AudioCodec* codec) = 0;
-    virtual void Feed(const std::vector<int16_t>& data) = 0;
+    virtual void Feed(std::span<const int16_t> data) = 0;
     virtual void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) = 0;
     virtual void StartDetection() = 0;
     virtual void StopDetection() = 0;
@@ -21,6 +22,8 @@ public:
     virtual void EncodeWakeWordData() = 0;
     virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
+    // Called when speech starts while detection is running, before any wake word is recognized
+    virtual void OnVoiceActivity(std::function<void()> callback) {}
 };
 
 #endif
@@ -2,69 +2,191 @@
 
 #include <esp_log.h>
 #include <esp_task_wdt.h>
+#include <cstdio>
 
 #define TAG "BackgroundTask"
 
-BackgroundTask::BackgroundTask(uint32_t stack_size) {
-    xTaskCreate([](void* arg) {
-        BackgroundTask* task = (BackgroundTask*)arg;
-        task->BackgroundTaskLoop();
-    }, "background_task", stack_size, this, 2, &background_task_handle_);
+BackgroundTask::BackgroundTask(uint32_t stack_size, uint32_t strand_stack_size) {
+    if (strand_stack_size == 0) {
+        strand_stack_size = stack_size;
+    }
+    worker_count_ = BACKGROUND_TASK_MAX_WORKERS;
+    for (int i = 0; i < worker_count_; i++) {
+        auto& worker = workers_[i];
+        worker.owner = this;
+        worker.index = i;
+        uint32_t worker_stack_size = i == 0 ? stack_size : strand_stack_size;
+        worker.takes_unbound_jobs = worker_stack_size >= stack_size;
+        char name[24];
+        snprintf(name, sizeof(name), "background_task_%d", i);
+        xTaskCreatePinnedToCore([](void* arg) {
+            Worker* worker = (Worker*)arg;
+            worker->owner->BackgroundTaskLoop(worker->index);
+        }, name, worker_stack_size, &worker, 2, &worker.handle, i);
+    }
 }
 
 BackgroundTask::~BackgroundTask() {
-    if (background_task_handle_ != nullptr) {
-        vTaskDelete(background_task_handle_);
+    for (int i = 0; i < worker_count_; i++) {
+        if (workers_[i].handle != nullptr) {
+            vTaskDelete(workers_[i].handle);
+        }
+    }
+}
+
+void BackgroundTask::JobQueue::Push(Job&& job) {
+    if (size_ == BACKGROUND_TASK_QUEUE_SIZE || !overflow_.empty()) {
+        overflow_.push_back(std::move(job));
+        return;
     }
+    jobs_[(head_ + size_) % BACKGROUND_TASK_QUEUE_SIZE] = std::move(job);
+    size_++;
 }
 
-bool BackgroundTask::Schedule(std::function<void()> callback) {
+bool BackgroundTask::JobQueue::PopFront(Job& job) {
+    if (size_ == 0) {
+        return false;
+    }
+    job = std::move(jobs_[head_]);
+    head_ = (head_ + 1) % BACKGROUND_TASK_QUEUE_SIZE;
+    size_--;
+    // The oldest spilled job takes the freed slot, so the order is kept
+    if (!overflow_.empty()) {
+        jobs_[(head_ + size_) % BACKGROUND_TASK_QUEUE_SIZE] = std::move(overflow_.front());
+        overflow_.pop_front();
+        size_++;
+    }
+    return true;
+}
+
+bool BackgroundTask::JobQueue::StealBack(Job& job) {
+    // The newest jobs are in the overflow, if any
+    for (auto it = overflow_.end(); it != overflow_.begin(); ) {
+        --it;
+        if (it->strand != BACKGROUND_TASK_NO_STRAND) {
+            continue;
+        }
+        job = std::move(*it);
+        overflow_.erase(it);
+        return true;
+    }
+    for (size_t i = size_; i-- > 0; ) {
+        auto& candidate = jobs_[(head_ + i) % BACKGROUND_TASK_QUEUE_SIZE];
+        if (candidate.strand != BACKGROUND_TASK_NO_STRAND) {
+            continue;
+        }
+        job = std::move(candidate);
+        // Close the gap so the remaining jobs keep their order
+        for (size_t j = i; j + 1 < size_; j++) {
+            jobs_[(head_ + j) % BACKGROUND_TASK_QUEUE_SIZE] = std::move(jobs_[(head_ + j + 1) % BACKGROUND_TASK_QUEUE_SIZE]);
+        }
+        size_--;
+        if (!overflow_.empty()) {
+            jobs_[(head_ + size_) % BACKGROUND_TASK_QUEUE_SIZE] = std::move(overflow_.front());
+            overflow_.pop_front();
+            size_++;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool BackgroundTask::Schedule(Task callback, BackgroundTaskLane lane, int strand) {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (waiting_for_completion_ > 0) {
+    if (waiting_for_completion_[lane] > 0) {
         return false;
     }
-    if (active_tasks_ >= 30) {
+    int total_tasks = 0;
+    for (int i = 0; i < kBackgroundTaskLaneCount; i++) {
+        total_tasks += active_tasks_[i];
+    }
+    if (total_tasks >= 30) {
         int free_sram = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
         if (free_sram < 10000) {
-            ESP_LOGW(TAG, "active_tasks_ == %d, free_sram == %u", active_tasks_, free_sram);
+            ESP_LOGW(TAG, "active_tasks_ == %d, free_sram == %u", total_tasks, free_sram);
             return false;
         }
     }
-    active_tasks_++;
-    background_tasks_.emplace_back([this, cb = std::move(callback)]() {
-        cb();
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            active_tasks_--;
-            if (background_tasks_.empty() && active_tasks_ == 0) {
-                condition_variable_.notify_all();
+
+    int target = 0;
+    if (strand != BACKGROUND_TASK_NO_STRAND) {
+        target = strand % worker_count_;
+    } else {
+        for (int i = 1; i < worker_count_; i++) {
+            if (workers_[i].takes_unbound_jobs && workers_[i].queues[lane].size() < workers_[target].queues[lane].size()) {
+                target = i;
             }
         }
-    });
+    }
+    workers_[target].queues[lane].Push(Job{std::move(callback), strand});
+    active_tasks_[lane]++;
+    // Wake every worker, a strand job can only be taken by its own worker
     condition_variable_.notify_all();
     return true;
 }
 
 void BackgroundTask::WaitForCompletion() {
     std::unique_lock<std::mutex> lock(mutex_);
-    waiting_for_completion_++;
+    for (int i = 0; i < kBackgroundTaskLaneCount; i++) {
+        waiting_for_completion_[i]++;
+    }
     condition_variable_.wait(lock, [this]() {
-        return background_tasks_.empty() && active_tasks_ == 0;
+        for (int i = 0; i < kBackgroundTaskLaneCount; i++) {
+            if (active_tasks_[i] != 0) {
+                return false;
+            }
+        }
+        return true;
     });
-    waiting_for_completion_--;
+    for (int i = 0; i < kBackgroundTaskLaneCount; i++) {
+        waiting_for_completion_[i]--;
+    }
+}
+
+void BackgroundTask::WaitForCompletion(BackgroundTaskLane lane) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiting_for_completion_[lane]++;
+    condition_variable_.wait(lock, [this, lane]() { return active_tasks_[lane] == 0; });
+    waiting_for_completion_[lane]--;
+}
+
+bool BackgroundTask::TakeJob(int worker_index, Job& job, BackgroundTaskLane& lane) {
+    for (int l = 0; l < kBackgroundTaskLaneCount; l++) {
+        // Own queue first, in FIFO order
+        if (workers_[worker_index].queues[l].PopFront(job)) {
+            lane = (BackgroundTaskLane)l;
+            return true;
+        }
+        // Then steal the newest unbound job from another worker
+        for (int i = 1; i < worker_count_ && workers_[worker_index].takes_unbound_jobs; i++) {
+            if (workers_[(worker_index + i) % worker_count_].queues[l].StealBack(job)) {
+                lane = (BackgroundTaskLane)l;
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
-void BackgroundTask::BackgroundTaskLoop() {
-    ESP_LOGI(TAG, "background_task started");
+void BackgroundTask::BackgroundTaskLoop(int worker_index) {
+    ESP_LOGI(TAG, "background_task_%d started", worker_index);
+    Job job;
+    BackgroundTaskLane lane;
     while (true) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        condition_variable_.wait(lock, [this]() { return !background_tasks_.empty(); });
-        
-        std::list<std::function<void()>> tasks = std::move(background_tasks_);
-        lock.unlock();
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_variable_.wait(lock, [this, worker_index, &job, &lane]() {
+                return TakeJob(worker_index, job, lane);
+            });
+        }
+
+        job.callback();
+        job.callback = nullptr;
 
-        for (auto& task : tasks) {
-            task();
+        std::lock_guard<std::mutex> lock(mutex_);
+        active_tasks_[lane]--;
+        if (active_tasks_[lane] == 0) {
+            condition_variable_.notify_all();
         }
     }
 }
@@ -4,27 +4,96 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <mutex>
-#include <list>
 #include <condition_variable>
 #include <atomic>
+#include <deque>
 
+#include "inplace_task.h"
+
+// One worker per core, pinned, so encode and decode can run side by side on dual-core chips
+#define BACKGROUND_TASK_MAX_WORKERS portNUM_PROCESSORS
+#define BACKGROUND_TASK_NO_STRAND -1
+// Inline capture budget per job, enough for a lambda holding a PCM frame vector or an AudioStreamPacket
+#define BACKGROUND_TASK_INLINE_SIZE 64
+// Preallocated job slots per worker and lane. A burst beyond that spills to the heap instead of
+// failing, so only a completion wait or low memory make Schedule() return false.
+#define BACKGROUND_TASK_QUEUE_SIZE 20
+
+enum BackgroundTaskLane {
+    kBackgroundTaskLaneRealtime,    // Audio encode / decode, always picked before best-effort jobs
+    kBackgroundTaskLaneBestEffort,
+    kBackgroundTaskLaneCount,
+};
+
+/*
+ * Work-stealing executor with one worker task per core.
+ *
+ * Jobs scheduled on the same strand run one at a time in the order they were scheduled:
+ * they are bound to one worker and never stolen. Jobs without a strand go to the least
+ * loaded worker and may be stolen by any idle worker.
+ *
+ * Worker 0 gets stack_size. The other workers get strand_stack_size, which defaults to
+ * stack_size. When it is smaller, those workers only run the strand jobs bound to them
+ * and never take jobs without a strand, whose stack needs are unknown.
+ *
+ * Each lane has its own completion barrier, WaitForCompletion(lane) only drains that lane.
+ */
 class BackgroundTask {
 public:
-    BackgroundTask(uint32_t stack_size = 4096 * 2);
+    using Task = InplaceTask<BACKGROUND_TASK_INLINE_SIZE>;
+
+    BackgroundTask(uint32_t stack_size = 4096 * 2, uint32_t strand_stack_size = 0);
     ~BackgroundTask();
 
-    bool Schedule(std::function<void()> callback);
+    bool Schedule(Task callback, BackgroundTaskLane lane = kBackgroundTaskLaneBestEffort,
+        int strand = BACKGROUND_TASK_NO_STRAND);
+    // Wait for every lane
     void WaitForCompletion();
+    void WaitForCompletion(BackgroundTaskLane lane);
 
 private:
+    struct Job {
+        Task callback;
+        int strand = BACKGROUND_TASK_NO_STRAND;
+    };
+
+    // FIFO with preallocated slots, jobs are moved in and out of them. Once the slots are full,
+    // newer jobs wait in overflow_ and move into the slots as they free up.
+    class JobQueue {
+    public:
+        void Push(Job&& job);
+        bool PopFront(Job& job);
+        // Removes the newest job that is not bound to a strand
+        bool StealBack(Job& job);
+        inline size_t size() const { return size_ + overflow_.size(); }
+        inline bool empty() const { return size() == 0; }
+
+    private:
+        Job jobs_[BACKGROUND_TASK_QUEUE_SIZE];
+        size_t head_ = 0;
+        size_t size_ = 0;
+        std::deque<Job> overflow_;
+    };
+
+    struct Worker {
+        BackgroundTask* owner = nullptr;
+        int index = 0;
+        TaskHandle_t handle = nullptr;
+        // False for workers with a smaller stack than worker 0
+        bool takes_unbound_jobs = true;
+        JobQueue queues[kBackgroundTaskLaneCount];
+    };
+
     std::mutex mutex_;
-    std::list<std::function<void()>> background_tasks_;
     std::condition_variable condition_variable_;
-    TaskHandle_t background_task_handle_ = nullptr;
-    int active_tasks_ = 0;
-    int waiting_for_completion_ = 0;
+    Worker workers_[BACKGROUND_TASK_MAX_WORKERS];
+    int worker_count_ = 0;
+    // Queued plus running jobs per lane
+    int active_tasks_[kBackgroundTaskLaneCount] = {};
+    int waiting_for_completion_[kBackgroundTaskLaneCount] = {};
 
-    void BackgroundTaskLoop();
+    bool TakeJob(int worker_index, Job& job, BackgroundTaskLane& lane);
+    void BackgroundTaskLoop(int worker_index);
 };
 
 #endif
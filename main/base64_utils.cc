@@ -1,69 +1,183 @@
 #include "base64_utils.h"
-#include <algorithm>
 
-const std::string Base64Utils::base64_chars = 
+#include <array>
+
+static const char kEncodeTable[] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
     "abcdefghijklmnopqrstuvwxyz"
     "0123456789+/";
 
+// Character to its 6-bit value, 0xFF outside the alphabet so one test on the OR of a block finds any of them
+static constexpr std::array<uint8_t, 256> MakeDecodeTable() {
+    std::array<uint8_t, 256> table{};
+    for (auto& value : table) {
+        value = 0xFF;
+    }
+    for (int i = 0; i < 64; i++) {
+        table[(uint8_t)kEncodeTable[i]] = i;
+    }
+    return table;
+}
+static constexpr std::array<uint8_t, 256> kDecodeTable = MakeDecodeTable();
+
+// Decodes whole 4-character blocks, stops before the first block holding a character outside the alphabet
+static inline size_t DecodeBlocks(const uint8_t* input, size_t length, uint8_t* output, size_t& consumed) {
+    uint8_t* out = output;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint32_t a = kDecodeTable[input[i]];
+        uint32_t b = kDecodeTable[input[i + 1]];
+        uint32_t c = kDecodeTable[input[i + 2]];
+        uint32_t d = kDecodeTable[input[i + 3]];
+        if ((a | b | c | d) & 0x80) {
+            break;
+        }
+        uint32_t value = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = value >> 16;
+        out[1] = value >> 8;
+        out[2] = value;
+        out += 3;
+    }
+    consumed = i;
+    return out - output;
+}
+
+// The bytes held by an incomplete block of count characters, one character alone holds none
+static inline size_t FlushBits(uint32_t bits, int count, uint8_t* output) {
+    if (count == 2) {
+        output[0] = bits >> 4;
+        return 1;
+    } else if (count == 3) {
+        output[0] = bits >> 10;
+        output[1] = bits >> 2;
+        return 2;
+    }
+    return 0;
+}
+
 std::string Base64Utils::Encode(const std::vector<uint8_t>& data) {
     return Encode(data.data(), data.size());
 }
 
 std::string Base64Utils::Encode(const uint8_t* data, size_t length) {
     std::string result;
-    int val = 0, valb = -6;
-    
-    for (size_t i = 0; i < length; ++i) {
-        val = (val << 8) + data[i];
-        valb += 8;
-        while (valb >= 0) {
-            result.push_back(base64_chars[(val >> valb) & 0x3F]);
-            valb -= 6;
-        }
-    }
-    
-    if (valb > -6) {
-        result.push_back(base64_chars[((val << 8) >> (valb + 8)) & 0x3F]);
+    Encode(data, length, result);
+    return result;
+}
+
+void Base64Utils::Encode(const uint8_t* data, size_t length, std::string& output) {
+    size_t offset = output.size();
+    output.resize(offset + EncodedSize(length));
+    char* out = output.data() + offset;
+
+    size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        uint32_t value = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out[0] = kEncodeTable[value >> 18];
+        out[1] = kEncodeTable[(value >> 12) & 0x3F];
+        out[2] = kEncodeTable[(value >> 6) & 0x3F];
+        out[3] = kEncodeTable[value & 0x3F];
+        out += 4;
     }
-    
-    while (result.size() % 4) {
-        result.push_back('=');
+
+    size_t remaining = length - i;
+    if (remaining > 0) {
+        uint32_t value = data[i] << 16;
+        if (remaining == 2) {
+            value |= data[i + 1] << 8;
+        }
+        out[0] = kEncodeTable[value >> 18];
+        out[1] = kEncodeTable[(value >> 12) & 0x3F];
+        out[2] = remaining == 2 ? kEncodeTable[(value >> 6) & 0x3F] : '=';
+        out[3] = '=';
     }
-    
-    return result;
 }
 
 std::vector<uint8_t> Base64Utils::Decode(const std::string& encoded) {
     std::vector<uint8_t> result;
-    int val = 0, valb = -8;
-    
-    for (unsigned char c : encoded) {
-        if (!IsBase64Char(c)) {
+    Decode(encoded, result);
+    return result;
+}
+
+void Base64Utils::Decode(std::string_view encoded, std::vector<uint8_t>& output) {
+    output.resize(DecodedSize(encoded.size()));
+    output.resize(Decode(encoded.data(), encoded.size(), output.data()));
+}
+
+size_t Base64Utils::Decode(const char* encoded, size_t length, uint8_t* output) {
+    auto input = (const uint8_t*)encoded;
+    size_t consumed;
+    size_t written = DecodeBlocks(input, length, output, consumed);
+
+    // At most three characters remain before the end or the first character outside the alphabet
+    uint32_t bits = 0;
+    int count = 0;
+    for (size_t i = consumed; i < length; i++) {
+        uint8_t value = kDecodeTable[input[i]];
+        if (value & 0x80) {
             break;
         }
-        
-        val = (val << 6) + base64_chars.find(c);
-        valb += 6;
-        if (valb >= 0) {
-            result.push_back(char((val >> valb) & 0xFF));
-            valb -= 8;
+        bits = (bits << 6) | value;
+        count++;
+    }
+    return written + FlushBits(bits, count, output + written);
+}
+
+size_t Base64Utils::StreamDecoder::Feed(const char* data, size_t length, uint8_t* output) {
+    auto input = (const uint8_t*)data;
+    uint8_t* out = output;
+    size_t i = 0;
+    while (!finished_ && i < length) {
+        if (count_ == 0) {
+            size_t consumed;
+            out += DecodeBlocks(input + i, length - i, out, consumed);
+            i += consumed;
+            if (i == length) {
+                break;
+            }
+        }
+        uint8_t value = kDecodeTable[input[i++]];
+        if (value & 0x80) {
+            out += Finish(out);
+            finished_ = true;
+            break;
+        }
+        bits_ = (bits_ << 6) | value;
+        if (++count_ == 4) {
+            out[0] = bits_ >> 16;
+            out[1] = bits_ >> 8;
+            out[2] = bits_;
+            out += 3;
+            bits_ = 0;
+            count_ = 0;
         }
     }
-    
-    return result;
+    return out - output;
+}
+
+size_t Base64Utils::StreamDecoder::Finish(uint8_t* output) {
+    size_t written = FlushBits(bits_, count_, output);
+    bits_ = 0;
+    count_ = 0;
+    return written;
+}
+
+void Base64Utils::StreamDecoder::Reset() {
+    bits_ = 0;
+    count_ = 0;
+    finished_ = false;
 }
 
 bool Base64Utils::IsValidBase64(const std::string& encoded) {
     if (encoded.empty()) {
         return false;
     }
-    
+
     // 检查长度是否为4的倍数
     if (encoded.length() % 4 != 0) {
         return false;
     }
-    
+
     // 检查字符是否有效
     for (size_t i = 0; i < encoded.length(); ++i) {
         char c = encoded[i];
@@ -75,10 +189,10 @@ bool Base64Utils::IsValidBase64(const std::string& encoded) {
             return false;
         }
     }
-    
+
     return true;
 }
 
 bool Base64Utils::IsBase64Char(unsigned char c) {
-    return (isalnum(c) || (c == '+') || (c == '/'));
+    return kDecodeTable[c] != 0xFF;
 }
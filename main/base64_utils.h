@@ -1,7 +1,10 @@
 #ifndef BASE64_UTILS_H
 #define BASE64_UTILS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Base64Utils {
@@ -9,15 +12,49 @@ public:
     // 编码二进制数据为Base64字符串
     static std::string Encode(const std::vector<uint8_t>& data);
     static std::string Encode(const uint8_t* data, size_t length);
-    
+    // Appends to output, a string reused across calls stops allocating once it has grown
+    static void Encode(const uint8_t* data, size_t length, std::string& output);
+    static inline size_t EncodedSize(size_t length) {
+        return (length + 2) / 3 * 4;
+    }
+
     // 解码Base64字符串为二进制数据
+    // Decoding stops at the first character outside the alphabet, the '=' padding included
     static std::vector<uint8_t> Decode(const std::string& encoded);
-    
+    // Replaces the contents of output, keeping its capacity
+    static void Decode(std::string_view encoded, std::vector<uint8_t>& output);
+    // Writes at most DecodedSize(length) bytes and returns the number written.
+    // Output may be the input buffer itself, every byte is written behind the characters it came from.
+    static size_t Decode(const char* encoded, size_t length, uint8_t* output);
+    static inline size_t DecodedSize(size_t length) {
+        return (length + 3) / 4 * 3;
+    }
+
     // 检查字符串是否为有效的Base64
     static bool IsValidBase64(const std::string& encoded);
 
+    /*
+     * Decodes Base64 that arrives in pieces, e.g. a JSON string split across receive buffers.
+     * Characters left over from a piece are carried into the next, the first character outside
+     * the alphabet (the closing quote or '=') ends the stream and flushes the last bits.
+     */
+    class StreamDecoder {
+    public:
+        // Returns the bytes written to output, which needs DecodedSize(length) + 2 bytes and must not
+        // overlap data. Input after the end of the stream is ignored.
+        size_t Feed(const char* data, size_t length, uint8_t* output);
+        // Ends a stream that had no terminating character, writes at most 2 bytes
+        size_t Finish(uint8_t* output);
+        inline bool finished() const { return finished_; }
+        void Reset();
+
+    private:
+        uint32_t bits_ = 0;
+        int count_ = 0;
+        bool finished_ = false;
+    };
+
 private:
-    static const std::string base64_chars;
     static bool IsBase64Char(unsigned char c);
 };
 
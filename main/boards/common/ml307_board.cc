@@ -149,6 +149,12 @@ std::string Ml307Board::GetDeviceStatusJson() {
      *         "type": "cellular",
      *         "carrier": "CHINA MOBILE",
      *         "csq": 10
+     *     },
+     *     "connection": {
+     *         "state": "connected",
+     *         "health": 95,
+     *         "rtt_ms": 120,
+     *         "failures": 0
      *     }
      * }
      */
@@ -204,6 +210,12 @@ std::string Ml307Board::GetDeviceStatusJson() {
     }
     cJSON_AddItemToObject(root, "network", network);
 
+    // Control connection
+    auto connection = Application::GetInstance().GetConnectionStatusJson();
+    if (connection) {
+        cJSON_AddItemToObject(root, "connection", connection);
+    }
+
     auto json_str = cJSON_PrintUnformatted(root);
     std::string json(json_str);
     cJSON_free(json_str);
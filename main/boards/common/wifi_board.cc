@@ -206,6 +206,12 @@ std::string WifiBoard::GetDeviceStatusJson() {
      *     },
      *     "chip": {
      *         "temperature": 25
+     *     },
+     *     "connection": {
+     *         "state": "connected",
+     *         "health": 95,
+     *         "rtt_ms": 120,
+     *         "failures": 0
      *     }
      * }
      */
@@ -266,6 +272,12 @@ std::string WifiBoard::GetDeviceStatusJson() {
         cJSON_AddItemToObject(root, "chip", chip);
     }
 
+    // Control connection
+    auto connection = Application::GetInstance().GetConnectionStatusJson();
+    if (connection) {
+        cJSON_AddItemToObject(root, "connection", connection);
+    }
+
     auto json_str = cJSON_PrintUnformatted(root);
     std::string json(json_str);
     cJSON_free(json_str);
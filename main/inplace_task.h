@@ -0,0 +1,128 @@
+#ifndef INPLACE_TASK_H
+#define INPLACE_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Move-only replacement for std::function that keeps callables of up to N bytes inline,
+ * so scheduling a lambda that captures a frame or a packet never touches the heap.
+ *
+ * Larger callables still work but are moved to the heap. Hot paths should check
+ * InplaceTask<N>::fits_inline<decltype(lambda)> with a static_assert.
+ */
+template <size_t N, typename Signature = void()>
+class InplaceTask;
+
+template <size_t N, typename R, typename... Args>
+class InplaceTask<N, R(Args...)> {
+public:
+    template <typename F>
+    static constexpr bool fits_inline = sizeof(F) <= N && alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible_v<F>;
+
+    InplaceTask() = default;
+    InplaceTask(std::nullptr_t) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InplaceTask> &&
+        std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+    InplaceTask(F&& callable) {
+        using T = std::decay_t<F>;
+        if constexpr (fits_inline<T>) {
+            new (storage_) T(std::forward<F>(callable));
+            ops_ = &kInlineOps<T>;
+        } else {
+            *reinterpret_cast<T**>(storage_) = new T(std::forward<F>(callable));
+            ops_ = &kHeapOps<T>;
+        }
+    }
+
+    InplaceTask(InplaceTask&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    InplaceTask& operator=(InplaceTask&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    InplaceTask& operator=(std::nullptr_t) {
+        Reset();
+        return *this;
+    }
+
+    InplaceTask(const InplaceTask&) = delete;
+    InplaceTask& operator=(const InplaceTask&) = delete;
+
+    ~InplaceTask() {
+        Reset();
+    }
+
+    R operator()(Args... args) {
+        return ops_->invoke(storage_, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+    friend bool operator==(const InplaceTask& task, std::nullptr_t) { return task.ops_ == nullptr; }
+    friend bool operator!=(const InplaceTask& task, std::nullptr_t) { return task.ops_ != nullptr; }
+
+private:
+    struct Ops {
+        R (*invoke)(void* storage, Args&&... args);
+        // Move-constructs into dst and destroys src
+        void (*relocate)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename T>
+    static constexpr Ops kInlineOps = {
+        [](void* storage, Args&&... args) -> R {
+            return (*static_cast<T*>(storage))(std::forward<Args>(args)...);
+        },
+        [](void* dst, void* src) {
+            new (dst) T(std::move(*static_cast<T*>(src)));
+            static_cast<T*>(src)->~T();
+        },
+        [](void* storage) {
+            static_cast<T*>(storage)->~T();
+        },
+    };
+
+    template <typename T>
+    static constexpr Ops kHeapOps = {
+        [](void* storage, Args&&... args) -> R {
+            return (**static_cast<T**>(storage))(std::forward<Args>(args)...);
+        },
+        [](void* dst, void* src) {
+            *static_cast<T**>(dst) = *static_cast<T**>(src);
+        },
+        [](void* storage) {
+            delete *static_cast<T**>(storage);
+        },
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[N < sizeof(void*) ? sizeof(void*) : N];
+    const Ops* ops_ = nullptr;
+
+    void MoveFrom(InplaceTask& other) {
+        if (other.ops_ != nullptr) {
+            other.ops_->relocate(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+};
+
+#endif // INPLACE_TASK_H
@@ -34,22 +34,19 @@ Thing* CreateThing(const std::string& type) {
 #endif
 }
 
-std::string Thing::GetDescriptorJson() {
-    std::string json_str = "{";
-    json_str += "\"name\":\"" + name_ + "\",";
-    json_str += "\"description\":\"" + description_ + "\",";
-    json_str += "\"properties\":" + properties_.GetDescriptorJson() + ",";
-    json_str += "\"methods\":" + methods_.GetDescriptorJson();
-    json_str += "}";
-    return json_str;
+void Thing::WriteDescriptorJson(JsonWriter& json) {
+    json.BeginObject().Key("name").String(name_).Key("description").String(description_);
+    json.Key("properties");
+    properties_.WriteDescriptorJson(json);
+    json.Key("methods");
+    methods_.WriteDescriptorJson(json);
+    json.EndObject();
 }
 
-std::string Thing::GetStateJson() {
-    std::string json_str = "{";
-    json_str += "\"name\":\"" + name_ + "\",";
-    json_str += "\"state\":" + properties_.GetStateJson();
-    json_str += "}";
-    return json_str;
+void Thing::WriteStateJson(JsonWriter& json) {
+    json.BeginObject().Key("name").String(name_).Key("state");
+    properties_.WriteStateJson(json);
+    json.EndObject();
 }
 
 void Thing::Invoke(const cJSON* command) {
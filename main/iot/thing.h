@@ -8,6 +8,8 @@
 #include <stdexcept>
 #include <cJSON.h>
 
+#include "json_writer.h"
+
 namespace iot {
 
 enum ValueType {
@@ -41,29 +43,28 @@ public:
     int number() const { return number_getter_(); }
     std::string string() const { return string_getter_(); }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
-        json_str += "\"description\":\"" + description_ + "\",";
+    void WriteDescriptorJson(JsonWriter& json) {
+        json.BeginObject().Key("description").String(description_);
         if (type_ == kValueTypeBoolean) {
-            json_str += "\"type\":\"boolean\"";
+            json.Key("type").String("boolean");
         } else if (type_ == kValueTypeNumber) {
-            json_str += "\"type\":\"number\"";
+            json.Key("type").String("number");
         } else if (type_ == kValueTypeString) {
-            json_str += "\"type\":\"string\"";
+            json.Key("type").String("string");
         }
-        json_str += "}";
-        return json_str;
+        json.EndObject();
     }
 
-    std::string GetStateJson() {
+    void WriteStateJson(JsonWriter& json) {
         if (type_ == kValueTypeBoolean) {
-            return boolean_getter_() ? "true" : "false";
+            json.Bool(boolean_getter_());
         } else if (type_ == kValueTypeNumber) {
-            return std::to_string(number_getter_());
+            json.Int(number_getter_());
         } else if (type_ == kValueTypeString) {
-            return "\"" + string_getter_() + "\"";
+            json.String(string_getter_());
+        } else {
+            json.Null();
         }
-        return "null";
     }
 };
 
@@ -94,28 +95,22 @@ public:
         throw std::runtime_error("Property not found: " + name);
     }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
+    void WriteDescriptorJson(JsonWriter& json) {
+        json.BeginObject();
         for (auto& property : properties_) {
-            json_str += "\"" + property.name() + "\":" + property.GetDescriptorJson() + ",";
-        }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
+            json.Key(property.name());
+            property.WriteDescriptorJson(json);
         }
-        json_str += "}";
-        return json_str;
+        json.EndObject();
     }
 
-    std::string GetStateJson() {
-        std::string json_str = "{";
+    void WriteStateJson(JsonWriter& json) {
+        json.BeginObject();
         for (auto& property : properties_) {
-            json_str += "\"" + property.name() + "\":" + property.GetStateJson() + ",";
-        }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
+            json.Key(property.name());
+            property.WriteStateJson(json);
         }
-        json_str += "}";
-        return json_str;
+        json.EndObject();
     }
 };
 
@@ -146,18 +141,16 @@ public:
     void set_number(int value) { number_ = value; }
     void set_string(const std::string& value) { string_ = value; }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
-        json_str += "\"description\":\"" + description_ + "\",";
+    void WriteDescriptorJson(JsonWriter& json) {
+        json.BeginObject().Key("description").String(description_);
         if (type_ == kValueTypeBoolean) {
-            json_str += "\"type\":\"boolean\"";
+            json.Key("type").String("boolean");
         } else if (type_ == kValueTypeNumber) {
-            json_str += "\"type\":\"number\"";
+            json.Key("type").String("number");
         } else if (type_ == kValueTypeString) {
-            json_str += "\"type\":\"string\"";
+            json.Key("type").String("string");
         }
-        json_str += "}";
-        return json_str;
+        json.EndObject();
     }
 };
 
@@ -185,16 +178,13 @@ public:
     auto begin() { return parameters_.begin(); }
     auto end() { return parameters_.end(); }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
+    void WriteDescriptorJson(JsonWriter& json) {
+        json.BeginObject();
         for (auto& parameter : parameters_) {
-            json_str += "\"" + parameter.name() + "\":" + parameter.GetDescriptorJson() + ",";
+            json.Key(parameter.name());
+            parameter.WriteDescriptorJson(json);
         }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
-        }
-        json_str += "}";
-        return json_str;
+        json.EndObject();
     }
 };
 
@@ -213,12 +203,10 @@ public:
     const std::string& description() const { return description_; }
     ParameterList& parameters() { return parameters_; }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
-        json_str += "\"description\":\"" + description_ + "\",";
-        json_str += "\"parameters\":" + parameters_.GetDescriptorJson();
-        json_str += "}";
-        return json_str;
+    void WriteDescriptorJson(JsonWriter& json) {
+        json.BeginObject().Key("description").String(description_).Key("parameters");
+        parameters_.WriteDescriptorJson(json);
+        json.EndObject();
     }
 
     void Invoke() {
@@ -247,16 +235,13 @@ public:
         throw std::runtime_error("Method not found: " + name);
     }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
+    void WriteDescriptorJson(JsonWriter& json) {
+        json.BeginObject();
         for (auto& method : methods_) {
-            json_str += "\"" + method.name() + "\":" + method.GetDescriptorJson() + ",";
-        }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
+            json.Key(method.name());
+            method.WriteDescriptorJson(json);
         }
-        json_str += "}";
-        return json_str;
+        json.EndObject();
     }
 };
 
@@ -266,8 +251,8 @@ public:
         name_(name), description_(description) {}
     virtual ~Thing() = default;
 
-    virtual std::string GetDescriptorJson();
-    virtual std::string GetStateJson();
+    virtual void WriteDescriptorJson(JsonWriter& json);
+    virtual void WriteStateJson(JsonWriter& json);
     virtual void Invoke(const cJSON* command);
 
     const std::string& name() const { return name_; }
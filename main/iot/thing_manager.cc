@@ -11,42 +11,45 @@ void ThingManager::AddThing(Thing* thing) {
 }
 
 std::string ThingManager::GetDescriptorsJson() {
-    std::string json_str = "[";
+    std::string json_str;
+    JsonWriter json(json_str);
+    json.BeginArray();
     for (auto& thing : things_) {
-        json_str += thing->GetDescriptorJson() + ",";
+        thing->WriteDescriptorJson(json);
     }
-    if (json_str.back() == ',') {
-        json_str.pop_back();
-    }
-    json_str += "]";
+    json.EndArray();
     return json_str;
 }
 
-bool ThingManager::GetStatesJson(std::string& json, bool delta) {
+bool ThingManager::GetStatesJson(std::string& json_str, bool delta) {
     if (!delta) {
         last_states_.clear();
     }
     bool changed = false;
-    json = "[";
+    JsonWriter json(json_str);
+    json.BeginArray();
     // 枚举thing，获取每个thing的state，如果发生变化，则更新，保存到last_states_
     // 如果delta为true，则只返回变化的部分
     for (auto& thing : things_) {
-        std::string state = thing->GetStateJson();
+        // Reused for every thing, only a changed state is copied into last_states_
+        JsonWriter state(state_json_);
+        thing->WriteStateJson(state);
         if (delta) {
             // 如果delta为true，则只返回变化的部分
             auto it = last_states_.find(thing->name());
-            if (it != last_states_.end() && it->second == state) {
+            if (it != last_states_.end() && it->second == state_json_) {
                 continue;
             }
             changed = true;
-            last_states_[thing->name()] = state;
+            if (it != last_states_.end()) {
+                it->second = state_json_;
+            } else {
+                last_states_[thing->name()] = state_json_;
+            }
         }
-        json += state + ",";
-    }
-    if (json.back() == ',') {
-        json.pop_back();
+        json.Raw(state_json_);
     }
-    json += "]";
+    json.EndArray();
     return changed;
 }
 
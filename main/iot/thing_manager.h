@@ -34,6 +34,7 @@ private:
 
     std::vector<Thing*> things_;
     std::map<std::string, std::string> last_states_;
+    std::string state_json_;
 };
 
 
@@ -0,0 +1,114 @@
+#include "json_writer.h"
+
+#include <charconv>
+
+JsonWriter::JsonWriter(std::string& buffer) : buffer_(buffer) {
+    buffer_.clear();
+}
+
+void JsonWriter::BeginValue() {
+    if (need_comma_) {
+        buffer_.push_back(',');
+    }
+    need_comma_ = true;
+}
+
+JsonWriter& JsonWriter::BeginObject() {
+    BeginValue();
+    buffer_.push_back('{');
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndObject() {
+    buffer_.push_back('}');
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray() {
+    BeginValue();
+    buffer_.push_back('[');
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndArray() {
+    buffer_.push_back(']');
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Key(std::string_view key) {
+    BeginValue();
+    buffer_.push_back('"');
+    AppendEscaped(key);
+    buffer_.append("\":", 2);
+    // The value follows the colon directly
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value) {
+    BeginValue();
+    buffer_.push_back('"');
+    AppendEscaped(value);
+    buffer_.push_back('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::Int(long long value) {
+    BeginValue();
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer_.append(digits, result.ptr - digits);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value) {
+    BeginValue();
+    buffer_.append(value ? "true" : "false");
+    return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+    BeginValue();
+    buffer_.append("null", 4);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Raw(std::string_view json) {
+    BeginValue();
+    buffer_.append(json);
+    return *this;
+}
+
+// Copies runs of plain characters in one go, UTF-8 passes through unchanged
+void JsonWriter::AppendEscaped(std::string_view value) {
+    static const char kHex[] = "0123456789abcdef";
+    size_t run_start = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        buffer_.append(value.data() + run_start, i - run_start);
+        run_start = i + 1;
+        buffer_.push_back('\\');
+        switch (c) {
+            case '"': buffer_.push_back('"'); break;
+            case '\\': buffer_.push_back('\\'); break;
+            case '\b': buffer_.push_back('b'); break;
+            case '\f': buffer_.push_back('f'); break;
+            case '\n': buffer_.push_back('n'); break;
+            case '\r': buffer_.push_back('r'); break;
+            case '\t': buffer_.push_back('t'); break;
+            default: {
+                char escape[5] = {'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+                buffer_.append(escape, sizeof(escape));
+                break;
+            }
+        }
+    }
+    buffer_.append(value.data() + run_start, value.size() - run_start);
+}
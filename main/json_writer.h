@@ -0,0 +1,42 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <string_view>
+
+/*
+ * Streams JSON text into a caller-supplied string. The string is cleared but keeps its
+ * capacity, so a buffer reused across messages stops allocating once it has grown to the
+ * largest message. Commas are inserted automatically, strings are escaped.
+ *
+ *   JsonWriter json(buffer);
+ *   json.BeginObject().Key("type").String("listen").Key("mode").String(mode).EndObject();
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& buffer);
+
+    JsonWriter& BeginObject();
+    JsonWriter& EndObject();
+    JsonWriter& BeginArray();
+    JsonWriter& EndArray();
+    JsonWriter& Key(std::string_view key);
+
+    JsonWriter& String(std::string_view value);
+    JsonWriter& Int(long long value);
+    JsonWriter& Bool(bool value);
+    JsonWriter& Null();
+    // Appends an already serialized JSON value as it is
+    JsonWriter& Raw(std::string_view json);
+
+    inline const std::string& str() const { return buffer_; }
+
+private:
+    std::string& buffer_;
+    bool need_comma_ = false;
+
+    void BeginValue();
+    void AppendEscaped(std::string_view value);
+};
+
+#endif // JSON_WRITER_H
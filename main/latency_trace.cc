@@ -0,0 +1,64 @@
+#include "latency_trace.h"
+
+#include <esp_log.h>
+#include <cstdio>
+
+#define TAG "LatencyTrace"
+
+// Indexed by LatencyTraceEvent, the host report script matches on these names
+static const char* const kLatencyTraceEventNames[] = {
+    "wake_word",
+    "vad_speech_start",
+    "vad_speech_end",
+    "uplink_flushed",
+    "uplink_batch",
+    "stt",
+    "tts_start",
+    "first_audio",
+    "tts_stop",
+    "device_state",
+    "llm_request",
+    "llm_first_token",
+};
+static_assert(sizeof(kLatencyTraceEventNames) / sizeof(kLatencyTraceEventNames[0]) == kTraceEventCount,
+    "Every trace event needs a name");
+
+size_t LatencyTrace::Dump(Writer& writer) {
+    uint32_t head = head_.load(std::memory_order_acquire);
+    if (head - read_cursor_ > CONFIG_LATENCY_TRACE_EVENTS) {
+        ESP_LOGW(TAG, "Trace ring overrun, %lu events lost", (unsigned long)(head - read_cursor_ - CONFIG_LATENCY_TRACE_EVENTS));
+        read_cursor_ = head - CONFIG_LATENCY_TRACE_EVENTS;
+    }
+
+    // Flush in chunks so serial and UDP writes stay small
+    char buffer[512];
+    size_t length = 0;
+    size_t count = 0;
+    for (; read_cursor_ != head; read_cursor_++) {
+        auto& slot = slots_[read_cursor_ & (CONFIG_LATENCY_TRACE_EVENTS - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != read_cursor_ + 1) {
+            continue;
+        }
+        int64_t time_us = slot.time_us;
+        uint16_t event = slot.event;
+        int32_t arg = slot.arg;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // Overwritten by a writer while copying
+        if (slot.sequence.load(std::memory_order_relaxed) != read_cursor_ + 1 || event >= kTraceEventCount) {
+            continue;
+        }
+
+        if (sizeof(buffer) - length < 128) {
+            writer(buffer, length);
+            length = 0;
+        }
+        length += snprintf(buffer + length, sizeof(buffer) - length,
+            "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%lld,\"pid\":1,\"tid\":1,\"args\":{\"arg\":%ld}},\n",
+            kLatencyTraceEventNames[event], (long long)time_us, (long)arg);
+        count++;
+    }
+    if (length > 0) {
+        writer(buffer, length);
+    }
+    return count;
+}
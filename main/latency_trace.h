@@ -0,0 +1,92 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_timer.h>
+#include "sdkconfig.h"
+
+#include "inplace_task.h"
+
+#ifndef CONFIG_LATENCY_TRACE_EVENTS
+#define CONFIG_LATENCY_TRACE_EVENTS 256
+#endif
+
+// Static event IDs, the names emitted in the dump live in kLatencyTraceEventNames
+enum LatencyTraceEvent : uint16_t {
+    kTraceWakeWord,
+    kTraceVadSpeechStart,
+    kTraceVadSpeechEnd,
+    kTraceUplinkFlushed,        // Send queue drained after the VAD speech end
+    kTraceUplinkBatch,          // arg: frames packed into one uplink message
+    kTraceStt,
+    kTraceTtsStart,
+    kTraceFirstAudio,           // First PCM of a tts stream written to the codec
+    kTraceTtsStop,
+    kTraceDeviceState,          // arg: new DeviceState
+    kTraceLlmRequest,           // Streamed chat completion request sent
+    kTraceLlmFirstToken,        // arg: time to first token in ms
+    kTraceEventCount
+};
+
+/*
+ * Fixed-size event ring for the voice round trip. Record() is lock-free and safe from any
+ * task: each writer claims a slot with one atomic increment and publishes it with a sequence
+ * number, so a reader skips slots that are being overwritten instead of blocking the writer.
+ * Events older than the ring size are lost; the dump reports how many.
+ *
+ * Dump() emits the events recorded since the previous dump in the Chrome trace event format,
+ * one JSON object per line, which chrome://tracing and Perfetto load once wrapped in [ ].
+ */
+class LatencyTrace {
+public:
+    using Writer = InplaceTask<16, void(const char* data, size_t size)>;
+
+    static LatencyTrace& GetInstance() {
+        static LatencyTrace instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    LatencyTrace(const LatencyTrace&) = delete;
+    LatencyTrace& operator=(const LatencyTrace&) = delete;
+
+    inline void Record(LatencyTraceEvent event, int32_t arg = 0) {
+        uint32_t index = head_.fetch_add(1, std::memory_order_relaxed);
+        auto& slot = slots_[index & (CONFIG_LATENCY_TRACE_EVENTS - 1)];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.time_us = esp_timer_get_time();
+        slot.event = event;
+        slot.arg = arg;
+        slot.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    // Not reentrant, call from one task at a time. Returns the number of events written.
+    size_t Dump(Writer& writer);
+
+private:
+    static_assert((CONFIG_LATENCY_TRACE_EVENTS & (CONFIG_LATENCY_TRACE_EVENTS - 1)) == 0,
+        "CONFIG_LATENCY_TRACE_EVENTS must be a power of two");
+
+    struct Slot {
+        std::atomic<uint32_t> sequence{0};     // Index + 1 of the event stored, 0 while being written
+        int64_t time_us = 0;
+        uint16_t event = 0;
+        int32_t arg = 0;
+    };
+
+    LatencyTrace() = default;
+
+    Slot slots_[CONFIG_LATENCY_TRACE_EVENTS];
+    std::atomic<uint32_t> head_{0};
+    uint32_t read_cursor_ = 0;
+};
+
+#if CONFIG_USE_LATENCY_TRACE
+#define LATENCY_TRACE(event, arg) LatencyTrace::GetInstance().Record(event, arg)
+#else
+#define LATENCY_TRACE(event, arg) do {} while (0)
+#endif
+
+#endif // LATENCY_TRACE_H
@@ -193,9 +193,13 @@ void McpServer::ParseMessage(const cJSON* json) {
             }
         }
         auto app_desc = esp_app_get_description();
-        std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
-        message += app_desc->version;
-        message += "\"}}";
+        std::string message;
+        JsonWriter json(message);
+        json.BeginObject()
+            .Key("protocolVersion").String("2024-11-05")
+            .Key("capabilities").BeginObject().Key("tools").BeginObject().EndObject().EndObject()
+            .Key("serverInfo").BeginObject().Key("name").String(BOARD_NAME).Key("version").String(app_desc->version).EndObject()
+            .EndObject();
         ReplyResult(id_int, message);
     } else if (method_str == "tools/list") {
         std::string cursor_str = "";
@@ -238,30 +242,37 @@ void McpServer::ParseMessage(const cJSON* json) {
 }
 
 void McpServer::ReplyResult(int id, const std::string& result) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id) + ",\"result\":";
-    payload += result;
-    payload += "}";
+    std::string payload;
+    payload.reserve(result.size() + 40);
+    JsonWriter json(payload);
+    json.BeginObject().Key("jsonrpc").String("2.0").Key("id").Int(id).Key("result").Raw(result).EndObject();
     Application::GetInstance().SendMcpMessage(payload);
 }
 
 void McpServer::ReplyError(int id, const std::string& message) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id);
-    payload += ",\"error\":{\"message\":\"";
-    payload += message;
-    payload += "\"}}";
+    std::string payload;
+    JsonWriter json(payload);
+    json.BeginObject()
+        .Key("jsonrpc").String("2.0")
+        .Key("id").Int(id)
+        .Key("error").BeginObject().Key("message").String(message).EndObject()
+        .EndObject();
     Application::GetInstance().SendMcpMessage(payload);
 }
 
 void McpServer::GetToolsList(int id, const std::string& cursor) {
     const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
+    std::string tools;
+    JsonWriter json(tools);
+    json.BeginObject().Key("tools").BeginArray();
+    size_t tool_count = 0;
+
     bool found_cursor = cursor.empty();
     auto it = tools_.begin();
     std::string next_cursor = "";
-    
+    // Each tool is written here first so one that does not fit can be left out
+    std::string tool_json;
+
     while (it != tools_.end()) {
         // 如果我们还没有找到起始位置，继续搜索
         if (!found_cursor) {
@@ -274,35 +285,33 @@ void McpServer::GetToolsList(int id, const std::string& cursor) {
         }
         
         // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
+        JsonWriter tool_writer(tool_json);
+        (*it)->WriteJson(tool_writer);
+        if (tools.length() + tool_json.length() + 30 > max_payload_size) {
             // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
             next_cursor = (*it)->name();
             break;
         }
         
-        json += tool_json;
+        json.Raw(tool_json);
+        tool_count++;
         ++it;
     }
     
-    if (json.back() == ',') {
-        json.pop_back();
-    }
-    
-    if (json.back() == '[' && !tools_.empty()) {
+    if (tool_count == 0 && !tools_.empty()) {
         // 如果没有添加任何tool，返回错误
         ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
         ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
         return;
     }
 
-    if (next_cursor.empty()) {
-        json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    json.EndArray();
+    if (!next_cursor.empty()) {
+        json.Key("nextCursor").String(next_cursor);
     }
+    json.EndObject();
     
-    ReplyResult(id, json);
+    ReplyResult(id, tools);
 }
 
 void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size) {
@@ -1,9 +1,11 @@
 #include "ai_model_protocol.h"
 #include "board.h"
+#include "application.h"
 #include "assets/lang_config.h"
 
 #include <esp_log.h>
 #include <cJSON.h>
+#include <algorithm>
 
 #define TAG "AIModelProtocol"
 
@@ -13,10 +15,22 @@ AIModelProtocol::AIModelProtocol() {
     
     // 创建适配器
     InitializeAdapter();
+
+    xTaskCreate([](void* arg) {
+        auto protocol = (AIModelProtocol*)arg;
+        protocol->DownlinkTask();
+    }, "ai_downlink", 4096, this, 5, &downlink_task_handle_);
 }
 
 AIModelProtocol::~AIModelProtocol() {
     CloseAudioChannel();
+    if (downlink_task_handle_ != nullptr) {
+        // Deleting the task from here could leave downlink_mutex_ locked, let it leave the loop instead
+        std::unique_lock<std::mutex> lock(downlink_mutex_);
+        downlink_stopping_ = true;
+        downlink_condition_.notify_all();
+        downlink_condition_.wait(lock, [this]() { return downlink_stopped_; });
+    }
 }
 
 bool AIModelProtocol::InitializeAdapter() {
@@ -40,8 +54,8 @@ bool AIModelProtocol::InitializeAdapter() {
     }
     
     // 设置回调函数
-    adapter_->SetAudioResponseCallback([this](const std::vector<uint8_t>& audio_data) {
-        OnAdapterAudioResponse(audio_data);
+    adapter_->SetAudioResponseCallback([this](AudioStreamPacket&& packet) {
+        OnAdapterAudioResponse(std::move(packet));
     });
     
     adapter_->SetTextResponseCallback([this](const std::string& text) {
@@ -59,6 +73,11 @@ bool AIModelProtocol::InitializeAdapter() {
     return true;
 }
 
+bool AIModelProtocol::Start() {
+    // The adapter connects when the audio channel is opened
+    return adapter_ != nullptr;
+}
+
 bool AIModelProtocol::OpenAudioChannel() {
     if (!adapter_) {
         ESP_LOGE(TAG, "AI model adapter not initialized");
@@ -83,9 +102,34 @@ bool AIModelProtocol::OpenAudioChannel() {
         voice_session_active_ = true;
     }
     
+    // Realtime providers speak raw audio, the transcoder converts it to and from the device's Opus.
+    // The adapter may have normalized the format and rate, so they are read back from it.
+    auto& adapter_config = adapter_->GetConfig();
+    if (!transcoder_.Configure(AudioTranscoder::ParseFormat(adapter_config.audio_format), adapter_config.sample_rate,
+            DEVICE_UPLINK_SAMPLE_RATE, server_frame_duration_)) {
+        adapter_->Disconnect();
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(downlink_mutex_);
+        DiscardDownlink();
+        downlink_sequence_ = 0;
+        downlink_discarding_ = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(incoming_json_mutex_);
+        sentence_splitter_.Reset();
+    }
+    
+    error_occurred_ = false;
+    server_sample_rate_ = transcoder_.passthrough() ? adapter_config.sample_rate : transcoder_.downlink_sample_rate();
+    last_incoming_time_ = std::chrono::steady_clock::now();
     audio_channel_opened_ = true;
     ESP_LOGI(TAG, "Audio channel opened successfully");
     
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
     return true;
 }
 
@@ -101,25 +145,35 @@ void AIModelProtocol::CloseAudioChannel() {
         }
         adapter_->Disconnect();
     }
+    {
+        std::lock_guard<std::mutex> lock(downlink_mutex_);
+        DiscardDownlink();
+    }
     
     audio_channel_opened_ = false;
     ESP_LOGI(TAG, "Audio channel closed");
+    
+    if (on_audio_channel_closed_ != nullptr) {
+        on_audio_channel_closed_();
+    }
 }
 
-bool AIModelProtocol::IsAudioChannelOpened() {
-    return audio_channel_opened_ && adapter_ && adapter_->IsConnected();
+bool AIModelProtocol::IsAudioChannelOpened() const {
+    return audio_channel_opened_ && adapter_ && adapter_->IsConnected() && !error_occurred_;
 }
 
-bool AIModelProtocol::SendAudio(AudioStreamPacket&& packet) {
+bool AIModelProtocol::SendAudio(AudioStreamPacket& packet) {
     if (!IsAudioChannelOpened()) {
         ESP_LOGE(TAG, "Audio channel not opened");
         return false;
     }
     
     if (adapter_->GetModelType() == AIModelType::kRealtime) {
-        // 对于实时语音模型，直接发送音频数据
-        std::vector<uint8_t> audio_data = ConvertAudioPacket(packet);
-        return adapter_->SendAudioData(audio_data);
+        // 跳过为传输头预留的 headroom，转换为模型要求的音频格式
+        if (!transcoder_.EncodeUplink(packet.payload.data() + packet.headroom, packet.payload.size() - packet.headroom, uplink_audio_)) {
+            return false;
+        }
+        return adapter_->SendAudioData(uplink_audio_);
     } else {
         // 对于文本模型，需要先将音频转换为文本
         // 这里需要集成语音识别服务
@@ -142,61 +196,233 @@ bool AIModelProtocol::SendText(const std::string& text) {
     return adapter_->SendTextMessage(text);
 }
 
-bool AIModelProtocol::SendMcpMessage(const std::string& payload) {
+// The xiaozhi abort message would reach the model as user text, the rest of the response is dropped here instead
+void AIModelProtocol::SendAbortSpeaking(AbortReason reason) {
+    std::lock_guard<std::mutex> lock(downlink_mutex_);
+    if (!speaking_) {
+        return;
+    }
+    if (!downlink_done_) {
+        downlink_discarding_ = true;
+    }
+    DiscardDownlink();
+    DispatchTtsState("stop");
+}
+
+void AIModelProtocol::SendMcpMessage(const std::string& payload) {
     // AI模型协议暂不支持MCP消息
     // 可以考虑将MCP消息转换为文本消息发送
     ESP_LOGW(TAG, "MCP message sending not supported in AI model protocol");
-    return false;
 }
 
-void AIModelProtocol::OnIncomingAudio(std::function<void(AudioStreamPacket&&)> callback) {
-    audio_callback_ = callback;
+// Runs on the adapter's receive task. Frames are queued, DownlinkTask() hands them to the application
+void AIModelProtocol::OnAdapterAudioResponse(AudioStreamPacket&& packet) {
+    last_incoming_time_ = std::chrono::steady_clock::now();
+    if (on_incoming_audio_ == nullptr) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(downlink_mutex_);
+        if (downlink_discarding_) {
+            return;
+        }
+        downlink_done_ = false;
+        if (!speaking_) {
+            speaking_ = true;
+            downlink_started_ = false;
+            downlink_released_ = 0;
+            // tts start and stop are dispatched under the lock, so they reach the application in order
+            DispatchTtsState("start");
+            // The application enters the speaking state on the main loop, frames released before that would be
+            // dropped. Tasks run in order, so once this one runs the state has changed
+            uint32_t generation = ++downlink_generation_;
+            Application::GetInstance().Schedule([this, generation]() {
+                std::lock_guard<std::mutex> lock(downlink_mutex_);
+                if (generation == downlink_generation_ && speaking_) {
+                    downlink_started_ = true;
+                    downlink_start_time_ = std::chrono::steady_clock::now();
+                    downlink_last_release_time_ = downlink_start_time_;
+                    downlink_condition_.notify_one();
+                }
+            });
+        }
+    }
+    
+    if (transcoder_.passthrough()) {
+        packet.sample_rate = server_sample_rate_;
+        packet.frame_duration = server_frame_duration_;
+        QueueDownlinkFrame(packet);
+        return;
+    }
+    
+    transcoder_.PushDownlink(packet.payload.data(), packet.payload.size());
+    while (transcoder_.PopDownlinkFrame(downlink_packet_)) {
+        QueueDownlinkFrame(downlink_packet_);
+    }
+}
+
+void AIModelProtocol::OnAdapterAudioDone() {
+    bool discarding;
+    {
+        std::lock_guard<std::mutex> lock(downlink_mutex_);
+        discarding = downlink_discarding_;
+        downlink_discarding_ = false;
+    }
+    // The last partial frame is padded with silence, or dropped with the rest of an aborted response
+    if (transcoder_.FlushDownlink(downlink_packet_) && !discarding) {
+        QueueDownlinkFrame(downlink_packet_);
+    }
+    
+    std::lock_guard<std::mutex> lock(downlink_mutex_);
+    if (speaking_) {
+        downlink_done_ = true;
+        downlink_condition_.notify_one();
+    }
 }
 
-void AIModelProtocol::OnIncomingText(std::function<void(const std::string&)> callback) {
-    text_callback_ = callback;
+// Moves the frame into the queue, packet gets a spare buffer back
+void AIModelProtocol::QueueDownlinkFrame(AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(downlink_mutex_);
+    if (!speaking_) {
+        return;
+    }
+    packet.sequence = ++downlink_sequence_;
+    downlink_queue_.push_back(std::move(packet));
+    if (!downlink_spares_.empty()) {
+        packet = std::move(downlink_spares_.back());
+        downlink_spares_.pop_back();
+    }
+    downlink_condition_.notify_one();
 }
 
-void AIModelProtocol::OnMcpMessage(std::function<void(const std::string&)> callback) {
-    mcp_callback_ = callback;
+// Drops the frames not released yet, the pacing task goes back to waiting. Called with downlink_mutex_ held
+void AIModelProtocol::DiscardDownlink() {
+    for (auto& packet : downlink_queue_) {
+        downlink_spares_.push_back(std::move(packet));
+    }
+    downlink_queue_.clear();
+    speaking_ = false;
+    downlink_started_ = false;
+    downlink_done_ = false;
+    downlink_generation_++;
+    downlink_condition_.notify_one();
 }
 
-void AIModelProtocol::OnNetworkError(std::function<void(const std::string&)> callback) {
-    error_callback_ = callback;
+// Releases the queued frames at playback speed, AI_MODEL_DOWNLINK_LEAD_FRAMES ahead, so a burst from the
+// provider never overflows the jitter buffer. tts stop follows once the last frame has been played out.
+void AIModelProtocol::DownlinkTask() {
+    AudioStreamPacket packet;
+    std::unique_lock<std::mutex> lock(downlink_mutex_);
+    while (!downlink_stopping_) {
+        if (!downlink_started_) {
+            downlink_condition_.wait(lock);
+            continue;
+        }
+        
+        auto frame_duration = std::chrono::milliseconds(server_frame_duration_);
+        auto now = std::chrono::steady_clock::now();
+        if (!downlink_queue_.empty()) {
+            auto due = downlink_start_time_ + frame_duration * ((int)downlink_released_ - AI_MODEL_DOWNLINK_LEAD_FRAMES);
+            if (now < due) {
+                downlink_condition_.wait_until(lock, due);
+                continue;
+            }
+            std::swap(packet, downlink_queue_.front());
+            downlink_queue_.pop_front();
+            downlink_released_++;
+            downlink_last_release_time_ = now;
+            lock.unlock();
+            // The jitter buffer swaps a free buffer into the packet
+            on_incoming_audio_(std::move(packet));
+            lock.lock();
+            downlink_spares_.push_back(std::move(packet));
+            continue;
+        }
+        
+        if (!downlink_done_) {
+            downlink_condition_.wait(lock);
+            continue;
+        }
+        
+        // Frames released late, after the provider fell behind, play out later than the schedule says
+        auto played_out = std::max(downlink_start_time_ + frame_duration * downlink_released_,
+            downlink_last_release_time_ + frame_duration) + std::chrono::milliseconds(AI_MODEL_DOWNLINK_DRAIN_MS);
+        if (now < played_out) {
+            downlink_condition_.wait_until(lock, played_out);
+            continue;
+        }
+        speaking_ = false;
+        downlink_started_ = false;
+        downlink_done_ = false;
+        DispatchTtsState("stop");
+    }
+
+    // The destructor returns once the mutex is released, nothing of this object is touched after that
+    downlink_stopped_ = true;
+    downlink_condition_.notify_all();
+    lock.unlock();
+    vTaskDelete(NULL);
 }
 
-void AIModelProtocol::OnAdapterAudioResponse(const std::vector<uint8_t>& audio_data) {
-    if (audio_callback_) {
-        AudioStreamPacket packet = ConvertAudioData(audio_data);
-        audio_callback_(std::move(packet));
+// The device state follows the tts messages of the xiaozhi server, they are synthesized around each response
+void AIModelProtocol::DispatchTtsState(const char* state) {
+    if (on_incoming_json_ == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(incoming_json_mutex_);
+    JsonWriter json(incoming_json_);
+    json.BeginObject().Key("type").String("tts").Key("state").String(state).EndObject();
+    JsonMessage message(incoming_json_.data(), incoming_json_.size());
+    if (message.valid()) {
+        on_incoming_json_(message);
     }
 }
 
+// Text replies stream in as deltas of a few words. Like the xiaozhi server, each complete sentence
+// is sent as its own tts sentence_start, the display shows one sentence at a time
 void AIModelProtocol::OnAdapterTextResponse(const std::string& text) {
-    if (text_callback_) {
-        text_callback_(text);
+    last_incoming_time_ = std::chrono::steady_clock::now();
+    if (on_incoming_json_ == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(incoming_json_mutex_);
+    sentence_splitter_.Append(text);
+    while (sentence_splitter_.Next(sentence_)) {
+        DispatchSentence(sentence_);
     }
 }
 
-void AIModelProtocol::OnAdapterError(const std::string& error) {
-    ESP_LOGE(TAG, "AI model adapter error: %s", error.c_str());
-    if (error_callback_) {
-        error_callback_(error);
+void AIModelProtocol::OnAdapterTextDone() {
+    if (on_incoming_json_ == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(incoming_json_mutex_);
+    if (sentence_splitter_.Finish(sentence_)) {
+        DispatchSentence(sentence_);
     }
 }
 
-void AIModelProtocol::OnAdapterStatus(const std::string& status) {
-    ESP_LOGI(TAG, "AI model adapter status: %s", status.c_str());
+// Called with incoming_json_mutex_ held
+void AIModelProtocol::DispatchSentence(const std::string& text) {
+    JsonWriter json(incoming_json_);
+    json.BeginObject().Key("type").String("tts").Key("state").String("sentence_start").Key("text").String(text).EndObject();
+    JsonMessage message(incoming_json_.data(), incoming_json_.size());
+    if (message.valid()) {
+        on_incoming_json_(message);
+    }
 }
 
-AudioStreamPacket AIModelProtocol::ConvertAudioData(const std::vector<uint8_t>& audio_data) {
-    AudioStreamPacket packet;
-    packet.payload = audio_data;
-    packet.sample_rate = config_.sample_rate;
-    packet.frame_duration = 60; // 默认60ms帧
-    return packet;
+void AIModelProtocol::OnAdapterError(const std::string& error) {
+    ESP_LOGE(TAG, "AI model adapter error: %s", error.c_str());
+    SetError(error);
 }
 
-std::vector<uint8_t> AIModelProtocol::ConvertAudioPacket(const AudioStreamPacket& packet) {
-    return packet.payload;
+void AIModelProtocol::OnAdapterStatus(const std::string& status) {
+    ESP_LOGI(TAG, "AI model adapter status: %s", status.c_str());
+    if (status == AI_MODEL_STATUS_AUDIO_DONE) {
+        OnAdapterAudioDone();
+    } else if (status == AI_MODEL_STATUS_TEXT_DONE) {
+        OnAdapterTextDone();
+    }
 }
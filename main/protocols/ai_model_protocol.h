@@ -2,56 +2,107 @@
 #define AI_MODEL_PROTOCOL_H
 
 #include "protocol.h"
+#include "audio_transcoder.h"
+#include "sentence_splitter.h"
 #include "../ai_model_adapter.h"
 
 #include <memory>
 #include <string>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 #include <functional>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// The uplink encoder always runs at 16 kHz
+#define DEVICE_UPLINK_SAMPLE_RATE 16000
+// Provider audio arrives faster than real time, it is handed to the jitter buffer at playback speed
+// this many frames ahead, far below the 2.4 s the jitter buffer holds
+#define AI_MODEL_DOWNLINK_LEAD_FRAMES 5
+// After the last frame is released, time for the jitter buffer and the codec to play it out before tts stop
+#define AI_MODEL_DOWNLINK_DRAIN_MS 500
+
 class AIModelProtocol : public Protocol {
 public:
     AIModelProtocol();
     ~AIModelProtocol() override;
 
     // Protocol interface implementation
+    bool Start() override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
-    bool IsAudioChannelOpened() override;
+    bool IsAudioChannelOpened() const override;
     
-    bool SendAudio(AudioStreamPacket&& packet) override;
-    bool SendText(const std::string& text) override;
-    bool SendMcpMessage(const std::string& payload) override;
-    
-    void OnIncomingAudio(std::function<void(AudioStreamPacket&&)> callback) override;
-    void OnIncomingText(std::function<void(const std::string&)> callback) override;
-    void OnMcpMessage(std::function<void(const std::string&)> callback) override;
-    void OnNetworkError(std::function<void(const std::string&)> callback) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
+    void SendAbortSpeaking(AbortReason reason) override;
+    void SendMcpMessage(const std::string& payload) override;
 
 private:
     std::unique_ptr<AIModelAdapter> adapter_;
     AIModelConfig config_;
     
-    // 回调函数
-    std::function<void(AudioStreamPacket&&)> audio_callback_;
-    std::function<void(const std::string&)> text_callback_;
-    std::function<void(const std::string&)> mcp_callback_;
-    std::function<void(const std::string&)> error_callback_;
-    
     // 状态管理
     bool audio_channel_opened_ = false;
     bool voice_session_active_ = false;
     
+    AudioTranscoder transcoder_;
+    // Reused buffers: uplink frame handed to the adapter, downlink frame being encoded on the adapter's receive task
+    std::vector<uint8_t> uplink_audio_;
+    AudioStreamPacket downlink_packet_;
+    
+    // Downlink frames wait here until the pacing task releases them. The adapter's receive task
+    // fills the queue, everything below is guarded by downlink_mutex_
+    std::mutex downlink_mutex_;
+    std::condition_variable downlink_condition_;
+    TaskHandle_t downlink_task_handle_ = nullptr;
+    std::deque<AudioStreamPacket> downlink_queue_;
+    // Buffers of released frames, handed back by the jitter buffer and reused for the next ones
+    std::vector<AudioStreamPacket> downlink_spares_;
+    uint32_t downlink_sequence_ = 0;
+    // Between the synthesized tts start and stop
+    bool speaking_ = false;
+    // Set on the main loop after the application has seen tts start, frames before that would be dropped
+    bool downlink_started_ = false;
+    // The provider has sent the whole response
+    bool downlink_done_ = false;
+    // The rest of an aborted response is dropped until the provider finishes it
+    bool downlink_discarding_ = false;
+    // Tells a late start from an earlier response apart from the current one
+    uint32_t downlink_generation_ = 0;
+    // The destructor asks the pacing task to exit and waits until it has let go of the mutex
+    bool downlink_stopping_ = false;
+    bool downlink_stopped_ = false;
+    uint32_t downlink_released_ = 0;
+    std::chrono::steady_clock::time_point downlink_start_time_;
+    std::chrono::steady_clock::time_point downlink_last_release_time_;
+    
+    // Messages synthesized for the application, dispatched from several tasks. The text deltas
+    // of a reply are collected into sentences under the same lock
+    std::mutex incoming_json_mutex_;
+    std::string incoming_json_;
+    SentenceSplitter sentence_splitter_;
+    std::string sentence_;
+    
+    bool SendText(const std::string& text) override;
+    
     // 音频处理
-    void OnAdapterAudioResponse(const std::vector<uint8_t>& audio_data);
+    void OnAdapterAudioResponse(AudioStreamPacket&& packet);
+    void OnAdapterAudioDone();
+    void QueueDownlinkFrame(AudioStreamPacket& packet);
+    void DiscardDownlink();
+    void DownlinkTask();
+    void DispatchTtsState(const char* state);
     void OnAdapterTextResponse(const std::string& text);
+    void OnAdapterTextDone();
+    void DispatchSentence(const std::string& text);
     void OnAdapterError(const std::string& error);
     void OnAdapterStatus(const std::string& status);
     
     // 辅助方法
     bool InitializeAdapter();
-    AudioStreamPacket ConvertAudioData(const std::vector<uint8_t>& audio_data);
-    std::vector<uint8_t> ConvertAudioPacket(const AudioStreamPacket& packet);
 };
 
 #endif // AI_MODEL_PROTOCOL_H
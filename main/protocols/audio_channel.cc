@@ -0,0 +1,42 @@
+#include "audio_channel.h"
+
+#include <cstring>
+#include <arpa/inet.h>
+
+std::span<uint8_t> AudioChannel::FrameAudio(AudioStreamPacket& packet, size_t header_size) {
+    size_t opus_size = packet.payload.size() - packet.headroom;
+    if (packet.headroom >= header_size) {
+        return std::span<uint8_t>(packet.payload.data() + packet.headroom - header_size, header_size + opus_size);
+    }
+    send_buffer_.resize(header_size + opus_size);
+    memcpy(send_buffer_.data() + header_size, packet.payload.data() + packet.headroom, opus_size);
+    return std::span<uint8_t>(send_buffer_);
+}
+
+bool AudioChannel::SendBatch(std::span<AudioStreamPacket> packets) {
+    for (auto& packet : packets) {
+        if (!Send(packet)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::span<uint8_t> AudioChannel::FrameAudioBatch(std::span<AudioStreamPacket> packets, size_t header_size) {
+    size_t size = header_size;
+    for (auto& packet : packets) {
+        size += AUDIO_BATCH_ENTRY_HEADER_SIZE + packet.payload.size() - packet.headroom;
+    }
+    send_buffer_.resize(size);
+    uint8_t* entry = send_buffer_.data() + header_size;
+    for (auto& packet : packets) {
+        size_t opus_size = packet.payload.size() - packet.headroom;
+        uint32_t timestamp = htonl(packet.timestamp);
+        uint16_t payload_size = htons(opus_size);
+        memcpy(entry, &timestamp, sizeof(timestamp));
+        memcpy(entry + 4, &payload_size, sizeof(payload_size));
+        memcpy(entry + AUDIO_BATCH_ENTRY_HEADER_SIZE, packet.payload.data() + packet.headroom, opus_size);
+        entry += AUDIO_BATCH_ENTRY_HEADER_SIZE + opus_size;
+    }
+    return std::span<uint8_t>(send_buffer_);
+}
@@ -0,0 +1,59 @@
+#ifndef AUDIO_CHANNEL_H
+#define AUDIO_CHANNEL_H
+
+#include "protocol.h"
+
+#include <span>
+#include <vector>
+
+/*
+ * The media half of a protocol session. The control channel (websocket or MQTT JSON)
+ * negotiates in the hello exchange which AudioChannel carries the Opus frames, so the
+ * same media path can be paired with either control channel.
+ */
+class AudioChannel {
+public:
+    virtual ~AudioChannel() = default;
+
+    // Value of media_transport in the hello exchange
+    virtual const char* name() const = 0;
+    virtual bool Open() = 0;
+    virtual void Close() = 0;
+    virtual bool IsOpened() const = 0;
+    // May write the transport header into the packet's headroom
+    virtual bool Send(AudioStreamPacket& packet) = 0;
+    // Whether SendBatch() packs the frames into one message
+    virtual bool SupportsBatch() const { return false; }
+    // Packs the frames into one message, each prefixed with |timestamp 4u|payload_size 2u|.
+    // Channels without a batch format send them one by one.
+    virtual bool SendBatch(std::span<AudioStreamPacket> packets);
+    // Estimated bytes each message costs on the wire on top of the Opus data
+    virtual size_t message_overhead() const = 0;
+
+    inline void OnIncomingAudio(ProtocolCallback<void(AudioStreamPacket&& packet)> callback) {
+        on_incoming_audio_ = std::move(callback);
+    }
+    inline void SetServerAudioParams(int sample_rate, int frame_duration) {
+        server_sample_rate_ = sample_rate;
+        server_frame_duration_ = frame_duration;
+    }
+
+protected:
+    ProtocolCallback<void(AudioStreamPacket&& packet)> on_incoming_audio_;
+    int server_sample_rate_ = 24000;
+    int server_frame_duration_ = 60;
+    // Downlink packet reused for every frame, only touched by the receive task.
+    // The jitter buffer swaps in a free buffer, so steady-state frames do not allocate.
+    AudioStreamPacket incoming_packet_;
+
+    // Returns header_size bytes followed by the Opus data, the caller fills in the header.
+    // The header goes into the packet's headroom, only packets without enough are copied.
+    std::span<uint8_t> FrameAudio(AudioStreamPacket& packet, size_t header_size);
+    // Returns header_size bytes followed by the batch entries, in the same reused buffer
+    std::span<uint8_t> FrameAudioBatch(std::span<AudioStreamPacket> packets, size_t header_size);
+
+private:
+    std::vector<uint8_t> send_buffer_;
+};
+
+#endif // AUDIO_CHANNEL_H
@@ -0,0 +1,274 @@
+#include "audio_transcoder.h"
+
+#include <esp_log.h>
+#include <array>
+#include <cstring>
+
+#define TAG "AudioTranscoder"
+
+// Largest Opus frame the device sends and the longest one the decoder may return
+#define TRANSCODER_MAX_FRAME_MS 120
+#define TRANSCODER_MAX_OPUS_PACKET_SIZE 1500
+// Downlink frames are decoded on the device right away, low complexity keeps the receive task responsive
+#define TRANSCODER_DOWNLINK_COMPLEXITY 0
+#define TRANSCODER_DOWNLINK_BITRATE 32000
+
+// G.711 as in ITU-T reference code, μ-law and A-law share the segment layout
+static constexpr int16_t UlawToLinear(uint8_t value) {
+    value = ~value;
+    int t = (((value & 0x0F) << 3) + 0x84) << ((value & 0x70) >> 4);
+    return (value & 0x80) ? (0x84 - t) : (t - 0x84);
+}
+
+static constexpr int16_t AlawToLinear(uint8_t value) {
+    value ^= 0x55;
+    int t = (value & 0x0F) << 4;
+    int segment = (value & 0x70) >> 4;
+    if (segment == 0) {
+        t += 8;
+    } else {
+        t = (t + 0x108) << (segment - 1);
+    }
+    return (value & 0x80) ? t : -t;
+}
+
+template <int16_t (*Decode)(uint8_t)>
+static constexpr std::array<int16_t, 256> MakeG711Table() {
+    std::array<int16_t, 256> table{};
+    for (int i = 0; i < 256; i++) {
+        table[i] = Decode(i);
+    }
+    return table;
+}
+static constexpr std::array<int16_t, 256> kUlawTable = MakeG711Table<UlawToLinear>();
+static constexpr std::array<int16_t, 256> kAlawTable = MakeG711Table<AlawToLinear>();
+
+static inline uint8_t LinearToUlaw(int16_t pcm) {
+    int sample = pcm >> 2;
+    int mask = 0xFF;
+    if (sample < 0) {
+        mask = 0x7F;
+        sample = -sample;
+    }
+    if (sample > 8159) {
+        sample = 8159;
+    }
+    sample += 0x84 >> 2;
+    // The bias sets bit 5, so the segment is the highest set bit above it
+    int segment = (31 - __builtin_clz(sample)) - 5;
+    if (segment >= 8) {
+        return 0x7F ^ mask;
+    }
+    int value = (segment << 4) | ((sample >> (segment + 1)) & 0x0F);
+    return value ^ mask;
+}
+
+static inline uint8_t LinearToAlaw(int16_t pcm) {
+    int sample = pcm >> 3;
+    int mask = 0xD5;
+    if (sample < 0) {
+        mask = 0x55;
+        sample = -sample - 1;
+    }
+    if (sample > 0xFFF) {
+        return 0x7F ^ mask;
+    }
+    int segment = sample < 0x20 ? 0 : (31 - __builtin_clz(sample)) - 4;
+    int value = segment << 4;
+    value |= (segment < 2 ? sample >> 1 : sample >> segment) & 0x0F;
+    return value ^ mask;
+}
+
+AudioTranscoder::AudioTranscoder() {
+}
+
+AudioTranscoder::~AudioTranscoder() {
+    Destroy();
+}
+
+void AudioTranscoder::Destroy() {
+    if (uplink_decoder_ != nullptr) {
+        opus_decoder_destroy(uplink_decoder_);
+        uplink_decoder_ = nullptr;
+    }
+    if (downlink_encoder_ != nullptr) {
+        opus_encoder_destroy(downlink_encoder_);
+        downlink_encoder_ = nullptr;
+    }
+}
+
+ProviderAudioFormat AudioTranscoder::ParseFormat(std::string_view name) {
+    if (name == "pcm16") {
+        return ProviderAudioFormat::kPcm16;
+    } else if (name == "g711_ulaw") {
+        return ProviderAudioFormat::kG711Ulaw;
+    } else if (name == "g711_alaw") {
+        return ProviderAudioFormat::kG711Alaw;
+    }
+    return ProviderAudioFormat::kOpus;
+}
+
+bool AudioTranscoder::Configure(ProviderAudioFormat format, int provider_sample_rate, int device_sample_rate, int frame_duration) {
+    Destroy();
+    format_ = format;
+    provider_sample_rate_ = provider_sample_rate;
+    device_sample_rate_ = device_sample_rate;
+    frame_duration_ = frame_duration;
+    Reset();
+    if (passthrough()) {
+        return true;
+    }
+
+    int error;
+    uplink_decoder_ = opus_decoder_create(device_sample_rate_, 1, &error);
+    if (uplink_decoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create uplink decoder, error code: %d", error);
+        return false;
+    }
+    uplink_pcm_.resize(device_sample_rate_ / 1000 * TRANSCODER_MAX_FRAME_MS);
+    if (provider_sample_rate_ != device_sample_rate_) {
+        uplink_resampler_.Configure(device_sample_rate_, provider_sample_rate_);
+    }
+
+    downlink_encoder_ = opus_encoder_create(provider_sample_rate_, 1, OPUS_APPLICATION_VOIP, &error);
+    if (downlink_encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create downlink encoder, error code: %d", error);
+        Destroy();
+        return false;
+    }
+    opus_encoder_ctl(downlink_encoder_, OPUS_SET_COMPLEXITY(TRANSCODER_DOWNLINK_COMPLEXITY));
+    opus_encoder_ctl(downlink_encoder_, OPUS_SET_BITRATE(TRANSCODER_DOWNLINK_BITRATE));
+    downlink_frame_size_ = provider_sample_rate_ / 1000 * frame_duration_;
+    downlink_pcm_.reserve(downlink_frame_size_ * 4);
+
+    ESP_LOGI(TAG, "Provider audio %d Hz, uplink %d Hz, downlink %d ms frames",
+        provider_sample_rate_, device_sample_rate_, frame_duration_);
+    return true;
+}
+
+void AudioTranscoder::Reset() {
+    if (uplink_decoder_ != nullptr) {
+        opus_decoder_ctl(uplink_decoder_, OPUS_RESET_STATE);
+    }
+    if (downlink_encoder_ != nullptr) {
+        opus_encoder_ctl(downlink_encoder_, OPUS_RESET_STATE);
+    }
+    downlink_pcm_.clear();
+    downlink_offset_ = 0;
+    has_odd_byte_ = false;
+}
+
+bool AudioTranscoder::EncodeUplink(const uint8_t* opus, size_t size, std::vector<uint8_t>& output) {
+    if (passthrough()) {
+        output.assign(opus, opus + size);
+        return true;
+    }
+    if (uplink_decoder_ == nullptr) {
+        return false;
+    }
+
+    int samples = opus_decode(uplink_decoder_, opus, size, uplink_pcm_.data(), uplink_pcm_.size(), 0);
+    if (samples < 0) {
+        ESP_LOGE(TAG, "Failed to decode uplink audio, error code: %d", samples);
+        return false;
+    }
+    const int16_t* pcm = uplink_pcm_.data();
+    if (provider_sample_rate_ != device_sample_rate_) {
+        uplink_resampled_.resize(uplink_resampler_.GetOutputSamples(samples));
+        uplink_resampler_.Process(pcm, samples, uplink_resampled_.data());
+        pcm = uplink_resampled_.data();
+        samples = uplink_resampled_.size();
+    }
+
+    if (format_ == ProviderAudioFormat::kPcm16) {
+        // Both sides are little-endian
+        output.resize(samples * sizeof(int16_t));
+        memcpy(output.data(), pcm, output.size());
+    } else {
+        output.resize(samples);
+        bool ulaw = format_ == ProviderAudioFormat::kG711Ulaw;
+        for (int i = 0; i < samples; i++) {
+            output[i] = ulaw ? LinearToUlaw(pcm[i]) : LinearToAlaw(pcm[i]);
+        }
+    }
+    return true;
+}
+
+void AudioTranscoder::PushDownlink(const uint8_t* data, size_t size) {
+    if (passthrough() || size == 0) {
+        return;
+    }
+
+    // Drop the frames already popped, the buffer keeps its capacity
+    if (downlink_offset_ > 0) {
+        downlink_pcm_.erase(downlink_pcm_.begin(), downlink_pcm_.begin() + downlink_offset_);
+        downlink_offset_ = 0;
+    }
+
+    size_t start = downlink_pcm_.size();
+    if (format_ == ProviderAudioFormat::kPcm16) {
+        // Chunks are not required to end on a sample boundary, the odd byte is carried over
+        size_t count = (size + has_odd_byte_) / 2;
+        downlink_pcm_.resize(start + count);
+        auto out = (uint8_t*)(downlink_pcm_.data() + start);
+        size_t used = 0;
+        if (has_odd_byte_ && count > 0) {
+            out[0] = odd_byte_;
+            out[1] = data[0];
+            out += 2;
+            used = 1;
+            count--;
+        }
+        memcpy(out, data + used, count * 2);
+        used += count * 2;
+        has_odd_byte_ = used < size;
+        if (has_odd_byte_) {
+            odd_byte_ = data[size - 1];
+        }
+    } else {
+        downlink_pcm_.resize(start + size);
+        auto& table = format_ == ProviderAudioFormat::kG711Ulaw ? kUlawTable : kAlawTable;
+        for (size_t i = 0; i < size; i++) {
+            downlink_pcm_[start + i] = table[data[i]];
+        }
+    }
+}
+
+bool AudioTranscoder::PopDownlinkFrame(AudioStreamPacket& packet) {
+    if (downlink_encoder_ == nullptr || downlink_pcm_.size() - downlink_offset_ < downlink_frame_size_) {
+        return false;
+    }
+    const int16_t* pcm = downlink_pcm_.data() + downlink_offset_;
+    downlink_offset_ += downlink_frame_size_;
+    return EncodeDownlinkFrame(pcm, packet);
+}
+
+bool AudioTranscoder::FlushDownlink(AudioStreamPacket& packet) {
+    size_t remaining = downlink_pcm_.size() - downlink_offset_;
+    if (downlink_encoder_ == nullptr || remaining == 0) {
+        return false;
+    }
+    downlink_pcm_.resize(downlink_offset_ + downlink_frame_size_, 0);
+    bool encoded = PopDownlinkFrame(packet);
+    downlink_pcm_.clear();
+    downlink_offset_ = 0;
+    has_odd_byte_ = false;
+    return encoded;
+}
+
+bool AudioTranscoder::EncodeDownlinkFrame(const int16_t* pcm, AudioStreamPacket& packet) {
+    // Shrinking keeps the capacity, a buffer that came back from the jitter buffer does not allocate
+    packet.payload.resize(TRANSCODER_MAX_OPUS_PACKET_SIZE);
+    auto ret = opus_encode(downlink_encoder_, pcm, downlink_frame_size_, packet.payload.data(), packet.payload.size());
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to encode downlink audio, error code: %d", ret);
+        packet.payload.clear();
+        return false;
+    }
+    packet.payload.resize(ret);
+    packet.sample_rate = provider_sample_rate_;
+    packet.frame_duration = frame_duration_;
+    packet.headroom = 0;
+    packet.timestamp = 0;
+    return true;
+}
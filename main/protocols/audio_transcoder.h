@@ -0,0 +1,82 @@
+#ifndef AUDIO_TRANSCODER_H
+#define AUDIO_TRANSCODER_H
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include <opus.h>
+#include <opus_resampler.h>
+
+#include "protocol.h"
+
+enum class ProviderAudioFormat {
+    kOpus,          // Passed through unchanged
+    kPcm16,         // 16-bit little-endian mono
+    kG711Ulaw,
+    kG711Alaw,
+};
+
+/*
+ * Converts between the device's Opus frames and the raw audio realtime providers speak.
+ *
+ * Uplink: each Opus frame is decoded, resampled to the provider rate and written out as
+ * PCM16 or G.711. Downlink: provider audio arrives in chunks of any size, it is collected
+ * and encoded into Opus frames of exactly frame_duration, ready for the decode queue.
+ *
+ * The uplink and downlink sides keep separate state and may run on different tasks,
+ * Configure() and Reset() must not run concurrently with either.
+ */
+class AudioTranscoder {
+public:
+    AudioTranscoder();
+    ~AudioTranscoder();
+    AudioTranscoder(const AudioTranscoder&) = delete;
+    AudioTranscoder& operator=(const AudioTranscoder&) = delete;
+
+    // Unknown names map to kOpus
+    static ProviderAudioFormat ParseFormat(std::string_view name);
+
+    // device_sample_rate is the rate of the uplink Opus frames
+    bool Configure(ProviderAudioFormat format, int provider_sample_rate, int device_sample_rate, int frame_duration);
+    void Reset();
+
+    inline bool passthrough() const { return format_ == ProviderAudioFormat::kOpus; }
+    // Sample rate of the downlink Opus frames, the provider rate. The adapters only configure
+    // rates Opus runs at (8 kHz G.711, 24 kHz PCM16), so the downlink is never resampled.
+    inline int downlink_sample_rate() const { return provider_sample_rate_; }
+    inline int frame_duration() const { return frame_duration_; }
+
+    // Replaces the contents of output with one uplink frame in the provider format
+    bool EncodeUplink(const uint8_t* opus, size_t size, std::vector<uint8_t>& output);
+
+    // Buffers provider audio, PopDownlinkFrame() then returns the complete frames
+    void PushDownlink(const uint8_t* data, size_t size);
+    // Writes the next Opus frame into packet, reusing its payload buffer
+    bool PopDownlinkFrame(AudioStreamPacket& packet);
+    // Pads the last partial frame with silence, call at the end of a response
+    bool FlushDownlink(AudioStreamPacket& packet);
+
+private:
+    ProviderAudioFormat format_ = ProviderAudioFormat::kOpus;
+    int provider_sample_rate_ = 0;
+    int device_sample_rate_ = 0;
+    int frame_duration_ = 60;
+
+    OpusDecoder* uplink_decoder_ = nullptr;
+    OpusResampler uplink_resampler_;
+    std::vector<int16_t> uplink_pcm_;
+    std::vector<int16_t> uplink_resampled_;
+
+    OpusEncoder* downlink_encoder_ = nullptr;
+    std::vector<int16_t> downlink_pcm_;
+    size_t downlink_offset_ = 0;
+    size_t downlink_frame_size_ = 0;
+    bool has_odd_byte_ = false;
+    uint8_t odd_byte_ = 0;
+
+    void Destroy();
+    bool EncodeDownlinkFrame(const int16_t* pcm, AudioStreamPacket& packet);
+};
+
+#endif // AUDIO_TRANSCODER_H
@@ -0,0 +1,93 @@
+#include "connection_health.h"
+
+#include <esp_random.h>
+#include <algorithm>
+
+// Round trips up to this long cost nothing, slower ones lower the score of a success
+#define CONNECTION_GOOD_RTT_MS 300
+
+// Rounded toward the sample, truncating alone would leave a recovered score stuck at 97
+void ConnectionHealth::AddScoreSample(int sample) {
+    score_ = sample > score_ ? (score_ * 3 + sample + 3) / 4 : (score_ * 3 + sample) / 4;
+}
+
+void ConnectionHealth::OnConnecting() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = kConnectionStateConnecting;
+}
+
+void ConnectionHealth::OnConnected() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = kConnectionStateConnected;
+    consecutive_failures_ = 0;
+    AddScoreSample(100);
+}
+
+void ConnectionHealth::OnFailure() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = kConnectionStateBackoff;
+    consecutive_failures_++;
+    AddScoreSample(0);
+}
+
+void ConnectionHealth::OnDisconnected() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == kConnectionStateConnected) {
+        state_ = kConnectionStateDisconnected;
+        AddScoreSample(30);
+    }
+}
+
+void ConnectionHealth::OnClosed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = kConnectionStateIdle;
+}
+
+void ConnectionHealth::OnRttSample(int rtt_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Smoothed like TCP's SRTT
+    rtt_ms_ = rtt_ms_ == 0 ? rtt_ms : (rtt_ms_ * 7 + rtt_ms) / 8;
+    int penalty = std::clamp((rtt_ms - CONNECTION_GOOD_RTT_MS) / 20, 0, 50);
+    AddScoreSample(100 - penalty);
+}
+
+ConnectionState ConnectionHealth::state() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+int ConnectionHealth::score() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return score_;
+}
+
+int ConnectionHealth::rtt_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rtt_ms_;
+}
+
+int ConnectionHealth::consecutive_failures() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return consecutive_failures_;
+}
+
+int ConnectionHealth::NextRetryDelayMs() const {
+    int failures = consecutive_failures();
+    int delay = CONNECTION_BACKOFF_MIN_MS;
+    for (int i = 1; i < failures && delay < CONNECTION_BACKOFF_MAX_MS; i++) {
+        delay *= 2;
+    }
+    delay = std::min(delay, CONNECTION_BACKOFF_MAX_MS);
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+const char* ConnectionHealth::StateName(ConnectionState state) {
+    switch (state) {
+        case kConnectionStateIdle: return "idle";
+        case kConnectionStateConnecting: return "connecting";
+        case kConnectionStateConnected: return "connected";
+        case kConnectionStateDisconnected: return "disconnected";
+        case kConnectionStateBackoff: return "backoff";
+    }
+    return "unknown";
+}
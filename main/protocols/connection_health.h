@@ -0,0 +1,54 @@
+#ifndef CONNECTION_HEALTH_H
+#define CONNECTION_HEALTH_H
+
+#include <mutex>
+
+// Reconnect delay doubles with each consecutive failure between these bounds
+#define CONNECTION_BACKOFF_MIN_MS 1000
+#define CONNECTION_BACKOFF_MAX_MS 60000
+
+enum ConnectionState {
+    kConnectionStateIdle,
+    kConnectionStateConnecting,
+    kConnectionStateConnected,
+    kConnectionStateDisconnected,
+    kConnectionStateBackoff
+};
+
+/*
+ * Connection outcomes and round trip times reported by a protocol, folded into a 0-100
+ * health score. Written by the protocol's tasks, read by the supervisor and status queries.
+ */
+class ConnectionHealth {
+public:
+    void OnConnecting();
+    void OnConnected();
+    void OnFailure();
+    void OnDisconnected();
+    // Closed on purpose, not held against the score
+    void OnClosed();
+    // Time from sending a request to its reply, e.g. client hello to server hello
+    void OnRttSample(int rtt_ms);
+
+    ConnectionState state() const;
+    int score() const;
+    // Smoothed round trip time, 0 until the first sample
+    int rtt_ms() const;
+    int consecutive_failures() const;
+    // Exponential in the consecutive failures, with the upper half randomized so devices
+    // that lost the server together do not come back in lockstep
+    int NextRetryDelayMs() const;
+
+    static const char* StateName(ConnectionState state);
+
+private:
+    mutable std::mutex mutex_;
+    ConnectionState state_ = kConnectionStateIdle;
+    int score_ = 100;
+    int rtt_ms_ = 0;
+    int consecutive_failures_ = 0;
+
+    void AddScoreSample(int sample);
+};
+
+#endif // CONNECTION_HEALTH_H
@@ -0,0 +1,59 @@
+#include "connection_supervisor.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "ConnectionSupervisor"
+
+ConnectionSupervisor::ConnectionSupervisor(Protocol& protocol, std::function<bool()> can_reconnect)
+    : protocol_(protocol), can_reconnect_(can_reconnect) {
+    // Reconnecting runs the TLS handshake on this task
+    xTaskCreate([](void* arg) {
+        auto supervisor = (ConnectionSupervisor*)arg;
+        supervisor->Run();
+    }, "conn_supervisor", 4096 * 2, this, 2, &task_handle_);
+}
+
+ConnectionSupervisor::~ConnectionSupervisor() {
+    if (task_handle_ != nullptr) {
+        vTaskDelete(task_handle_);
+    }
+}
+
+void ConnectionSupervisor::Run() {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CONNECTION_SUPERVISOR_POLL_MS));
+        if (!protocol_.NeedsReconnect() || !can_reconnect_()) {
+            continue;
+        }
+        if (esp_timer_get_time() < next_attempt_time_) {
+            continue;
+        }
+
+        auto& health = protocol_.health();
+        ESP_LOGI(TAG, "Reconnecting, %d failures so far", health.consecutive_failures());
+        if (protocol_.Reconnect()) {
+            next_attempt_time_ = 0;
+            ESP_LOGI(TAG, "Reconnected, health %d", health.score());
+        } else {
+            int delay_ms = health.NextRetryDelayMs();
+            next_attempt_time_ = esp_timer_get_time() + delay_ms * 1000LL;
+            ESP_LOGW(TAG, "Reconnect failed, next attempt in %d ms", delay_ms);
+        }
+    }
+}
+
+cJSON* ConnectionSupervisor::GetStatusJson() const {
+    auto& health = protocol_.health();
+    auto state = health.state();
+    auto json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "state", ConnectionHealth::StateName(state));
+    cJSON_AddNumberToObject(json, "health", health.score());
+    cJSON_AddNumberToObject(json, "rtt_ms", health.rtt_ms());
+    cJSON_AddNumberToObject(json, "failures", health.consecutive_failures());
+    if (state == kConnectionStateBackoff && next_attempt_time_ > 0) {
+        int64_t retry_in_us = next_attempt_time_ - esp_timer_get_time();
+        cJSON_AddNumberToObject(json, "retry_in_ms", retry_in_us > 0 ? retry_in_us / 1000 : 0);
+    }
+    return json;
+}
@@ -0,0 +1,39 @@
+#ifndef CONNECTION_SUPERVISOR_H
+#define CONNECTION_SUPERVISOR_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cJSON.h>
+
+#include <atomic>
+#include <functional>
+
+#include "protocol.h"
+
+// How often the supervisor checks the control connection
+#define CONNECTION_SUPERVISOR_POLL_MS 2000
+
+/*
+ * Keeps the protocol's control connection up between conversations. When the protocol
+ * reports it needs a reconnect, the supervisor retries with the jittered exponential
+ * backoff from ConnectionHealth, but only while `can_reconnect` allows it, so the
+ * reconnect happens while the device is idle instead of on the next wake word.
+ */
+class ConnectionSupervisor {
+public:
+    ConnectionSupervisor(Protocol& protocol, std::function<bool()> can_reconnect);
+    ~ConnectionSupervisor();
+
+    // {"state", "health", "rtt_ms", "failures", "retry_in_ms"}, owned by the caller
+    cJSON* GetStatusJson() const;
+
+private:
+    Protocol& protocol_;
+    std::function<bool()> can_reconnect_;
+    TaskHandle_t task_handle_ = nullptr;
+    std::atomic<int64_t> next_attempt_time_ = 0;
+
+    void Run();
+};
+
+#endif // CONNECTION_SUPERVISOR_H
@@ -0,0 +1,261 @@
+#include "json_message.h"
+
+#include <cstring>
+
+static constexpr size_t kNotFound = (size_t)-1;
+
+static size_t SkipWhitespace(const char* data, size_t length, size_t pos) {
+    while (pos < length && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\n' || data[pos] == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+// `pos` is at the opening quote, returns the position after the closing quote
+static size_t SkipString(const char* data, size_t length, size_t pos) {
+    for (pos++; pos < length; pos++) {
+        if (data[pos] == '\\') {
+            pos++;
+        } else if (data[pos] == '"') {
+            return pos + 1;
+        }
+    }
+    return kNotFound;
+}
+
+static size_t SkipValue(const char* data, size_t length, size_t pos) {
+    if (data[pos] == '"') {
+        return SkipString(data, length, pos);
+    }
+    if (data[pos] == '{' || data[pos] == '[') {
+        int depth = 0;
+        while (pos < length) {
+            char c = data[pos];
+            if (c == '"') {
+                pos = SkipString(data, length, pos);
+                if (pos == kNotFound) {
+                    return kNotFound;
+                }
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return pos + 1;
+            }
+            pos++;
+        }
+        return kNotFound;
+    }
+    // Number, true, false or null
+    size_t start = pos;
+    while (pos < length && data[pos] != ',' && data[pos] != '}' && data[pos] != ']' &&
+        data[pos] != ' ' && data[pos] != '\t' && data[pos] != '\n' && data[pos] != '\r') {
+        pos++;
+    }
+    return pos > start ? pos : kNotFound;
+}
+
+template <typename Visitor>
+bool JsonMessage::Scan(Visitor visitor) const {
+    size_t pos = SkipWhitespace(data_, length_, 0);
+    if (pos >= length_ || data_[pos] != '{') {
+        return false;
+    }
+    pos = SkipWhitespace(data_, length_, pos + 1);
+    if (pos < length_ && data_[pos] == '}') {
+        return true;
+    }
+    while (pos < length_) {
+        if (data_[pos] != '"') {
+            return false;
+        }
+        size_t key_end = SkipString(data_, length_, pos);
+        if (key_end == kNotFound) {
+            return false;
+        }
+        std::string_view key(data_ + pos + 1, key_end - pos - 2);
+
+        pos = SkipWhitespace(data_, length_, key_end);
+        if (pos >= length_ || data_[pos] != ':') {
+            return false;
+        }
+        pos = SkipWhitespace(data_, length_, pos + 1);
+        if (pos >= length_) {
+            return false;
+        }
+        size_t value_end = SkipValue(data_, length_, pos);
+        if (value_end == kNotFound) {
+            return false;
+        }
+        bool is_string = data_[pos] == '"';
+        std::string_view value = is_string ? std::string_view(data_ + pos + 1, value_end - pos - 2)
+                                           : std::string_view(data_ + pos, value_end - pos);
+        if (visitor(key, value, is_string)) {
+            return true;
+        }
+
+        pos = SkipWhitespace(data_, length_, value_end);
+        if (pos < length_ && data_[pos] == '}') {
+            return true;
+        }
+        if (pos >= length_ || data_[pos] != ',') {
+            return false;
+        }
+        pos = SkipWhitespace(data_, length_, pos + 1);
+    }
+    return false;
+}
+
+JsonMessage::JsonMessage(const char* data, size_t length) : data_(data), length_(length) {
+    // One pass picks up the routing fields and checks the structure
+    valid_ = Scan([this](std::string_view key, std::string_view value, bool is_string) {
+        if (is_string) {
+            if (key == "type") {
+                type_ = value;
+            } else if (key == "state") {
+                state_ = value;
+            }
+        }
+        return false;
+    });
+}
+
+JsonMessage::~JsonMessage() {
+    if (root_ != nullptr) {
+        cJSON_Delete(root_);
+    }
+}
+
+bool JsonMessage::GetString(const char* key, std::string_view& value) const {
+    bool found = false;
+    Scan([key, &value, &found](std::string_view field, std::string_view field_value, bool is_string) {
+        if (is_string && field == key) {
+            value = field_value;
+            found = true;
+        }
+        return found;
+    });
+    return found;
+}
+
+static bool ParseHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back((char)code_point);
+    } else if (code_point < 0x800) {
+        out.push_back((char)(0xC0 | (code_point >> 6)));
+        out.push_back((char)(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.push_back((char)(0xE0 | (code_point >> 12)));
+        out.push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code_point & 0x3F)));
+    } else {
+        out.push_back((char)(0xF0 | (code_point >> 18)));
+        out.push_back((char)(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code_point & 0x3F)));
+    }
+}
+
+std::string JsonMessage::GetText(const char* key) const {
+    std::string_view raw;
+    if (!GetString(key, raw)) {
+        return std::string();
+    }
+    if (raw.find('\\') == std::string_view::npos) {
+        return std::string(raw);
+    }
+
+    std::string text;
+    text.reserve(raw.size());
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    while (p < end) {
+        if (*p != '\\' || p + 1 >= end) {
+            text.push_back(*p++);
+            continue;
+        }
+        char escape = p[1];
+        p += 2;
+        switch (escape) {
+            case 'b': text.push_back('\b'); break;
+            case 'f': text.push_back('\f'); break;
+            case 'n': text.push_back('\n'); break;
+            case 'r': text.push_back('\r'); break;
+            case 't': text.push_back('\t'); break;
+            case 'u': {
+                uint32_t code_point;
+                if (!ParseHex4(p, end, code_point)) {
+                    return text;
+                }
+                p += 4;
+                // Characters outside the BMP come as a surrogate pair
+                uint32_t low;
+                if (code_point >= 0xD800 && code_point < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                    ParseHex4(p + 2, end, low) && low >= 0xDC00 && low < 0xE000) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                AppendUtf8(text, code_point);
+                break;
+            }
+            default:
+                // \" \\ \/
+                text.push_back(escape);
+                break;
+        }
+    }
+    return text;
+}
+
+const cJSON* JsonMessage::root() const {
+    if (root_ == nullptr && valid_) {
+        root_ = cJSON_ParseWithLength(data_, length_);
+    }
+    return root_;
+}
+
+bool ForEachJsonElement(std::string_view array, const std::function<void(std::string_view element)>& callback) {
+    const char* data = array.data();
+    size_t length = array.size();
+    size_t pos = SkipWhitespace(data, length, 0);
+    if (pos >= length || data[pos] != '[') {
+        return false;
+    }
+    pos = SkipWhitespace(data, length, pos + 1);
+    if (pos < length && data[pos] == ']') {
+        return true;
+    }
+    while (pos < length) {
+        size_t end = SkipValue(data, length, pos);
+        if (end == kNotFound) {
+            return false;
+        }
+        callback(std::string_view(data + pos, end - pos));
+        pos = SkipWhitespace(data, length, end);
+        if (pos < length && data[pos] == ']') {
+            return true;
+        }
+        if (pos >= length || data[pos] != ',') {
+            return false;
+        }
+        pos = SkipWhitespace(data, length, pos + 1);
+    }
+    return false;
+}
@@ -0,0 +1,52 @@
+#ifndef JSON_MESSAGE_H
+#define JSON_MESSAGE_H
+
+#include <cJSON.h>
+#include <string>
+#include <string_view>
+#include <functional>
+
+/*
+ * Read-only view of an incoming JSON text message. The top-level string fields are found by
+ * scanning the text in place, so routing on type and state and reading a few strings never
+ * allocates. A full cJSON tree is only built when a handler asks for root().
+ *
+ * The view does not own the text, it must outlive the message.
+ */
+class JsonMessage {
+public:
+    JsonMessage(const char* data, size_t length);
+    ~JsonMessage();
+    JsonMessage(const JsonMessage&) = delete;
+    JsonMessage& operator=(const JsonMessage&) = delete;
+
+    // False if the text is not a JSON object
+    inline bool valid() const { return valid_; }
+    inline std::string_view type() const { return type_; }
+    inline std::string_view state() const { return state_; }
+    inline std::string_view text() const { return std::string_view(data_, length_); }
+
+    // Raw contents of a top-level string field, escape sequences are left as they are
+    bool GetString(const char* key, std::string_view& value) const;
+    // Top-level string field with escape sequences decoded, empty if missing
+    std::string GetText(const char* key) const;
+    // Full parse, built on first use and freed with the message
+    const cJSON* root() const;
+
+private:
+    const char* data_;
+    size_t length_;
+    bool valid_ = false;
+    std::string_view type_;
+    std::string_view state_;
+    mutable cJSON* root_ = nullptr;
+
+    // Calls `visitor(key, value, is_string)` for every top-level field until it returns true
+    template <typename Visitor>
+    bool Scan(Visitor visitor) const;
+};
+
+// Calls `callback` with the raw text of each element of a JSON array, false if the array is malformed
+bool ForEachJsonElement(std::string_view array, const std::function<void(std::string_view element)>& callback);
+
+#endif // JSON_MESSAGE_H
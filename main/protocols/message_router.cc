@@ -0,0 +1,71 @@
+#include "message_router.h"
+
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "MessageRouter"
+
+static_assert((MESSAGE_ROUTER_TABLE_SIZE & (MESSAGE_ROUTER_TABLE_SIZE - 1)) == 0,
+    "MESSAGE_ROUTER_TABLE_SIZE must be a power of 2");
+
+// FNV-1a with the seed mixed into the offset basis
+uint32_t MessageRouter::Hash(std::string_view type, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : type) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void MessageRouter::On(const char* type, Handler handler) {
+    for (auto& route : routes_) {
+        if (route.type == type) {
+            route.handler = std::move(handler);
+            return;
+        }
+    }
+    if (routes_.size() >= MESSAGE_ROUTER_TABLE_SIZE / 2) {
+        ESP_LOGE(TAG, "Too many message types, dropping %s", type);
+        return;
+    }
+    routes_.push_back({type, std::move(handler)});
+    BuildTable();
+}
+
+void MessageRouter::BuildTable() {
+    // With the table at most half full a collision free seed turns up within a few hundred tries
+    for (uint32_t seed = 0; seed < 100000; seed++) {
+        memset(table_, -1, sizeof(table_));
+        bool collision = false;
+        for (size_t i = 0; i < routes_.size() && !collision; i++) {
+            auto slot = Hash(routes_[i].type, seed) & (MESSAGE_ROUTER_TABLE_SIZE - 1);
+            if (table_[slot] >= 0) {
+                collision = true;
+            } else {
+                table_[slot] = i;
+            }
+        }
+        if (!collision) {
+            seed_ = seed;
+            return;
+        }
+    }
+    ESP_LOGE(TAG, "No perfect hash found for %u message types", routes_.size());
+}
+
+bool MessageRouter::Dispatch(const JsonMessage& message) {
+    if (routes_.empty()) {
+        return false;
+    }
+    auto index = table_[Hash(message.type(), seed_) & (MESSAGE_ROUTER_TABLE_SIZE - 1)];
+    if (index < 0) {
+        return false;
+    }
+    auto& route = routes_[index];
+    if (route.type != message.type() || route.handler == nullptr) {
+        return false;
+    }
+    route.handler(message);
+    return true;
+}
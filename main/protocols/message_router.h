@@ -0,0 +1,43 @@
+#ifndef MESSAGE_ROUTER_H
+#define MESSAGE_ROUTER_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "json_message.h"
+#include "protocol.h"
+
+// Slots in the handler table, must be a power of 2 and larger than the number of message types
+#define MESSAGE_ROUTER_TABLE_SIZE 32
+
+/*
+ * Dispatches incoming messages by their "type" field.
+ *
+ * Handlers are registered once at startup. Each registration searches for a hash seed that
+ * puts every type in its own slot, so a dispatch is one hash of the type string, one table
+ * lookup and one compare.
+ */
+class MessageRouter {
+public:
+    using Handler = ProtocolCallback<void(const JsonMessage& message)>;
+
+    void On(const char* type, Handler handler);
+    // False if no handler is registered for the message type
+    bool Dispatch(const JsonMessage& message);
+
+private:
+    struct Route {
+        std::string_view type;
+        Handler handler;
+    };
+
+    std::vector<Route> routes_;
+    uint32_t seed_ = 0;
+    int8_t table_[MESSAGE_ROUTER_TABLE_SIZE];
+
+    static uint32_t Hash(std::string_view type, uint32_t seed);
+    void BuildTable();
+};
+
+#endif // MESSAGE_ROUTER_H
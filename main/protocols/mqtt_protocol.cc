@@ -4,8 +4,8 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <ml307_mqtt.h>
-#include <ml307_udp.h>
 #include <cstring>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
@@ -18,24 +18,42 @@ MqttProtocol::MqttProtocol() {
 
 MqttProtocol::~MqttProtocol() {
     ESP_LOGI(TAG, "MqttProtocol deinit");
-    if (udp_ != nullptr) {
-        delete udp_;
-    }
-    if (mqtt_ != nullptr) {
-        delete mqtt_;
-    }
+    DestroyMqttClient();
     vEventGroupDelete(event_group_handle_);
 }
 
 bool MqttProtocol::Start() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
     return StartMqttClient(false);
 }
 
-bool MqttProtocol::StartMqttClient(bool report_error) {
-    if (mqtt_ != nullptr) {
-        ESP_LOGW(TAG, "Mqtt client already started");
-        delete mqtt_;
+bool MqttProtocol::NeedsReconnect() const {
+    std::lock_guard<std::mutex> lock(mqtt_mutex_);
+    return mqtt_ == nullptr || !mqtt_->IsConnected();
+}
+
+bool MqttProtocol::Reconnect() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    if (!NeedsReconnect()) {
+        return true;
     }
+    return StartMqttClient(false);
+}
+
+// Unpublishes the client under the lock and deletes it outside
+void MqttProtocol::DestroyMqttClient() {
+    Mqtt* mqtt;
+    {
+        std::lock_guard<std::mutex> lock(mqtt_mutex_);
+        mqtt = mqtt_;
+        mqtt_ = nullptr;
+    }
+    delete mqtt;
+}
+
+// Called with connect_mutex_ held, the new client is only published once it is connected
+bool MqttProtocol::StartMqttClient(bool report_error) {
+    DestroyMqttClient();
 
     Settings settings("mqtt", false);
     auto endpoint = settings.GetString("endpoint");
@@ -43,7 +61,7 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     auto username = settings.GetString("username");
     auto password = settings.GetString("password");
     int keepalive_interval = settings.GetInt("keepalive", 120);
-    publish_topic_ = settings.GetString("publish_topic");
+    auto publish_topic = settings.GetString("publish_topic");
 
     if (endpoint.empty()) {
         ESP_LOGW(TAG, "MQTT endpoint is not specified");
@@ -53,41 +71,41 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         return false;
     }
 
-    mqtt_ = Board::GetInstance().CreateMqtt();
-    mqtt_->SetKeepAlive(keepalive_interval);
+    auto mqtt = Board::GetInstance().CreateMqtt();
+    mqtt->SetKeepAlive(keepalive_interval);
 
-    mqtt_->OnDisconnected([this]() {
+    mqtt->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Disconnected from endpoint");
+        health_.OnDisconnected();
     });
 
-    mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
-        cJSON* root = cJSON_Parse(payload.c_str());
-        if (root == nullptr) {
+    mqtt->OnMessage([this](const std::string& topic, const std::string& payload) {
+        JsonMessage message(payload.data(), payload.size());
+        if (!message.valid()) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
             return;
         }
-        cJSON* type = cJSON_GetObjectItem(root, "type");
-        if (!cJSON_IsString(type)) {
+        if (message.type().empty()) {
             ESP_LOGE(TAG, "Message type is invalid");
-            cJSON_Delete(root);
             return;
         }
+        // Before dispatching, the server hello wakes OpenAudioChannel which checks for a timeout
+        last_incoming_time_ = std::chrono::steady_clock::now();
 
-        if (strcmp(type->valuestring, "hello") == 0) {
-            ParseServerHello(root);
-        } else if (strcmp(type->valuestring, "goodbye") == 0) {
-            auto session_id = cJSON_GetObjectItem(root, "session_id");
-            ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id ? session_id->valuestring : "null");
-            if (session_id == nullptr || session_id_ == session_id->valuestring) {
+        if (message.type() == "hello") {
+            ParseServerHello(message.root());
+        } else if (message.type() == "goodbye") {
+            std::string_view session_id;
+            bool has_session_id = message.GetString("session_id", session_id);
+            ESP_LOGI(TAG, "Received goodbye message, session_id: %.*s", (int)session_id.size(), session_id.data());
+            if (!has_session_id || session_id_ == session_id) {
                 Application::GetInstance().Schedule([this]() {
                     CloseAudioChannel();
                 });
             }
         } else if (on_incoming_json_ != nullptr) {
-            on_incoming_json_(root);
+            on_incoming_json_(message);
         }
-        cJSON_Delete(root);
-        last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
     ESP_LOGI(TAG, "Connecting to endpoint %s", endpoint.c_str());
@@ -100,79 +118,80 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     } else {
         broker_address = endpoint;
     }
-    if (!mqtt_->Connect(broker_address, broker_port, client_id, username, password)) {
+    health_.OnConnecting();
+    auto start_time = esp_timer_get_time();
+    if (!mqtt->Connect(broker_address, broker_port, client_id, username, password)) {
         ESP_LOGE(TAG, "Failed to connect to endpoint");
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        delete mqtt;
+        health_.OnFailure();
+        // Background reconnects stay quiet, the supervisor retries them
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        }
         return false;
     }
 
-    ESP_LOGI(TAG, "Connected to endpoint");
+    {
+        std::lock_guard<std::mutex> lock(mqtt_mutex_);
+        mqtt_ = mqtt;
+        publish_topic_ = std::move(publish_topic);
+    }
+    health_.OnConnected();
+    ESP_LOGI(TAG, "Connected to endpoint in %ld ms", (long)((esp_timer_get_time() - start_time) / 1000));
     return true;
 }
 
 bool MqttProtocol::SendText(const std::string& text) {
-    if (publish_topic_.empty()) {
-        return false;
-    }
-    if (!mqtt_->Publish(publish_topic_, text)) {
-        ESP_LOGE(TAG, "Failed to publish message: %s", text.c_str());
-        SetError(Lang::Strings::SERVER_ERROR);
-        return false;
+    {
+        std::lock_guard<std::mutex> lock(mqtt_mutex_);
+        if (mqtt_ == nullptr || publish_topic_.empty()) {
+            return false;
+        }
+        if (mqtt_->Publish(publish_topic_, text)) {
+            return true;
+        }
     }
-    return true;
+    // The error callback may end up closing the channel, which publishes a goodbye
+    ESP_LOGE(TAG, "Failed to publish message: %s", text.c_str());
+    SetError(Lang::Strings::SERVER_ERROR);
+    return false;
 }
 
-bool MqttProtocol::SendAudio(const AudioStreamPacket& packet) {
-    std::lock_guard<std::mutex> lock(channel_mutex_);
-    if (udp_ == nullptr) {
-        return false;
-    }
-
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet.payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet.timestamp);
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
-
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet.payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
+bool MqttProtocol::SendAudio(AudioStreamPacket& packet) {
+    return udp_channel_.Send(packet);
+}
 
-    size_t nc_off = 0;
-    uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet.payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet.payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
-        ESP_LOGE(TAG, "Failed to encrypt audio data");
-        return false;
-    }
+bool MqttProtocol::SendAudioBatch(std::span<AudioStreamPacket> packets) {
+    return udp_channel_.SendBatch(packets);
+}
 
-    return udp_->Send(encrypted) > 0;
+size_t MqttProtocol::audio_message_overhead() const {
+    return udp_channel_.message_overhead();
 }
 
 void MqttProtocol::CloseAudioChannel() {
+    udp_channel_.Close();
+
     {
-        std::lock_guard<std::mutex> lock(channel_mutex_);
-        if (udp_ != nullptr) {
-            delete udp_;
-            udp_ = nullptr;
-        }
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        JsonWriter json(send_buffer_);
+        json.BeginObject().Key("session_id").String(session_id_).Key("type").String("goodbye").EndObject();
+        SendText(send_buffer_);
     }
 
-    std::string message = "{";
-    message += "\"session_id\":\"" + session_id_ + "\",";
-    message += "\"type\":\"goodbye\"";
-    message += "}";
-    SendText(message);
-
     if (on_audio_channel_closed_ != nullptr) {
         on_audio_channel_closed_();
     }
 }
 
 bool MqttProtocol::OpenAudioChannel() {
-    if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
-        ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
-        if (!StartMqttClient(true)) {
-            return false;
+    {
+        std::lock_guard<std::mutex> lock(connect_mutex_);
+        if (NeedsReconnect()) {
+            ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
+            if (!StartMqttClient(true)) {
+                return false;
+            }
         }
     }
 
@@ -181,6 +200,7 @@ bool MqttProtocol::OpenAudioChannel() {
     xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 
     auto message = GetHelloMessage();
+    auto hello_time = esp_timer_get_time();
     if (!SendText(message)) {
         return false;
     }
@@ -189,62 +209,16 @@ bool MqttProtocol::OpenAudioChannel() {
     EventBits_t bits = xEventGroupWaitBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
     if (!(bits & MQTT_PROTOCOL_SERVER_HELLO_EVENT)) {
         ESP_LOGE(TAG, "Failed to receive server hello");
+        health_.OnFailure();
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
+    health_.OnRttSample((esp_timer_get_time() - hello_time) / 1000);
 
-    std::lock_guard<std::mutex> lock(channel_mutex_);
-    if (udp_ != nullptr) {
-        delete udp_;
+    if (!udp_channel_.Open()) {
+        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        return false;
     }
-    udp_ = Board::GetInstance().CreateUdp();
-    udp_->OnMessage([this](const std::string& data) {
-        /*
-         * UDP Encrypted OPUS Packet Format:
-         * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
-         * |payload payload_len|
-         */
-        if (data.size() < sizeof(aes_nonce_)) {
-            ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
-            return;
-        }
-        if (data[0] != 0x01) {
-            ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
-            return;
-        }
-        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
-        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
-        }
-
-        size_t decrypted_size = data.size() - aes_nonce_.size();
-        size_t nc_off = 0;
-        uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        AudioStreamPacket packet;
-        packet.sample_rate = server_sample_rate_;
-        packet.frame_duration = server_frame_duration_;
-        packet.timestamp = timestamp;
-        packet.payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet.payload.data());
-        if (ret != 0) {
-            ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
-            return;
-        }
-        if (on_incoming_audio_ != nullptr) {
-            on_incoming_audio_(std::move(packet));
-        }
-        remote_sequence_ = sequence;
-        last_incoming_time_ = std::chrono::steady_clock::now();
-    });
-
-    udp_->Connect(udp_server_, udp_port_);
 
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
@@ -254,28 +228,21 @@ bool MqttProtocol::OpenAudioChannel() {
 
 std::string MqttProtocol::GetHelloMessage() {
     // 发送 hello 消息申请 UDP 通道
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", 3);
-    cJSON_AddStringToObject(root, "transport", "udp");
-    cJSON* features = cJSON_CreateObject();
+    std::string message;
+    JsonWriter json(message);
+    json.BeginObject().Key("type").String("hello").Key("version").Int(3).Key("transport").String("udp");
+    json.Key("features").BeginObject();
 #if CONFIG_USE_SERVER_AEC
-    cJSON_AddBoolToObject(features, "aec", true);
+    json.Key("aec").Bool(true);
 #endif
 #if CONFIG_IOT_PROTOCOL_MCP
-    cJSON_AddBoolToObject(features, "mcp", true);
+    json.Key("mcp").Bool(true);
 #endif
-    cJSON_AddItemToObject(root, "features", features);
-    cJSON* audio_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(audio_params, "format", "opus");
-    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
-    cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
-    cJSON_AddItemToObject(root, "audio_params", audio_params);
-    auto json_str = cJSON_PrintUnformatted(root);
-    std::string message(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(root);
+    json.EndObject();
+    json.Key("audio_params").BeginObject().Key("format").String("opus").Key("sample_rate").Int(16000).Key("channels").Int(1);
+    AddUplinkAudioParams(json);
+    json.EndObject();
+    json.EndObject();
     return message;
 }
 
@@ -310,40 +277,14 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGE(TAG, "UDP is not specified");
         return;
     }
-    udp_server_ = cJSON_GetObjectItem(udp, "server")->valuestring;
-    udp_port_ = cJSON_GetObjectItem(udp, "port")->valueint;
-    auto key = cJSON_GetObjectItem(udp, "key")->valuestring;
-    auto nonce = cJSON_GetObjectItem(udp, "nonce")->valuestring;
-
-    // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
-    // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
-    aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
-    local_sequence_ = 0;
-    remote_sequence_ = 0;
-    xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
-}
-
-static const char hex_chars[] = "0123456789ABCDEF";
-// 辅助函数，将单个十六进制字符转换为对应的数值
-static inline uint8_t CharToHex(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    return 0;  // 对于无效输入，返回0
-}
-
-std::string MqttProtocol::DecodeHexString(const std::string& hex_string) {
-    std::string decoded;
-    decoded.reserve(hex_string.size() / 2);
-    for (size_t i = 0; i < hex_string.size(); i += 2) {
-        char byte = (CharToHex(hex_string[i]) << 4) | CharToHex(hex_string[i + 1]);
-        decoded.push_back(byte);
+    if (!udp_channel_.Configure(udp)) {
+        return;
     }
-    return decoded;
+    BindAudioChannel(udp_channel_);
+    NegotiateAudioBatch(audio_params, udp_channel_);
+    xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
 bool MqttProtocol::IsAudioChannelOpened() const {
-    return udp_ != nullptr && !error_occurred_ && !IsTimeout();
+    return udp_channel_.IsOpened() && !error_occurred_ && !IsTimeout();
 }
@@ -3,10 +3,9 @@
 
 
 #include "protocol.h"
+#include "udp_audio_channel.h"
 #include <mqtt.h>
-#include <udp.h>
 #include <cJSON.h>
-#include <mbedtls/aes.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 
@@ -16,7 +15,6 @@
 #include <mutex>
 
 #define MQTT_PING_INTERVAL_SECONDS 90
-#define MQTT_RECONNECT_INTERVAL_MS 10000
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
@@ -26,29 +24,32 @@ public:
     ~MqttProtocol();
 
     bool Start() override;
-    bool SendAudio(const AudioStreamPacket& packet) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
+    bool SendAudioBatch(std::span<AudioStreamPacket> packets) override;
+    size_t audio_message_overhead() const override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    bool NeedsReconnect() const override;
+    bool Reconnect() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
 
-    std::string publish_topic_;
-
-    std::mutex channel_mutex_;
+    // Replaced by reconnects on the connection supervisor's task while the main loop, the audio
+    // tasks and the MQTT receive task publish. Never held while a client is deleted, that joins
+    // the receive task, whose handlers publish replies.
     Mqtt* mqtt_ = nullptr;
-    Udp* udp_ = nullptr;
-    mbedtls_aes_context aes_ctx_;
-    std::string aes_nonce_;
-    std::string udp_server_;
-    int udp_port_;
-    uint32_t local_sequence_;
-    uint32_t remote_sequence_;
+    std::string publish_topic_;
+    mutable std::mutex mqtt_mutex_;
+    // Serializes reconnects between the main loop and the connection supervisor
+    std::mutex connect_mutex_;
+    // MQTT carries the control messages, audio always goes over UDP
+    UdpAudioChannel udp_channel_;
 
     bool StartMqttClient(bool report_error=false);
+    void DestroyMqttClient();
     void ParseServerHello(const cJSON* root);
-    std::string DecodeHexString(const std::string& hex_string);
 
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
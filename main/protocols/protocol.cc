@@ -1,27 +1,59 @@
 #include "protocol.h"
+#include "audio_channel.h"
 
 #include <esp_log.h>
+#include <algorithm>
 
 #define TAG "Protocol"
 
-void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
-    on_incoming_json_ = callback;
+void Protocol::OnIncomingJson(ProtocolCallback<void(const JsonMessage& message)> callback) {
+    on_incoming_json_ = std::move(callback);
 }
 
-void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback) {
-    on_incoming_audio_ = callback;
+void Protocol::OnIncomingAudio(ProtocolCallback<void(AudioStreamPacket&& packet)> callback) {
+    on_incoming_audio_ = std::move(callback);
 }
 
-void Protocol::OnAudioChannelOpened(std::function<void()> callback) {
-    on_audio_channel_opened_ = callback;
+void Protocol::OnAudioChannelOpened(ProtocolCallback<void()> callback) {
+    on_audio_channel_opened_ = std::move(callback);
 }
 
-void Protocol::OnAudioChannelClosed(std::function<void()> callback) {
-    on_audio_channel_closed_ = callback;
+void Protocol::OnAudioChannelClosed(ProtocolCallback<void()> callback) {
+    on_audio_channel_closed_ = std::move(callback);
 }
 
-void Protocol::OnNetworkError(std::function<void(const std::string& message)> callback) {
-    on_network_error_ = callback;
+void Protocol::OnNetworkError(ProtocolCallback<void(const std::string& message)> callback) {
+    on_network_error_ = std::move(callback);
+}
+
+void Protocol::BindAudioChannel(AudioChannel& channel) {
+    channel.SetServerAudioParams(server_sample_rate_, server_frame_duration_);
+    channel.OnIncomingAudio([this](AudioStreamPacket&& packet) {
+        last_incoming_time_ = std::chrono::steady_clock::now();
+        if (on_incoming_audio_ != nullptr) {
+            on_incoming_audio_(std::move(packet));
+        }
+    });
+}
+
+bool Protocol::SendAudioBatch(std::span<AudioStreamPacket> packets) {
+    for (auto& packet : packets) {
+        if (!SendAudio(packet)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Protocol::NegotiateAudioBatch(const cJSON* audio_params, const AudioChannel& channel) {
+    audio_batch_frames_ = 1;
+#if CONFIG_UPLINK_AUDIO_BATCHING
+    auto batch_frames = cJSON_GetObjectItem(audio_params, "batch_frames");
+    if (cJSON_IsNumber(batch_frames) && batch_frames->valueint > 1 && channel.SupportsBatch()) {
+        audio_batch_frames_ = std::min(batch_frames->valueint, CONFIG_UPLINK_AUDIO_BATCH_FRAMES);
+        ESP_LOGI(TAG, "Uplink batching up to %d frames", audio_batch_frames_);
+    }
+#endif
 }
 
 void Protocol::SetError(const std::string& message) {
@@ -32,92 +64,85 @@ void Protocol::SetError(const std::string& message) {
 }
 
 void Protocol::SendAbortSpeaking(AbortReason reason) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    JsonWriter json(send_buffer_);
+    json.BeginObject().Key("session_id").String(session_id_).Key("type").String("abort");
     if (reason == kAbortReasonWakeWordDetected) {
-        message += ",\"reason\":\"wake_word_detected\"";
+        json.Key("reason").String("wake_word_detected");
     }
-    message += "}";
-    SendText(message);
+    json.EndObject();
+    SendText(send_buffer_);
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
-    std::string json = "{\"session_id\":\"" + session_id_ + 
-                      "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
-    SendText(json);
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    JsonWriter json(send_buffer_);
+    json.BeginObject()
+        .Key("session_id").String(session_id_)
+        .Key("type").String("listen")
+        .Key("state").String("detect")
+        .Key("text").String(wake_word)
+        .EndObject();
+    SendText(send_buffer_);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\"";
-    message += ",\"type\":\"listen\",\"state\":\"start\"";
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    JsonWriter json(send_buffer_);
+    json.BeginObject().Key("session_id").String(session_id_).Key("type").String("listen").Key("state").String("start");
     if (mode == kListeningModeRealtime) {
-        message += ",\"mode\":\"realtime\"";
+        json.Key("mode").String("realtime");
     } else if (mode == kListeningModeAutoStop) {
-        message += ",\"mode\":\"auto\"";
+        json.Key("mode").String("auto");
     } else {
-        message += ",\"mode\":\"manual\"";
+        json.Key("mode").String("manual");
     }
-    message += "}";
-    SendText(message);
+    json.EndObject();
+    SendText(send_buffer_);
 }
 
 void Protocol::SendStopListening() {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
-    SendText(message);
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    JsonWriter json(send_buffer_);
+    json.BeginObject().Key("session_id").String(session_id_).Key("type").String("listen").Key("state").String("stop").EndObject();
+    SendText(send_buffer_);
 }
 
+// One message per thing, the descriptors are copied as they are without a cJSON round trip
 void Protocol::SendIotDescriptors(const std::string& descriptors) {
-    cJSON* root = cJSON_Parse(descriptors.c_str());
-    if (root == nullptr) {
-        ESP_LOGE(TAG, "Failed to parse IoT descriptors: %s", descriptors.c_str());
-        return;
-    }
-
-    if (!cJSON_IsArray(root)) {
-        ESP_LOGE(TAG, "IoT descriptors should be an array");
-        cJSON_Delete(root);
-        return;
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    bool valid = ForEachJsonElement(descriptors, [this](std::string_view descriptor) {
+        JsonWriter json(send_buffer_);
+        json.BeginObject()
+            .Key("session_id").String(session_id_)
+            .Key("type").String("iot")
+            .Key("update").Bool(true)
+            .Key("descriptors").BeginArray().Raw(descriptor).EndArray()
+            .EndObject();
+        SendText(send_buffer_);
+    });
+    if (!valid) {
+        ESP_LOGE(TAG, "IoT descriptors should be an array: %s", descriptors.c_str());
     }
-
-    int arraySize = cJSON_GetArraySize(root);
-    for (int i = 0; i < arraySize; ++i) {
-        cJSON* descriptor = cJSON_GetArrayItem(root, i);
-        if (descriptor == nullptr) {
-            ESP_LOGE(TAG, "Failed to get IoT descriptor at index %d", i);
-            continue;
-        }
-
-        cJSON* messageRoot = cJSON_CreateObject();
-        cJSON_AddStringToObject(messageRoot, "session_id", session_id_.c_str());
-        cJSON_AddStringToObject(messageRoot, "type", "iot");
-        cJSON_AddBoolToObject(messageRoot, "update", true);
-
-        cJSON* descriptorArray = cJSON_CreateArray();
-        cJSON_AddItemToArray(descriptorArray, cJSON_Duplicate(descriptor, 1));
-        cJSON_AddItemToObject(messageRoot, "descriptors", descriptorArray);
-
-        char* message = cJSON_PrintUnformatted(messageRoot);
-        if (message == nullptr) {
-            ESP_LOGE(TAG, "Failed to print JSON message for IoT descriptor at index %d", i);
-            cJSON_Delete(messageRoot);
-            continue;
-        }
-
-        SendText(std::string(message));
-        cJSON_free(message);
-        cJSON_Delete(messageRoot);
-    }
-
-    cJSON_Delete(root);
 }
 
 void Protocol::SendIotStates(const std::string& states) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"iot\",\"update\":true,\"states\":" + states + "}";
-    SendText(message);
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    JsonWriter json(send_buffer_);
+    json.BeginObject()
+        .Key("session_id").String(session_id_)
+        .Key("type").String("iot")
+        .Key("update").Bool(true)
+        .Key("states").Raw(states)
+        .EndObject();
+    SendText(send_buffer_);
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
-    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
-    SendText(message);
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    JsonWriter json(send_buffer_);
+    json.BeginObject().Key("session_id").String(session_id_).Key("type").String("mcp").Key("payload").Raw(payload).EndObject();
+    SendText(send_buffer_);
 }
 
 bool Protocol::IsTimeout() const {
@@ -130,3 +155,16 @@ bool Protocol::IsTimeout() const {
     }
     return timeout;
 }
+
+void Protocol::AddUplinkAudioParams(JsonWriter& json) const {
+    json.Key("frame_duration").Int(uplink_audio_params_.frame_duration);
+    if (uplink_audio_params_.bitrate > 0) {
+        json.Key("bitrate").Int(uplink_audio_params_.bitrate);
+    }
+    json.Key("fec").Bool(uplink_audio_params_.fec);
+    json.Key("packet_loss").Int(uplink_audio_params_.packet_loss);
+#if CONFIG_UPLINK_AUDIO_BATCHING
+    // The server answers with the batch size it accepts, batches are only sent when the link is backed up
+    json.Key("batch_frames").Int(CONFIG_UPLINK_AUDIO_BATCH_FRAMES);
+#endif
+}
@@ -6,17 +6,43 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <mutex>
+#include <span>
+
+#include "inplace_task.h"
+#include "json_writer.h"
+#include "connection_health.h"
+#include "json_message.h"
+
+// Room the uplink encoder leaves in front of each Opus frame, enough for any transport header
+#define AUDIO_PACKET_HEADROOM 16
+// Most Opus frames packed into one batched uplink message
+#define AUDIO_BATCH_MAX_FRAMES 8
+// Each frame in a batch is prefixed with |timestamp 4u|payload_size 2u|
+#define AUDIO_BATCH_ENTRY_HEADER_SIZE 6
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    // Downlink order as assigned by the transport, used by the jitter buffer
+    uint32_t sequence = 0;
+    // Uplink only: bytes at the front of payload reserved for the transport header, the Opus data follows
+    uint16_t headroom = 0;
     std::vector<uint8_t> payload;
 };
 
+// Uplink encoder settings, reported to the server in the hello audio_params
+struct UplinkAudioParams {
+    int frame_duration = 60;
+    int bitrate = 0;        // 0: picked by the encoder
+    bool fec = false;
+    int packet_loss = 0;    // Expected loss in percent the encoder is tuned for
+};
+
 struct BinaryProtocol2 {
     uint16_t version;
-    uint16_t type;          // Message type (0: OPUS, 1: JSON)
+    uint16_t type;          // Message type (0: OPUS, 1: JSON, 2: OPUS batch)
     uint32_t reserved;      // Reserved for future use
     uint32_t timestamp;     // Timestamp in milliseconds (used for server-side AEC)
     uint32_t payload_size;  // Payload size in bytes
@@ -41,6 +67,14 @@ enum ListeningMode {
     kListeningModeRealtime // 需要 AEC 支持
 };
 
+// Protocol callbacks capture a few pointers at most, keep them inline
+#define PROTOCOL_CALLBACK_INLINE_SIZE 32
+
+template <typename Signature>
+using ProtocolCallback = InplaceTask<PROTOCOL_CALLBACK_INLINE_SIZE, Signature>;
+
+class AudioChannel;
+
 class Protocol {
 public:
     virtual ~Protocol() = default;
@@ -54,18 +88,39 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    inline void SetUplinkAudioParams(const UplinkAudioParams& params) {
+        uplink_audio_params_ = params;
+    }
+    inline const ConnectionHealth& health() const {
+        return health_;
+    }
+    // Frames per uplink message the server accepted in the hello, 1 when batching is off
+    inline int audio_batch_frames() const {
+        return audio_batch_frames_;
+    }
 
-    void OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback);
-    void OnIncomingJson(std::function<void(const cJSON* root)> callback);
-    void OnAudioChannelOpened(std::function<void()> callback);
-    void OnAudioChannelClosed(std::function<void()> callback);
-    void OnNetworkError(std::function<void(const std::string& message)> callback);
+    void OnIncomingAudio(ProtocolCallback<void(AudioStreamPacket&& packet)> callback);
+    void OnIncomingJson(ProtocolCallback<void(const JsonMessage& message)> callback);
+    void OnAudioChannelOpened(ProtocolCallback<void()> callback);
+    void OnAudioChannelClosed(ProtocolCallback<void()> callback);
+    void OnNetworkError(ProtocolCallback<void(const std::string& message)> callback);
 
     virtual bool Start() = 0;
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(const AudioStreamPacket& packet) = 0;
+    // Hint that the audio channel is likely to be opened soon, returns without waiting
+    virtual void PrepareAudioChannel() {}
+    // Protocols with a control connection that stays up between conversations report when it
+    // is down, the ConnectionSupervisor then calls Reconnect() off the main loop
+    virtual bool NeedsReconnect() const { return false; }
+    virtual bool Reconnect() { return true; }
+    // May write the transport header into the packet's headroom
+    virtual bool SendAudio(AudioStreamPacket& packet) = 0;
+    // Packs the frames into one transport message when batching was negotiated, sends them one by one otherwise
+    virtual bool SendAudioBatch(std::span<AudioStreamPacket> packets);
+    // Estimated bytes each audio message costs on the wire on top of its payload
+    virtual size_t audio_message_overhead() const { return 0; }
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
@@ -75,21 +130,33 @@ public:
     virtual void SendMcpMessage(const std::string& message);
 
 protected:
-    std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(AudioStreamPacket&& packet)> on_incoming_audio_;
-    std::function<void()> on_audio_channel_opened_;
-    std::function<void()> on_audio_channel_closed_;
-    std::function<void(const std::string& message)> on_network_error_;
+    ProtocolCallback<void(const JsonMessage& message)> on_incoming_json_;
+    ProtocolCallback<void(AudioStreamPacket&& packet)> on_incoming_audio_;
+    ProtocolCallback<void()> on_audio_channel_opened_;
+    ProtocolCallback<void()> on_audio_channel_closed_;
+    ProtocolCallback<void(const std::string& message)> on_network_error_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
     bool error_occurred_ = false;
     std::string session_id_;
+    UplinkAudioParams uplink_audio_params_;
+    int audio_batch_frames_ = 1;
+    ConnectionHealth health_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    // Outgoing control messages are written here, guarded by send_mutex_ as senders run on several tasks
+    std::mutex send_mutex_;
+    std::string send_buffer_;
 
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    // Writes frame_duration and the current encoder tuning into the open hello audio_params object
+    void AddUplinkAudioParams(JsonWriter& json) const;
+    // Passes the server audio params to the channel and forwards its downlink audio
+    void BindAudioChannel(AudioChannel& channel);
+    // Takes batch_frames from the server hello audio_params, if the channel that carries the uplink can batch
+    void NegotiateAudioBatch(const cJSON* audio_params, const AudioChannel& channel);
 };
 
 #endif // PROTOCOL_H
@@ -0,0 +1,85 @@
+#include "sentence_splitter.h"
+
+#include <cstdint>
+#include <cstring>
+
+static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Length of the sentence terminator at `text`, 0 if there is none. -1 if the end of the text
+// leaves it open, the caller waits for more then
+static int TerminatorLength(std::string_view text) {
+    switch (text[0]) {
+    case '!':
+    case '?':
+    case ';':
+    case '\n':
+        return 1;
+    case '.':
+        if (text.size() == 1) {
+            return -1;
+        }
+        return IsSpace(text[1]) ? 1 : 0;
+    }
+    // 。！？；… in UTF-8
+    static const char* const kTerminators[] = { "\xe3\x80\x82", "\xef\xbc\x81", "\xef\xbc\x9f", "\xef\xbc\x9b", "\xe2\x80\xa6" };
+    if ((uint8_t)text[0] == 0xe3 || (uint8_t)text[0] == 0xef || (uint8_t)text[0] == 0xe2) {
+        if (text.size() < 3) {
+            return -1;
+        }
+        for (auto terminator : kTerminators) {
+            if (memcmp(text.data(), terminator, 3) == 0) {
+                return 3;
+            }
+        }
+    }
+    return 0;
+}
+
+void SentenceSplitter::Append(std::string_view delta) {
+    pending_.append(delta);
+}
+
+bool SentenceSplitter::Next(std::string& sentence) {
+    while (scanned_ < pending_.size()) {
+        int length = TerminatorLength(std::string_view(pending_).substr(scanned_));
+        if (length < 0) {
+            return false;
+        }
+        if (length == 0) {
+            scanned_++;
+            continue;
+        }
+        if (Take(scanned_ + length, sentence)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SentenceSplitter::Finish(std::string& sentence) {
+    bool taken = Take(pending_.size(), sentence);
+    Reset();
+    return taken;
+}
+
+void SentenceSplitter::Reset() {
+    pending_.clear();
+    scanned_ = 0;
+}
+
+bool SentenceSplitter::Take(size_t length, std::string& sentence) {
+    size_t begin = 0;
+    size_t end = length;
+    while (begin < end && IsSpace(pending_[begin])) {
+        begin++;
+    }
+    while (end > begin && IsSpace(pending_[end - 1])) {
+        end--;
+    }
+    sentence.assign(pending_, begin, end - begin);
+    pending_.erase(0, length);
+    scanned_ = 0;
+    return !sentence.empty();
+}
@@ -0,0 +1,32 @@
+#ifndef SENTENCE_SPLITTER_H
+#define SENTENCE_SPLITTER_H
+
+#include <string>
+#include <string_view>
+
+/*
+ * Collects the text deltas of a streamed reply and hands it back one sentence at a time,
+ * the way the xiaozhi server sends sentence_start.
+ *
+ * A sentence ends after 。！？；… or their ASCII forms, or at a line break. A '.' only ends
+ * one when whitespace follows, so "3.14" stays whole, which means it waits for the next
+ * delta when it is the last character. Sentences are trimmed, empty ones are skipped.
+ */
+class SentenceSplitter {
+public:
+    void Append(std::string_view delta);
+    // Moves the next complete sentence into `sentence`
+    bool Next(std::string& sentence);
+    // Moves whatever is left into `sentence`, call once the reply has ended
+    bool Finish(std::string& sentence);
+    void Reset();
+
+private:
+    std::string pending_;
+    // Bytes of pending_ already known not to end a sentence
+    size_t scanned_ = 0;
+
+    bool Take(size_t length, std::string& sentence);
+};
+
+#endif // SENTENCE_SPLITTER_H
@@ -0,0 +1,203 @@
+#include "udp_audio_channel.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <cstring>
+#include <arpa/inet.h>
+
+#define TAG "UdpAudioChannel"
+
+UdpAudioChannel::UdpAudioChannel() {
+    mbedtls_aes_init(&aes_ctx_);
+}
+
+UdpAudioChannel::~UdpAudioChannel() {
+    Close();
+    mbedtls_aes_free(&aes_ctx_);
+}
+
+bool UdpAudioChannel::Configure(const cJSON* udp) {
+    auto server = cJSON_GetObjectItem(udp, "server");
+    auto port = cJSON_GetObjectItem(udp, "port");
+    auto key = cJSON_GetObjectItem(udp, "key");
+    auto nonce = cJSON_GetObjectItem(udp, "nonce");
+    if (!cJSON_IsString(server) || !cJSON_IsNumber(port) || !cJSON_IsString(key) || !cJSON_IsString(nonce)) {
+        ESP_LOGE(TAG, "UDP server, port, key and nonce are required");
+        return false;
+    }
+    auto aes_nonce = DecodeHexString(nonce->valuestring);
+    if (aes_nonce.size() != UDP_AUDIO_NONCE_SIZE) {
+        ESP_LOGE(TAG, "Invalid nonce size: %u", aes_nonce.size());
+        return false;
+    }
+
+    // A new session replaces the previous one
+    Close();
+    std::lock_guard<std::mutex> lock(mutex_);
+    server_ = server->valuestring;
+    port_ = port->valueint;
+    aes_nonce_ = std::move(aes_nonce);
+    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key->valuestring).c_str(), 128);
+    local_sequence_ = 0;
+    remote_sequence_ = 0;
+    return true;
+}
+
+bool UdpAudioChannel::Open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (aes_nonce_.empty()) {
+        ESP_LOGE(TAG, "UDP channel is not configured");
+        return false;
+    }
+    if (udp_ != nullptr) {
+        delete udp_;
+    }
+    udp_ = Board::GetInstance().CreateUdp();
+    udp_->OnMessage([this](const std::string& data) {
+        ParseDatagram(data);
+    });
+    if (!udp_->Connect(server_, port_)) {
+        ESP_LOGE(TAG, "Failed to connect to %s:%d", server_.c_str(), port_);
+        delete udp_;
+        udp_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void UdpAudioChannel::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (udp_ != nullptr) {
+        delete udp_;
+        udp_ = nullptr;
+    }
+}
+
+bool UdpAudioChannel::IsOpened() const {
+    return udp_ != nullptr;
+}
+
+// AES-CTR encryption and decryption are the same operation. The output may alias the input.
+// With CONFIG_MBEDTLS_HARDWARE_AES (the default) mbedtls runs this on the AES accelerator.
+bool UdpAudioChannel::CryptAudio(const uint8_t* nonce, const uint8_t* input, size_t size, uint8_t* output) {
+    // mbedtls advances the counter block, keep the nonce in the datagram intact
+    uint8_t counter[UDP_AUDIO_NONCE_SIZE];
+    memcpy(counter, nonce, sizeof(counter));
+    uint8_t stream_block[16] = {0};
+    size_t nc_off = 0;
+    return mbedtls_aes_crypt_ctr(&aes_ctx_, size, &nc_off, counter, stream_block, input, output) == 0;
+}
+
+bool UdpAudioChannel::SealDatagram(uint8_t type, uint8_t flags, uint32_t timestamp, uint32_t sequence,
+    const uint8_t* payload, size_t size) {
+    // Encrypt straight into the datagram, the buffer keeps its capacity between packets
+    datagram_.resize(UDP_AUDIO_NONCE_SIZE + size);
+    auto datagram = (uint8_t*)datagram_.data();
+    memcpy(datagram, aes_nonce_.data(), UDP_AUDIO_NONCE_SIZE);
+    datagram[0] = type;
+    datagram[1] = flags;
+    *(uint16_t*)&datagram[2] = htons(size);
+    *(uint32_t*)&datagram[8] = htonl(timestamp);
+    *(uint32_t*)&datagram[12] = htonl(sequence);
+
+    if (!CryptAudio(datagram, payload, size, datagram + UDP_AUDIO_NONCE_SIZE)) {
+        ESP_LOGE(TAG, "Failed to encrypt audio data");
+        return false;
+    }
+    return true;
+}
+
+bool UdpAudioChannel::Send(AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (udp_ == nullptr) {
+        return false;
+    }
+    size_t payload_size = packet.payload.size() - packet.headroom;
+    if (!SealDatagram(UDP_AUDIO_TYPE_OPUS, 0, packet.timestamp, ++local_sequence_,
+            packet.payload.data() + packet.headroom, payload_size)) {
+        return false;
+    }
+    return udp_->Send(datagram_) > 0;
+}
+
+bool UdpAudioChannel::SendBatch(std::span<AudioStreamPacket> packets) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (udp_ == nullptr) {
+        return false;
+    }
+    auto entries = FrameAudioBatch(packets, 0);
+    if (entries.size() > UINT16_MAX) {
+        ESP_LOGE(TAG, "Audio batch too large: %u", entries.size());
+        return false;
+    }
+    uint32_t sequence = local_sequence_ + 1;
+    local_sequence_ += packets.size();
+    if (!SealDatagram(UDP_AUDIO_TYPE_OPUS_BATCH, packets.size(), packets.front().timestamp, sequence,
+            entries.data(), entries.size())) {
+        return false;
+    }
+    return udp_->Send(datagram_) > 0;
+}
+
+size_t UdpAudioChannel::message_overhead() const {
+    return UDP_AUDIO_NONCE_SIZE + UDP_IP_HEADER_SIZE;
+}
+
+void UdpAudioChannel::ParseDatagram(const std::string& data) {
+    /*
+     * UDP Encrypted OPUS Packet Format:
+     * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
+     * |payload payload_len|
+     */
+    if (data.size() < UDP_AUDIO_NONCE_SIZE) {
+        ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
+        return;
+    }
+    if (data[0] != UDP_AUDIO_TYPE_OPUS) {
+        ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
+        return;
+    }
+    auto datagram = (const uint8_t*)data.data();
+    uint32_t timestamp = ntohl(*(const uint32_t*)&datagram[8]);
+    uint32_t sequence = ntohl(*(const uint32_t*)&datagram[12]);
+    // Reordered and missing packets are handled by the jitter buffer
+    if (sequence != remote_sequence_ + 1) {
+        ESP_LOGD(TAG, "Received audio packet with sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+    }
+
+    size_t decrypted_size = data.size() - UDP_AUDIO_NONCE_SIZE;
+    incoming_packet_.sample_rate = server_sample_rate_;
+    incoming_packet_.frame_duration = server_frame_duration_;
+    incoming_packet_.timestamp = timestamp;
+    incoming_packet_.sequence = sequence;
+    incoming_packet_.headroom = 0;
+    incoming_packet_.payload.resize(decrypted_size);
+    if (!CryptAudio(datagram, datagram + UDP_AUDIO_NONCE_SIZE, decrypted_size, incoming_packet_.payload.data())) {
+        ESP_LOGE(TAG, "Failed to decrypt audio data");
+        return;
+    }
+    if (on_incoming_audio_ != nullptr) {
+        on_incoming_audio_(std::move(incoming_packet_));
+    }
+    if ((int32_t)(sequence - remote_sequence_) > 0) {
+        remote_sequence_ = sequence;
+    }
+}
+
+// 辅助函数，将单个十六进制字符转换为对应的数值
+static inline uint8_t CharToHex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return 0;  // 对于无效输入，返回0
+}
+
+std::string UdpAudioChannel::DecodeHexString(const std::string& hex_string) {
+    std::string decoded;
+    decoded.reserve(hex_string.size() / 2);
+    for (size_t i = 0; i + 1 < hex_string.size(); i += 2) {
+        char byte = (CharToHex(hex_string[i]) << 4) | CharToHex(hex_string[i + 1]);
+        decoded.push_back(byte);
+    }
+    return decoded;
+}
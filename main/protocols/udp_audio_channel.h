@@ -0,0 +1,63 @@
+#ifndef UDP_AUDIO_CHANNEL_H
+#define UDP_AUDIO_CHANNEL_H
+
+#include "audio_channel.h"
+
+#include <udp.h>
+#include <cJSON.h>
+#include <mbedtls/aes.h>
+
+#include <mutex>
+#include <string>
+
+// Every UDP audio datagram starts with the AES-CTR nonce, which doubles as the packet header
+#define UDP_AUDIO_NONCE_SIZE 16
+// Datagram type in the first byte of the nonce
+#define UDP_AUDIO_TYPE_OPUS 0x01
+#define UDP_AUDIO_TYPE_OPUS_BATCH 0x02
+// IPv4 and UDP headers, counted in the per-datagram overhead
+#define UDP_IP_HEADER_SIZE 28
+
+/*
+ * AES-CTR encrypted Opus over UDP, as first used by MqttProtocol.
+ * Datagrams carry their own sequence numbers, so loss and reordering end up in the jitter
+ * buffer instead of stalling the stream the way a TCP retransmit does.
+ */
+class UdpAudioChannel : public AudioChannel {
+public:
+    UdpAudioChannel();
+    ~UdpAudioChannel();
+
+    const char* name() const override { return "udp"; }
+    // Takes server, port, key and nonce from the "udp" object of the server hello
+    bool Configure(const cJSON* udp);
+    bool Open() override;
+    void Close() override;
+    bool IsOpened() const override;
+    bool Send(AudioStreamPacket& packet) override;
+    bool SupportsBatch() const override { return true; }
+    // One datagram of type 2 with the frame count in the flags byte. The sequence is the first
+    // frame's, the next datagram continues after the last one.
+    bool SendBatch(std::span<AudioStreamPacket> packets) override;
+    size_t message_overhead() const override;
+
+private:
+    std::mutex mutex_;
+    Udp* udp_ = nullptr;
+    mbedtls_aes_context aes_ctx_;
+    std::string aes_nonce_;
+    std::string server_;
+    int port_ = 0;
+    uint32_t local_sequence_ = 0;
+    uint32_t remote_sequence_ = 0;
+    // Reused outgoing datagram, guarded by mutex_
+    std::string datagram_;
+
+    // Writes the nonce header into datagram_ and encrypts the payload after it, takes mutex_ held
+    bool SealDatagram(uint8_t type, uint8_t flags, uint32_t timestamp, uint32_t sequence, const uint8_t* payload, size_t size);
+    bool CryptAudio(const uint8_t* nonce, const uint8_t* input, size_t size, uint8_t* output);
+    void ParseDatagram(const std::string& data);
+    static std::string DecodeHexString(const std::string& hex_string);
+};
+
+#endif // UDP_AUDIO_CHANNEL_H
@@ -0,0 +1,122 @@
+#include "websocket_audio_channel.h"
+
+#include <esp_log.h>
+#include <arpa/inet.h>
+
+#define TAG "WebsocketAudioChannel"
+
+// Binary message type of a batch of Opus frames
+#define WEBSOCKET_AUDIO_TYPE_BATCH 2
+// Masked client frame header with a 16-bit length, plus a TLS 1.2 AES-GCM record header, explicit nonce and tag
+#define WEBSOCKET_MESSAGE_OVERHEAD (8 + 29)
+
+static_assert(sizeof(BinaryProtocol2) <= AUDIO_PACKET_HEADROOM && sizeof(BinaryProtocol3) <= AUDIO_PACKET_HEADROOM,
+    "Binary protocol headers must fit the packet headroom");
+
+WebsocketAudioChannel::WebsocketAudioChannel(WebSocket* websocket, int version)
+    : websocket_(websocket), version_(version) {
+}
+
+bool WebsocketAudioChannel::Open() {
+    remote_sequence_ = 0;
+    return websocket_->IsConnected();
+}
+
+void WebsocketAudioChannel::Close() {
+    // The websocket belongs to the protocol, it is closed together with the control channel
+}
+
+bool WebsocketAudioChannel::IsOpened() const {
+    return websocket_->IsConnected();
+}
+
+bool WebsocketAudioChannel::Send(AudioStreamPacket& packet) {
+    size_t payload_size = packet.payload.size() - packet.headroom;
+    if (version_ == 2) {
+        auto frame = FrameAudio(packet, sizeof(BinaryProtocol2));
+        auto bp2 = (BinaryProtocol2*)frame.data();
+        bp2->version = htons(version_);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(payload_size);
+        return websocket_->Send(frame.data(), frame.size(), true);
+    } else if (version_ == 3) {
+        auto frame = FrameAudio(packet, sizeof(BinaryProtocol3));
+        auto bp3 = (BinaryProtocol3*)frame.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(payload_size);
+        return websocket_->Send(frame.data(), frame.size(), true);
+    } else {
+        return websocket_->Send(packet.payload.data() + packet.headroom, payload_size, true);
+    }
+}
+
+bool WebsocketAudioChannel::SendBatch(std::span<AudioStreamPacket> packets) {
+    if (version_ == 2) {
+        auto frame = FrameAudioBatch(packets, sizeof(BinaryProtocol2));
+        auto bp2 = (BinaryProtocol2*)frame.data();
+        bp2->version = htons(version_);
+        bp2->type = htons(WEBSOCKET_AUDIO_TYPE_BATCH);
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packets.front().timestamp);
+        bp2->payload_size = htonl(frame.size() - sizeof(BinaryProtocol2));
+        return websocket_->Send(frame.data(), frame.size(), true);
+    } else if (version_ == 3) {
+        auto frame = FrameAudioBatch(packets, sizeof(BinaryProtocol3));
+        if (frame.size() - sizeof(BinaryProtocol3) > UINT16_MAX) {
+            return AudioChannel::SendBatch(packets);
+        }
+        auto bp3 = (BinaryProtocol3*)frame.data();
+        bp3->type = WEBSOCKET_AUDIO_TYPE_BATCH;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(frame.size() - sizeof(BinaryProtocol3));
+        return websocket_->Send(frame.data(), frame.size(), true);
+    }
+    return AudioChannel::SendBatch(packets);
+}
+
+size_t WebsocketAudioChannel::message_overhead() const {
+    if (version_ == 2) {
+        return WEBSOCKET_MESSAGE_OVERHEAD + sizeof(BinaryProtocol2);
+    } else if (version_ == 3) {
+        return WEBSOCKET_MESSAGE_OVERHEAD + sizeof(BinaryProtocol3);
+    }
+    return WEBSOCKET_MESSAGE_OVERHEAD;
+}
+
+// Reads the header in place and hands out the payload in the reused incoming_packet_
+void WebsocketAudioChannel::ParseFrame(const uint8_t* data, size_t len) {
+    uint32_t timestamp = 0;
+    const uint8_t* payload = data;
+    size_t payload_size = len;
+    if (version_ == 2) {
+        auto bp2 = (const BinaryProtocol2*)data;
+        if (len < sizeof(BinaryProtocol2) || ntohl(bp2->payload_size) > len - sizeof(BinaryProtocol2)) {
+            ESP_LOGE(TAG, "Invalid audio frame size: %u", len);
+            return;
+        }
+        timestamp = ntohl(bp2->timestamp);
+        payload = bp2->payload;
+        payload_size = ntohl(bp2->payload_size);
+    } else if (version_ == 3) {
+        auto bp3 = (const BinaryProtocol3*)data;
+        if (len < sizeof(BinaryProtocol3) || ntohs(bp3->payload_size) > len - sizeof(BinaryProtocol3)) {
+            ESP_LOGE(TAG, "Invalid audio frame size: %u", len);
+            return;
+        }
+        payload = bp3->payload;
+        payload_size = ntohs(bp3->payload_size);
+    }
+
+    incoming_packet_.sample_rate = server_sample_rate_;
+    incoming_packet_.frame_duration = server_frame_duration_;
+    incoming_packet_.timestamp = timestamp;
+    incoming_packet_.sequence = ++remote_sequence_;
+    incoming_packet_.headroom = 0;
+    incoming_packet_.payload.assign(payload, payload + payload_size);
+    if (on_incoming_audio_ != nullptr) {
+        on_incoming_audio_(std::move(incoming_packet_));
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef WEBSOCKET_AUDIO_CHANNEL_H
+#define WEBSOCKET_AUDIO_CHANNEL_H
+
+#include "audio_channel.h"
+
+#include <web_socket.h>
+
+/*
+ * Opus in binary websocket frames, framed by the negotiated protocol version:
+ * 1 raw payload, 2 BinaryProtocol2, 3 BinaryProtocol3.
+ * Versions 2 and 3 can carry a batch of frames in one message with type 2.
+ * The websocket is owned by the protocol, which passes binary frames to ParseFrame().
+ */
+class WebsocketAudioChannel : public AudioChannel {
+public:
+    WebsocketAudioChannel(WebSocket* websocket, int version);
+
+    const char* name() const override { return "websocket"; }
+    bool Open() override;
+    void Close() override;
+    bool IsOpened() const override;
+    bool Send(AudioStreamPacket& packet) override;
+    bool SupportsBatch() const override { return version_ == 2 || version_ == 3; }
+    bool SendBatch(std::span<AudioStreamPacket> packets) override;
+    size_t message_overhead() const override;
+
+    void ParseFrame(const uint8_t* data, size_t len);
+
+private:
+    WebSocket* websocket_;
+    int version_;
+    // The websocket delivers frames in order, number them for the jitter buffer
+    uint32_t remote_sequence_ = 0;
+};
+
+#endif // WEBSOCKET_AUDIO_CHANNEL_H
@@ -14,12 +14,30 @@
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    esp_timer_create_args_t keep_warm_timer_args = {
+        .callback = [](void* arg) {
+            auto protocol = (WebsocketProtocol*)arg;
+            // Deleting the websocket joins its receive task, do it on the main loop
+            Application::GetInstance().Schedule([protocol]() {
+                protocol->DropIdleConnection();
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_keep_warm",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&keep_warm_timer_args, &keep_warm_timer_);
+#endif
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
-    }
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    esp_timer_stop(keep_warm_timer_);
+    esp_timer_delete(keep_warm_timer_);
+#endif
+    DestroyConnection();
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -28,67 +46,114 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(const AudioStreamPacket& packet) {
-    if (websocket_ == nullptr) {
+bool WebsocketProtocol::SendAudio(AudioStreamPacket& packet) {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    if (websocket_ == nullptr || audio_channel_ == nullptr) {
         return false;
     }
-
-    if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet.payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
-        bp2->version = htons(version_);
-        bp2->type = 0;
-        bp2->reserved = 0;
-        bp2->timestamp = htonl(packet.timestamp);
-        bp2->payload_size = htonl(packet.payload.size());
-        memcpy(bp2->payload, packet.payload.data(), packet.payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet.payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
-        bp3->type = 0;
-        bp3->reserved = 0;
-        bp3->payload_size = htons(packet.payload.size());
-        memcpy(bp3->payload, packet.payload.data(), packet.payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else {
-        return websocket_->Send(packet.payload.data(), packet.payload.size(), true);
-    }
+    return audio_channel_->Send(packet);
 }
 
-bool WebsocketProtocol::SendText(const std::string& text) {
-    if (websocket_ == nullptr) {
+bool WebsocketProtocol::SendAudioBatch(std::span<AudioStreamPacket> packets) {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    if (websocket_ == nullptr || audio_channel_ == nullptr) {
         return false;
     }
+    return audio_channel_->SendBatch(packets);
+}
 
-    if (!websocket_->Send(text)) {
-        ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
-        SetError(Lang::Strings::SERVER_ERROR);
-        return false;
+size_t WebsocketProtocol::audio_message_overhead() const {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    return audio_channel_ != nullptr ? audio_channel_->message_overhead() : 0;
+}
+
+bool WebsocketProtocol::SendText(const std::string& text) {
+    {
+        std::lock_guard<std::mutex> lock(websocket_mutex_);
+        if (websocket_ == nullptr) {
+            return false;
+        }
+        if (websocket_->Send(text)) {
+            return true;
+        }
     }
 
-    return true;
+    // The error callback may close the channel, which needs the lock
+    ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
+    SetError(Lang::Strings::SERVER_ERROR);
+    return false;
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    return channel_opened_ && websocket_ != nullptr && websocket_->IsConnected() && audio_channel_ != nullptr &&
+        audio_channel_->IsOpened() && !error_occurred_ && !IsTimeout();
 }
 
-void WebsocketProtocol::CloseAudioChannel() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
+// Unpublishes the connection under the lock and deletes it outside, the websocket goes first
+// because its receive task still feeds the websocket channel until it is joined
+void WebsocketProtocol::DestroyConnection() {
+    WebSocket* websocket;
+    std::unique_ptr<WebsocketAudioChannel> websocket_channel;
+    std::unique_ptr<UdpAudioChannel> udp_channel;
+    {
+        std::lock_guard<std::mutex> lock(websocket_mutex_);
+        websocket = websocket_;
         websocket_ = nullptr;
+        audio_channel_ = nullptr;
+        websocket_channel = std::move(websocket_channel_);
+        udp_channel = std::move(udp_channel_);
     }
+    delete websocket;
 }
 
-bool WebsocketProtocol::OpenAudioChannel() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
+void WebsocketProtocol::CloseAudioChannel() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    bool was_opened = channel_opened_.exchange(false);
+    if (was_opened) {
+        session_closed_time_ = esp_timer_get_time();
+    }
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    if (IsConnectionWarm()) {
+        // End the session but keep the connection, the next wake word only needs a hello
+        {
+            std::lock_guard<std::mutex> send_lock(send_mutex_);
+            JsonWriter json(send_buffer_);
+            json.BeginObject().Key("session_id").String(session_id_).Key("type").String("goodbye").EndObject();
+            SendText(send_buffer_);
+        }
+        std::unique_ptr<UdpAudioChannel> udp_channel;
+        {
+            std::lock_guard<std::mutex> channel_lock(websocket_mutex_);
+            udp_channel = std::move(udp_channel_);
+            audio_channel_ = websocket_channel_.get();
+        }
+        if (udp_channel != nullptr) {
+            udp_channel->Close();
+        }
+        KeepWarm();
+        if (was_opened && on_audio_channel_closed_ != nullptr) {
+            on_audio_channel_closed_();
+        }
+        return;
     }
+#endif
+    health_.OnClosed();
+    DestroyConnection();
+    if (was_opened && on_audio_channel_closed_ != nullptr) {
+        on_audio_channel_closed_();
+    }
+}
+
+bool WebsocketProtocol::IsConnectionWarm() const {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_;
+}
+
+// Creates the websocket and does the TCP/TLS and upgrade handshakes, errors are left to the caller.
+// The new connection is only published once it is up.
+bool WebsocketProtocol::Connect() {
+    DestroyConnection();
 
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
@@ -100,103 +165,125 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     error_occurred_ = false;
 
-    websocket_ = Board::GetInstance().CreateWebSocket();
+    auto websocket = Board::GetInstance().CreateWebSocket();
+    // Audio stays on the websocket unless the server hello picks another media transport
+    auto websocket_channel = std::make_unique<WebsocketAudioChannel>(websocket, version_);
     
     if (!token.empty()) {
         // If token not has a space, add "Bearer " prefix
         if (token.find(" ") == std::string::npos) {
             token = "Bearer " + token;
         }
-        websocket_->SetHeader("Authorization", token.c_str());
+        websocket->SetHeader("Authorization", token.c_str());
     }
-    websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    websocket->SetHeader("Protocol-Version", std::to_string(version_).c_str());
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+    // The channel is deleted after the websocket, so it outlives the receive task
+    websocket->OnData([this, channel = websocket_channel.get()](const char* data, size_t len, bool binary) {
+        // Before dispatching, the server hello wakes OpenAudioChannel which checks for a timeout
+        last_incoming_time_ = std::chrono::steady_clock::now();
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    });
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    });
-                } else {
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    });
-                }
-            }
+            channel->ParseFrame((const uint8_t*)data, len);
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
-                    ParseServerHello(root);
-                } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
-                }
-            } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
+            // Only the routing fields are scanned here, handlers parse what they need
+            JsonMessage message(data, len);
+            if (message.type().empty()) {
+                ESP_LOGE(TAG, "Missing message type, data: %.*s", (int)len, data);
+            } else if (message.type() == "hello") {
+                ParseServerHello(message.root());
+            } else if (on_incoming_json_ != nullptr) {
+                on_incoming_json_(message);
             }
-            cJSON_Delete(root);
         }
-        last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    websocket->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
-        if (on_audio_channel_closed_ != nullptr) {
-            on_audio_channel_closed_();
+        health_.OnDisconnected();
+        // An idle warm connection going away is not a closed channel
+        if (channel_opened_.exchange(false)) {
+            session_closed_time_ = esp_timer_get_time();
+            if (on_audio_channel_closed_ != nullptr) {
+                on_audio_channel_closed_();
+            }
         }
     });
 
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
+    auto start_time = esp_timer_get_time();
+    if (!websocket->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server");
+        delete websocket;
+        return false;
+    }
+    ESP_LOGI(TAG, "Connected in %ld ms", (long)((esp_timer_get_time() - start_time) / 1000));
+
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    websocket_ = websocket;
+    websocket_channel_ = std::move(websocket_channel);
+    return true;
+}
+
+bool WebsocketProtocol::OpenAudioChannel() {
+    // Waits for a pre-connect that is still in progress and then uses its connection
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    auto start_time = esp_timer_get_time();
+    auto elapsed_ms = [start_time]() {
+        return (long)((esp_timer_get_time() - start_time) / 1000);
+    };
+
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    esp_timer_stop(keep_warm_timer_);
+    keep_warm_until_ = 0;
+    bool warm = IsConnectionWarm();
+#else
+    bool warm = false;
+#endif
+    health_.OnConnecting();
+    if (!warm && !Connect()) {
+        ESP_LOGE(TAG, "Failed to open audio channel after %ld ms", elapsed_ms());
+        health_.OnFailure();
         SetError(Lang::Strings::SERVER_NOT_CONNECTED);
         return false;
     }
 
     // Send hello message to describe the client
     auto message = GetHelloMessage();
+    auto hello_time = esp_timer_get_time();
     if (!SendText(message)) {
+        health_.OnFailure();
         return false;
     }
 
     // Wait for server hello
     EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
     if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
-        ESP_LOGE(TAG, "Failed to receive server hello");
+        ESP_LOGE(TAG, "Failed to receive server hello after %ld ms", elapsed_ms());
+        health_.OnFailure();
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
+    health_.OnConnected();
+    health_.OnRttSample((esp_timer_get_time() - hello_time) / 1000);
 
+    bool opened;
+    {
+        std::lock_guard<std::mutex> channel_lock(websocket_mutex_);
+        opened = audio_channel_ != nullptr && audio_channel_->Open();
+        if (!opened) {
+            ESP_LOGE(TAG, "Failed to open %s audio channel", audio_channel_ != nullptr ? audio_channel_->name() : "no");
+        }
+    }
+    if (!opened) {
+        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        return false;
+    }
+
+    channel_opened_ = true;
+    ESP_LOGI(TAG, "Audio channel opened in %ld ms, %s connection%s", elapsed_ms(), warm ? "warm" : "new",
+        session_resumed_ ? ", session resumed" : "");
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -204,30 +291,103 @@ bool WebsocketProtocol::OpenAudioChannel() {
     return true;
 }
 
+#if CONFIG_WEBSOCKET_KEEP_WARM
+void WebsocketProtocol::PrepareAudioChannel() {
+    if (channel_opened_ || warming_up_.exchange(true)) {
+        return;
+    }
+    // Connecting blocks for the whole TLS handshake, keep it off the caller's task
+    auto ret = xTaskCreate([](void* arg) {
+        auto protocol = (WebsocketProtocol*)arg;
+        protocol->WarmUp();
+        protocol->warming_up_ = false;
+        vTaskDelete(NULL);
+    }, "ws_warm_up", 4096 * 2, this, 2, nullptr);
+    if (ret != pdPASS) {
+        warming_up_ = false;
+    }
+}
+
+void WebsocketProtocol::WarmUp() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    if (channel_opened_ || IsConnectionWarm()) {
+        return;
+    }
+    ESP_LOGI(TAG, "Voice activity, pre-connecting");
+    // A failed guess stays quiet, OpenAudioChannel reports its own errors
+    if (Connect()) {
+        KeepWarm();
+    }
+}
+
+void WebsocketProtocol::KeepWarm() {
+    esp_timer_stop(keep_warm_timer_);
+    keep_warm_until_ = esp_timer_get_time() + CONFIG_WEBSOCKET_KEEP_WARM_SECONDS * 1000000LL;
+    esp_timer_start_once(keep_warm_timer_, CONFIG_WEBSOCKET_KEEP_WARM_SECONDS * 1000000LL);
+}
+
+// Only a warm connection that went away before its window ended is brought back. Once the
+// window is over the connection is dropped anyway, the next wake word connects again.
+bool WebsocketProtocol::NeedsReconnect() const {
+    return !channel_opened_ && esp_timer_get_time() < keep_warm_until_ && !IsConnectionWarm();
+}
+
+// The keep-warm timer keeps running, so a reconnected connection is still closed when the
+// original window ends
+bool WebsocketProtocol::Reconnect() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    if (!NeedsReconnect()) {
+        return true;
+    }
+    ESP_LOGI(TAG, "Warm connection lost, reconnecting");
+    health_.OnConnecting();
+    if (!Connect()) {
+        health_.OnFailure();
+        return false;
+    }
+    health_.OnConnected();
+    return true;
+}
+
+void WebsocketProtocol::DropIdleConnection() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    if (channel_opened_ || websocket_ == nullptr) {
+        return;
+    }
+    ESP_LOGI(TAG, "Closing idle connection");
+    keep_warm_until_ = 0;
+    health_.OnClosed();
+    DestroyConnection();
+}
+#endif
+
 std::string WebsocketProtocol::GetHelloMessage() {
     // keys: message type, version, audio_params (format, sample_rate, channels)
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", version_);
-    cJSON* features = cJSON_CreateObject();
+    std::string message;
+    JsonWriter json(message);
+    json.BeginObject().Key("type").String("hello").Key("version").Int(version_);
+    json.Key("features").BeginObject();
 #if CONFIG_USE_SERVER_AEC
-    cJSON_AddBoolToObject(features, "aec", true);
+    json.Key("aec").Bool(true);
 #endif
 #if CONFIG_IOT_PROTOCOL_MCP
-    cJSON_AddBoolToObject(features, "mcp", true);
+    json.Key("mcp").Bool(true);
+#endif
+    json.EndObject();
+    json.Key("transport").String("websocket");
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    // A session that ended moments ago can be picked up again by the server
+    if (!session_id_.empty() &&
+        esp_timer_get_time() - session_closed_time_ < CONFIG_WEBSOCKET_KEEP_WARM_SECONDS * 1000000LL) {
+        json.Key("resume_session_id").String(session_id_);
+    }
 #endif
-    cJSON_AddItemToObject(root, "features", features);
-    cJSON_AddStringToObject(root, "transport", "websocket");
-    cJSON* audio_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(audio_params, "format", "opus");
-    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
-    cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
-    cJSON_AddItemToObject(root, "audio_params", audio_params);
-    auto json_str = cJSON_PrintUnformatted(root);
-    std::string message(json_str);
-    cJSON_free(json_str);
-    cJSON_Delete(root);
+    // Media transports the server may pick for audio, the websocket itself is always possible
+    json.Key("media_transports").BeginArray().String("websocket").String("udp").EndArray();
+    json.Key("audio_params").BeginObject().Key("format").String("opus").Key("sample_rate").Int(16000).Key("channels").Int(1);
+    AddUplinkAudioParams(json);
+    json.EndObject();
+    json.EndObject();
     return message;
 }
 
@@ -239,7 +399,9 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
     }
 
     auto session_id = cJSON_GetObjectItem(root, "session_id");
+    session_resumed_ = false;
     if (cJSON_IsString(session_id)) {
+        session_resumed_ = session_id_ == session_id->valuestring;
         session_id_ = session_id->valuestring;
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
@@ -256,5 +418,33 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         }
     }
 
+    // The UDP socket is set up before taking the lock, senders only wait for the swap
+    std::unique_ptr<UdpAudioChannel> udp_channel;
+    auto media_transport = cJSON_GetObjectItem(root, "media_transport");
+    if (cJSON_IsString(media_transport) && strcmp(media_transport->valuestring, "udp") == 0) {
+        udp_channel = std::make_unique<UdpAudioChannel>();
+        if (udp_channel->Configure(cJSON_GetObjectItem(root, "udp"))) {
+            BindAudioChannel(*udp_channel);
+        } else {
+            ESP_LOGW(TAG, "Invalid UDP media parameters, audio stays on the websocket");
+            udp_channel.reset();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(websocket_mutex_);
+        if (websocket_channel_ == nullptr) {
+            // The connection is being torn down
+            return;
+        }
+        // Downlink frames on the websocket are accepted whichever transport carries the uplink
+        BindAudioChannel(*websocket_channel_);
+        // A channel from an earlier hello on this connection is freed after the lock is released
+        std::swap(udp_channel_, udp_channel);
+        audio_channel_ = udp_channel_ != nullptr ? (AudioChannel*)udp_channel_.get() : websocket_channel_.get();
+        NegotiateAudioBatch(audio_params, *audio_channel_);
+        ESP_LOGI(TAG, "Media transport: %s", audio_channel_->name());
+    }
+
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
@@ -3,10 +3,17 @@
 
 
 #include "protocol.h"
+#include "websocket_audio_channel.h"
+#include "udp_audio_channel.h"
 
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
@@ -16,17 +23,51 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(const AudioStreamPacket& packet) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
+    bool SendAudioBatch(std::span<AudioStreamPacket> packets) override;
+    size_t audio_message_overhead() const override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    void PrepareAudioChannel() override;
+    bool NeedsReconnect() const override;
+    bool Reconnect() override;
+#endif
 
 private:
     EventGroupHandle_t event_group_handle_;
+    // The connection and its channels are replaced under both mutexes. The send paths and the
+    // status checks only take websocket_mutex_, it is never held while a websocket is deleted,
+    // since that joins the receive task which takes it too.
     WebSocket* websocket_ = nullptr;
     int version_ = 1;
+    std::unique_ptr<WebsocketAudioChannel> websocket_channel_;
+    std::unique_ptr<UdpAudioChannel> udp_channel_;
+    // Media channel negotiated in the server hello, one of the two above
+    AudioChannel* audio_channel_ = nullptr;
+    mutable std::mutex websocket_mutex_;
+    // Held while connecting, so OpenAudioChannel picks up a pre-connect that is still running
+    std::mutex connect_mutex_;
+    std::atomic<bool> channel_opened_ = false;
+    bool session_resumed_ = false;
+    int64_t session_closed_time_ = 0;
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    std::atomic<bool> warming_up_ = false;
+    // End of the keep-warm window, a connection lost before then is reconnected by the supervisor
+    std::atomic<int64_t> keep_warm_until_ = 0;
+    // Closes the connection once it has been idle for CONFIG_WEBSOCKET_KEEP_WARM_SECONDS
+    esp_timer_handle_t keep_warm_timer_ = nullptr;
+
+    void WarmUp();
+    void KeepWarm();
+    void DropIdleConnection();
+#endif
 
+    bool Connect();
+    bool IsConnectionWarm() const;
     void ParseServerHello(const cJSON* root);
+    void DestroyConnection();
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
 };
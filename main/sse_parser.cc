@@ -0,0 +1,105 @@
+#include "sse_parser.h"
+
+#include <cstring>
+
+void SseParser::OnEvent(EventCallback callback) {
+    on_event_ = std::move(callback);
+}
+
+void SseParser::Feed(const char* data, size_t length) {
+    const char* end = data + length;
+    if (skip_line_feed_ && data < end && *data == '\n') {
+        data++;
+    }
+    skip_line_feed_ = false;
+
+    while (data < end) {
+        // Lines end with "\r\n", "\n" or "\r"
+        auto line_end = (const char*)memchr(data, '\n', end - data);
+        auto cr = (const char*)memchr(data, '\r', (line_end ? line_end : end) - data);
+        if (cr != nullptr) {
+            line_end = cr;
+        }
+        if (line_end == nullptr) {
+            line_.append(data, end - data);
+            return;
+        }
+
+        // Complete lines are parsed in place, only a line split across chunks is copied
+        if (line_.empty()) {
+            ProcessLine(std::string_view(data, line_end - data));
+        } else {
+            line_.append(data, line_end - data);
+            ProcessLine(line_);
+            line_.clear();
+        }
+
+        data = line_end + 1;
+        if (*line_end == '\r') {
+            if (data == end) {
+                skip_line_feed_ = true;
+            } else if (*data == '\n') {
+                data++;
+            }
+        }
+    }
+}
+
+void SseParser::Finish() {
+    if (!line_.empty()) {
+        ProcessLine(line_);
+        line_.clear();
+    }
+    Dispatch();
+    skip_line_feed_ = false;
+}
+
+void SseParser::Reset() {
+    line_.clear();
+    event_.clear();
+    data_.clear();
+    has_data_ = false;
+    skip_line_feed_ = false;
+}
+
+void SseParser::ProcessLine(std::string_view line) {
+    if (line.empty()) {
+        Dispatch();
+        return;
+    }
+    if (line[0] == ':') {
+        return;
+    }
+
+    std::string_view field = line;
+    std::string_view value;
+    auto colon = line.find(':');
+    if (colon != std::string_view::npos) {
+        field = line.substr(0, colon);
+        value = line.substr(colon + 1);
+        if (!value.empty() && value[0] == ' ') {
+            value.remove_prefix(1);
+        }
+    }
+
+    if (field == "data") {
+        if (has_data_) {
+            data_.push_back('\n');
+        }
+        data_.append(value);
+        has_data_ = true;
+    } else if (field == "event") {
+        event_.assign(value);
+    }
+}
+
+void SseParser::Dispatch() {
+    // An event without data lines is dropped, as browsers do
+    if (has_data_ && on_event_) {
+        on_event_(event_, data_);
+    }
+    // The buffers keep their capacity for the next event
+    event_.clear();
+    data_.clear();
+    has_data_ = false;
+}
@@ -0,0 +1,40 @@
+#ifndef SSE_PARSER_H
+#define SSE_PARSER_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+/*
+ * Incremental parser for a text/event-stream body (server-sent events).
+ *
+ * Feed() takes the body in chunks of any size, as they come off the socket. An event is
+ * dispatched when the blank line that ends it arrives, with its "event" field (empty if
+ * there was none) and its "data" lines joined by '\n'. Only the event being parsed is
+ * buffered, never the whole body. Comments, "id" and "retry" fields are ignored.
+ */
+class SseParser {
+public:
+    using EventCallback = std::function<void(std::string_view event, std::string_view data)>;
+
+    void OnEvent(EventCallback callback);
+    void Feed(const char* data, size_t length);
+    // Dispatches an event the stream ended without a blank line after
+    void Finish();
+    void Reset();
+
+private:
+    EventCallback on_event_;
+    // Part of a line split across chunks
+    std::string line_;
+    std::string event_;
+    std::string data_;
+    bool has_data_ = false;
+    // A '\r' ended the previous chunk, a '\n' starting the next one belongs to the same line break
+    bool skip_line_feed_ = false;
+
+    void ProcessLine(std::string_view line);
+    void Dispatch();
+};
+
+#endif // SSE_PARSER_H
@@ -0,0 +1,137 @@
+#include "uplink_rate_controller.h"
+
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "UplinkRateController"
+
+UplinkRateController::UplinkRateController(int frame_duration) : default_frame_duration_(frame_duration) {
+    params_.frame_duration = frame_duration;
+    params_.bitrate = 0;
+}
+
+void UplinkRateController::OnSendResult(bool success, int64_t send_time_us) {
+    if (success) {
+        sent_++;
+    } else {
+        failures_++;
+    }
+    send_time_us_ += send_time_us;
+}
+
+void UplinkRateController::OnQueueDepth(size_t depth) {
+    max_queue_depth_ = std::max(max_queue_depth_, depth);
+}
+
+void UplinkRateController::OnEncoderDrop(int count) {
+    drops_.fetch_add(count, std::memory_order_relaxed);
+}
+
+void UplinkRateController::OnBatchSent(size_t frames, int saved_bytes) {
+    batches_++;
+    batched_frames_ += frames;
+    saved_bytes_ += saved_bytes;
+}
+
+size_t UplinkRateController::NextBatchSize(size_t queue_depth, int max_frames, int rtt_ms, bool can_hold) {
+    if (queue_depth == 0) {
+        holding_ = false;
+        return 0;
+    }
+    if (max_frames <= 1) {
+        return 1;
+    }
+    if (queue_depth >= 2) {
+        holding_ = false;
+        return std::min(queue_depth, (size_t)max_frames);
+    }
+#if CONFIG_UPLINK_AUDIO_BATCHING
+    // An idle link sends every frame at once, holding back only pays off when each message is expensive
+    bool slow_link = congested_ || (CONFIG_UPLINK_AUDIO_BATCH_RTT_MS > 0 && rtt_ms >= CONFIG_UPLINK_AUDIO_BATCH_RTT_MS);
+    if (can_hold && !holding_ && slow_link) {
+        holding_ = true;
+        return 0;
+    }
+#endif
+    holding_ = false;
+    return 1;
+}
+
+void UplinkRateController::ResetWindow(int64_t now_us) {
+    window_start_us_ = now_us;
+    sent_ = 0;
+    failures_ = 0;
+    send_time_us_ = 0;
+    max_queue_depth_ = 0;
+    batches_ = 0;
+    batched_frames_ = 0;
+    saved_bytes_ = 0;
+}
+
+bool UplinkRateController::Update(int64_t now_us) {
+    if (window_start_us_ == 0) {
+        ResetWindow(now_us);
+        return false;
+    }
+    if (now_us - window_start_us_ < UPLINK_RATE_WINDOW_MS * 1000) {
+        return false;
+    }
+
+    int drops = drops_.exchange(0, std::memory_order_relaxed);
+    int attempts = sent_ + failures_ + drops;
+    if (attempts == 0) {
+        ResetWindow(now_us);
+        return false;
+    }
+
+    int loss_perc = (failures_ + drops) * 100 / attempts;
+    int send_ms = sent_ + failures_ > 0 ? (int)(send_time_us_ / (sent_ + failures_) / 1000) : 0;
+    bool congested = loss_perc >= 2 || send_ms > params_.frame_duration / 2 || max_queue_depth_ > UPLINK_QUEUE_DEPTH_THRESHOLD;
+
+    // Follow loss up immediately, decay slowly so FEC stays on through bursty periods
+    loss_estimate_ = loss_perc > loss_estimate_ ? loss_perc : (loss_estimate_ * 3 + loss_perc) / 4;
+
+    UplinkAudioParams next = params_;
+#if CONFIG_UPLINK_RATE_CONTROL
+    int bitrate = params_.bitrate > 0 ? params_.bitrate : UPLINK_BITRATE_BASELINE;
+    if (congested) {
+        clean_windows_ = 0;
+#if CONFIG_UPLINK_ADAPTIVE_FRAME_DURATION
+        if (params_.bitrate == UPLINK_BITRATE_MIN) {
+            // Longer frames halve the per-packet overhead once the bitrate cannot go lower
+            next.frame_duration = UPLINK_CONGESTED_FRAME_DURATION_MS;
+        }
+#endif
+        next.bitrate = std::max(UPLINK_BITRATE_MIN, bitrate * 3 / 4);
+    } else if (++clean_windows_ >= UPLINK_RATE_RECOVER_WINDOWS) {
+        clean_windows_ = 0;
+        if (params_.frame_duration != default_frame_duration_) {
+            next.frame_duration = default_frame_duration_;
+        } else if (params_.bitrate > 0) {
+            // Hand the choice back to the encoder once the cut has been recovered
+            next.bitrate = bitrate + UPLINK_BITRATE_STEP >= UPLINK_BITRATE_BASELINE ? 0 : bitrate + UPLINK_BITRATE_STEP;
+        }
+    }
+    next.packet_loss = std::min(loss_estimate_, 30);
+    next.fec = next.packet_loss > 0;
+#endif
+
+    if (congested) {
+        ESP_LOGW(TAG, "Congested: loss %d%%, send %d ms, queue %u", loss_perc, send_ms, (unsigned)max_queue_depth_);
+    }
+    if (batches_ > 0) {
+        ESP_LOGI(TAG, "Batched %d frames in %d messages, %d bytes of overhead saved",
+            batched_frames_, batches_, saved_bytes_);
+    }
+    congested_ = congested;
+    ResetWindow(now_us);
+
+    if (next.bitrate == params_.bitrate && next.fec == params_.fec && next.packet_loss == params_.packet_loss &&
+        next.frame_duration == params_.frame_duration) {
+        return false;
+    }
+    params_ = next;
+    ESP_LOGI(TAG, "Uplink: bitrate %d, fec %d, packet loss %d%%, frame %d ms",
+        params_.bitrate, params_.fec, params_.packet_loss, params_.frame_duration);
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef UPLINK_RATE_CONTROLLER_H
+#define UPLINK_RATE_CONTROLLER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+#define UPLINK_BITRATE_MIN 8000
+// About what OPUS_AUTO picks for 16 kHz mono 60 ms frames, the first cut starts from here
+#define UPLINK_BITRATE_BASELINE 16000
+#define UPLINK_BITRATE_STEP 2000
+// Network feedback is evaluated once per window
+#define UPLINK_RATE_WINDOW_MS 2000
+// Clean windows needed before stepping the bitrate back up
+#define UPLINK_RATE_RECOVER_WINDOWS 3
+// Packets waiting in the send queue that indicate the link cannot keep up
+#define UPLINK_QUEUE_DEPTH_THRESHOLD 3
+// Frame duration used when the bitrate floor is reached and the link is still congested
+#define UPLINK_CONGESTED_FRAME_DURATION_MS 120
+
+/*
+ * Picks the uplink Opus parameters from network feedback: send failures, packets dropped
+ * because the send queue was full, time spent in SendAudio, and send queue depth.
+ * Until the first congested window the encoder keeps its baseline settings (bitrate 0 means
+ * OPUS_AUTO). Congestion cuts the bitrate by a quarter and raises the expected loss so the
+ * encoder adds in-band FEC, clean windows step the bitrate back up until it is back at the
+ * baseline (AIMD). With CONFIG_UPLINK_RATE_CONTROL off the parameters never change.
+ *
+ * With batching negotiated it also decides how many frames go into each uplink message:
+ * everything queued when the queue has backed up, and on congested or high-RTT links a lone
+ * frame is held back for at most one frame duration so it can share a message with the next.
+ *
+ * OnEncoderDrop() may be called from any task, everything else from the main event loop.
+ */
+class UplinkRateController {
+public:
+    UplinkRateController(int frame_duration);
+
+    void OnSendResult(bool success, int64_t send_time_us);
+    void OnQueueDepth(size_t depth);
+    void OnEncoderDrop(int count = 1);
+    // saved_bytes: per-message overhead avoided by not sending the frames one by one
+    void OnBatchSent(size_t frames, int saved_bytes);
+
+    // Frames to pack into the next uplink message, 0 when a single queued frame is held back.
+    // can_hold is false when the frame must leave now, e.g. before a control message.
+    size_t NextBatchSize(size_t queue_depth, int max_frames, int rtt_ms, bool can_hold);
+    inline bool holding() const { return holding_; }
+
+    // Evaluates the current window, returns true when params() changed
+    bool Update(int64_t now_us);
+    inline const UplinkAudioParams& params() const { return params_; }
+
+private:
+    UplinkAudioParams params_;
+    int default_frame_duration_;
+    int64_t window_start_us_ = 0;
+    int sent_ = 0;
+    int failures_ = 0;
+    int64_t send_time_us_ = 0;
+    size_t max_queue_depth_ = 0;
+    std::atomic<int> drops_{0};
+    int clean_windows_ = 0;
+    int loss_estimate_ = 0;
+    bool congested_ = false;
+    bool holding_ = false;
+    int batches_ = 0;
+    int batched_frames_ = 0;
+    int saved_bytes_ = 0;
+
+    void ResetWindow(int64_t now_us);
+};
+
+#endif // UPLINK_RATE_CONTROLLER_H
@@ -2,11 +2,15 @@ import socket
 import wave
 import argparse
 
+# Must match AUDIO_DEBUGGER_TRACE_MAGIC in audio_debugger.h
+TRACE_MAGIC = b"TRACE\n"
+
 
 '''
   Create a UDP socket and bind it to the server's IP:8000.
   Listen for incoming messages and print them to the console.
   Save the audio to a WAV file.
+  Latency trace datagrams (prefixed with TRACE) are appended to trace.log instead.
 '''
 def main(samplerate, channels):
     # Create a UDP socket
@@ -20,12 +24,19 @@ def main(samplerate, channels):
     wav_file.setsampwidth(2)            # 2 bytes per sample (16-bit)
     wav_file.setframerate(samplerate)   # samplerate parameter
 
+    trace_file = open("trace.log", "a")
+
     print(f"Start saving audio from 0.0.0.0:8000 to {filename}...")
 
     try:
         while True:
             # Receive a message from the client
             message, address = server_socket.recvfrom(8000)
+
+            if message.startswith(TRACE_MAGIC):
+                trace_file.write(message[len(TRACE_MAGIC):].decode(errors="ignore"))
+                trace_file.flush()
+                continue
             
             # Write PCM data to WAV file
             wav_file.writeframes(message)
@@ -39,6 +50,7 @@ def main(samplerate, channels):
     finally:
         # Close files and socket
         wav_file.close()
+        trace_file.close()
         server_socket.close()
         print(f"WAV file '{filename}' saved successfully")
 
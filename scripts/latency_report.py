@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Per-turn latency report for traces dumped by the firmware (CONFIG_USE_LATENCY_TRACE)
+
+Input is any mix of serial monitor logs and trace files saved by audio_debug_server.py,
+the trace events are picked out line by line. Each turn starts at the VAD speech end and
+ends at the first PCM written to the codec. Text requests to the streaming chat adapters
+(Google, Anthropic) are turns of their own, from the request to the first token.
+
+  python latency_report.py monitor.log
+  python latency_report.py monitor.log --chrome trace.json   # open in chrome://tracing or Perfetto
+  python latency_report.py new.log --save new.json --compare release_1.6.json
+"""
+
+import argparse
+import json
+import re
+import sys
+
+EVENT_PATTERN = re.compile(r'\{"name":"[a-z_]+".*?\}\}')
+
+# (stage name, from event, to event)
+STAGES = [
+    ("vad_end -> uplink_flushed", "vad_speech_end", "uplink_flushed"),
+    ("vad_end -> stt", "vad_speech_end", "stt"),
+    ("stt -> tts_start", "stt", "tts_start"),
+    ("tts_start -> first_audio", "tts_start", "first_audio"),
+    ("vad_end -> first_audio", "vad_speech_end", "first_audio"),
+    ("llm_request -> first_token", "llm_request", "llm_first_token"),
+]
+
+
+def load_events(paths):
+    events = []
+    for path in paths:
+        with open(path, "r", errors="ignore") as f:
+            for line in f:
+                for match in EVENT_PATTERN.finditer(line):
+                    try:
+                        events.append(json.loads(match.group(0)))
+                    except json.JSONDecodeError:
+                        pass
+    return events
+
+
+def split_turns(events):
+    """Group events into turns, each turn maps event name to its first timestamp (us)"""
+    turns = []
+    current = None
+    last_ts = None
+    for event in events:
+        name, ts = event["name"], event["ts"]
+        # Timestamps restart after a reboot
+        if last_ts is not None and ts < last_ts:
+            current = None
+        last_ts = ts
+
+        if name == "vad_speech_end" or (name == "llm_request" and current is None):
+            current = {name: ts}
+            turns.append(current)
+        elif current is not None and name not in current:
+            current[name] = ts
+            if name == "first_audio" or (name == "llm_first_token" and "vad_speech_end" not in current):
+                current = None
+    return turns
+
+
+def percentile(values, p):
+    values = sorted(values)
+    index = min(len(values) - 1, max(0, int(round(p / 100.0 * (len(values) - 1)))))
+    return values[index]
+
+
+def summarize(turns):
+    summary = {}
+    for stage, start, end in STAGES:
+        values = [(t[end] - t[start]) / 1000.0 for t in turns if start in t and end in t and t[end] >= t[start]]
+        if not values:
+            continue
+        summary[stage] = {
+            "count": len(values),
+            "p50": percentile(values, 50),
+            "p90": percentile(values, 90),
+            "p99": percentile(values, 99),
+            "max": max(values),
+        }
+    return summary
+
+
+def print_summary(summary, baseline=None):
+    header = f"{'stage':<28}{'count':>7}{'p50 ms':>10}{'p90 ms':>10}{'p99 ms':>10}{'max ms':>10}"
+    if baseline:
+        header += f"{'p50 delta':>12}{'p90 delta':>12}"
+    print(header)
+    for stage, _, _ in STAGES:
+        if stage not in summary:
+            continue
+        s = summary[stage]
+        line = f"{stage:<28}{s['count']:>7}{s['p50']:>10.1f}{s['p90']:>10.1f}{s['p99']:>10.1f}{s['max']:>10.1f}"
+        if baseline and stage in baseline:
+            line += f"{s['p50'] - baseline[stage]['p50']:>+12.1f}{s['p90'] - baseline[stage]['p90']:>+12.1f}"
+        print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Per-turn voice latency percentiles from firmware traces")
+    parser.add_argument("inputs", nargs="+", help="Serial logs or trace files")
+    parser.add_argument("--chrome", help="Write all events as a Chrome trace JSON file")
+    parser.add_argument("--save", help="Save the summary as JSON, to compare against later releases")
+    parser.add_argument("--compare", help="Baseline summary saved with --save")
+    args = parser.parse_args()
+
+    events = load_events(args.inputs)
+    if not events:
+        print("No trace events found", file=sys.stderr)
+        return 1
+
+    if args.chrome:
+        with open(args.chrome, "w") as f:
+            json.dump(events, f)
+
+    turns = split_turns(events)
+    summary = summarize(turns)
+    print(f"{len(events)} events, {len(turns)} turns")
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    print_summary(summary, baseline)
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(summary, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
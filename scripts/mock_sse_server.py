@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""
+Mock server for the streaming chat adapters, answers in server-sent events like the real APIs
+
+  Google     POST <base_url>/<model>:streamGenerateContent?alt=sse&key=...
+  Anthropic  POST <base_url> with "stream": true
+
+The answer is --reply split into words, sent as one event per word after --first-token-ms and
+then every --token-ms, so the device's time to first token and the incremental display can be
+checked. Events go out in HTTP/1.1 chunks of random size that do not line up with event or line
+boundaries, which is what the parser sees behind a proxy. --status makes every request fail.
+
+  python mock_sse_server.py --port 8080 --first-token-ms 400
+  # Google:    base_url http://<host>:8080/v1beta/models
+  # Anthropic: base_url http://<host>:8080/v1/messages
+"""
+
+import argparse
+import json
+import random
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+def google_events(words):
+    for word in words:
+        chunk = {"candidates": [{"content": {"role": "model", "parts": [{"text": word}]}, "index": 0}]}
+        yield f"data: {json.dumps(chunk, ensure_ascii=False)}\r\n\r\n"
+    done = {"candidates": [{"content": {"role": "model", "parts": [{"text": ""}]}, "finishReason": "STOP", "index": 0}]}
+    yield f"data: {json.dumps(done)}\r\n\r\n"
+
+
+def anthropic_events(words):
+    def event(name, data):
+        return f"event: {name}\ndata: {json.dumps(data, ensure_ascii=False)}\n\n"
+
+    yield event("message_start", {"type": "message_start", "message": {"id": "msg_mock", "type": "message",
+                                                                        "role": "assistant", "content": []}})
+    yield event("content_block_start", {"type": "content_block_start", "index": 0,
+                                        "content_block": {"type": "text", "text": ""}})
+    yield event("ping", {"type": "ping"})
+    for word in words:
+        yield event("content_block_delta", {"type": "content_block_delta", "index": 0,
+                                            "delta": {"type": "text_delta", "text": word}})
+    yield event("content_block_stop", {"type": "content_block_stop", "index": 0})
+    yield event("message_delta", {"type": "message_delta", "delta": {"stop_reason": "end_turn"}})
+    yield event("message_stop", {"type": "message_stop"})
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    options = None
+
+    def log_message(self, format, *args):
+        print(f"{self.client_address[0]} {format % args}")
+
+    def write_chunk(self, data):
+        self.wfile.write(f"{len(data):x}\r\n".encode() + data + b"\r\n")
+        self.wfile.flush()
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        body = json.loads(self.rfile.read(length) or b"{}")
+        options = self.options
+
+        if ":streamGenerateContent" in self.path:
+            events = google_events
+        elif body.get("stream"):
+            events = anthropic_events
+        else:
+            self.send_error(400, "Only streaming requests are mocked")
+            return
+
+        if options.status != 200:
+            error = json.dumps({"error": {"message": f"mock error {options.status}"}}).encode()
+            self.send_response(options.status)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(error)))
+            self.end_headers()
+            self.wfile.write(error)
+            return
+
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Cache-Control", "no-cache")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+
+        try:
+            self.stream(events, options)
+        except (BrokenPipeError, ConnectionResetError):
+            print("client closed the stream")
+
+    def stream(self, events, options):
+        words = [word + " " for word in options.reply.split()]
+        start = time.monotonic()
+        time.sleep(options.first_token_ms / 1000.0)
+        pending = b""
+        for index, event in enumerate(events(words)):
+            if index > 0:
+                time.sleep(options.token_ms / 1000.0)
+            pending += event.encode()
+            # Split at random points, keep the tail for the next write
+            while len(pending) > options.max_chunk:
+                size = random.randint(1, options.max_chunk)
+                self.write_chunk(pending[:size])
+                pending = pending[size:]
+            if pending and random.random() < 0.7:
+                self.write_chunk(pending)
+                pending = b""
+        if pending:
+            self.write_chunk(pending)
+        self.wfile.write(b"0\r\n\r\n")
+        self.wfile.flush()
+        print(f"streamed {len(words)} words in {(time.monotonic() - start) * 1000:.0f} ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Mock SSE server for the Google and Anthropic streaming adapters")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--reply", default="你好 这是 一个 流式 回复 的 测试 Hello from the mock streaming server",
+                        help="Answer text, streamed one word per event")
+    parser.add_argument("--first-token-ms", type=int, default=300, help="Delay before the first event")
+    parser.add_argument("--token-ms", type=int, default=50, help="Delay between events")
+    parser.add_argument("--max-chunk", type=int, default=64, help="Largest HTTP chunk written")
+    parser.add_argument("--status", type=int, default=200, help="Answer every request with this status")
+    args = parser.parse_args()
+
+    Handler.options = args
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    print(f"Mock SSE server on http://{args.host}:{args.port}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""
+Stand-in websocket server for trying the media transports negotiated in the hello exchange
+
+The device offers "media_transports" in its hello, this server picks one with --media:
+  websocket  Opus in binary websocket frames (protocol version 1, 2 or 3)
+  udp        AES-CTR encrypted Opus datagrams, the same format MqttProtocol uses
+
+Whatever the device says between "listen start" and "listen stop" is played back to it as
+the tts stream, so both directions of the chosen transport are exercised. With keep-warm
+enabled the device ends a session with "goodbye" and leaves the connection open, the next
+hello may carry "resume_session_id" and gets the same session back. A device built with
+uplink batching offers "batch_frames" in its hello audio_params, --batch-frames accepts it.
+There is no VAD here, in auto mode a turn simply ends after --turn-seconds.
+
+  pip install websockets cryptography
+  python stand_in_server.py --media udp --host 192.168.1.10
+  # then point the device websocket url at ws://192.168.1.10:8000/
+"""
+
+import argparse
+import asyncio
+import json
+import os
+import struct
+import uuid
+
+import websockets
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+
+FRAME_DURATION_MS = 60
+TYPE_OPUS_BATCH = 2
+
+
+def split_batch(payload):
+    """Opus frames of a batch, each prefixed with |timestamp 4u|payload_size 2u|"""
+    frames = []
+    offset = 0
+    while offset + 6 <= len(payload):
+        _, size = struct.unpack_from(">IH", payload, offset)
+        frames.append(payload[offset + 6:offset + 6 + size])
+        offset += 6 + size
+    return frames
+
+
+def aes_ctr(key, nonce, data):
+    cipher = Cipher(algorithms.AES(key), modes.CTR(nonce))
+    return cipher.encryptor().update(data)
+
+
+class UdpMedia(asyncio.DatagramProtocol):
+    """One UDP socket for all sessions, datagrams are routed by the ssrc the server put in the nonce"""
+
+    def __init__(self):
+        self.transport = None
+        self.sessions = {}      # nonce prefix (ssrc) -> Session
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        if len(data) < 16 or data[0] not in (0x01, TYPE_OPUS_BATCH):
+            return
+        session = self.sessions.get(data[4:8])
+        if session is None:
+            return
+        session.udp_addr = addr
+        payload = aes_ctr(session.key, data[:16], data[16:])
+        if data[0] == TYPE_OPUS_BATCH:
+            session.on_uplink_batch(split_batch(payload))
+        else:
+            session.on_uplink(payload)
+
+    def send(self, session, opus):
+        session.downlink_sequence += 1
+        nonce = bytearray(session.nonce)
+        struct.pack_into(">H", nonce, 2, len(opus))
+        struct.pack_into(">II", nonce, 8, 0, session.downlink_sequence)
+        self.transport.sendto(bytes(nonce) + aes_ctr(session.key, bytes(nonce), opus), session.udp_addr)
+
+
+class Session:
+    def __init__(self, ws, version, udp_media):
+        self.ws = ws
+        self.version = version
+        self.udp_media = udp_media
+        self.session_id = str(uuid.uuid4())
+        self.media = "websocket"
+        self.key = os.urandom(16)
+        self.nonce = b"\x01\x00\x00\x00" + os.urandom(4) + b"\x00" * 8
+        self.udp_addr = None
+        self.downlink_sequence = 0
+        self.listening = False
+        self.recorded = []
+        self.batch_frames = 1
+        self.batches = 0
+
+    def on_uplink(self, opus):
+        if self.listening:
+            self.recorded.append(opus)
+
+    def on_uplink_batch(self, frames):
+        self.batches += 1
+        for opus in frames:
+            self.on_uplink(opus)
+
+    def parse_binary(self, data):
+        """Opus frames in a binary message, more than one for a batch"""
+        if self.version == 2:
+            _, message_type, _, _, size = struct.unpack(">HHIII", data[:16])
+            payload = data[16:16 + size]
+        elif self.version == 3:
+            message_type, _, size = struct.unpack(">BBH", data[:4])
+            payload = data[4:4 + size]
+        else:
+            return [data]
+        if message_type == TYPE_OPUS_BATCH:
+            self.batches += 1
+            return split_batch(payload)
+        return [payload]
+
+    def frame_binary(self, opus):
+        if self.version == 2:
+            return struct.pack(">HHIII", 2, 0, 0, 0, len(opus)) + opus
+        if self.version == 3:
+            return struct.pack(">BBH", 0, 0, len(opus)) + opus
+        return opus
+
+    async def hello(self, message, media, host, udp_port, batch_frames):
+        # A kept-warm connection sends a new hello per wake word, resuming the session it just ended
+        resumed = message.get("resume_session_id") == self.session_id
+        if not resumed:
+            self.session_id = str(uuid.uuid4())
+        offered = message.get("media_transports", ["websocket"])
+        self.media = media if media in offered else "websocket"
+        reply = {
+            "type": "hello",
+            "transport": "websocket",
+            "session_id": self.session_id,
+            "audio_params": {"format": "opus", "sample_rate": 16000, "channels": 1, "frame_duration": FRAME_DURATION_MS},
+            "media_transport": self.media,
+        }
+        offered_batch = message.get("audio_params", {}).get("batch_frames", 1)
+        self.batch_frames = min(offered_batch, batch_frames)
+        if self.batch_frames > 1:
+            reply["audio_params"]["batch_frames"] = self.batch_frames
+        if self.media == "udp":
+            self.udp_media.sessions[self.nonce[4:8]] = self
+            reply["udp"] = {"server": host, "port": udp_port, "key": self.key.hex(), "nonce": self.nonce.hex()}
+        print(f"[{self.session_id[:8]}] hello, version {self.version}, media {self.media} (offered {offered})"
+              f"{', resumed' if resumed else ''}{f', batches of {self.batch_frames}' if self.batch_frames > 1 else ''}")
+        await self.ws.send(json.dumps(reply))
+
+    async def play_back(self):
+        frames, self.recorded = self.recorded, []
+        batches, self.batches = self.batches, 0
+        print(f"[{self.session_id[:8]}] playing back {len(frames)} frames over {self.media}"
+              f"{f', {batches} uplink batches' if batches else ''}")
+        await self.ws.send(json.dumps({"session_id": self.session_id, "type": "tts", "state": "start"}))
+        for opus in frames:
+            if self.media == "udp" and self.udp_addr is not None:
+                self.udp_media.send(self, opus)
+            else:
+                await self.ws.send(self.frame_binary(opus))
+            await asyncio.sleep(FRAME_DURATION_MS / 1000)
+        await self.ws.send(json.dumps({"session_id": self.session_id, "type": "tts", "state": "stop"}))
+
+    def close(self):
+        self.udp_media.sessions.pop(self.nonce[4:8], None)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="Stand-in server for websocket and UDP media transports")
+    parser.add_argument("--host", default="127.0.0.1", help="Address the device uses to reach this server")
+    parser.add_argument("--port", type=int, default=8000, help="Websocket port")
+    parser.add_argument("--udp-port", type=int, default=8001, help="UDP media port")
+    parser.add_argument("--media", choices=["websocket", "udp"], default="udp", help="Media transport to pick")
+    parser.add_argument("--batch-frames", type=int, default=4, help="Most uplink frames per batch to accept, 1 to refuse")
+    parser.add_argument("--turn-seconds", type=float, default=4, help="Turn length in auto listening mode")
+    args = parser.parse_args()
+
+    loop = asyncio.get_running_loop()
+    _, udp_media = await loop.create_datagram_endpoint(UdpMedia, local_addr=("0.0.0.0", args.udp_port))
+
+    async def end_turn_later(session, seconds):
+        await asyncio.sleep(seconds)
+        if session.listening:
+            session.listening = False
+            await session.play_back()
+
+    async def handler(ws, path=None):
+        request = getattr(ws, "request", None)
+        headers = request.headers if request is not None else ws.request_headers
+        session = Session(ws, int(headers.get("Protocol-Version", "1")), udp_media)
+        try:
+            async for message in ws:
+                if isinstance(message, bytes):
+                    for opus in session.parse_binary(message):
+                        session.on_uplink(opus)
+                    continue
+                message = json.loads(message)
+                if message.get("type") == "hello":
+                    await session.hello(message, args.media, args.host, args.udp_port, args.batch_frames)
+                elif message.get("type") == "goodbye":
+                    print(f"[{session.session_id[:8]}] goodbye, connection kept open")
+                    session.listening = False
+                    session.close()
+                elif message.get("type") == "listen":
+                    state = message.get("state")
+                    if state == "start":
+                        session.listening = True
+                        if message.get("mode") == "auto":
+                            asyncio.create_task(end_turn_later(session, args.turn_seconds))
+                    elif state == "stop" and session.listening:
+                        session.listening = False
+                        asyncio.create_task(session.play_back())
+        except websockets.ConnectionClosed:
+            pass
+        finally:
+            session.close()
+
+    print(f"Listening on ws://0.0.0.0:{args.port}/ and udp://0.0.0.0:{args.udp_port}, media {args.media}")
+    async with websockets.serve(handler, "0.0.0.0", args.port):
+        await asyncio.Future()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
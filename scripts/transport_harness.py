@@ -0,0 +1,544 @@
+#!/usr/bin/env python3
+"""
+Transport harness for the websocket and UDP audio paths, impairs the link and measures it
+
+proxy   Sits between the device and a server (the real one or stand_in_server.py). Every message
+        is forwarded after the configured latency and jitter. UDP audio datagrams are dropped
+        and reordered. The websocket runs on TCP, so a loss there stalls the stream for --rto
+        and keeps the order. With --record the session is saved as JSON lines, and UDP audio
+        is decrypted with the key from the server hello.
+replay  Plays the role of the server from a recording. Each server message is sent at its
+        recorded offset from the client message it answered, so wake word, listen and speak
+        cycles follow the device. Downlink audio always goes over the websocket.
+
+Both modes print per-session numbers when the device disconnects: messages, bytes, Opus
+frames and batches, throughput, gaps between audio messages, and the time from "listen stop"
+to the first downlink audio.
+
+  pip install websockets cryptography
+  python transport_harness.py proxy --upstream ws://127.0.0.1:8000/ --host 192.168.1.10 --record s.jsonl
+  python transport_harness.py replay s.jsonl --latency 150 --jitter 50 --loss 3
+  # then point the device websocket url at ws://192.168.1.10:9000/
+
+Load with many virtual devices comes from xiaozhi_load in the host build (tests/host), which
+runs the firmware's own protocol code.
+"""
+
+import argparse
+import asyncio
+import base64
+import heapq
+import itertools
+import json
+import random
+import struct
+import time
+
+import websockets
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+
+FRAME_DURATION_MS = 60
+TYPE_OPUS = 0
+TYPE_OPUS_BATCH = 2
+UDP_TYPE_OPUS = 0x01
+UDP_TYPE_OPUS_BATCH = 0x02
+FORWARDED_HEADERS = ("Authorization", "Protocol-Version", "Device-Id", "Client-Id")
+
+
+def aes_ctr(key, nonce, data):
+    cipher = Cipher(algorithms.AES(key), modes.CTR(nonce))
+    return cipher.encryptor().update(data)
+
+
+def split_batch(payload):
+    """Opus frames of a batch, each prefixed with |timestamp 4u|payload_size 2u|"""
+    frames = []
+    offset = 0
+    while offset + 6 <= len(payload):
+        _, size = struct.unpack_from(">IH", payload, offset)
+        frames.append(payload[offset + 6:offset + 6 + size])
+        offset += 6 + size
+    return frames
+
+
+def parse_binary(version, data):
+    """(message type, Opus frames) of a binary websocket message"""
+    if version == 2 and len(data) >= 16:
+        _, message_type, _, _, size = struct.unpack(">HHIII", data[:16])
+        payload = data[16:16 + size]
+    elif version == 3 and len(data) >= 4:
+        message_type, _, size = struct.unpack(">BBH", data[:4])
+        payload = data[4:4 + size]
+    else:
+        return TYPE_OPUS, [data]
+    if message_type == TYPE_OPUS_BATCH:
+        return message_type, split_batch(payload)
+    return message_type, [payload]
+
+
+def frame_binary(version, opus):
+    if version == 2:
+        return struct.pack(">HHIII", 2, TYPE_OPUS, 0, 0, len(opus)) + opus
+    if version == 3:
+        return struct.pack(">BBH", TYPE_OPUS, 0, len(opus)) + opus
+    return opus
+
+
+def get_header(ws, name):
+    request = getattr(ws, "request", None)
+    headers = request.headers if request is not None else ws.request_headers
+    return headers.get(name)
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+class DirectionStats:
+    def __init__(self, name):
+        self.name = name
+        self.messages = 0
+        self.bytes = 0
+        self.frames = 0
+        self.batches = 0
+        self.dropped = 0
+        self.reordered = 0
+        self.stalls = 0
+        self.first_time = None
+        self.last_time = None
+        self.last_audio_time = None
+        self.gaps_ms = []
+
+    def on_message(self, size, frames=0, batch=False):
+        now = time.monotonic()
+        if self.first_time is None:
+            self.first_time = now
+        self.last_time = now
+        self.messages += 1
+        self.bytes += size
+        if frames:
+            self.frames += frames
+            self.batches += 1 if batch else 0
+            if self.last_audio_time is not None:
+                self.gaps_ms.append((now - self.last_audio_time) * 1000)
+            self.last_audio_time = now
+
+    def report(self):
+        duration = (self.last_time - self.first_time) if self.messages > 1 else 0
+        kbps = self.bytes * 8 / duration / 1000 if duration > 0 else 0
+        line = (f"  {self.name:<8} {self.messages} messages, {self.bytes} bytes, {kbps:.1f} kbps, "
+                f"{self.frames} frames in {self.batches} batches")
+        if self.dropped or self.reordered or self.stalls:
+            line += f", {self.dropped} dropped, {self.reordered} reordered, {self.stalls} stalls"
+        if self.gaps_ms:
+            line += (f"\n           audio gap p50 {percentile(self.gaps_ms, 50):.0f} ms, "
+                     f"p95 {percentile(self.gaps_ms, 95):.0f} ms, max {max(self.gaps_ms):.0f} ms")
+        return line
+
+
+class SessionStats:
+    def __init__(self, name):
+        self.name = name
+        self.up = DirectionStats("uplink")
+        self.down = DirectionStats("downlink")
+        self.listen_stop_time = None
+        self.response_ms = []
+
+    def on_text(self, direction, text):
+        if direction == "up":
+            self.up.on_message(len(text))
+            if '"listen"' in text and '"stop"' in text:
+                self.listen_stop_time = time.monotonic()
+        else:
+            self.down.on_message(len(text))
+
+    def on_audio(self, direction, size, frames, batch=False):
+        stats = self.up if direction == "up" else self.down
+        stats.on_message(size, len(frames), batch)
+        if direction == "down" and self.listen_stop_time is not None:
+            self.response_ms.append((time.monotonic() - self.listen_stop_time) * 1000)
+            self.listen_stop_time = None
+
+    def report(self):
+        print(f"[{self.name}] session ended")
+        print(self.up.report())
+        print(self.down.report())
+        if self.response_ms:
+            print(f"  listen stop -> first audio: p50 {percentile(self.response_ms, 50):.0f} ms, "
+                  f"max {max(self.response_ms):.0f} ms over {len(self.response_ms)} turns")
+
+
+class Link:
+    """
+    Delivers the messages of one direction after the configured latency and jitter.
+    An ordered link (TCP) turns a loss into a stall of every later message, an unordered
+    link (UDP) drops the message and lets a few overtake each other.
+    """
+
+    def __init__(self, send, args, stats, ordered):
+        self.send = send
+        self.args = args
+        self.stats = stats
+        self.ordered = ordered
+        self.queue = []
+        self.counter = itertools.count()
+        self.last_due = 0
+        self.wakeup = asyncio.Event()
+        self.task = asyncio.create_task(self.run())
+
+    def push(self, item, audio=False):
+        now = time.monotonic()
+        delay = (self.args.latency + random.uniform(0, self.args.jitter)) / 1000
+        lost = audio and random.uniform(0, 100) < self.args.loss
+        if lost and not self.ordered:
+            self.stats.dropped += 1
+            return
+        if lost:
+            self.stats.stalls += 1
+            delay += self.args.rto / 1000
+        if audio and not self.ordered and random.uniform(0, 100) < self.args.reorder:
+            self.stats.reordered += 1
+            delay += FRAME_DURATION_MS / 1000
+        due = now + delay
+        if self.ordered:
+            due = max(due, self.last_due)
+        self.last_due = due
+        heapq.heappush(self.queue, (due, next(self.counter), item))
+        self.wakeup.set()
+
+    async def run(self):
+        while True:
+            if not self.queue:
+                self.wakeup.clear()
+                await self.wakeup.wait()
+                continue
+            due = self.queue[0][0]
+            wait = due - time.monotonic()
+            if wait > 0:
+                self.wakeup.clear()
+                try:
+                    await asyncio.wait_for(self.wakeup.wait(), wait)
+                except asyncio.TimeoutError:
+                    pass
+                continue
+            _, _, item = heapq.heappop(self.queue)
+            try:
+                await self.send(item)
+            except (websockets.ConnectionClosed, OSError):
+                return
+
+    def close(self):
+        self.task.cancel()
+
+
+class Recorder:
+    def __init__(self, path):
+        self.file = open(path, "a") if path else None
+        self.start = time.monotonic()
+
+    def restart(self):
+        self.start = time.monotonic()
+        if self.file:
+            self.file.write(json.dumps({"t": 0, "dir": "session"}) + "\n")
+
+    def text(self, direction, text):
+        if self.file:
+            self.write({"dir": direction, "text": text})
+
+    def audio(self, direction, frames):
+        if self.file:
+            for opus in frames:
+                self.write({"dir": direction, "opus": base64.b64encode(opus).decode()})
+
+    def write(self, entry):
+        entry["t"] = round(time.monotonic() - self.start, 4)
+        self.file.write(json.dumps(entry) + "\n")
+        self.file.flush()
+
+
+class UdpDeviceSide(asyncio.DatagramProtocol):
+    """The UDP socket devices see, datagrams are routed to sessions by the ssrc in the nonce"""
+
+    def __init__(self):
+        self.transport = None
+        self.sessions = {}
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        if len(data) < 16:
+            return
+        session = self.sessions.get(data[4:8])
+        if session is not None:
+            session.on_device_datagram(data, addr)
+
+
+class UdpServerSide(asyncio.DatagramProtocol):
+    def __init__(self, session):
+        self.session = session
+        self.transport = None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        self.session.on_server_datagram(data)
+
+
+class ProxySession:
+    def __init__(self, device_ws, args, udp_device, recorder):
+        self.device_ws = device_ws
+        self.args = args
+        self.udp_device = udp_device
+        self.recorder = recorder
+        self.version = int(get_header(device_ws, "Protocol-Version") or "1")
+        self.stats = SessionStats(get_header(device_ws, "Device-Id") or "device")
+        self.upstream = None
+        self.udp_server = None
+        self.udp_device_addr = None
+        self.udp_key = None
+        self.ssrc = None
+        self.links = []
+
+    async def connect_upstream(self):
+        headers = {name: get_header(self.device_ws, name) for name in FORWARDED_HEADERS
+                   if get_header(self.device_ws, name) is not None}
+        try:
+            return await websockets.connect(self.args.upstream, additional_headers=headers)
+        except TypeError:
+            return await websockets.connect(self.args.upstream, extra_headers=headers)
+
+    async def run(self):
+        self.upstream = await self.connect_upstream()
+        self.recorder.restart()
+        self.ws_up = Link(self.upstream.send, self.args, self.stats.up, ordered=True)
+        self.ws_down = Link(self.device_ws.send, self.args, self.stats.down, ordered=True)
+        self.links += [self.ws_up, self.ws_down]
+        try:
+            await asyncio.gather(self.pump_uplink(), self.pump_downlink())
+        except websockets.ConnectionClosed:
+            pass
+        finally:
+            self.close()
+
+    async def pump_uplink(self):
+        async for message in self.device_ws:
+            if isinstance(message, bytes):
+                message_type, frames = parse_binary(self.version, message)
+                self.stats.on_audio("up", len(message), frames, message_type == TYPE_OPUS_BATCH)
+                self.recorder.audio("up", frames)
+                self.ws_up.push(message, audio=True)
+            else:
+                self.stats.on_text("up", message)
+                self.recorder.text("up", message)
+                self.ws_up.push(message)
+        await self.upstream.close()
+
+    async def pump_downlink(self):
+        async for message in self.upstream:
+            if isinstance(message, bytes):
+                _, frames = parse_binary(self.version, message)
+                self.stats.on_audio("down", len(message), frames)
+                self.recorder.audio("down", frames)
+                self.ws_down.push(message, audio=True)
+                continue
+            self.stats.on_text("down", message)
+            self.recorder.text("down", message)
+            try:
+                parsed = json.loads(message)
+            except json.JSONDecodeError:
+                parsed = None
+            if isinstance(parsed, dict) and parsed.get("type") == "hello" and parsed.get("media_transport") == "udp":
+                message = await self.relay_udp(parsed)
+            self.ws_down.push(message)
+        await self.device_ws.close()
+
+    async def relay_udp(self, hello):
+        """Points the device at the proxy's UDP socket and relays its datagrams to the server"""
+        udp = hello["udp"]
+        self.udp_key = bytes.fromhex(udp["key"])
+        nonce = bytes.fromhex(udp["nonce"])
+        if self.udp_server is None:
+            loop = asyncio.get_running_loop()
+            self.udp_server, _ = await loop.create_datagram_endpoint(
+                lambda: UdpServerSide(self), remote_addr=(udp["server"], udp["port"]))
+            self.udp_up = Link(self.send_to_server, self.args, self.stats.up, ordered=False)
+            self.udp_down = Link(self.send_to_device, self.args, self.stats.down, ordered=False)
+            self.links += [self.udp_up, self.udp_down]
+        if self.ssrc is not None:
+            self.udp_device.sessions.pop(self.ssrc, None)
+        self.ssrc = nonce[4:8]
+        self.udp_device.sessions[self.ssrc] = self
+        udp["server"] = self.args.host
+        udp["port"] = self.args.udp_port
+        return json.dumps(hello)
+
+    def decrypt_frames(self, data):
+        payload = aes_ctr(self.udp_key, data[:16], data[16:])
+        return split_batch(payload) if data[0] == UDP_TYPE_OPUS_BATCH else [payload]
+
+    def on_device_datagram(self, data, addr):
+        self.udp_device_addr = addr
+        frames = self.decrypt_frames(data)
+        self.stats.on_audio("up", len(data), frames, data[0] == UDP_TYPE_OPUS_BATCH)
+        self.recorder.audio("up", frames)
+        self.udp_up.push(data, audio=True)
+
+    def on_server_datagram(self, data):
+        if len(data) < 16 or data[0] != UDP_TYPE_OPUS:
+            return
+        frames = self.decrypt_frames(data)
+        self.stats.on_audio("down", len(data), frames)
+        self.recorder.audio("down", frames)
+        self.udp_down.push(data, audio=True)
+
+    async def send_to_server(self, data):
+        self.udp_server.sendto(data)
+
+    async def send_to_device(self, data):
+        if self.udp_device_addr is not None:
+            self.udp_device.transport.sendto(data, self.udp_device_addr)
+
+    def close(self):
+        for link in self.links:
+            link.close()
+        if self.ssrc is not None:
+            self.udp_device.sessions.pop(self.ssrc, None)
+        if self.udp_server is not None:
+            self.udp_server.close()
+        self.stats.report()
+
+
+def load_recording(path):
+    """
+    Server messages of the first session in the recording, each anchored to the client text
+    message it followed: [(anchor index, offset seconds, entry)]. Anchor 0 is the client hello.
+    """
+    replies = []
+    anchor = -1
+    anchor_time = 0
+    with open(path) as f:
+        for line in f:
+            entry = json.loads(line)
+            if entry["dir"] == "session":
+                if anchor >= 0:
+                    break
+                continue
+            if entry["dir"] == "up" and "text" in entry:
+                anchor += 1
+                anchor_time = entry["t"]
+            elif entry["dir"] == "down" and anchor >= 0:
+                replies.append((anchor, entry["t"] - anchor_time, entry))
+    return replies
+
+
+class ReplaySession:
+    def __init__(self, ws, args, replies):
+        self.ws = ws
+        self.args = args
+        self.replies = replies
+        self.version = int(get_header(ws, "Protocol-Version") or "1")
+        self.stats = SessionStats(get_header(ws, "Device-Id") or "device")
+        self.anchor = -1
+        self.session_id = None
+
+    async def run(self):
+        down = Link(self.ws.send, self.args, self.stats.down, ordered=True)
+        try:
+            async for message in self.ws:
+                if isinstance(message, bytes):
+                    message_type, frames = parse_binary(self.version, message)
+                    self.stats.on_audio("up", len(message), frames, message_type == TYPE_OPUS_BATCH)
+                    continue
+                self.stats.on_text("up", message)
+                self.anchor += 1
+                asyncio.create_task(self.play(down, self.anchor))
+        except websockets.ConnectionClosed:
+            pass
+        finally:
+            down.close()
+            self.stats.report()
+
+    async def play(self, down, anchor):
+        start = time.monotonic()
+        for reply_anchor, offset, entry in self.replies:
+            if reply_anchor != anchor:
+                continue
+            wait = start + offset - time.monotonic()
+            if wait > 0:
+                await asyncio.sleep(wait)
+            if "opus" in entry:
+                opus = base64.b64decode(entry["opus"])
+                self.stats.on_audio("down", len(opus), [opus])
+                down.push(frame_binary(self.version, opus), audio=True)
+            else:
+                text = self.rewrite(entry["text"])
+                self.stats.on_text("down", text)
+                down.push(text)
+
+    def rewrite(self, text):
+        """Audio is replayed over the websocket, and the hello hands out the recorded session id"""
+        try:
+            message = json.loads(text)
+        except json.JSONDecodeError:
+            return text
+        if message.get("type") == "hello":
+            message.pop("udp", None)
+            message["media_transport"] = "websocket"
+            message.get("audio_params", {}).pop("batch_frames", None)
+            self.session_id = message.get("session_id")
+        elif self.session_id is not None and "session_id" in message:
+            message["session_id"] = self.session_id
+        return json.dumps(message)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="Impairing proxy and session replay for the device transports")
+    parser.add_argument("--port", type=int, default=9000, help="Websocket port the device connects to")
+    parser.add_argument("--latency", type=float, default=0, help="One-way latency in ms")
+    parser.add_argument("--jitter", type=float, default=0, help="Random extra latency up to this many ms")
+    parser.add_argument("--loss", type=float, default=0, help="Audio loss in percent, a stall of --rto on the websocket")
+    parser.add_argument("--reorder", type=float, default=0, help="UDP audio datagrams delayed by one frame, in percent")
+    parser.add_argument("--rto", type=float, default=200, help="TCP retransmit stall in ms for a lost websocket message")
+    parser.add_argument("--seed", type=int, help="Random seed, for repeatable runs")
+    subparsers = parser.add_subparsers(dest="mode", required=True)
+    proxy = subparsers.add_parser("proxy", help="Forward between the device and a server")
+    proxy.add_argument("--upstream", required=True, help="Server websocket url")
+    proxy.add_argument("--host", default="127.0.0.1", help="Address the device uses to reach this proxy")
+    proxy.add_argument("--udp-port", type=int, default=9001, help="UDP media port")
+    proxy.add_argument("--record", help="Append the sessions to this JSON lines file, record one device at a time")
+    replay = subparsers.add_parser("replay", help="Play the server from a recording")
+    replay.add_argument("recording", help="JSON lines file written by proxy --record")
+    args = parser.parse_args()
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    if args.mode == "proxy":
+        loop = asyncio.get_running_loop()
+        _, udp_device = await loop.create_datagram_endpoint(UdpDeviceSide, local_addr=("0.0.0.0", args.udp_port))
+        recorder = Recorder(args.record)
+
+        async def handler(ws, path=None):
+            await ProxySession(ws, args, udp_device, recorder).run()
+        print(f"Proxying ws://0.0.0.0:{args.port}/ to {args.upstream}, UDP on {args.udp_port}")
+    else:
+        replies = load_recording(args.recording)
+        print(f"Loaded {len(replies)} server messages from {args.recording}")
+
+        async def handler(ws, path=None):
+            await ReplaySession(ws, args, replies).run()
+        print(f"Replaying on ws://0.0.0.0:{args.port}/")
+
+    async with websockets.serve(handler, "0.0.0.0", args.port):
+        await asyncio.Future()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,112 @@
+#include "audio_input_pipeline.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+
+// Microphone on the left channel, reference on the right, both a ramp that continues across reads
+class FakeInputCodec : public AudioCodec {
+public:
+    FakeInputCodec(int sample_rate, int channels) {
+        input_sample_rate_ = sample_rate;
+        output_sample_rate_ = sample_rate;
+        input_channels_ = channels;
+        input_enabled_ = true;
+    }
+
+protected:
+    int Read(int16_t* dest, int samples) override {
+        for (int i = 0; i < samples; i += input_channels_) {
+            dest[i] = (int16_t)next_;
+            if (input_channels_ == 2) {
+                dest[i + 1] = (int16_t)-next_;
+            }
+            next_ = (next_ + 7) % 20000;
+        }
+        return samples;
+    }
+
+    int Write(const int16_t* data, int samples) override {
+        return samples;
+    }
+
+private:
+    int next_ = 0;
+};
+
+TEST(AudioInputPipeline, SameRatePassesFramesThrough) {
+    FakeInputCodec codec(16000, 1);
+    AudioInputPipeline pipeline;
+    pipeline.Initialize(&codec, 16000, 60);
+
+    std::span<const int16_t> frame;
+    ASSERT_TRUE(pipeline.Read(960, frame));
+    ASSERT_EQ(frame.size(), 960u);
+    for (size_t i = 0; i < frame.size(); i++) {
+        EXPECT_EQ(frame[i], (int16_t)(i * 7));
+    }
+}
+
+TEST(AudioInputPipeline, StereoSplitsResamplesAndInterleaves) {
+    FakeInputCodec codec(24000, 2);
+    AudioInputPipeline pipeline;
+    pipeline.Initialize(&codec, 16000, 60);
+
+    std::span<const int16_t> frame;
+    ASSERT_TRUE(pipeline.Read(960 * 2, frame));
+    ASSERT_EQ(frame.size(), 960u * 2);
+
+    // The same resampler on the separated channels gives the expected output
+    std::vector<int16_t> mic(1440), reference(1440), expected_mic(960), expected_reference(960);
+    for (int i = 0; i < 1440; i++) {
+        mic[i] = (int16_t)(i * 7);
+        reference[i] = (int16_t)-(i * 7);
+    }
+    OpusResampler resampler;
+    resampler.Configure(24000, 16000);
+    resampler.Process(mic.data(), mic.size(), expected_mic.data());
+    resampler.Process(reference.data(), reference.size(), expected_reference.data());
+    for (size_t i = 0; i < 960; i++) {
+        ASSERT_EQ(frame[2 * i], expected_mic[i]) << "frame " << i;
+        ASSERT_EQ(frame[2 * i + 1], expected_reference[i]) << "frame " << i;
+    }
+}
+
+TEST(AudioInputPipeline, SteadyStateReadsDoNotAllocate) {
+    struct Case {
+        int input_rate;
+        int channels;
+        int samples;
+    };
+    // Wake word feeds are 30 ms, the audio processor asks for up to 60 ms
+    for (auto c : {Case{16000, 1, 480}, Case{24000, 1, 960}, Case{24000, 2, 1920}, Case{48000, 2, 960}}) {
+        FakeInputCodec codec(c.input_rate, c.channels);
+        AudioInputPipeline pipeline;
+        pipeline.Initialize(&codec, 16000, 60);
+
+        std::span<const int16_t> frame;
+        ASSERT_TRUE(pipeline.Read(c.samples, frame));
+        AllocationScope allocations;
+        for (int i = 0; i < 100; i++) {
+            ASSERT_TRUE(pipeline.Read(c.samples, frame));
+        }
+        EXPECT_EQ(allocations.count(), 0u) << c.input_rate << " Hz x " << c.channels;
+    }
+}
+
+TEST(AudioInputPipelineBenchmark, CyclesPerFrame) {
+    FakeInputCodec codec(24000, 2);
+    AudioInputPipeline pipeline;
+    pipeline.Initialize(&codec, 16000, 60);
+    std::span<const int16_t> frame;
+
+    AllocationScope allocations;
+    Bench("AudioInputPipeline 24k stereo 30 ms", 2000, [&]() {
+        pipeline.Read(480 * 2, frame);
+    });
+    EXPECT_EQ(allocations.count(), 0u);
+}
+
+} // namespace
@@ -0,0 +1,218 @@
+#include "audio_kernels.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+#include <climits>
+#include <random>
+#include <vector>
+
+namespace {
+
+using DeinterleaveFn = void (*)(const int16_t*, int16_t*, int16_t*, size_t);
+using InterleaveFn = void (*)(const int16_t*, const int16_t*, int16_t*, size_t);
+using ShiftSaturateFn = void (*)(const int32_t*, int16_t*, size_t, int);
+using ApplyGainFn = void (*)(const int16_t*, int32_t*, size_t, int32_t);
+
+template <typename Fn>
+struct Variant {
+    const char* name;
+    Fn fn;
+};
+
+const std::vector<Variant<DeinterleaveFn>> kDeinterleave = {
+    {"swar", audio_kernels::swar::Deinterleave},
+#if defined(__ARM_NEON)
+    {"neon", audio_kernels::neon::Deinterleave},
+#endif
+#if defined(__SSE2__)
+    {"sse2", audio_kernels::sse2::Deinterleave},
+#endif
+    {"dispatch", audio_kernels::Deinterleave},
+};
+
+const std::vector<Variant<InterleaveFn>> kInterleave = {
+    {"swar", audio_kernels::swar::Interleave},
+#if defined(__ARM_NEON)
+    {"neon", audio_kernels::neon::Interleave},
+#endif
+#if defined(__SSE2__)
+    {"sse2", audio_kernels::sse2::Interleave},
+#endif
+    {"dispatch", audio_kernels::Interleave},
+};
+
+const std::vector<Variant<ShiftSaturateFn>> kShiftSaturate = {
+#if defined(__ARM_NEON)
+    {"neon", audio_kernels::neon::ShiftSaturate},
+#endif
+#if defined(__SSE2__)
+    {"sse2", audio_kernels::sse2::ShiftSaturate},
+#endif
+    {"dispatch", audio_kernels::ShiftSaturate},
+};
+
+const std::vector<Variant<ApplyGainFn>> kApplyGain = {
+#if defined(__ARM_NEON)
+    {"neon", audio_kernels::neon::ApplyGain},
+#endif
+#if defined(__SSE4_1__)
+    {"sse41", audio_kernels::sse41::ApplyGain},
+#endif
+    {"dispatch", audio_kernels::ApplyGain},
+};
+
+// Lengths around the vector widths and their tails, plus a typical 60 ms frame
+const size_t kLengths[] = {0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 33, 960};
+// Offsets in elements from a 16 byte aligned base, odd ones exercise the SWAR fallback
+const size_t kOffsets[] = {0, 1, 2, 3};
+
+std::mt19937 rng(20240611);
+
+template <typename T>
+void FillRandom(std::vector<T>& values, bool with_extremes) {
+    std::uniform_int_distribution<int64_t> dist(std::numeric_limits<T>::min(), std::numeric_limits<T>::max());
+    for (auto& v : values) {
+        v = (T)dist(rng);
+    }
+    if (with_extremes && values.size() >= 4) {
+        values[0] = std::numeric_limits<T>::min();
+        values[1] = std::numeric_limits<T>::max();
+        values[2] = 0;
+        values[3] = -1;
+    }
+}
+
+TEST(AudioKernels, DeinterleaveMatchesScalar) {
+    for (auto& variant : kDeinterleave) {
+        for (size_t frames : kLengths) {
+            for (size_t offset : kOffsets) {
+                std::vector<int16_t> input(frames * 2 + 8);
+                FillRandom(input, true);
+                std::vector<int16_t> expected_l(frames + 8), expected_r(frames + 8);
+                std::vector<int16_t> actual_l(frames + 8, 0x5555), actual_r(frames + 8, 0x5555);
+                audio_kernels::scalar::Deinterleave(input.data() + offset, expected_l.data(), expected_r.data(), frames);
+                variant.fn(input.data() + offset, actual_l.data() + offset, actual_r.data() + offset, frames);
+                for (size_t i = 0; i < frames; i++) {
+                    ASSERT_EQ(actual_l[offset + i], expected_l[i]) << variant.name << " frames " << frames << " offset " << offset;
+                    ASSERT_EQ(actual_r[offset + i], expected_r[i]) << variant.name << " frames " << frames << " offset " << offset;
+                }
+                // Nothing written past the end
+                ASSERT_EQ(actual_l[offset + frames], 0x5555) << variant.name;
+                ASSERT_EQ(actual_r[offset + frames], 0x5555) << variant.name;
+            }
+        }
+    }
+}
+
+TEST(AudioKernels, InterleaveMatchesScalar) {
+    for (auto& variant : kInterleave) {
+        for (size_t frames : kLengths) {
+            for (size_t offset : kOffsets) {
+                std::vector<int16_t> left(frames + 8), right(frames + 8);
+                FillRandom(left, true);
+                FillRandom(right, true);
+                std::vector<int16_t> expected(frames * 2 + 8);
+                std::vector<int16_t> actual(frames * 2 + 8, 0x5555);
+                audio_kernels::scalar::Interleave(left.data() + offset, right.data() + offset, expected.data(), frames);
+                variant.fn(left.data() + offset, right.data() + offset, actual.data() + offset, frames);
+                for (size_t i = 0; i < frames * 2; i++) {
+                    ASSERT_EQ(actual[offset + i], expected[i]) << variant.name << " frames " << frames << " offset " << offset;
+                }
+                ASSERT_EQ(actual[offset + frames * 2], 0x5555) << variant.name;
+            }
+        }
+    }
+}
+
+TEST(AudioKernels, ShiftSaturateMatchesScalar) {
+    for (auto& variant : kShiftSaturate) {
+        for (int shift : {0, 1, 8, 12, 14, 16, 24, 31}) {
+            for (size_t samples : kLengths) {
+                for (size_t offset : kOffsets) {
+                    std::vector<int32_t> input(samples + 8);
+                    FillRandom(input, true);
+                    std::vector<int16_t> expected(samples + 8);
+                    std::vector<int16_t> actual(samples + 8, 0x5555);
+                    audio_kernels::scalar::ShiftSaturate(input.data() + offset, expected.data(), samples, shift);
+                    variant.fn(input.data() + offset, actual.data() + offset, samples, shift);
+                    for (size_t i = 0; i < samples; i++) {
+                        ASSERT_EQ(actual[offset + i], expected[i]) << variant.name << " shift " << shift << " input " << input[offset + i];
+                    }
+                    ASSERT_EQ(actual[offset + samples], 0x5555) << variant.name;
+                }
+            }
+        }
+    }
+}
+
+TEST(AudioKernels, ShiftSaturateClampsSymmetrically) {
+    const int32_t input[] = {INT32_MIN, INT32_MAX, -32768, 32767, -40000, 40000, 0, -1};
+    int16_t output[8];
+    audio_kernels::ShiftSaturate(input, output, 8, 0);
+    const int16_t expected[] = {-INT16_MAX, INT16_MAX, -INT16_MAX, INT16_MAX, -INT16_MAX, INT16_MAX, 0, -1};
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(output[i], expected[i]) << i;
+    }
+}
+
+TEST(AudioKernels, ApplyGainMatchesScalar) {
+    for (auto& variant : kApplyGain) {
+        for (int32_t gain : {0, 1, 12345, 32768, 65535, 65536}) {
+            for (size_t samples : kLengths) {
+                for (size_t offset : kOffsets) {
+                    std::vector<int16_t> input(samples + 8);
+                    FillRandom(input, true);
+                    std::vector<int32_t> expected(samples + 8);
+                    std::vector<int32_t> actual(samples + 8, 0x55555555);
+                    audio_kernels::scalar::ApplyGain(input.data() + offset, expected.data(), samples, gain);
+                    variant.fn(input.data() + offset, actual.data() + offset, samples, gain);
+                    for (size_t i = 0; i < samples; i++) {
+                        ASSERT_EQ(actual[offset + i], expected[i]) << variant.name << " gain " << gain;
+                    }
+                    ASSERT_EQ(actual[offset + samples], 0x55555555) << variant.name;
+                }
+            }
+        }
+    }
+}
+
+TEST(AudioKernelsBenchmark, StereoFrame) {
+    // One 60 ms stereo frame at 16 kHz
+    const size_t frames = 960;
+    std::vector<int16_t> stereo(frames * 2), left(frames), right(frames);
+    std::vector<int32_t> wide(frames);
+    FillRandom(stereo, false);
+
+    Bench("Deinterleave scalar", 20000, [&] {
+        audio_kernels::scalar::Deinterleave(stereo.data(), left.data(), right.data(), frames);
+    });
+    Bench("Deinterleave swar", 20000, [&] {
+        audio_kernels::swar::Deinterleave(stereo.data(), left.data(), right.data(), frames);
+    });
+    Bench("Deinterleave dispatch", 20000, [&] {
+        audio_kernels::Deinterleave(stereo.data(), left.data(), right.data(), frames);
+    });
+    Bench("Interleave scalar", 20000, [&] {
+        audio_kernels::scalar::Interleave(left.data(), right.data(), stereo.data(), frames);
+    });
+    Bench("Interleave swar", 20000, [&] {
+        audio_kernels::swar::Interleave(left.data(), right.data(), stereo.data(), frames);
+    });
+    Bench("Interleave dispatch", 20000, [&] {
+        audio_kernels::Interleave(left.data(), right.data(), stereo.data(), frames);
+    });
+    Bench("ApplyGain scalar", 20000, [&] {
+        audio_kernels::scalar::ApplyGain(left.data(), wide.data(), frames, 40000);
+    });
+    Bench("ApplyGain dispatch", 20000, [&] {
+        audio_kernels::ApplyGain(left.data(), wide.data(), frames, 40000);
+    });
+    Bench("ShiftSaturate scalar", 20000, [&] {
+        audio_kernels::scalar::ShiftSaturate(wide.data(), right.data(), frames, 15);
+    });
+    Bench("ShiftSaturate dispatch", 20000, [&] {
+        audio_kernels::ShiftSaturate(wide.data(), right.data(), frames, 15);
+    });
+}
+
+} // namespace
@@ -0,0 +1,174 @@
+#include "audio_packet_ring.h"
+#include "audio_jitter_buffer.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Same depth as the application's downlink queues
+const size_t kCapacity = 40;
+
+void FillPacket(AudioStreamPacket& packet, uint32_t sequence, size_t size = 120) {
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = sequence * 60;
+    packet.sequence = sequence;
+    packet.payload.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        packet.payload[i] = (uint8_t)(sequence + i);
+    }
+}
+
+bool PayloadMatches(const AudioStreamPacket& packet, uint32_t sequence, size_t size = 120) {
+    if (packet.sequence != sequence || packet.payload.size() != size) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (packet.payload[i] != (uint8_t)(sequence + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(AudioPacketRing, KeepsOrderAndDropPolicies) {
+    AudioPacketRing ring(3);
+    AudioStreamPacket in, out;
+    for (uint32_t i = 0; i < 3; i++) {
+        FillPacket(in, i);
+        ASSERT_TRUE(ring.Push(in));
+    }
+    EXPECT_TRUE(ring.Full());
+    FillPacket(in, 3);
+    EXPECT_FALSE(ring.Push(in, kAudioPacketDropNewest));
+    EXPECT_TRUE(ring.Push(in, kAudioPacketDropOldest));
+    EXPECT_EQ(ring.Size(), 3u);
+
+    for (uint32_t expected : {1u, 2u, 3u}) {
+        ASSERT_TRUE(ring.Pop(out));
+        EXPECT_TRUE(PayloadMatches(out, expected));
+        EXPECT_EQ(out.timestamp, expected * 60);
+    }
+    EXPECT_FALSE(ring.Pop(out));
+
+    FillPacket(in, 4);
+    ring.Push(in);
+    ring.Clear();
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_FALSE(ring.Pop(out));
+}
+
+// The decode path keeps one packet and pops into it frame after frame, as Application::decode_packet_ does
+TEST(AudioPacketRing, SteadyStatePushAndPopDoNotAllocate) {
+    AudioPacketRing ring(kCapacity);
+    AudioStreamPacket in, out;
+    in.payload.reserve(AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+    out.payload.reserve(AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+
+    AllocationScope allocations;
+    for (uint32_t i = 0; i < 1000; i++) {
+        FillPacket(in, i, 100 + i % 300);
+        ASSERT_TRUE(ring.Push(in));
+        if (i % 3 != 0) {
+            continue;
+        }
+        while (ring.Pop(out)) {
+        }
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+}
+
+TEST(AudioPacketRing, ConcurrentProducerAndConsumer) {
+    AudioPacketRing ring(8);
+    const uint32_t count = 20000;
+    std::thread producer([&]() {
+        AudioStreamPacket in;
+        for (uint32_t i = 0; i < count; i++) {
+            FillPacket(in, i, 16 + i % 200);
+            while (!ring.Push(in)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    AudioStreamPacket out;
+    for (uint32_t i = 0; i < count; i++) {
+        while (!ring.Pop(out)) {
+            std::this_thread::yield();
+        }
+        ASSERT_TRUE(PayloadMatches(out, i, 16 + i % 200)) << "packet " << i;
+    }
+    producer.join();
+}
+
+TEST(AudioJitterBuffer, ReordersAndReportsLoss) {
+    AudioJitterBuffer buffer(8);
+    AudioStreamPacket in, out;
+    // 2 arrives before 1, 3 never arrives
+    for (uint32_t sequence : {0u, 2u, 1u, 4u}) {
+        FillPacket(in, sequence);
+        ASSERT_TRUE(buffer.Put(in));
+    }
+    FillPacket(in, 2);
+    EXPECT_FALSE(buffer.Put(in));
+
+    for (uint32_t expected : {0u, 1u, 2u}) {
+        ASSERT_EQ(buffer.Get(out), kJitterBufferPacket);
+        EXPECT_TRUE(PayloadMatches(out, expected));
+    }
+    ASSERT_EQ(buffer.Get(out), kJitterBufferLost);
+    EXPECT_TRUE(out.payload.empty());
+    ASSERT_EQ(buffer.Get(out), kJitterBufferPacket);
+    EXPECT_TRUE(PayloadMatches(out, 4));
+    EXPECT_EQ(buffer.Get(out), kJitterBufferEmpty);
+
+    // Too late for its playout point
+    FillPacket(in, 3);
+    EXPECT_FALSE(buffer.Put(in));
+    auto stats = buffer.GetStats();
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.late, 1u);
+    EXPECT_EQ(stats.duplicate, 1u);
+}
+
+// The receive task reuses one packet for Put(), the decode path one for Get()
+TEST(AudioJitterBuffer, SteadyStatePutAndGetDoNotAllocate) {
+    AudioJitterBuffer buffer(kCapacity);
+    AudioStreamPacket in, out;
+    in.payload.reserve(AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+    out.payload.reserve(AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+
+    AllocationScope allocations;
+    for (uint32_t i = 0; i < 1000; i++) {
+        FillPacket(in, i, 100 + i % 300);
+        ASSERT_TRUE(buffer.Put(in));
+        buffer.Get(out);
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+}
+
+TEST(AudioPacketQueuesBenchmark, PerFrame) {
+    AudioPacketRing ring(kCapacity);
+    AudioJitterBuffer buffer(kCapacity);
+    AudioStreamPacket in, out;
+    FillPacket(in, 0, 180);
+    out.payload.reserve(AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+
+    Bench("AudioPacketRing push + pop 180 B", 200000, [&]() {
+        ring.Push(in);
+        ring.Pop(out);
+    });
+    uint32_t sequence = 0;
+    Bench("AudioJitterBuffer put + get 180 B", 200000, [&]() {
+        in.sequence = sequence++;
+        in.payload.resize(180);
+        buffer.Put(in);
+        buffer.Get(out);
+    });
+}
+
+} // namespace
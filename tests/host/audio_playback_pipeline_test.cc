@@ -0,0 +1,214 @@
+#include "audio_playback_pipeline.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Records what the sink writes, Write() can be held to stand in for a blocking I2S write
+class FakeOutputCodec : public AudioCodec {
+public:
+    FakeOutputCodec(int sample_rate) {
+        input_sample_rate_ = sample_rate;
+        output_sample_rate_ = sample_rate;
+        output_enabled_ = true;
+        first_samples_.reserve(1000);
+    }
+
+    std::atomic<bool> hold{false};
+    std::atomic<int> writes_started{0};
+
+    std::vector<int16_t> first_samples() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return first_samples_;
+    }
+
+protected:
+    int Read(int16_t* dest, int samples) override {
+        return 0;
+    }
+
+    int Write(const int16_t* data, int samples) override {
+        writes_started++;
+        while (hold.load()) {
+            std::this_thread::yield();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (samples > 0 && first_samples_.size() < first_samples_.capacity()) {
+                first_samples_.push_back(data[0]);
+            }
+        }
+        return samples;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<int16_t> first_samples_;
+};
+
+struct PlayedFrames {
+    std::mutex mutex;
+    std::vector<uint32_t> timestamps;
+    std::atomic<int> count{0};
+};
+
+// The sink task cannot be stopped on the host, so each test leaks its pipeline and codec on purpose
+struct Fixture {
+    FakeOutputCodec* codec;
+    AudioPlaybackPipeline* pipeline;
+    PlayedFrames* played;
+};
+
+Fixture StartPipeline(int sample_rate, size_t lookahead = AUDIO_PLAYBACK_LOOKAHEAD_FRAMES) {
+    Fixture f{new FakeOutputCodec(sample_rate), new AudioPlaybackPipeline(lookahead), new PlayedFrames()};
+    f.played->timestamps.reserve(4096);
+    auto played = f.played;
+    f.pipeline->Start(f.codec, [played](uint32_t timestamp) {
+        {
+            std::lock_guard<std::mutex> lock(played->mutex);
+            if (played->timestamps.size() < played->timestamps.capacity()) {
+                played->timestamps.push_back(timestamp);
+            }
+        }
+        played->count++;
+    });
+    return f;
+}
+
+void WaitFor(const std::atomic<int>& value, int target) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (value.load() < target && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    ASSERT_GE(value.load(), target);
+}
+
+// Pushes one frame whose first sample is `marker`, waiting while the decode stage is ahead
+void PushFrame(AudioPlaybackPipeline& pipeline, std::vector<int16_t>& pcm, size_t samples, int16_t marker, uint32_t timestamp) {
+    pcm.assign(samples, marker);
+    while (!pipeline.Push(pcm, timestamp)) {
+        std::this_thread::yield();
+    }
+}
+
+TEST(AudioPlaybackPipeline, PlaysFramesInOrder) {
+    auto f = StartPipeline(16000);
+    std::vector<int16_t> pcm;
+    for (int i = 0; i < 50; i++) {
+        PushFrame(*f.pipeline, pcm, 960, (int16_t)i, 1000 + i);
+    }
+    WaitFor(f.played->count, 50);
+
+    auto samples = f.codec->first_samples();
+    ASSERT_EQ(samples.size(), 50u);
+    std::lock_guard<std::mutex> lock(f.played->mutex);
+    for (int i = 0; i < 50; i++) {
+        EXPECT_EQ(samples[i], i);
+        EXPECT_EQ(f.played->timestamps[i], 1000u + i);
+    }
+    EXPECT_EQ(f.pipeline->GetStats().frames, 50u);
+}
+
+TEST(AudioPlaybackPipeline, DecodeStageRunsAheadByTheLookahead) {
+    auto f = StartPipeline(16000, 2);
+    f.codec->hold = true;
+    std::vector<int16_t> pcm;
+
+    // The sink takes the first frame and blocks in Write(), then the ring fills
+    PushFrame(*f.pipeline, pcm, 960, 0, 0);
+    WaitFor(f.codec->writes_started, 1);
+    pcm.assign(960, 1);
+    ASSERT_TRUE(f.pipeline->Push(pcm, 1));
+    pcm.assign(960, 2);
+    ASSERT_TRUE(f.pipeline->Push(pcm, 2));
+    EXPECT_TRUE(f.pipeline->Full());
+    pcm.assign(960, 3);
+    EXPECT_FALSE(f.pipeline->Push(pcm, 3));
+    // A rejected push leaves the frame with the caller
+    EXPECT_EQ(pcm.size(), 960u);
+
+    // Clear drops what the sink has not taken, the frame inside Write() still plays
+    f.pipeline->Clear();
+    EXPECT_FALSE(f.pipeline->Full());
+    f.codec->hold = false;
+    WaitFor(f.played->count, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(f.played->count.load(), 1);
+}
+
+TEST(AudioPlaybackPipeline, MeasuresFirstAudioAndUnderruns) {
+    auto f = StartPipeline(16000);
+    std::vector<int16_t> pcm;
+
+    f.pipeline->MarkStreamStart();
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    PushFrame(*f.pipeline, pcm, 16, 0, 0);
+    WaitFor(f.played->count, 1);
+    auto stats = f.pipeline->GetStats();
+    EXPECT_EQ(stats.streams, 1u);
+    EXPECT_GE(stats.last_first_audio_ms, 30);
+    EXPECT_LT(stats.last_first_audio_ms, 1000);
+    EXPECT_EQ(stats.underruns, 0u);
+
+    // 16 samples at 16 kHz last 1 ms, a 50 ms gap is an underrun, a 1.2 s gap is a pause
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    PushFrame(*f.pipeline, pcm, 16, 1, 1);
+    WaitFor(f.played->count, 2);
+    EXPECT_EQ(f.pipeline->GetStats().underruns, 1u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(AUDIO_PLAYBACK_UNDERRUN_WINDOW_MS + 200));
+    PushFrame(*f.pipeline, pcm, 16, 2, 2);
+    WaitFor(f.played->count, 3);
+    EXPECT_EQ(f.pipeline->GetStats().underruns, 1u);
+
+    f.pipeline->RecordScheduleLatency(100);
+    f.pipeline->RecordScheduleLatency(300);
+    stats = f.pipeline->GetStats();
+    EXPECT_EQ(stats.avg_schedule_us, 200);
+    EXPECT_EQ(stats.max_schedule_us, 300);
+}
+
+TEST(AudioPlaybackPipeline, SteadyStateDoesNotAllocate) {
+    auto f = StartPipeline(24000);
+    std::vector<int16_t> pcm;
+    pcm.reserve(1440);
+    // Buffers circulate between the decode stage, the ring and the sink, the first laps give them capacity
+    for (int i = 0; i < 10; i++) {
+        PushFrame(*f.pipeline, pcm, 1440, (int16_t)i, i);
+    }
+    WaitFor(f.played->count, 10);
+
+    AllocationScope allocations;
+    for (int i = 0; i < 200; i++) {
+        PushFrame(*f.pipeline, pcm, 1440, (int16_t)i, i);
+    }
+    WaitFor(f.played->count, 210);
+    EXPECT_EQ(allocations.count(), 0u);
+}
+
+TEST(AudioPlaybackPipelineBenchmark, HandoffPerFrame) {
+    auto f = StartPipeline(24000);
+    std::vector<int16_t> pcm;
+    pcm.reserve(1440);
+    int pushed = 0;
+
+    // Decode stage to codec write for one 60 ms frame, the sink never blocks here
+    Bench("AudioPlaybackPipeline push to played", 20000, [&]() {
+        PushFrame(*f.pipeline, pcm, 1440, 0, pushed++);
+    });
+    WaitFor(f.played->count, pushed);
+
+    // Latency of a lone frame: push into an idle pipeline until the sink has written it
+    Bench("AudioPlaybackPipeline idle push latency", 2000, [&]() {
+        int target = f.played->count.load() + 1;
+        PushFrame(*f.pipeline, pcm, 1440, 0, pushed++);
+        while (f.played->count.load() < target) {
+        }
+    });
+}
+
+} // namespace
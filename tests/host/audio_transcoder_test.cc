@@ -0,0 +1,282 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "audio_transcoder.h"
+#include "test_support.h"
+
+// The host opus.h stores PCM as it is, so a frame's payload is its samples
+static std::vector<int16_t> Samples(const AudioStreamPacket& packet) {
+    std::vector<int16_t> samples(packet.payload.size() / sizeof(int16_t));
+    memcpy(samples.data(), packet.payload.data(), samples.size() * sizeof(int16_t));
+    return samples;
+}
+
+// Pops every complete frame, and the padded last one when flush is set
+static std::vector<std::vector<int16_t>> Drain(AudioTranscoder& transcoder, bool flush) {
+    std::vector<std::vector<int16_t>> frames;
+    AudioStreamPacket packet;
+    while (transcoder.PopDownlinkFrame(packet)) {
+        frames.push_back(Samples(packet));
+    }
+    if (flush && transcoder.FlushDownlink(packet)) {
+        frames.push_back(Samples(packet));
+    }
+    return frames;
+}
+
+static std::vector<int16_t> Concat(const std::vector<std::vector<int16_t>>& frames) {
+    std::vector<int16_t> samples;
+    for (auto& frame : frames) {
+        samples.insert(samples.end(), frame.begin(), frame.end());
+    }
+    return samples;
+}
+
+static std::vector<uint8_t> EncodeUplink(AudioTranscoder& transcoder, const std::vector<int16_t>& pcm) {
+    std::vector<uint8_t> output;
+    EXPECT_TRUE(transcoder.EncodeUplink((const uint8_t*)pcm.data(), pcm.size() * sizeof(int16_t), output));
+    return output;
+}
+
+// Expansion tables of the ITU-T G.191 reference g711.c, indexed by code
+static const int16_t kUlawReference[256] = {
+    -32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956, -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+    -15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412, -11900, -11388, -10876, -10364, -9852, -9340, -8828, -8316,
+    -7932, -7676, -7420, -7164, -6908, -6652, -6396, -6140, -5884, -5628, -5372, -5116, -4860, -4604, -4348, -4092,
+    -3900, -3772, -3644, -3516, -3388, -3260, -3132, -3004, -2876, -2748, -2620, -2492, -2364, -2236, -2108, -1980,
+    -1884, -1820, -1756, -1692, -1628, -1564, -1500, -1436, -1372, -1308, -1244, -1180, -1116, -1052, -988, -924,
+    -876, -844, -812, -780, -748, -716, -684, -652, -620, -588, -556, -524, -492, -460, -428, -396,
+    -372, -356, -340, -324, -308, -292, -276, -260, -244, -228, -212, -196, -180, -164, -148, -132,
+    -120, -112, -104, -96, -88, -80, -72, -64, -56, -48, -40, -32, -24, -16, -8, 0,
+    32124, 31100, 30076, 29052, 28028, 27004, 25980, 24956, 23932, 22908, 21884, 20860, 19836, 18812, 17788, 16764,
+    15996, 15484, 14972, 14460, 13948, 13436, 12924, 12412, 11900, 11388, 10876, 10364, 9852, 9340, 8828, 8316,
+    7932, 7676, 7420, 7164, 6908, 6652, 6396, 6140, 5884, 5628, 5372, 5116, 4860, 4604, 4348, 4092,
+    3900, 3772, 3644, 3516, 3388, 3260, 3132, 3004, 2876, 2748, 2620, 2492, 2364, 2236, 2108, 1980,
+    1884, 1820, 1756, 1692, 1628, 1564, 1500, 1436, 1372, 1308, 1244, 1180, 1116, 1052, 988, 924,
+    876, 844, 812, 780, 748, 716, 684, 652, 620, 588, 556, 524, 492, 460, 428, 396,
+    372, 356, 340, 324, 308, 292, 276, 260, 244, 228, 212, 196, 180, 164, 148, 132,
+    120, 112, 104, 96, 88, 80, 72, 64, 56, 48, 40, 32, 24, 16, 8, 0,
+};
+
+static const int16_t kAlawReference[256] = {
+    -5504, -5248, -6016, -5760, -4480, -4224, -4992, -4736, -7552, -7296, -8064, -7808, -6528, -6272, -7040, -6784,
+    -2752, -2624, -3008, -2880, -2240, -2112, -2496, -2368, -3776, -3648, -4032, -3904, -3264, -3136, -3520, -3392,
+    -22016, -20992, -24064, -23040, -17920, -16896, -19968, -18944, -30208, -29184, -32256, -31232, -26112, -25088, -28160, -27136,
+    -11008, -10496, -12032, -11520, -8960, -8448, -9984, -9472, -15104, -14592, -16128, -15616, -13056, -12544, -14080, -13568,
+    -344, -328, -376, -360, -280, -264, -312, -296, -472, -456, -504, -488, -408, -392, -440, -424,
+    -88, -72, -120, -104, -24, -8, -56, -40, -216, -200, -248, -232, -152, -136, -184, -168,
+    -1376, -1312, -1504, -1440, -1120, -1056, -1248, -1184, -1888, -1824, -2016, -1952, -1632, -1568, -1760, -1696,
+    -688, -656, -752, -720, -560, -528, -624, -592, -944, -912, -1008, -976, -816, -784, -880, -848,
+    5504, 5248, 6016, 5760, 4480, 4224, 4992, 4736, 7552, 7296, 8064, 7808, 6528, 6272, 7040, 6784,
+    2752, 2624, 3008, 2880, 2240, 2112, 2496, 2368, 3776, 3648, 4032, 3904, 3264, 3136, 3520, 3392,
+    22016, 20992, 24064, 23040, 17920, 16896, 19968, 18944, 30208, 29184, 32256, 31232, 26112, 25088, 28160, 27136,
+    11008, 10496, 12032, 11520, 8960, 8448, 9984, 9472, 15104, 14592, 16128, 15616, 13056, 12544, 14080, 13568,
+    344, 328, 376, 360, 280, 264, 312, 296, 472, 456, 504, 488, 408, 392, 440, 424,
+    88, 72, 120, 104, 24, 8, 56, 40, 216, 200, 248, 232, 152, 136, 184, 168,
+    1376, 1312, 1504, 1440, 1120, 1056, 1248, 1184, 1888, 1824, 2016, 1952, 1632, 1568, 1760, 1696,
+    688, 656, 752, 720, 560, 528, 624, 592, 944, 912, 1008, 976, 816, 784, 880, 848,
+};
+
+// Compression points checked against the same reference, including both clipping ends
+static const int16_t kLinearPoints[] = {
+    -32768, -32767, -32124, -16384, -8192, -1000, -100, -9, -8, -1,
+    0, 1, 7, 8, 100, 1000, 8192, 16384, 32124, 32767,
+};
+static const uint8_t kUlawPoints[] = {
+    0x00, 0x00, 0x00, 0x0f, 0x1f, 0x4e, 0x72, 0x7d, 0x7e, 0x7e,
+    0xff, 0xff, 0xfe, 0xfe, 0xf2, 0xce, 0x9f, 0x8f, 0x80, 0x80,
+};
+static const uint8_t kAlawPoints[] = {
+    0x2a, 0x2a, 0x2a, 0x3a, 0x0a, 0x7a, 0x53, 0x55, 0x55, 0x55,
+    0xd5, 0xd5, 0xd5, 0xd5, 0xd3, 0xfa, 0xb5, 0xa5, 0xaa, 0xaa,
+};
+
+static void ExpectExpansion(ProviderAudioFormat format, const int16_t* reference) {
+    AudioTranscoder transcoder;
+    ASSERT_TRUE(transcoder.Configure(format, 8000, 16000, 20));
+    std::vector<uint8_t> codes(256);
+    for (int i = 0; i < 256; i++) {
+        codes[i] = i;
+    }
+    transcoder.PushDownlink(codes.data(), codes.size());
+    auto samples = Concat(Drain(transcoder, true));
+    ASSERT_GE(samples.size(), 256u);
+    for (int i = 0; i < 256; i++) {
+        EXPECT_EQ(samples[i], reference[i]) << "code " << i;
+    }
+}
+
+static void ExpectCompression(ProviderAudioFormat format, const int16_t* reference, const uint8_t* points) {
+    AudioTranscoder transcoder;
+    // Same rate on both sides, so the uplink is not resampled
+    ASSERT_TRUE(transcoder.Configure(format, 8000, 8000, 20));
+
+    std::vector<int16_t> pcm(std::begin(kLinearPoints), std::end(kLinearPoints));
+    auto codes = EncodeUplink(transcoder, pcm);
+    ASSERT_EQ(codes.size(), pcm.size());
+    for (size_t i = 0; i < pcm.size(); i++) {
+        EXPECT_EQ(codes[i], points[i]) << "sample " << pcm[i];
+    }
+
+    // Every reconstruction level maps back to its own code, except μ-law's negative zero
+    pcm.assign(reference, reference + 256);
+    codes = EncodeUplink(transcoder, pcm);
+    ASSERT_EQ(codes.size(), 256u);
+    for (int i = 0; i < 256; i++) {
+        if (format == ProviderAudioFormat::kG711Ulaw && i == 0x7F) {
+            EXPECT_EQ(codes[i], 0xFF);
+            continue;
+        }
+        EXPECT_EQ(codes[i], i) << "level " << reference[i];
+    }
+}
+
+TEST(AudioTranscoder, UlawExpandsToTheReferenceLevels) {
+    ExpectExpansion(ProviderAudioFormat::kG711Ulaw, kUlawReference);
+}
+
+TEST(AudioTranscoder, AlawExpandsToTheReferenceLevels) {
+    ExpectExpansion(ProviderAudioFormat::kG711Alaw, kAlawReference);
+}
+
+TEST(AudioTranscoder, UlawCompressesLikeTheReference) {
+    ExpectCompression(ProviderAudioFormat::kG711Ulaw, kUlawReference, kUlawPoints);
+}
+
+TEST(AudioTranscoder, AlawCompressesLikeTheReference) {
+    ExpectCompression(ProviderAudioFormat::kG711Alaw, kAlawReference, kAlawPoints);
+}
+
+TEST(AudioTranscoder, ParsesFormatNames) {
+    EXPECT_EQ(AudioTranscoder::ParseFormat("pcm16"), ProviderAudioFormat::kPcm16);
+    EXPECT_EQ(AudioTranscoder::ParseFormat("g711_ulaw"), ProviderAudioFormat::kG711Ulaw);
+    EXPECT_EQ(AudioTranscoder::ParseFormat("g711_alaw"), ProviderAudioFormat::kG711Alaw);
+    EXPECT_EQ(AudioTranscoder::ParseFormat("opus"), ProviderAudioFormat::kOpus);
+    EXPECT_EQ(AudioTranscoder::ParseFormat("mp3"), ProviderAudioFormat::kOpus);
+}
+
+TEST(AudioTranscoder, Pcm16CarriesOddBytesAcrossChunks) {
+    AudioTranscoder transcoder;
+    ASSERT_TRUE(transcoder.Configure(ProviderAudioFormat::kPcm16, 24000, 16000, 20));
+    const size_t frame_samples = 24000 / 1000 * 20;
+
+    std::vector<int16_t> pcm(frame_samples * 3);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = (int16_t)(i * 37 - 5000);
+    }
+    auto bytes = (const uint8_t*)pcm.data();
+    size_t total = pcm.size() * sizeof(int16_t);
+
+    // Chunk sizes that split samples in every possible way, including single bytes
+    const size_t sizes[] = { 1, 1, 3, 2, 7, 1, 64, 5, 333 };
+    std::vector<std::vector<int16_t>> frames;
+    size_t offset = 0;
+    for (size_t i = 0; offset < total; i++) {
+        size_t size = std::min(sizes[i % std::size(sizes)], total - offset);
+        transcoder.PushDownlink(bytes + offset, size);
+        offset += size;
+        for (auto& frame : Drain(transcoder, false)) {
+            frames.push_back(frame);
+        }
+    }
+    ASSERT_EQ(frames.size(), 3u);
+    EXPECT_EQ(Concat(frames), pcm);
+}
+
+TEST(AudioTranscoder, PacksExactFramesAndPadsTheLastOne) {
+    AudioTranscoder transcoder;
+    ASSERT_TRUE(transcoder.Configure(ProviderAudioFormat::kPcm16, 24000, 16000, 20));
+    const size_t frame_samples = 24000 / 1000 * 20;
+
+    std::vector<int16_t> pcm(frame_samples * 5 / 2);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = (int16_t)(i + 1);
+    }
+    transcoder.PushDownlink((const uint8_t*)pcm.data(), pcm.size() * sizeof(int16_t));
+
+    AudioStreamPacket packet;
+    packet.headroom = 16;
+    packet.timestamp = 1234;
+    for (int i = 0; i < 2; i++) {
+        ASSERT_TRUE(transcoder.PopDownlinkFrame(packet));
+        EXPECT_EQ(packet.sample_rate, 24000);
+        EXPECT_EQ(packet.frame_duration, 20);
+        EXPECT_EQ(packet.headroom, 0);
+        EXPECT_EQ(packet.timestamp, 0u);
+        auto samples = Samples(packet);
+        ASSERT_EQ(samples.size(), frame_samples);
+        EXPECT_EQ(samples.front(), (int16_t)(i * frame_samples + 1));
+        EXPECT_EQ(samples.back(), (int16_t)((i + 1) * frame_samples));
+    }
+    // Half a frame is left, it only comes out when the response ends
+    EXPECT_FALSE(transcoder.PopDownlinkFrame(packet));
+
+    ASSERT_TRUE(transcoder.FlushDownlink(packet));
+    auto samples = Samples(packet);
+    ASSERT_EQ(samples.size(), frame_samples);
+    for (size_t i = 0; i < frame_samples; i++) {
+        EXPECT_EQ(samples[i], i < frame_samples / 2 ? (int16_t)(2 * frame_samples + i + 1) : 0) << i;
+    }
+    EXPECT_FALSE(transcoder.PopDownlinkFrame(packet));
+    EXPECT_FALSE(transcoder.FlushDownlink(packet));
+}
+
+TEST(AudioTranscoder, FlushDropsADanglingOddByte) {
+    AudioTranscoder transcoder;
+    ASSERT_TRUE(transcoder.Configure(ProviderAudioFormat::kPcm16, 24000, 16000, 20));
+
+    const uint8_t first[] = { 0x34, 0x12, 0x99 };
+    transcoder.PushDownlink(first, sizeof(first));
+    AudioStreamPacket packet;
+    ASSERT_TRUE(transcoder.FlushDownlink(packet));
+    auto samples = Samples(packet);
+    EXPECT_EQ(samples[0], 0x1234);
+    EXPECT_EQ(samples[1], 0);
+
+    // The next response starts on a sample boundary again
+    const uint8_t second[] = { 0x78, 0x56 };
+    transcoder.PushDownlink(second, sizeof(second));
+    ASSERT_TRUE(transcoder.FlushDownlink(packet));
+    EXPECT_EQ(Samples(packet)[0], 0x5678);
+}
+
+TEST(AudioTranscoder, OpusPassesThrough) {
+    AudioTranscoder transcoder;
+    ASSERT_TRUE(transcoder.Configure(ProviderAudioFormat::kOpus, 16000, 16000, 60));
+    EXPECT_TRUE(transcoder.passthrough());
+
+    const uint8_t opus[] = { 1, 2, 3, 4, 5 };
+    std::vector<uint8_t> output;
+    ASSERT_TRUE(transcoder.EncodeUplink(opus, sizeof(opus), output));
+    EXPECT_EQ(output, std::vector<uint8_t>(std::begin(opus), std::end(opus)));
+
+    transcoder.PushDownlink(opus, sizeof(opus));
+    AudioStreamPacket packet;
+    EXPECT_FALSE(transcoder.PopDownlinkFrame(packet));
+    EXPECT_FALSE(transcoder.FlushDownlink(packet));
+}
+
+TEST(AudioTranscoder, SteadyStateDownlinkDoesNotAllocate) {
+    AudioTranscoder transcoder;
+    ASSERT_TRUE(transcoder.Configure(ProviderAudioFormat::kG711Ulaw, 8000, 16000, 20));
+    std::vector<uint8_t> chunk(100, 0x55);
+    AudioStreamPacket packet;
+    // Warm up the buffers once
+    for (int i = 0; i < 10; i++) {
+        transcoder.PushDownlink(chunk.data(), chunk.size());
+        while (transcoder.PopDownlinkFrame(packet)) {
+        }
+    }
+
+    AllocationScope allocations;
+    for (int i = 0; i < 100; i++) {
+        transcoder.PushDownlink(chunk.data(), chunk.size());
+        while (transcoder.PopDownlinkFrame(packet)) {
+        }
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+}
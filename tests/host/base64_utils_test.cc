@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base64_utils.h"
+#include "test_support.h"
+
+// Base64Utils as it was before the table rewrite, the reference for every decode and encode
+namespace legacy {
+
+const std::string base64_chars =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "abcdefghijklmnopqrstuvwxyz"
+    "0123456789+/";
+
+bool IsBase64Char(unsigned char c) {
+    return (isalnum(c) || (c == '+') || (c == '/'));
+}
+
+std::string Encode(const uint8_t* data, size_t length) {
+    std::string result;
+    int val = 0, valb = -6;
+
+    for (size_t i = 0; i < length; ++i) {
+        val = (val << 8) + data[i];
+        valb += 8;
+        while (valb >= 0) {
+            result.push_back(base64_chars[(val >> valb) & 0x3F]);
+            valb -= 6;
+        }
+    }
+
+    if (valb > -6) {
+        result.push_back(base64_chars[((val << 8) >> (valb + 8)) & 0x3F]);
+    }
+
+    while (result.size() % 4) {
+        result.push_back('=');
+    }
+
+    return result;
+}
+
+std::vector<uint8_t> Decode(const std::string& encoded) {
+    std::vector<uint8_t> result;
+    int val = 0, valb = -8;
+
+    for (unsigned char c : encoded) {
+        if (!IsBase64Char(c)) {
+            break;
+        }
+
+        val = (val << 6) + base64_chars.find(c);
+        valb += 6;
+        if (valb >= 0) {
+            result.push_back(char((val >> valb) & 0xFF));
+            valb -= 8;
+        }
+    }
+
+    return result;
+}
+
+bool IsValidBase64(const std::string& encoded) {
+    if (encoded.empty()) {
+        return false;
+    }
+    if (encoded.length() % 4 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < encoded.length(); ++i) {
+        char c = encoded[i];
+        if (i >= encoded.length() - 2 && c == '=') {
+            continue;
+        }
+        if (!IsBase64Char(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace legacy
+
+static std::vector<uint8_t> RandomBytes(std::mt19937& random, size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (auto& byte : bytes) {
+        byte = random();
+    }
+    return bytes;
+}
+
+// Mostly valid Base64 with padding, sometimes cut short and sometimes with characters outside
+// the alphabet mixed in, the way a JSON string ends in a quote
+static std::string RandomEncoded(std::mt19937& random) {
+    auto bytes = RandomBytes(random, random() % 200);
+    auto encoded = legacy::Encode(bytes.data(), bytes.size());
+    switch (random() % 4) {
+    case 0:
+        encoded.resize(random() % (encoded.size() + 1));
+        break;
+    case 1: {
+        static const char kJunk[] = "\"=\n \\-_.\x80\xff";
+        encoded.insert(encoded.begin() + random() % (encoded.size() + 1), kJunk[random() % (sizeof(kJunk) - 1)]);
+        break;
+    }
+    case 2:
+        encoded.insert(random() % (encoded.size() + 1), 1, '\0');
+        break;
+    }
+    return encoded;
+}
+
+TEST(Base64Utils, EncodeMatchesLegacy) {
+    std::mt19937 random(21);
+    std::string appended;
+    for (int round = 0; round < 20000; round++) {
+        auto bytes = RandomBytes(random, random() % 300);
+        auto expected = legacy::Encode(bytes.data(), bytes.size());
+        ASSERT_EQ(Base64Utils::Encode(bytes), expected) << round;
+        ASSERT_EQ(expected.size(), Base64Utils::EncodedSize(bytes.size()));
+
+        // Appends after what the caller already wrote
+        appended.assign("{\"audio\":\"");
+        Base64Utils::Encode(bytes.data(), bytes.size(), appended);
+        ASSERT_EQ(appended, "{\"audio\":\"" + expected) << round;
+    }
+}
+
+TEST(Base64Utils, DecodeMatchesLegacy) {
+    std::mt19937 random(2121);
+    std::vector<uint8_t> reused;
+    std::vector<uint8_t> buffer;
+    for (int round = 0; round < 20000; round++) {
+        auto encoded = RandomEncoded(random);
+        auto expected = legacy::Decode(encoded);
+        ASSERT_EQ(Base64Utils::Decode(encoded), expected) << round << " " << encoded;
+
+        Base64Utils::Decode(encoded, reused);
+        ASSERT_EQ(reused, expected) << round;
+
+        buffer.assign(Base64Utils::DecodedSize(encoded.size()), 0xAA);
+        size_t written = Base64Utils::Decode(encoded.data(), encoded.size(), buffer.data());
+        ASSERT_LE(written, Base64Utils::DecodedSize(encoded.size()));
+        ASSERT_EQ(std::vector<uint8_t>(buffer.begin(), buffer.begin() + written), expected) << round;
+
+        ASSERT_EQ(Base64Utils::IsValidBase64(encoded), legacy::IsValidBase64(encoded)) << round << " " << encoded;
+    }
+}
+
+// Decoding over the input itself, as the OpenAI adapter does in its receive buffer
+TEST(Base64Utils, DecodesInPlace) {
+    std::mt19937 random(212121);
+    for (int round = 0; round < 20000; round++) {
+        auto encoded = RandomEncoded(random);
+        auto expected = legacy::Decode(encoded);
+        std::string buffer = encoded;
+        size_t written = Base64Utils::Decode(buffer.data(), buffer.size(), (uint8_t*)buffer.data());
+        ASSERT_EQ(std::vector<uint8_t>(buffer.begin(), buffer.begin() + written), expected) << round << " " << encoded;
+    }
+}
+
+// The same result however the input is split, and never more output than Feed promises
+TEST(Base64Utils, StreamDecoderMatchesLegacyOnAnySplit) {
+    std::mt19937 random(21212121);
+    const uint8_t kCanary = 0x5A;
+    std::vector<uint8_t> piece_output;
+    for (int round = 0; round < 20000; round++) {
+        auto encoded = RandomEncoded(random);
+        auto expected = legacy::Decode(encoded);
+
+        Base64Utils::StreamDecoder decoder;
+        std::vector<uint8_t> decoded;
+        size_t offset = 0;
+        while (offset < encoded.size()) {
+            size_t length = std::min<size_t>(encoded.size() - offset, random() % 9);
+            size_t limit = Base64Utils::DecodedSize(length) + 2;
+            piece_output.assign(limit + 4, kCanary);
+            size_t written = decoder.Feed(encoded.data() + offset, length, piece_output.data());
+            ASSERT_LE(written, limit) << round;
+            for (size_t i = limit; i < piece_output.size(); i++) {
+                ASSERT_EQ(piece_output[i], kCanary) << round;
+            }
+            decoded.insert(decoded.end(), piece_output.begin(), piece_output.begin() + written);
+            offset += length;
+        }
+        uint8_t tail[2 + 4];
+        memset(tail, kCanary, sizeof(tail));
+        size_t written = decoder.Finish(tail);
+        ASSERT_LE(written, 2u);
+        decoded.insert(decoded.end(), tail, tail + written);
+        ASSERT_EQ(decoded, expected) << round << " " << encoded;
+
+        bool terminated = encoded.find_first_not_of(legacy::base64_chars) != std::string::npos;
+        ASSERT_EQ(decoder.finished(), terminated) << round;
+    }
+}
+
+TEST(Base64Utils, StreamDecoderStopsAtTheClosingQuote) {
+    Base64Utils::StreamDecoder decoder;
+    uint8_t output[16];
+    // "hello" is aGVsbG8=, split inside a block and ended by the quote of the JSON string
+    EXPECT_EQ(decoder.Feed("aGVs", 4, output), 3u);
+    EXPECT_EQ(decoder.Feed("bG", 2, output + 3), 0u);
+    EXPECT_FALSE(decoder.finished());
+    EXPECT_EQ(decoder.Feed("8\",\"type\":\"x\"}", 14, output + 3), 2u);
+    EXPECT_TRUE(decoder.finished());
+    EXPECT_EQ(std::string((char*)output, 5), "hello");
+    EXPECT_EQ(decoder.Feed("QUJD", 4, output), 0u);
+    EXPECT_EQ(decoder.Finish(output), 0u);
+
+    decoder.Reset();
+    EXPECT_FALSE(decoder.finished());
+    EXPECT_EQ(decoder.Feed("QUJD", 4, output), 3u);
+    EXPECT_EQ(std::string((char*)output, 3), "ABC");
+}
+
+TEST(Base64Utils, ReusedBuffersDoNotAllocate) {
+    std::mt19937 random(7);
+    auto pcm = RandomBytes(random, 3840);
+    auto encoded = Base64Utils::Encode(pcm);
+    std::string message;
+    std::vector<uint8_t> decoded;
+    auto round_trip = [&]() {
+        message.assign("{\"type\":\"input_audio_buffer.append\",\"audio\":\"");
+        Base64Utils::Encode(pcm.data(), pcm.size(), message);
+        message += "\"}";
+        Base64Utils::Decode(encoded, decoded);
+    };
+    round_trip();
+    AllocationScope allocations;
+    for (int i = 0; i < 100; i++) {
+        round_trip();
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+    EXPECT_EQ(decoded, pcm);
+}
+
+// A 200 ms PCM16 24 kHz audio delta, the size the realtime APIs send
+TEST(Base64UtilsBenchmark, AudioDelta) {
+    std::mt19937 random(8);
+    auto pcm = RandomBytes(random, 9600);
+    auto encoded = Base64Utils::Encode(pcm);
+    size_t bytes = 0;
+
+    Bench("legacy Decode 12.8 KB", 5000, [&]() {
+        bytes += legacy::Decode(encoded).size();
+    });
+    Bench("Decode 12.8 KB", 5000, [&]() {
+        bytes += Base64Utils::Decode(encoded).size();
+    });
+    std::vector<uint8_t> reused;
+    Bench("Decode 12.8 KB into reused vector", 5000, [&]() {
+        Base64Utils::Decode(encoded, reused);
+        bytes += reused.size();
+    });
+    std::string buffer = encoded;
+    Bench("Decode 12.8 KB in place", 5000, [&]() {
+        // Decoding in place destroys the input, the copy is part of the cost
+        memcpy(buffer.data(), encoded.data(), encoded.size());
+        bytes += Base64Utils::Decode(buffer.data(), buffer.size(), (uint8_t*)buffer.data());
+    });
+    // Pieces the size of a TLS record payload, as the receive buffer hands them over
+    std::vector<uint8_t> output(Base64Utils::DecodedSize(1400) + 2);
+    Bench("StreamDecoder 12.8 KB in 1400 B pieces", 5000, [&]() {
+        Base64Utils::StreamDecoder decoder;
+        for (size_t offset = 0; offset < encoded.size(); offset += 1400) {
+            bytes += decoder.Feed(encoded.data() + offset, std::min<size_t>(1400, encoded.size() - offset), output.data());
+        }
+        bytes += decoder.Finish(output.data());
+    });
+
+    Bench("legacy Encode 9.6 KB", 5000, [&]() {
+        bytes += legacy::Encode(pcm.data(), pcm.size()).size();
+    });
+    std::string message;
+    Bench("Encode 9.6 KB appended to reused string", 5000, [&]() {
+        message.clear();
+        Base64Utils::Encode(pcm.data(), pcm.size(), message);
+        bytes += message.size();
+    });
+    EXPECT_GT(bytes, 0u);
+}
@@ -0,0 +1,125 @@
+#include "connection_health.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <set>
+
+TEST(ConnectionHealth, StartsIdleAndHealthy) {
+    ConnectionHealth health;
+    EXPECT_EQ(health.state(), kConnectionStateIdle);
+    EXPECT_EQ(health.score(), 100);
+    EXPECT_EQ(health.rtt_ms(), 0);
+    EXPECT_EQ(health.consecutive_failures(), 0);
+}
+
+TEST(ConnectionHealth, FailuresDecayTheScore) {
+    ConnectionHealth health;
+    int previous = health.score();
+    for (int i = 1; i <= 20; i++) {
+        health.OnConnecting();
+        health.OnFailure();
+        EXPECT_EQ(health.state(), kConnectionStateBackoff);
+        EXPECT_EQ(health.consecutive_failures(), i);
+        EXPECT_LT(health.score(), previous) << i;
+        previous = health.score();
+        if (previous == 0) {
+            break;
+        }
+    }
+    // A quarter of the distance per sample: 100, 75, 56, 42, ...
+    ConnectionHealth fresh;
+    fresh.OnFailure();
+    EXPECT_EQ(fresh.score(), 75);
+    fresh.OnFailure();
+    EXPECT_EQ(fresh.score(), 56);
+    EXPECT_EQ(previous, 0);
+}
+
+TEST(ConnectionHealth, RecoversFullyAfterSuccesses) {
+    ConnectionHealth health;
+    for (int i = 0; i < 30; i++) {
+        health.OnFailure();
+    }
+    ASSERT_EQ(health.score(), 0);
+
+    health.OnConnecting();
+    health.OnConnected();
+    EXPECT_EQ(health.state(), kConnectionStateConnected);
+    EXPECT_EQ(health.consecutive_failures(), 0);
+    int previous = health.score();
+    EXPECT_EQ(previous, 25);
+    for (int i = 0; i < 40 && health.score() < 100; i++) {
+        health.OnConnected();
+        EXPECT_GT(health.score(), previous) << i;
+        previous = health.score();
+    }
+    EXPECT_EQ(health.score(), 100);
+}
+
+TEST(ConnectionHealth, OnlyAnEstablishedConnectionCountsAsDisconnected) {
+    ConnectionHealth health;
+    health.OnDisconnected();
+    EXPECT_EQ(health.state(), kConnectionStateIdle);
+    EXPECT_EQ(health.score(), 100);
+
+    health.OnConnected();
+    health.OnDisconnected();
+    EXPECT_EQ(health.state(), kConnectionStateDisconnected);
+    EXPECT_EQ(health.score(), 82);
+    // Reported again by a second callback, not held against the score twice
+    health.OnDisconnected();
+    EXPECT_EQ(health.score(), 82);
+
+    // Closing on purpose leaves the score alone
+    health.OnConnected();
+    int score = health.score();
+    health.OnClosed();
+    EXPECT_EQ(health.state(), kConnectionStateIdle);
+    EXPECT_EQ(health.score(), score);
+}
+
+TEST(ConnectionHealth, SlowRoundTripsLowerTheScoreWithinBounds) {
+    ConnectionHealth health;
+    health.OnRttSample(200);
+    EXPECT_EQ(health.rtt_ms(), 200);
+    EXPECT_EQ(health.score(), 100);
+    // Smoothed like SRTT, an eighth of the difference
+    health.OnRttSample(1000);
+    EXPECT_EQ(health.rtt_ms(), 300);
+    EXPECT_LT(health.score(), 100);
+
+    // The penalty stops at 50, however slow the server is
+    for (int i = 0; i < 50; i++) {
+        health.OnRttSample(60000);
+    }
+    EXPECT_EQ(health.score(), 50);
+    for (int i = 0; i < 50; i++) {
+        health.OnRttSample(100);
+    }
+    EXPECT_EQ(health.score(), 100);
+}
+
+TEST(ConnectionHealth, BackoffDoublesWithinBounds) {
+    ConnectionHealth health;
+    for (int failures = 0; failures <= 30; failures++) {
+        int base = CONNECTION_BACKOFF_MIN_MS;
+        for (int i = 1; i < failures; i++) {
+            base = std::min(base * 2, CONNECTION_BACKOFF_MAX_MS);
+        }
+        std::set<int> delays;
+        for (int i = 0; i < 200; i++) {
+            int delay = health.NextRetryDelayMs();
+            ASSERT_GE(delay, base / 2) << failures;
+            ASSERT_LE(delay, base) << failures;
+            ASSERT_LE(delay, CONNECTION_BACKOFF_MAX_MS);
+            delays.insert(delay);
+        }
+        // Jittered, devices that lost the server together spread out
+        EXPECT_GT(delays.size(), 50u) << failures;
+        health.OnFailure();
+    }
+
+    // A success starts over at the minimum
+    health.OnConnected();
+    EXPECT_LE(health.NextRetryDelayMs(), CONNECTION_BACKOFF_MIN_MS);
+}
@@ -0,0 +1,120 @@
+#include "fake_transports.h"
+
+FakeReceiveTask::FakeReceiveTask() : thread_(&FakeReceiveTask::Run, this) {
+}
+
+FakeReceiveTask::~FakeReceiveTask() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+}
+
+void FakeReceiveTask::Post(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    condition_.notify_all();
+}
+
+void FakeReceiveTask::WaitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return jobs_.empty() && !busy_; });
+}
+
+// Jobs still queued when the transport is deleted are dropped, like frames in a closed socket
+void FakeReceiveTask::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        condition_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+            return;
+        }
+        auto job = std::move(jobs_.front());
+        jobs_.pop_front();
+        busy_ = true;
+        lock.unlock();
+        job();
+        lock.lock();
+        busy_ = false;
+        condition_.notify_all();
+    }
+}
+
+bool FakeWebSocket::Send(const void* data, size_t len, bool binary, bool fin) {
+    if (!connected) {
+        return false;
+    }
+    std::string_view message((const char*)data, len);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (binary) {
+            last_binary.assign(message);
+            binary_sent++;
+        } else {
+            last_text.assign(message);
+            text_sent++;
+        }
+    }
+    if (server) {
+        server(*this, message, binary);
+    }
+    return true;
+}
+
+void FakeWebSocket::Receive(std::string data, bool binary) {
+    receive_task_.Post([this, data = std::move(data), binary]() {
+        Deliver(data.data(), data.size(), binary);
+    });
+}
+
+void FakeWebSocket::Deliver(const char* data, size_t len, bool binary) {
+    if (on_data_) {
+        on_data_(data, len, binary);
+    }
+}
+
+void FakeWebSocket::Disconnect() {
+    receive_task_.Post([this]() {
+        connected = false;
+        if (on_disconnected_) {
+            on_disconnected_();
+        }
+    });
+}
+
+bool FakeMqtt::Publish(const std::string& topic, const std::string& payload, int qos) {
+    if (!connected) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        last_topic.assign(topic);
+        last_payload.assign(payload);
+        published++;
+    }
+    if (server) {
+        server(*this, topic, payload);
+    }
+    return true;
+}
+
+void FakeMqtt::Receive(std::string topic, std::string payload) {
+    receive_task_.Post([this, topic = std::move(topic), payload = std::move(payload)]() {
+        if (on_message_) {
+            on_message_(topic, payload);
+        }
+    });
+}
+
+void FakeMqtt::Drop() {
+    receive_task_.Post([this]() {
+        connected = false;
+        if (on_disconnected_) {
+            on_disconnected_();
+        }
+    });
+}
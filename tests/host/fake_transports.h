@@ -0,0 +1,207 @@
+#ifndef FAKE_TRANSPORTS_H
+#define FAKE_TRANSPORTS_H
+
+#include <udp.h>
+#include <web_socket.h>
+#include <mqtt.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/*
+ * In-memory transports for the host tests. HostBoard hands out whatever the installed factory
+ * creates, so a test sees every transport the code under test opens. Sent messages are kept
+ * in buffers that keep their capacity, so recording them does not allocate in steady state.
+ *
+ * Like the esp-ml307 clients, the websocket and MQTT fakes deliver incoming messages on their
+ * own receive thread, which is joined when the transport is deleted. A scripted server hook
+ * sees every outgoing message and answers with Receive().
+ */
+class FakeUdp : public Udp {
+public:
+    bool Connect(const std::string& host, int port) override {
+        this->host = host;
+        this->port = port;
+        connected_ = connect_result;
+        return connected_;
+    }
+
+    void Disconnect() override {
+        connected_ = false;
+    }
+
+    int Send(const std::string& data) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        last_datagram.assign(data);
+        sent++;
+        return data.size();
+    }
+
+    // Delivers a datagram as if it came from the server, on the calling thread
+    void Receive(const std::string& data) {
+        if (message_callback_) {
+            message_callback_(data);
+        }
+    }
+
+    std::string host;
+    int port = 0;
+    bool connect_result = true;
+    std::mutex mutex;
+    std::string last_datagram;
+    std::atomic<int> sent{0};
+};
+
+// Runs jobs one after another on its own thread, the stand-in for a transport's receive task
+class FakeReceiveTask {
+public:
+    FakeReceiveTask();
+    ~FakeReceiveTask();
+
+    void Post(std::function<void()> job);
+    // Returns once every job posted so far has run
+    void WaitIdle();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::function<void()>> jobs_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::thread thread_;
+
+    void Run();
+};
+
+class FakeWebSocket : public WebSocket {
+public:
+    void SetHeader(const char* key, const char* value) override {
+        headers[key] = value;
+    }
+
+    bool Connect(const char* uri) override {
+        url = uri;
+        connected = connect_result;
+        return connected;
+    }
+
+    bool IsConnected() const override {
+        return connected;
+    }
+
+    bool Send(const std::string& data) override {
+        return Send(data.data(), data.size(), false, true);
+    }
+
+    bool Send(const void* data, size_t len, bool binary = false, bool fin = true) override;
+
+    void Close() override {
+        connected = false;
+    }
+
+    // A frame from the server, delivered on the receive thread
+    void Receive(std::string data, bool binary);
+    // A frame from the server, delivered on the calling thread, which stands in for the receive task
+    void Deliver(const char* data, size_t len, bool binary);
+    // The server closes the connection
+    void Disconnect();
+    void WaitIdle() { receive_task_.WaitIdle(); }
+
+    // Scripted server, called on the sending thread with every message the device sends
+    std::function<void(FakeWebSocket& websocket, std::string_view data, bool binary)> server;
+    bool connect_result = true;
+    std::atomic<bool> connected{false};
+    std::map<std::string, std::string> headers;
+    std::string url;
+
+    std::mutex mutex;
+    std::string last_text;
+    std::string last_binary;
+    std::atomic<int> text_sent{0};
+    std::atomic<int> binary_sent{0};
+
+private:
+    // Declared last, so the thread is joined before anything it uses goes away
+    FakeReceiveTask receive_task_;
+};
+
+class FakeMqtt : public Mqtt {
+public:
+    void SetKeepAlive(int keep_alive_seconds) override {
+        keep_alive = keep_alive_seconds;
+    }
+
+    bool Connect(const std::string& broker_address, int broker_port, const std::string& client_id,
+        const std::string& username, const std::string& password) override {
+        this->broker_address = broker_address;
+        this->broker_port = broker_port;
+        this->client_id = client_id;
+        this->username = username;
+        this->password = password;
+        connected = connect_result;
+        return connected;
+    }
+
+    void Disconnect() override {
+        connected = false;
+    }
+
+    bool Publish(const std::string& topic, const std::string& payload, int qos = 0) override;
+
+    bool Subscribe(const std::string& topic, int qos = 0) override {
+        return connected;
+    }
+
+    bool Unsubscribe(const std::string& topic) override {
+        return connected;
+    }
+
+    bool IsConnected() override {
+        return connected;
+    }
+
+    // A message from the broker, delivered on the receive thread
+    void Receive(std::string topic, std::string payload);
+    // The broker drops the connection
+    void Drop();
+    void WaitIdle() { receive_task_.WaitIdle(); }
+
+    // Scripted server, called on the publishing thread
+    std::function<void(FakeMqtt& mqtt, const std::string& topic, const std::string& payload)> server;
+    bool connect_result = true;
+    std::atomic<bool> connected{false};
+    std::string broker_address;
+    int broker_port = 0;
+    std::string client_id;
+    std::string username;
+    std::string password;
+    int keep_alive = 0;
+
+    std::mutex mutex;
+    std::string last_topic;
+    std::string last_payload;
+    std::atomic<int> published{0};
+
+private:
+    FakeReceiveTask receive_task_;
+};
+
+struct HostTransports {
+    std::function<WebSocket*()> create_websocket;
+    std::function<Mqtt*()> create_mqtt;
+    std::function<Udp*()> create_udp;
+};
+
+// Replaced by each test, the default creates plain fakes
+HostTransports& GetHostTransports();
+// Puts the default factories back
+void ResetHostTransports();
+
+#endif // FAKE_TRANSPORTS_H
@@ -0,0 +1,30 @@
+#include "board.h"
+#include "fake_transports.h"
+
+static HostTransports DefaultTransports() {
+    return HostTransports{
+        .create_websocket = []() -> WebSocket* { return new FakeWebSocket(); },
+        .create_mqtt = []() -> Mqtt* { return new FakeMqtt(); },
+        .create_udp = []() -> Udp* { return new FakeUdp(); },
+    };
+}
+
+HostTransports& GetHostTransports() {
+    static HostTransports transports = DefaultTransports();
+    return transports;
+}
+
+void ResetHostTransports() {
+    GetHostTransports() = DefaultTransports();
+}
+
+class HostBoard : public Board {
+public:
+    WebSocket* CreateWebSocket() override { return GetHostTransports().create_websocket(); }
+    Mqtt* CreateMqtt() override { return GetHostTransports().create_mqtt(); }
+    Udp* CreateUdp() override { return GetHostTransports().create_udp(); }
+};
+
+void* create_board() {
+    return new HostBoard();
+}
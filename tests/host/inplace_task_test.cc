@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "inplace_task.h"
+#include "protocol.h"
+#include "test_support.h"
+
+namespace {
+
+// Callable of about `Size` bytes that counts its live instances and moves
+template <size_t Size, bool NothrowMove = true>
+struct Counted {
+    static inline int alive = 0;
+    static inline int moves = 0;
+
+    int value;
+    char padding[Size > sizeof(int) ? Size - sizeof(int) : 1] = {};
+
+    explicit Counted(int value) : value(value) { alive++; }
+    Counted(const Counted& other) : value(other.value) { alive++; }
+    Counted(Counted&& other) noexcept(NothrowMove) : value(other.value) {
+        alive++;
+        moves++;
+    }
+    ~Counted() { alive--; }
+
+    int operator()(int add) { return value + add; }
+
+    static void ResetCounts() {
+        alive = 0;
+        moves = 0;
+    }
+};
+
+using Task = InplaceTask<32, int(int)>;
+using Small = Counted<16>;
+using Large = Counted<64>;
+using ThrowingMove = Counted<8, false>;
+
+struct alignas(64) OverAligned {
+    int operator()(int add) { return add; }
+};
+
+} // namespace
+
+TEST(InplaceTask, KeepsSmallCallablesInline) {
+    static_assert(Task::fits_inline<Small>);
+    static_assert(Task::fits_inline<Counted<32>>);
+    static_assert(!Task::fits_inline<Counted<33>>);
+
+    Small::ResetCounts();
+    {
+        AllocationScope allocations;
+        Task task(Small(40));
+        EXPECT_EQ(allocations.count(), 0u);
+        EXPECT_TRUE(task);
+        EXPECT_EQ(task(2), 42);
+        EXPECT_EQ(Small::alive, 1);
+    }
+    EXPECT_EQ(Small::alive, 0);
+}
+
+TEST(InplaceTask, MovesLargeAndUnsuitableCallablesToTheHeap) {
+    static_assert(!Task::fits_inline<Large>);
+    // Small, but moving it could throw, the inline relocation must not
+    static_assert(!Task::fits_inline<ThrowingMove>);
+    static_assert(!Task::fits_inline<OverAligned>);
+
+    Large::ResetCounts();
+    {
+        Large callable(1);
+        AllocationScope allocations;
+        Task task(std::move(callable));
+        EXPECT_EQ(allocations.count(), 1u);
+        EXPECT_EQ(task(1), 2);
+        EXPECT_EQ(Large::alive, 2);
+    }
+    EXPECT_EQ(Large::alive, 0);
+
+    ThrowingMove::ResetCounts();
+    {
+        Task task(ThrowingMove(5));
+        EXPECT_EQ(task(1), 6);
+    }
+    EXPECT_EQ(ThrowingMove::alive, 0);
+
+    Task aligned{OverAligned()};
+    EXPECT_EQ(aligned(7), 7);
+}
+
+TEST(InplaceTask, MoveRelocatesInlineCallables) {
+    Small::ResetCounts();
+    {
+        Task first(Small(10));
+        int moves = Small::moves;
+
+        Task second(std::move(first));
+        EXPECT_TRUE(first == nullptr);
+        EXPECT_TRUE(second != nullptr);
+        EXPECT_EQ(second(1), 11);
+        // One move into the new storage, the old instance is destroyed right away
+        EXPECT_EQ(Small::moves, moves + 1);
+        EXPECT_EQ(Small::alive, 1);
+
+        Task third;
+        third = std::move(second);
+        EXPECT_FALSE(second);
+        EXPECT_EQ(third(2), 12);
+        EXPECT_EQ(Small::alive, 1);
+    }
+    EXPECT_EQ(Small::alive, 0);
+}
+
+TEST(InplaceTask, MoveHandsOverTheHeapCallable) {
+    Large::ResetCounts();
+    {
+        Task first(Large(20));
+        int moves = Large::moves;
+
+        AllocationScope allocations;
+        Task second(std::move(first));
+        Task third;
+        third = std::move(second);
+        // Only the pointer changes hands
+        EXPECT_EQ(allocations.count(), 0u);
+        EXPECT_EQ(Large::moves, moves);
+        EXPECT_FALSE(first);
+        EXPECT_FALSE(second);
+        EXPECT_EQ(third(3), 23);
+        EXPECT_EQ(Large::alive, 1);
+    }
+    EXPECT_EQ(Large::alive, 0);
+}
+
+TEST(InplaceTask, ReplacingOrClearingDestroysTheOldCallable) {
+    Small::ResetCounts();
+    Large::ResetCounts();
+
+    Task task(Small(1));
+    task = Task(Large(2));
+    EXPECT_EQ(Small::alive, 0);
+    EXPECT_EQ(Large::alive, 1);
+    EXPECT_EQ(task(0), 2);
+
+    task = Task(Small(3));
+    EXPECT_EQ(Large::alive, 0);
+    EXPECT_EQ(Small::alive, 1);
+
+    task = nullptr;
+    EXPECT_FALSE(task);
+    EXPECT_EQ(Small::alive, 0);
+
+    // Self move-assignment keeps the callable
+    task = Task(Small(4));
+    auto& self = task;
+    task = std::move(self);
+    EXPECT_EQ(task(0), 4);
+    EXPECT_EQ(Small::alive, 1);
+}
+
+TEST(InplaceTask, ForwardsArgumentsAndResults) {
+    InplaceTask<16, std::string(std::unique_ptr<int>, const std::string&)> task(
+        [](std::unique_ptr<int> value, const std::string& text) {
+            return text + std::to_string(*value);
+        });
+    EXPECT_EQ(task(std::make_unique<int>(7), "x"), "x7");
+
+    int calls = 0;
+    InplaceTask<16> counter([&calls]() { calls++; });
+    counter();
+    counter();
+    EXPECT_EQ(calls, 2);
+}
+
+// The handlers Application registers capture `this` plus up to two more pointers
+TEST(InplaceTask, ProtocolCallbacksStayInline) {
+    static_assert(PROTOCOL_CALLBACK_INLINE_SIZE == 32);
+    struct Application;
+    struct Board;
+    Application* app = nullptr;
+    Board* board = nullptr;
+    void* codec = nullptr;
+
+    auto on_audio = [app](AudioStreamPacket&& packet) { (void)app; };
+    auto on_json = [app](const JsonMessage& message) { (void)app; };
+    auto on_opened = [app, codec, board]() { (void)app; (void)codec; (void)board; };
+    auto on_error = [app](const std::string& message) { (void)app; };
+    static_assert(ProtocolCallback<void(AudioStreamPacket&&)>::fits_inline<decltype(on_audio)>);
+    static_assert(ProtocolCallback<void(const JsonMessage&)>::fits_inline<decltype(on_json)>);
+    static_assert(ProtocolCallback<void()>::fits_inline<decltype(on_opened)>);
+    static_assert(ProtocolCallback<void(const std::string&)>::fits_inline<decltype(on_error)>);
+
+    // Four pointers is the limit
+    auto four = [app, codec, board, other = codec]() { (void)app; (void)codec; (void)board; (void)other; };
+    auto five = [app, codec, board, other = codec, more = codec]() {
+        (void)app; (void)codec; (void)board; (void)other; (void)more;
+    };
+    static_assert(ProtocolCallback<void()>::fits_inline<decltype(four)>);
+    static_assert(!ProtocolCallback<void()>::fits_inline<decltype(five)>);
+
+    AllocationScope allocations;
+    ProtocolCallback<void()> callback(on_opened);
+    callback();
+    EXPECT_EQ(allocations.count(), 0u);
+}
@@ -0,0 +1,336 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "json_message.h"
+#include "message_router.h"
+#include "test_support.h"
+
+// cJSON allocates with malloc, this counts its heap blocks the way AllocationScope counts operator new
+class CjsonAllocationScope {
+public:
+    CjsonAllocationScope() {
+        count_ = 0;
+        cJSON_Hooks hooks = {CountedMalloc, free};
+        cJSON_InitHooks(&hooks);
+    }
+    ~CjsonAllocationScope() { cJSON_InitHooks(nullptr); }
+    size_t count() const { return count_; }
+
+private:
+    static inline size_t count_ = 0;
+
+    static void* CountedMalloc(size_t size) {
+        count_++;
+        return malloc(size);
+    }
+};
+
+static JsonMessage Message(const std::string& text) {
+    return JsonMessage(text.data(), text.size());
+}
+
+// One message per line, captured from a conversation with the xiaozhi server
+static std::vector<std::string> LoadServerTraffic() {
+    std::vector<std::string> messages;
+    std::ifstream file(HOST_TEST_DATA_DIR "/server_traffic.jsonl");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) {
+            messages.push_back(line);
+        }
+    }
+    return messages;
+}
+
+TEST(JsonMessage, PicksUpTypeAndState) {
+    std::string text = R"({"type":"tts","state":"sentence_start","text":"hi","session_id":"abc"})";
+    JsonMessage message(text.data(), text.size());
+    EXPECT_TRUE(message.valid());
+    EXPECT_EQ(message.type(), "tts");
+    EXPECT_EQ(message.state(), "sentence_start");
+    EXPECT_EQ(message.text(), text);
+}
+
+TEST(JsonMessage, SkipsNestedValuesAndWhitespace) {
+    std::string text = " {\n\t\"payload\" : {\"type\":\"inner\",\"list\":[1, \"]\", {\"state\":\"x\"}]},\r\n"
+        "  \"ok\": true , \"n\": -1.5e3, \"none\": null,\n  \"type\" : \"mcp\" } ";
+    JsonMessage message(text.data(), text.size());
+    EXPECT_TRUE(message.valid());
+    // Only top-level fields count
+    EXPECT_EQ(message.type(), "mcp");
+    EXPECT_EQ(message.state(), "");
+    std::string_view value;
+    EXPECT_FALSE(message.GetString("list", value));
+    // Non-string values are not returned as strings
+    EXPECT_FALSE(message.GetString("ok", value));
+}
+
+TEST(JsonMessage, RejectsMalformedText) {
+    for (const char* text : {"", "   ", "[]", "\"tts\"", "{", "{\"type\"", "{\"type\":", "{\"type\":\"tts\"",
+             "{\"type\":\"tts\",}", "{\"type\" \"tts\"}", "{type:\"tts\"}", "{\"a\":[1,2}", "{\"a\":\"unterminated}"}) {
+        JsonMessage message(text, strlen(text));
+        EXPECT_FALSE(message.valid()) << text;
+        EXPECT_EQ(message.root(), nullptr) << text;
+    }
+    JsonMessage empty("{}", 2);
+    EXPECT_TRUE(empty.valid());
+    EXPECT_EQ(empty.type(), "");
+}
+
+TEST(JsonMessage, GetStringIsRawAndGetTextDecodes) {
+    std::string text = R"({"type":"stt","text":"Say \"hi\"\n\\ \/ \t你好 😊","plain":"abc"})";
+    JsonMessage message(text.data(), text.size());
+    std::string_view raw;
+    ASSERT_TRUE(message.GetString("text", raw));
+    EXPECT_EQ(raw, R"(Say \"hi\"\n\\ \/ \t你好 😊)");
+    EXPECT_EQ(message.GetText("text"), "Say \"hi\"\n\\ / \t\xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x8a");
+    EXPECT_EQ(message.GetText("plain"), "abc");
+    EXPECT_EQ(message.GetText("missing"), "");
+    // The decoded text matches what cJSON makes of it
+    auto item = cJSON_GetObjectItem(message.root(), "text");
+    ASSERT_TRUE(cJSON_IsString(item));
+    EXPECT_EQ(message.GetText("text"), item->valuestring);
+}
+
+TEST(JsonMessage, EscapedQuoteDoesNotEndTheString) {
+    std::string text = R"({"text":"a \"type\":\"fake\" b","type":"real"})";
+    JsonMessage message(text.data(), text.size());
+    EXPECT_TRUE(message.valid());
+    EXPECT_EQ(message.type(), "real");
+}
+
+TEST(JsonMessage, RootIsParsedOnDemand) {
+    std::string text = R"({"type":"mcp","payload":{"jsonrpc":"2.0","method":"tools/list","id":2}})";
+    JsonMessage message(text.data(), text.size());
+    const cJSON* root;
+    {
+        CjsonAllocationScope allocations;
+        EXPECT_EQ(message.type(), "mcp");
+        EXPECT_EQ(allocations.count(), 0u);
+        root = message.root();
+        EXPECT_GT(allocations.count(), 0u);
+    }
+    ASSERT_NE(root, nullptr);
+    EXPECT_EQ(message.root(), root);
+    auto payload = cJSON_GetObjectItem(root, "payload");
+    EXPECT_STREQ(cJSON_GetObjectItem(payload, "method")->valuestring, "tools/list");
+}
+
+TEST(ForEachJsonElement, VisitsRawElements) {
+    std::vector<std::string> elements;
+    auto collect = [&elements](std::string_view element) { elements.emplace_back(element); };
+    EXPECT_TRUE(ForEachJsonElement(R"( [ 1, "a,]", {"b":[2,3]} ,true,null, [] ] )", collect));
+    EXPECT_EQ(elements, (std::vector<std::string>{"1", "\"a,]\"", "{\"b\":[2,3]}", "true", "null", "[]"}));
+
+    elements.clear();
+    EXPECT_TRUE(ForEachJsonElement("[]", collect));
+    EXPECT_TRUE(ForEachJsonElement(" [ ] ", collect));
+    EXPECT_TRUE(elements.empty());
+}
+
+TEST(ForEachJsonElement, RejectsMalformedArrays) {
+    auto ignore = [](std::string_view) {};
+    for (const char* text : {"", "{}", "[", "[1", "[1,", "[1 2]", "[\"a]", "[{\"a\":1]", "[,]"}) {
+        EXPECT_FALSE(ForEachJsonElement(text, ignore)) << text;
+    }
+}
+
+TEST(MessageRouter, DispatchesByType) {
+    MessageRouter router;
+    std::vector<std::string> calls;
+    const char* types[] = {"tts", "stt", "llm", "mcp", "iot", "system", "alert", "hello", "goodbye"};
+    for (auto type : types) {
+        router.On(type, [&calls, type](const JsonMessage& message) {
+            EXPECT_EQ(message.type(), type);
+            calls.push_back(type);
+        });
+    }
+    for (auto type : types) {
+        EXPECT_TRUE(router.Dispatch(Message(std::string("{\"type\":\"") + type + "\"}"))) << type;
+    }
+    EXPECT_EQ(calls.size(), std::size(types));
+
+    // Unknown types, prefixes and a missing type all miss
+    for (const char* text : {R"({"type":"tt"})", R"({"type":"ttsx"})", R"({"type":"TTS"})", R"({"state":"start"})", "{}"}) {
+        EXPECT_FALSE(router.Dispatch(Message(text))) << text;
+    }
+    EXPECT_EQ(calls.size(), std::size(types));
+}
+
+TEST(MessageRouter, ReplacesHandlerOfTheSameType) {
+    MessageRouter router;
+    int first = 0, second = 0;
+    router.On("tts", [&first](const JsonMessage&) { first++; });
+    router.On("tts", [&second](const JsonMessage&) { second++; });
+    EXPECT_TRUE(router.Dispatch(Message(R"({"type":"tts"})")));
+    EXPECT_EQ(first, 0);
+    EXPECT_EQ(second, 1);
+
+    MessageRouter empty;
+    EXPECT_FALSE(empty.Dispatch(Message(R"({"type":"tts"})")));
+}
+
+// Routing the recorded traffic reads the same fields as cJSON does, and only the tree handlers allocate
+TEST(MessageRouter, RoutesServerTrafficWithoutAllocating) {
+    auto traffic = LoadServerTraffic();
+    ASSERT_GT(traffic.size(), 20u);
+
+    MessageRouter router;
+    size_t handled = 0;
+    size_t decoded_bytes = 0;
+    router.On("tts", [&](const JsonMessage& message) {
+        handled++;
+        std::string_view raw;
+        if (message.state() == "sentence_start" && message.GetString("text", raw)) {
+            decoded_bytes += raw.size();
+        }
+    });
+    router.On("stt", [&](const JsonMessage& message) {
+        handled++;
+        std::string_view raw;
+        EXPECT_TRUE(message.GetString("text", raw));
+    });
+    router.On("llm", [&](const JsonMessage& message) {
+        handled++;
+        std::string_view emotion;
+        EXPECT_TRUE(message.GetString("emotion", emotion));
+    });
+    router.On("system", [&](const JsonMessage& message) {
+        handled++;
+    });
+    router.On("alert", [&](const JsonMessage& message) {
+        handled++;
+    });
+
+    for (auto& line : traffic) {
+        JsonMessage message(line.data(), line.size());
+        ASSERT_TRUE(message.valid()) << line;
+
+        auto root = cJSON_Parse(line.c_str());
+        ASSERT_NE(root, nullptr) << line;
+        auto type = cJSON_GetObjectItem(root, "type");
+        auto state = cJSON_GetObjectItem(root, "state");
+        auto text_item = cJSON_GetObjectItem(root, "text");
+        EXPECT_EQ(message.type(), type->valuestring);
+        EXPECT_EQ(message.state(), cJSON_IsString(state) ? state->valuestring : "");
+        if (cJSON_IsString(text_item)) {
+            EXPECT_EQ(message.GetText("text"), text_item->valuestring) << line;
+        }
+        cJSON_Delete(root);
+    }
+
+    size_t routed = 0;
+    AllocationScope allocations;
+    CjsonAllocationScope cjson_allocations;
+    for (auto& line : traffic) {
+        JsonMessage message(line.data(), line.size());
+        if (message.type() == "mcp" || message.type() == "iot" || message.type() == "hello") {
+            continue;
+        }
+        EXPECT_TRUE(router.Dispatch(message)) << line;
+        routed++;
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+    EXPECT_EQ(cjson_allocations.count(), 0u);
+    EXPECT_EQ(handled, routed);
+    EXPECT_GT(decoded_bytes, 0u);
+}
+
+// The dispatch of the firmware before the router: a full cJSON tree and a strcmp chain on the type
+static size_t DispatchWithCjson(const std::string& line) {
+    size_t fields = 0;
+    auto root = cJSON_Parse(line.c_str());
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (strcmp(type->valuestring, "tts") == 0) {
+        auto state = cJSON_GetObjectItem(root, "state");
+        if (strcmp(state->valuestring, "sentence_start") == 0) {
+            auto text = cJSON_GetObjectItem(root, "text");
+            fields += strlen(text->valuestring);
+        }
+    } else if (strcmp(type->valuestring, "stt") == 0) {
+        fields += strlen(cJSON_GetObjectItem(root, "text")->valuestring);
+    } else if (strcmp(type->valuestring, "llm") == 0) {
+        fields += strlen(cJSON_GetObjectItem(root, "emotion")->valuestring);
+    } else if (strcmp(type->valuestring, "mcp") == 0) {
+        fields += cJSON_IsObject(cJSON_GetObjectItem(root, "payload"));
+    } else if (strcmp(type->valuestring, "iot") == 0) {
+        fields += cJSON_GetArraySize(cJSON_GetObjectItem(root, "commands"));
+    } else if (strcmp(type->valuestring, "system") == 0) {
+        fields += strlen(cJSON_GetObjectItem(root, "command")->valuestring);
+    } else if (strcmp(type->valuestring, "alert") == 0) {
+        fields += strlen(cJSON_GetObjectItem(root, "message")->valuestring);
+    }
+    cJSON_Delete(root);
+    return fields;
+}
+
+TEST(MessageRouter, ServerTrafficBenchmark) {
+    auto traffic = LoadServerTraffic();
+    ASSERT_FALSE(traffic.empty());
+
+    // The same work as the application's handlers: decoded text for the display, the tree for mcp and iot
+    size_t fields = 0;
+    MessageRouter router;
+    router.On("tts", [&fields](const JsonMessage& message) {
+        if (message.state() == "sentence_start") {
+            fields += message.GetText("text").size();
+        }
+    });
+    router.On("stt", [&fields](const JsonMessage& message) { fields += message.GetText("text").size(); });
+    router.On("llm", [&fields](const JsonMessage& message) {
+        std::string_view emotion;
+        fields += message.GetString("emotion", emotion) ? emotion.size() : 0;
+    });
+    router.On("mcp", [&fields](const JsonMessage& message) {
+        fields += cJSON_IsObject(cJSON_GetObjectItem(message.root(), "payload"));
+    });
+    router.On("iot", [&fields](const JsonMessage& message) {
+        fields += cJSON_GetArraySize(cJSON_GetObjectItem(message.root(), "commands"));
+    });
+    router.On("system", [&fields](const JsonMessage& message) {
+        std::string_view command;
+        fields += message.GetString("command", command) ? command.size() : 0;
+    });
+    router.On("alert", [&fields](const JsonMessage& message) { fields += message.GetText("message").size(); });
+
+    // Heap blocks on the device: the decoded strings and the trees of mcp and iot when routed, every
+    // node and string of every message with cJSON. The stand-in's own std::string temporaries do not count.
+    size_t router_allocations, cjson_allocations;
+    {
+        AllocationScope allocations;
+        CjsonAllocationScope tree_allocations;
+        for (auto& line : traffic) {
+            router.Dispatch(JsonMessage(line.data(), line.size()));
+        }
+        router_allocations = allocations.count() + tree_allocations.count();
+    }
+    {
+        CjsonAllocationScope tree_allocations;
+        for (auto& line : traffic) {
+            fields += DispatchWithCjson(line);
+        }
+        cjson_allocations = tree_allocations.count();
+    }
+    printf("[ BENCH    ] %zu recorded messages: %zu heap blocks routed, %zu with cJSON\n",
+        traffic.size(), router_allocations, cjson_allocations);
+
+    auto routed = Bench("JsonMessage + MessageRouter (conversation)", 2000, [&]() {
+        for (auto& line : traffic) {
+            router.Dispatch(JsonMessage(line.data(), line.size()));
+        }
+    });
+    auto parsed = Bench("cJSON_Parse + strcmp chain (conversation)", 2000, [&]() {
+        for (auto& line : traffic) {
+            fields += DispatchWithCjson(line);
+        }
+    });
+    printf("[ BENCH    ] %.1f ns per message routed, %.1f ns with cJSON\n",
+        routed.ns_per_iteration / traffic.size(), parsed.ns_per_iteration / traffic.size());
+    EXPECT_LT(router_allocations, cjson_allocations);
+    EXPECT_GT(fields, 0u);
+}
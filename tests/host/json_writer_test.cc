@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include <climits>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include <cJSON.h>
+
+#include "json_writer.h"
+#include "test_support.h"
+
+static std::string PrintWithCjson(cJSON* root) {
+    auto printed = cJSON_PrintUnformatted(root);
+    std::string text(printed);
+    cJSON_free(printed);
+    cJSON_Delete(root);
+    return text;
+}
+
+TEST(JsonWriter, WritesNestedValuesWithCommas) {
+    std::string buffer;
+    JsonWriter json(buffer);
+    json.BeginObject()
+        .Key("a").Int(1)
+        .Key("b").BeginArray().Int(-2).Bool(true).Bool(false).Null().BeginObject().EndObject().BeginArray().EndArray().EndArray()
+        .Key("c").BeginObject().Key("d").String("e").EndObject()
+        .Key("raw").Raw("{\"x\":[1,2]}")
+        .Key("min").Int(LLONG_MIN)
+        .EndObject();
+    EXPECT_EQ(json.str(), R"({"a":1,"b":[-2,true,false,null,{},[]],"c":{"d":"e"},"raw":{"x":[1,2]},"min":-9223372036854775808})");
+    EXPECT_EQ(&json.str(), &buffer);
+}
+
+TEST(JsonWriter, EscapesLikeJson) {
+    std::string buffer;
+    JsonWriter json(buffer);
+    const char value[] = "\"\\/\b\f\n\r\t\x01\x1f\x7f 你好 😊\0end";
+    json.BeginObject().Key("k\"ey").String(std::string_view(value, sizeof(value) - 1)).EndObject();
+    EXPECT_EQ(json.str(), "{\"k\\\"ey\":\"\\\"\\\\/\\b\\f\\n\\r\\t\\u0001\\u001f\x7f \xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x8a\\u0000end\"}");
+}
+
+// Every byte string comes back unchanged through cJSON's parser, and cJSON prints the same text
+TEST(JsonWriter, MatchesCjsonOnRandomStrings) {
+    std::mt19937 random(1234);
+    std::string buffer;
+    for (int round = 0; round < 2000; round++) {
+        std::string value(random() % 40, '\0');
+        for (auto& c : value) {
+            // Mostly the troublesome range, nothing that needs a NUL
+            auto r = random() % 4;
+            c = r == 0 ? (char)(1 + random() % 0x7F) : r == 1 ? "\"\\/\b\f\n\r\t"[random() % 8] : (char)(1 + random() % 0x20);
+        }
+        if (round % 7 == 0) {
+            value += "中文 😊";
+        }
+
+        JsonWriter json(buffer);
+        json.BeginObject().Key(value).String(value).Key("n").Int(round).EndObject();
+
+        auto root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, value.c_str(), value.c_str());
+        cJSON_AddNumberToObject(root, "n", round);
+        ASSERT_EQ(json.str(), PrintWithCjson(root)) << round;
+
+        auto parsed = cJSON_ParseWithLength(json.str().data(), json.str().size());
+        ASSERT_NE(parsed, nullptr) << json.str();
+        // By position, the random key may spell "n" in any case
+        auto item = cJSON_GetArrayItem(parsed, 1);
+        EXPECT_EQ(item->valueint, round);
+        EXPECT_EQ(parsed->child->string, value);
+        EXPECT_EQ(parsed->child->valuestring, value);
+        cJSON_Delete(parsed);
+    }
+}
+
+// The protocol messages as the firmware wrote them with cJSON before
+TEST(JsonWriter, MatchesCjsonOnProtocolMessages) {
+    std::string buffer;
+    JsonWriter json(buffer);
+    json.BeginObject()
+        .Key("session_id").String("9c1f3e2a")
+        .Key("type").String("listen")
+        .Key("state").String("detect")
+        .Key("text").String("你好小智")
+        .EndObject();
+    auto root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "session_id", "9c1f3e2a");
+    cJSON_AddStringToObject(root, "type", "listen");
+    cJSON_AddStringToObject(root, "state", "detect");
+    cJSON_AddStringToObject(root, "text", "你好小智");
+    EXPECT_EQ(json.str(), PrintWithCjson(root));
+
+    JsonWriter hello(buffer);
+    hello.BeginObject()
+        .Key("type").String("hello")
+        .Key("version").Int(3)
+        .Key("features").BeginObject().Key("mcp").Bool(true).EndObject()
+        .Key("transport").String("websocket")
+        .Key("audio_params").BeginObject()
+            .Key("format").String("opus")
+            .Key("sample_rate").Int(16000)
+            .Key("channels").Int(1)
+            .Key("frame_duration").Int(60)
+        .EndObject()
+        .EndObject();
+    root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", "hello");
+    cJSON_AddNumberToObject(root, "version", 3);
+    auto features = cJSON_AddObjectToObject(root, "features");
+    cJSON_AddBoolToObject(features, "mcp", true);
+    cJSON_AddStringToObject(root, "transport", "websocket");
+    auto audio_params = cJSON_AddObjectToObject(root, "audio_params");
+    cJSON_AddStringToObject(audio_params, "format", "opus");
+    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
+    cJSON_AddNumberToObject(audio_params, "channels", 1);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", 60);
+    EXPECT_EQ(hello.str(), PrintWithCjson(root));
+}
+
+TEST(JsonWriter, ReusedBufferDoesNotAllocate) {
+    std::string buffer;
+    std::string wake_word = "你好小智";
+    std::string payload = R"({"jsonrpc":"2.0","id":3,"result":{"content":[{"type":"text","text":"true"}],"isError":false}})";
+    auto write = [&]() {
+        JsonWriter json(buffer);
+        json.BeginObject()
+            .Key("session_id").String("9c1f3e2a")
+            .Key("type").String("listen")
+            .Key("state").String("detect")
+            .Key("text").String(wake_word)
+            .EndObject();
+        JsonWriter mcp(buffer);
+        mcp.BeginObject().Key("session_id").String("9c1f3e2a").Key("type").String("mcp").Key("payload").Raw(payload).EndObject();
+    };
+    write();
+    AllocationScope allocations;
+    for (int i = 0; i < 100; i++) {
+        write();
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+}
+
+TEST(JsonWriterBenchmark, ListenAndMcpMessages) {
+    std::string buffer;
+    std::string payload = R"({"jsonrpc":"2.0","id":3,"result":{"content":[{"type":"text","text":"true"}],"isError":false}})";
+    size_t bytes = 0;
+    Bench("JsonWriter listen + mcp", 200000, [&]() {
+        JsonWriter json(buffer);
+        json.BeginObject()
+            .Key("session_id").String("9c1f3e2a")
+            .Key("type").String("listen")
+            .Key("state").String("detect")
+            .Key("text").String("你好小智")
+            .EndObject();
+        bytes += buffer.size();
+        JsonWriter mcp(buffer);
+        mcp.BeginObject().Key("session_id").String("9c1f3e2a").Key("type").String("mcp").Key("payload").Raw(payload).EndObject();
+        bytes += buffer.size();
+    });
+    Bench("cJSON listen + mcp", 200000, [&]() {
+        auto root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "session_id", "9c1f3e2a");
+        cJSON_AddStringToObject(root, "type", "listen");
+        cJSON_AddStringToObject(root, "state", "detect");
+        cJSON_AddStringToObject(root, "text", "你好小智");
+        bytes += PrintWithCjson(root).size();
+        // The payload had to be parsed back into a tree to be embedded
+        root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "session_id", "9c1f3e2a");
+        cJSON_AddStringToObject(root, "type", "mcp");
+        cJSON_AddItemToObject(root, "payload", cJSON_Parse(payload.c_str()));
+        bytes += PrintWithCjson(root).size();
+    });
+    EXPECT_GT(bytes, 0u);
+}
@@ -0,0 +1,631 @@
+#include "posix_transports.h"
+
+#include <esp_log.h>
+#include <esp_random.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <chrono>
+#include <cstring>
+#include <strings.h>
+
+#define TAG "PosixTransports"
+
+// Blocking calls give up after this long, so a silent server cannot hang a virtual device
+#define SOCKET_TIMEOUT_SECONDS 10
+#define UDP_RECEIVE_TIMEOUT_MS 100
+#define WEBSOCKET_MAX_HANDSHAKE_SIZE 16384
+
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_UNSUBSCRIBE 0xA2
+#define MQTT_PINGREQ 0xC0
+#define MQTT_DISCONNECT 0xE0
+
+static void SetTimeout(int fd, int option, int milliseconds) {
+    timeval timeout = {
+        .tv_sec = milliseconds / 1000,
+        .tv_usec = (milliseconds % 1000) * 1000,
+    };
+    setsockopt(fd, SOL_SOCKET, option, &timeout, sizeof(timeout));
+}
+
+static int OpenSocket(const std::string& host, int port, int type) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+    addrinfo* addresses = nullptr;
+    auto service = std::to_string(port);
+    int ret = getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to resolve %s: %s", host.c_str(), gai_strerror(ret));
+        return -1;
+    }
+    int fd = -1;
+    for (auto address = addresses; address != nullptr; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        SetTimeout(fd, SO_SNDTIMEO, SOCKET_TIMEOUT_SECONDS * 1000);
+        SetTimeout(fd, SO_RCVTIMEO, SOCKET_TIMEOUT_SECONDS * 1000);
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Failed to connect to %s:%d: %s", host.c_str(), port, strerror(errno));
+        return -1;
+    }
+    if (type == SOCK_STREAM) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool WriteAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        auto sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+// Waits out receive timeouts while the socket is in use, false once it is closed or broken
+static bool ReadExact(int fd, char* data, size_t len, const std::atomic<bool>& closing) {
+    while (len > 0) {
+        auto received = recv(fd, data, len, 0);
+        if (received < 0 && (errno == EINTR || errno == EAGAIN) && !closing) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        len -= received;
+    }
+    return true;
+}
+
+static std::string EncodeBase64(const unsigned char* data, size_t len) {
+    std::string encoded(4 * ((len + 2) / 3), '\0');
+    EVP_EncodeBlock((unsigned char*)encoded.data(), data, len);
+    return encoded;
+}
+
+// Joins a receive thread unless it is the one deleting its transport from a callback
+static void JoinReceiveThread(std::thread& thread) {
+    if (!thread.joinable()) {
+        return;
+    }
+    if (thread.get_id() == std::this_thread::get_id()) {
+        thread.detach();
+    } else {
+        thread.join();
+    }
+}
+
+PosixUdp::~PosixUdp() {
+    Disconnect();
+    JoinReceiveThread(receive_thread_);
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool PosixUdp::Connect(const std::string& host, int port) {
+    fd_ = OpenSocket(host, port, SOCK_DGRAM);
+    if (fd_ < 0) {
+        return false;
+    }
+    // Short timeouts let the receive thread notice Disconnect()
+    SetTimeout(fd_, SO_RCVTIMEO, UDP_RECEIVE_TIMEOUT_MS);
+    connected_ = true;
+    running_ = true;
+    receive_thread_ = std::thread(&PosixUdp::ReceiveLoop, this);
+    return true;
+}
+
+void PosixUdp::Disconnect() {
+    connected_ = false;
+    running_ = false;
+}
+
+int PosixUdp::Send(const std::string& data) {
+    if (!running_) {
+        return -1;
+    }
+    return send(fd_, data.data(), data.size(), 0);
+}
+
+void PosixUdp::ReceiveLoop() {
+    // Keeps its capacity, a datagram is at most one MTU
+    std::string datagram;
+    while (running_) {
+        datagram.resize(1500);
+        auto received = recv(fd_, datagram.data(), datagram.size(), 0);
+        if (received <= 0) {
+            continue;
+        }
+        datagram.resize(received);
+        if (message_callback_) {
+            message_callback_(datagram);
+        }
+    }
+}
+
+PosixWebSocket::~PosixWebSocket() {
+    Close();
+    JoinReceiveThread(receive_thread_);
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void PosixWebSocket::SetHeader(const char* key, const char* value) {
+    headers_.emplace_back(key, value);
+}
+
+bool PosixWebSocket::Connect(const char* uri) {
+    std::string url(uri);
+    if (url.rfind("ws://", 0) != 0) {
+        ESP_LOGE(TAG, "Only ws:// urls are supported: %s", uri);
+        return false;
+    }
+    auto authority_end = url.find('/', 5);
+    std::string authority = url.substr(5, authority_end == std::string::npos ? std::string::npos : authority_end - 5);
+    std::string path = authority_end == std::string::npos ? "/" : url.substr(authority_end);
+    std::string host = authority;
+    int port = 80;
+    auto colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+        host = authority.substr(0, colon);
+        port = std::stoi(authority.substr(colon + 1));
+    }
+
+    fd_ = OpenSocket(host, port, SOCK_STREAM);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    unsigned char nonce[16];
+    for (auto& byte : nonce) {
+        byte = esp_random();
+    }
+    auto key = EncodeBase64(nonce, sizeof(nonce));
+    std::string request = "GET " + path + " HTTP/1.1\r\n"
+        "Host: " + authority + "\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: " + key + "\r\n"
+        "Sec-WebSocket-Version: 13\r\n";
+    for (auto& [name, value] : headers_) {
+        request += name + ": " + value + "\r\n";
+    }
+    request += "\r\n";
+    if (!WriteAll(fd_, request.data(), request.size())) {
+        ESP_LOGE(TAG, "Failed to send the websocket handshake");
+        return false;
+    }
+
+    size_t header_end;
+    while ((header_end = receive_buffer_.find("\r\n\r\n")) == std::string::npos) {
+        char chunk[1024];
+        auto received = recv(fd_, chunk, sizeof(chunk), 0);
+        if (received <= 0 || receive_buffer_.size() > WEBSOCKET_MAX_HANDSHAKE_SIZE) {
+            ESP_LOGE(TAG, "No websocket handshake response from %s", uri);
+            return false;
+        }
+        receive_buffer_.append(chunk, received);
+    }
+    std::string response = receive_buffer_.substr(0, header_end);
+    receive_buffer_.erase(0, header_end + 4);
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0) {
+        ESP_LOGE(TAG, "Websocket upgrade refused: %s", response.substr(0, response.find("\r\n")).c_str());
+        return false;
+    }
+
+    // The server proves it read the key: base64(SHA1(key + GUID))
+    auto accept_input = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1((const unsigned char*)accept_input.data(), accept_input.size(), digest);
+    auto expected = "sec-websocket-accept: " + EncodeBase64(digest, sizeof(digest));
+    bool accepted = false;
+    for (size_t line = 0; line != std::string::npos && !accepted; ) {
+        size_t next = response.find("\r\n", line);
+        auto header = response.substr(line, next == std::string::npos ? std::string::npos : next - line);
+        accepted = header.size() == expected.size() && strncasecmp(header.c_str(), expected.c_str(), 22) == 0 &&
+            header.compare(22, std::string::npos, expected, 22) == 0;
+        line = next == std::string::npos ? next : next + 2;
+    }
+    if (!accepted) {
+        ESP_LOGE(TAG, "Websocket upgrade without a valid Sec-WebSocket-Accept");
+        return false;
+    }
+
+    connected_ = true;
+    receive_thread_ = std::thread(&PosixWebSocket::ReceiveLoop, this);
+    if (on_connected_) {
+        on_connected_();
+    }
+    return true;
+}
+
+bool PosixWebSocket::Send(const std::string& data) {
+    return Send(data.data(), data.size(), false, true);
+}
+
+bool PosixWebSocket::Send(const void* data, size_t len, bool binary, bool fin) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    int opcode = continuation_ ? WS_OPCODE_CONTINUATION : binary ? WS_OPCODE_BINARY : WS_OPCODE_TEXT;
+    continuation_ = !fin;
+    return SendFrame(opcode, data, len, fin);
+}
+
+// Called with send_mutex_ held, control frames may go out between the fragments of a message
+bool PosixWebSocket::SendFrame(int opcode, const void* data, size_t len, bool fin) {
+    if (!connected_) {
+        return false;
+    }
+    send_buffer_.clear();
+    send_buffer_.push_back((char)((fin ? 0x80 : 0) | opcode));
+    if (len < 126) {
+        send_buffer_.push_back((char)(0x80 | len));
+    } else if (len <= 0xFFFF) {
+        send_buffer_.push_back((char)(0x80 | 126));
+        send_buffer_.push_back((char)(len >> 8));
+        send_buffer_.push_back((char)len);
+    } else {
+        send_buffer_.push_back((char)(0x80 | 127));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            send_buffer_.push_back((char)((uint64_t)len >> shift));
+        }
+    }
+    uint32_t mask_word = esp_random();
+    char mask[4];
+    memcpy(mask, &mask_word, sizeof(mask));
+    send_buffer_.append(mask, sizeof(mask));
+    size_t offset = send_buffer_.size();
+    send_buffer_.append((const char*)data, len);
+    for (size_t i = 0; i < len; i++) {
+        send_buffer_[offset + i] ^= mask[i & 3];
+    }
+    return WriteAll(fd_, send_buffer_.data(), send_buffer_.size());
+}
+
+void PosixWebSocket::Close() {
+    closing_ = true;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (connected_) {
+            uint8_t status[2] = {0x03, 0xE8};  // 1000, normal closure
+            SendFrame(WS_OPCODE_CLOSE, status, sizeof(status), true);
+        }
+        connected_ = false;
+    }
+    if (fd_ >= 0) {
+        shutdown(fd_, SHUT_RDWR);
+    }
+}
+
+void PosixWebSocket::ReceiveLoop() {
+    std::string message;
+    bool message_binary = false;
+    size_t offset = 0;
+    bool open = true;
+    while (open) {
+        // Every complete frame in the buffer
+        while (open) {
+            size_t available = receive_buffer_.size() - offset;
+            if (available < 2) {
+                break;
+            }
+            auto frame = (uint8_t*)receive_buffer_.data() + offset;
+            bool fin = frame[0] & 0x80;
+            int opcode = frame[0] & 0x0F;
+            bool masked = frame[1] & 0x80;
+            uint64_t len = frame[1] & 0x7F;
+            size_t header_size = 2;
+            if (len == 126) {
+                header_size = 4;
+                if (available < header_size) {
+                    break;
+                }
+                len = (frame[2] << 8) | frame[3];
+            } else if (len == 127) {
+                header_size = 10;
+                if (available < header_size) {
+                    break;
+                }
+                len = 0;
+                for (int i = 0; i < 8; i++) {
+                    len = (len << 8) | frame[2 + i];
+                }
+            }
+            size_t mask_offset = header_size;
+            if (masked) {
+                header_size += 4;
+            }
+            if (available < header_size + len) {
+                break;
+            }
+            auto payload = (char*)frame + header_size;
+            if (masked) {
+                for (uint64_t i = 0; i < len; i++) {
+                    payload[i] ^= frame[mask_offset + (i & 3)];
+                }
+            }
+            offset += header_size + len;
+
+            switch (opcode) {
+            case WS_OPCODE_CLOSE: {
+                // Echo the close, then the server ends the connection
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                SendFrame(WS_OPCODE_CLOSE, payload, std::min<uint64_t>(len, 2), true);
+                open = false;
+                break;
+            }
+            case WS_OPCODE_PING: {
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                SendFrame(WS_OPCODE_PONG, payload, len, true);
+                break;
+            }
+            case WS_OPCODE_PONG:
+                break;
+            default:
+                if (opcode != WS_OPCODE_CONTINUATION) {
+                    message_binary = opcode == WS_OPCODE_BINARY;
+                }
+                if (fin && message.empty() && opcode != WS_OPCODE_CONTINUATION) {
+                    // Unfragmented, delivered straight from the receive buffer
+                    if (on_data_) {
+                        on_data_(payload, len, message_binary);
+                    }
+                } else {
+                    message.append(payload, len);
+                    if (fin) {
+                        if (on_data_) {
+                            on_data_(message.data(), message.size(), message_binary);
+                        }
+                        message.clear();
+                    }
+                }
+                break;
+            }
+        }
+        if (!open) {
+            break;
+        }
+
+        // Drop the parsed frames, the buffer keeps its capacity
+        receive_buffer_.erase(0, offset);
+        offset = 0;
+        size_t size = receive_buffer_.size();
+        receive_buffer_.resize(size + 4096);
+        auto received = recv(fd_, receive_buffer_.data() + size, 4096, 0);
+        if (received < 0 && (errno == EINTR || errno == EAGAIN) && !closing_) {
+            received = 0;
+        } else if (received <= 0) {
+            open = false;
+            received = 0;
+        }
+        receive_buffer_.resize(size + received);
+    }
+
+    bool was_connected = connected_.exchange(false);
+    if (was_connected && !closing_ && on_disconnected_) {
+        on_disconnected_();
+    }
+}
+
+PosixMqtt::~PosixMqtt() {
+    Disconnect();
+    JoinReceiveThread(receive_thread_);
+    JoinReceiveThread(ping_thread_);
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+static void AppendUint16(std::string& out, uint16_t value) {
+    out.push_back((char)(value >> 8));
+    out.push_back((char)value);
+}
+
+static void AppendString(std::string& out, const std::string& value) {
+    AppendUint16(out, value.size());
+    out += value;
+}
+
+bool PosixMqtt::Connect(const std::string& broker_address, int broker_port, const std::string& client_id,
+    const std::string& username, const std::string& password) {
+    fd_ = OpenSocket(broker_address, broker_port, SOCK_STREAM);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    std::string body;
+    AppendString(body, "MQTT");
+    body.push_back(4);  // 3.1.1
+    uint8_t flags = 0x02;  // Clean session
+    if (!username.empty()) {
+        flags |= 0x80;
+    }
+    if (!password.empty()) {
+        flags |= 0x40;
+    }
+    body.push_back((char)flags);
+    AppendUint16(body, keep_alive_seconds_);
+    AppendString(body, client_id);
+    if (!username.empty()) {
+        AppendString(body, username);
+    }
+    if (!password.empty()) {
+        AppendString(body, password);
+    }
+    connected_ = true;
+    if (!SendPacket(MQTT_CONNECT, body)) {
+        connected_ = false;
+        return false;
+    }
+
+    char connack[4];
+    if (!ReadExact(fd_, connack, sizeof(connack), closing_) || (uint8_t)connack[0] != MQTT_CONNACK || connack[3] != 0) {
+        ESP_LOGE(TAG, "Broker %s:%d refused the connection", broker_address.c_str(), broker_port);
+        connected_ = false;
+        return false;
+    }
+
+    receive_thread_ = std::thread(&PosixMqtt::ReceiveLoop, this);
+    ping_thread_ = std::thread(&PosixMqtt::PingLoop, this);
+    if (on_connected_) {
+        on_connected_();
+    }
+    return true;
+}
+
+void PosixMqtt::Disconnect() {
+    closing_ = true;
+    if (connected_) {
+        SendPacket(MQTT_DISCONNECT, "");
+        connected_ = false;
+    }
+    if (fd_ >= 0) {
+        shutdown(fd_, SHUT_RDWR);
+    }
+}
+
+// QoS 1 and 2 are sent as QoS 0, the protocols only publish at QoS 0
+bool PosixMqtt::Publish(const std::string& topic, const std::string& payload, int qos) {
+    std::string body;
+    body.reserve(2 + topic.size() + payload.size());
+    AppendString(body, topic);
+    body += payload;
+    return SendPacket(MQTT_PUBLISH, body);
+}
+
+bool PosixMqtt::Subscribe(const std::string& topic, int qos) {
+    std::string body;
+    AppendUint16(body, ++packet_id_);
+    AppendString(body, topic);
+    body.push_back((char)qos);
+    return SendPacket(MQTT_SUBSCRIBE, body);
+}
+
+bool PosixMqtt::Unsubscribe(const std::string& topic) {
+    std::string body;
+    AppendUint16(body, ++packet_id_);
+    AppendString(body, topic);
+    return SendPacket(MQTT_UNSUBSCRIBE, body);
+}
+
+bool PosixMqtt::SendPacket(uint8_t header, const std::string& body) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!connected_) {
+        return false;
+    }
+    send_buffer_.clear();
+    send_buffer_.push_back((char)header);
+    size_t remaining = body.size();
+    do {
+        uint8_t byte = remaining % 128;
+        remaining /= 128;
+        send_buffer_.push_back((char)(remaining > 0 ? byte | 0x80 : byte));
+    } while (remaining > 0);
+    send_buffer_ += body;
+    return WriteAll(fd_, send_buffer_.data(), send_buffer_.size());
+}
+
+void PosixMqtt::ReceiveLoop() {
+    std::string body;
+    std::string topic;
+    std::string payload;
+    while (true) {
+        char header;
+        if (!ReadExact(fd_, &header, 1, closing_)) {
+            break;
+        }
+        size_t remaining = 0;
+        int shift = 0;
+        char byte;
+        do {
+            if (shift > 21 || !ReadExact(fd_, &byte, 1, closing_)) {
+                remaining = SIZE_MAX;
+                break;
+            }
+            remaining |= (size_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        if (remaining == SIZE_MAX) {
+            break;
+        }
+        body.resize(remaining);
+        if (!ReadExact(fd_, body.data(), remaining, closing_)) {
+            break;
+        }
+
+        if (((uint8_t)header & 0xF0) != MQTT_PUBLISH || remaining < 2) {
+            continue;  // Acks and ping responses
+        }
+        size_t topic_size = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+        size_t offset = 2 + topic_size;
+        if (((uint8_t)header & 0x06) != 0) {
+            offset += 2;  // Packet id of QoS 1 and 2
+        }
+        if (offset > remaining) {
+            continue;
+        }
+        topic.assign(body, 2, topic_size);
+        payload.assign(body, offset, std::string::npos);
+        if (on_message_) {
+            on_message_(topic, payload);
+        }
+    }
+
+    bool was_connected = connected_.exchange(false);
+    if (was_connected && !closing_ && on_disconnected_) {
+        on_disconnected_();
+    }
+}
+
+void PosixMqtt::PingLoop() {
+    auto interval = std::chrono::seconds(std::max(1, keep_alive_seconds_ / 2));
+    auto next_ping = std::chrono::steady_clock::now() + interval;
+    while (connected_ && !closing_) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() >= next_ping) {
+            SendPacket(MQTT_PINGREQ, "");
+            next_ping += interval;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef POSIX_TRANSPORTS_H
+#define POSIX_TRANSPORTS_H
+
+#include <udp.h>
+#include <web_socket.h>
+#include <mqtt.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * Socket implementations of the esp-ml307 transport interfaces, so the protocol code runs
+ * against a real server from the host. Like the device clients, each one delivers incoming
+ * messages on its own receive thread, and deleting it closes the socket and joins that thread.
+ * Plain TCP only: ws:// and MQTT without TLS.
+ */
+
+class PosixUdp : public Udp {
+public:
+    ~PosixUdp();
+    bool Connect(const std::string& host, int port) override;
+    void Disconnect() override;
+    int Send(const std::string& data) override;
+
+private:
+    int fd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread receive_thread_;
+
+    void ReceiveLoop();
+};
+
+// RFC 6455 client: masked frames out, fragmented messages reassembled, pings answered
+class PosixWebSocket : public WebSocket {
+public:
+    ~PosixWebSocket();
+    void SetHeader(const char* key, const char* value) override;
+    bool Connect(const char* uri) override;
+    bool IsConnected() const override { return connected_; }
+    bool Send(const std::string& data) override;
+    bool Send(const void* data, size_t len, bool binary = false, bool fin = true) override;
+    void Close() override;
+
+private:
+    int fd_ = -1;
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> closing_{false};
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::mutex send_mutex_;
+    std::string send_buffer_;
+    bool continuation_ = false;
+    // Received bytes not parsed yet, the first ones may arrive with the handshake response
+    std::string receive_buffer_;
+    std::thread receive_thread_;
+
+    bool SendFrame(int opcode, const void* data, size_t len, bool fin);
+    void ReceiveLoop();
+};
+
+// MQTT 3.1.1 client with QoS 0 publishing and a keep-alive ping
+class PosixMqtt : public Mqtt {
+public:
+    ~PosixMqtt();
+    void SetKeepAlive(int keep_alive_seconds) override { keep_alive_seconds_ = keep_alive_seconds; }
+    bool Connect(const std::string& broker_address, int broker_port, const std::string& client_id,
+        const std::string& username, const std::string& password) override;
+    void Disconnect() override;
+    bool Publish(const std::string& topic, const std::string& payload, int qos = 0) override;
+    bool Subscribe(const std::string& topic, int qos = 0) override;
+    bool Unsubscribe(const std::string& topic) override;
+    bool IsConnected() override { return connected_; }
+
+private:
+    int fd_ = -1;
+    int keep_alive_seconds_ = 120;
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> closing_{false};
+    std::mutex send_mutex_;
+    std::string send_buffer_;
+    uint16_t packet_id_ = 0;
+    std::thread receive_thread_;
+    std::thread ping_thread_;
+
+    bool SendPacket(uint8_t header, const std::string& body);
+    void ReceiveLoop();
+    void PingLoop();
+};
+
+#endif // POSIX_TRANSPORTS_H
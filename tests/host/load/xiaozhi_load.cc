@@ -0,0 +1,510 @@
+/*
+ * Load generator for xiaozhi-compatible servers. Every virtual device is the firmware's own
+ * WebsocketProtocol or MqttProtocol on socket transports. Headers, hello, listen messages,
+ * BinaryProtocol framing, uplink batches and the encrypted UDP media channel are therefore
+ * exactly what a device sends.
+ *
+ * A session opens the audio channel and runs --turns cycles. Each cycle is:
+ *   1. wake word detect
+ *   2. listen start
+ *   3. the Opus frames of a P3 file, streamed in real time
+ *   4. listen stop
+ *   5. waiting for tts stop
+ * Latency histograms over all sessions are printed at the end.
+ *
+ *   xiaozhi_load --url ws://127.0.0.1:8000/xiaozhi/v1/ --devices 50 --turns 3 --ramp 10
+ *   xiaozhi_load --mqtt 192.168.1.10:1883 --username u --password p --publish-topic device-server
+ *
+ * Only plain ws:// and MQTT over TCP are supported. Put a TLS terminator in front to test
+ * wss:// or MQTT over TLS.
+ */
+
+#include "websocket_protocol.h"
+#include "mqtt_protocol.h"
+#include "application.h"
+#include "settings.h"
+#include "system_info.h"
+#include "fake_transports.h"
+#include "posix_transports.h"
+
+#include <arpa/inet.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions {
+    std::string url;
+    std::string token;
+    int version = 1;
+    std::string mqtt_endpoint;
+    std::string username;
+    std::string password;
+    std::string publish_topic;
+    std::string client_id_prefix = "GID_load";
+    int devices = 10;
+    int sessions = 1;
+    int turns = 3;
+    double ramp_seconds = 5;
+    double think_seconds = 1;
+    double turn_timeout_seconds = 30;
+    int batch = 1;
+    std::string wake_word = "你好小智";
+    std::string audio = LOAD_DEFAULT_AUDIO;
+};
+
+// Opus frames of a P3 file, each prefixed with |type 1u|reserved 1u|payload_size 2u|
+static std::vector<AudioStreamPacket> LoadP3(const std::string& path, int frame_duration) {
+    std::ifstream file(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<AudioStreamPacket> packets;
+    size_t offset = 0;
+    while (offset + sizeof(BinaryProtocol3) <= data.size()) {
+        auto header = (const BinaryProtocol3*)(data.data() + offset);
+        size_t size = ntohs(header->payload_size);
+        offset += sizeof(BinaryProtocol3);
+        if (offset + size > data.size()) {
+            break;
+        }
+        // Laid out like the encoder output, with headroom for the framing
+        AudioStreamPacket packet;
+        packet.sample_rate = 16000;
+        packet.frame_duration = frame_duration;
+        packet.timestamp = packets.size() * frame_duration;
+        packet.headroom = AUDIO_PACKET_HEADROOM;
+        packet.payload.resize(AUDIO_PACKET_HEADROOM + size);
+        memcpy(packet.payload.data() + AUDIO_PACKET_HEADROOM, data.data() + offset, size);
+        packets.push_back(std::move(packet));
+        offset += size;
+    }
+    return packets;
+}
+
+class Histogram {
+public:
+    void Add(double ms) {
+        values_.push_back(std::max(0.0, ms));
+    }
+
+    void Print(const char* name) {
+        static const int kBucketsMs[] = {50, 100, 200, 400, 800, 1600, 3200, 6400};
+        static const int kBucketCount = sizeof(kBucketsMs) / sizeof(kBucketsMs[0]);
+        if (values_.empty()) {
+            printf("  %s: no samples\n", name);
+            return;
+        }
+        std::sort(values_.begin(), values_.end());
+        auto percentile = [this](int p) {
+            return values_[std::min(values_.size() - 1, values_.size() * p / 100)];
+        };
+        printf("  %s: n %zu, p50 %.0f ms, p90 %.0f ms, p99 %.0f ms, max %.0f ms\n", name, values_.size(),
+            percentile(50), percentile(90), percentile(99), values_.back());
+        int counts[kBucketCount + 1] = {};
+        for (auto value : values_) {
+            counts[std::upper_bound(kBucketsMs, kBucketsMs + kBucketCount, (int)value) - kBucketsMs]++;
+        }
+        int peak = *std::max_element(counts, counts + kBucketCount + 1);
+        for (int i = 0; i <= kBucketCount; i++) {
+            if (counts[i] == 0) {
+                continue;
+            }
+            char label[32];
+            int low = i > 0 ? kBucketsMs[i - 1] : 0;
+            if (i < kBucketCount) {
+                snprintf(label, sizeof(label), "%d-%d", low, kBucketsMs[i]);
+            } else {
+                snprintf(label, sizeof(label), "%d+", low);
+            }
+            printf("    %10s ms %6d %s\n", label, counts[i], std::string(std::max(1, counts[i] * 40 / peak), '#').c_str());
+        }
+    }
+
+private:
+    std::vector<double> values_;
+};
+
+class LoadReport {
+public:
+    void Add(const std::string& name, Clock::duration duration) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        histograms_[name].Add(std::chrono::duration<double, std::milli>(duration).count());
+    }
+
+    void Fail(const std::string& reason) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failures_[reason]++;
+    }
+
+    void Print(double elapsed_seconds) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        printf("%d sessions, %d turns in %.1f s, %ld frames sent, %ld received\n", sessions.load(), turns.load(),
+            elapsed_seconds, frames_sent.load(), frames_received.load());
+        for (auto& [reason, count] : failures_) {
+            printf("  failed: %s x%d\n", reason.c_str(), count);
+        }
+        for (auto name : {"open channel", "stop -> stt", "stop -> tts start", "stop -> first audio", "tts duration"}) {
+            histograms_[name].Print(name);
+        }
+    }
+
+    std::atomic<int> sessions{0};
+    std::atomic<int> turns{0};
+    std::atomic<long> frames_sent{0};
+    std::atomic<long> frames_received{0};
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, Histogram> histograms_;
+    std::map<std::string, int> failures_;
+};
+
+// Settings are process-wide, devices take turns to put their client id in before connecting
+static std::mutex settings_mutex;
+
+class VirtualDevice {
+public:
+    VirtualDevice(int index, const LoadOptions& options, std::vector<AudioStreamPacket>& packets, LoadReport& report)
+        : index_(index), options_(options), packets_(packets), report_(report) {
+        if (!options_.mqtt_endpoint.empty()) {
+            protocol_ = std::make_unique<MqttProtocol>();
+        } else {
+            protocol_ = std::make_unique<WebsocketProtocol>();
+        }
+        protocol_->OnIncomingAudio([this](AudioStreamPacket&& packet) {
+            report_.frames_received++;
+            Post(kEventAudio);
+        });
+        protocol_->OnIncomingJson([this](const JsonMessage& message) {
+            if (message.type() == "stt") {
+                Post(kEventStt);
+            } else if (message.type() == "tts") {
+                if (message.state() == "start") {
+                    Post(kEventTtsStart);
+                } else if (message.state() == "stop") {
+                    Post(kEventTtsStop);
+                }
+            }
+        });
+        protocol_->OnAudioChannelClosed([this]() {
+            Post(kEventClosed);
+        });
+        protocol_->OnNetworkError([this](const std::string& message) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last_error_ = message;
+        });
+    }
+
+    void Run() {
+        char mac[32];
+        snprintf(mac, sizeof(mac), "02:00:%02x:%02x:%02x:%02x", (index_ >> 24) & 0xFF, (index_ >> 16) & 0xFF,
+            (index_ >> 8) & 0xFF, index_ & 0xFF);
+        char uuid[40];
+        snprintf(uuid, sizeof(uuid), "00000000-0000-4000-8000-%012x", index_);
+        GetHostDeviceIdentity().mac_address = mac;
+        GetHostDeviceIdentity().uuid = uuid;
+
+        for (int session = 0; session < options_.sessions; session++) {
+            RunSession();
+        }
+    }
+
+    Protocol& protocol() { return *protocol_; }
+
+private:
+    enum Event {
+        kEventAudio,
+        kEventStt,
+        kEventTtsStart,
+        kEventTtsStop,
+        kEventClosed,
+        kEventCount,
+    };
+
+    int index_;
+    const LoadOptions& options_;
+    std::vector<AudioStreamPacket>& packets_;
+    LoadReport& report_;
+    std::unique_ptr<Protocol> protocol_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::pair<Clock::time_point, Event>> events_;
+    std::string last_error_;
+    bool started_ = false;
+
+    void Post(Event event) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.emplace_back(Clock::now(), event);
+        condition_.notify_one();
+    }
+
+    void ClearEvents() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.clear();
+    }
+
+    std::string TakeError(const char* stage) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string reason = std::string(stage) + ": " + (last_error_.empty() ? "failed" : last_error_);
+        last_error_.clear();
+        return reason;
+    }
+
+    // The MQTT client reads its client id from the settings when it connects
+    bool StartClient() {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        if (!options_.mqtt_endpoint.empty()) {
+            auto client_id = options_.client_id_prefix + "@@@" + GetHostDeviceIdentity().mac_address;
+            std::replace(client_id.begin(), client_id.end(), ':', '_');
+            Settings("mqtt", true).SetString("client_id", client_id);
+        }
+        if (!started_) {
+            started_ = protocol_->Start();
+            return started_;
+        }
+        return !protocol_->NeedsReconnect() || protocol_->Reconnect();
+    }
+
+    void RunSession() {
+        if (!StartClient()) {
+            report_.Fail(TakeError("start"));
+            return;
+        }
+        ClearEvents();
+        auto start = Clock::now();
+        if (!protocol_->OpenAudioChannel()) {
+            report_.Fail(TakeError("open channel"));
+            return;
+        }
+        report_.Add("open channel", Clock::now() - start);
+
+        for (int turn = 0; turn < options_.turns; turn++) {
+            if (!RunTurn()) {
+                break;
+            }
+            if (turn + 1 < options_.turns) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(options_.think_seconds));
+            }
+            if (turn + 1 == options_.turns) {
+                report_.sessions++;
+            }
+        }
+        protocol_->CloseAudioChannel();
+    }
+
+    // Sends the frames at the pace the encoder produces them, as the batches the device would send
+    bool StreamAudio() {
+        size_t batch = std::max(1, std::min(options_.batch, protocol_->audio_batch_frames()));
+        auto start = Clock::now();
+        for (size_t i = 0; i < packets_.size(); i += batch) {
+            size_t count = std::min(batch, packets_.size() - i);
+            std::this_thread::sleep_until(start + std::chrono::milliseconds((i + count) * packets_[i].frame_duration));
+            bool sent = count == 1 ? protocol_->SendAudio(packets_[i])
+                : protocol_->SendAudioBatch(std::span<AudioStreamPacket>(packets_.data() + i, count));
+            if (!sent) {
+                return false;
+            }
+            report_.frames_sent += count;
+        }
+        return true;
+    }
+
+    bool RunTurn() {
+        protocol_->SendWakeWordDetected(options_.wake_word);
+        protocol_->SendStartListening(kListeningModeManualStop);
+        if (!StreamAudio()) {
+            report_.Fail(TakeError("send audio"));
+            return false;
+        }
+        ClearEvents();
+        auto stop_time = Clock::now();
+        protocol_->SendStopListening();
+
+        Clock::time_point firsts[kEventCount] = {};
+        auto deadline = stop_time + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(options_.turn_timeout_seconds));
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (firsts[kEventTtsStop] == Clock::time_point()) {
+            if (!condition_.wait_until(lock, deadline, [this]() { return !events_.empty(); })) {
+                lock.unlock();
+                report_.Fail("turn: timeout");
+                return false;
+            }
+            auto [when, event] = events_.front();
+            events_.pop_front();
+            if (event == kEventClosed) {
+                lock.unlock();
+                report_.Fail("turn: channel closed");
+                return false;
+            }
+            if (firsts[event] == Clock::time_point()) {
+                firsts[event] = when;
+            }
+        }
+        lock.unlock();
+
+        const std::pair<const char*, Event> latencies[] = {
+            {"stop -> stt", kEventStt},
+            {"stop -> tts start", kEventTtsStart},
+            {"stop -> first audio", kEventAudio},
+        };
+        for (auto& [name, event] : latencies) {
+            if (firsts[event] != Clock::time_point()) {
+                report_.Add(name, firsts[event] - stop_time);
+            }
+        }
+        if (firsts[kEventTtsStart] != Clock::time_point()) {
+            report_.Add("tts duration", firsts[kEventTtsStop] - firsts[kEventTtsStart]);
+        }
+        report_.turns++;
+        return true;
+    }
+};
+
+static void PrintUsage(const char* program) {
+    printf("Usage: %s (--url ws://host:port/path | --mqtt host:port) [options]\n"
+        "  --token TOKEN             Websocket access token, sent as Authorization\n"
+        "  --version N               Binary protocol version 1, 2 or 3 (default 1)\n"
+        "  --username, --password    MQTT credentials\n"
+        "  --publish-topic TOPIC     MQTT topic the devices publish to\n"
+        "  --client-id-prefix NAME   MQTT client ids are NAME@@@<mac> (default GID_load)\n"
+        "  --devices N               Concurrent virtual devices (default 10)\n"
+        "  --sessions N              Sessions per device, each opens the audio channel (default 1)\n"
+        "  --turns N                 Listen and speak cycles per session (default 3)\n"
+        "  --ramp SECONDS            Time over which the devices start (default 5)\n"
+        "  --think SECONDS           Pause between turns (default 1)\n"
+        "  --turn-timeout SECONDS    Time to wait for tts stop (default 30)\n"
+        "  --batch N                 Send uplink batches of up to N frames when the server accepts them\n"
+        "  --wake-word TEXT          Text of the wake word detect message\n"
+        "  --audio FILE              P3 file streamed each turn (default %s)\n", program, LOAD_DEFAULT_AUDIO);
+}
+
+static bool ParseOptions(int argc, char* argv[], LoadOptions& options) {
+    enum {
+        kUrl = 1, kToken, kVersion, kMqtt, kUsername, kPassword, kPublishTopic, kClientIdPrefix, kDevices,
+        kSessions, kTurns, kRamp, kThink, kTurnTimeout, kBatch, kWakeWord, kAudio, kHelp,
+    };
+    static const option kOptions[] = {
+        {"url", required_argument, nullptr, kUrl},
+        {"token", required_argument, nullptr, kToken},
+        {"version", required_argument, nullptr, kVersion},
+        {"mqtt", required_argument, nullptr, kMqtt},
+        {"username", required_argument, nullptr, kUsername},
+        {"password", required_argument, nullptr, kPassword},
+        {"publish-topic", required_argument, nullptr, kPublishTopic},
+        {"client-id-prefix", required_argument, nullptr, kClientIdPrefix},
+        {"devices", required_argument, nullptr, kDevices},
+        {"sessions", required_argument, nullptr, kSessions},
+        {"turns", required_argument, nullptr, kTurns},
+        {"ramp", required_argument, nullptr, kRamp},
+        {"think", required_argument, nullptr, kThink},
+        {"turn-timeout", required_argument, nullptr, kTurnTimeout},
+        {"batch", required_argument, nullptr, kBatch},
+        {"wake-word", required_argument, nullptr, kWakeWord},
+        {"audio", required_argument, nullptr, kAudio},
+        {"help", no_argument, nullptr, kHelp},
+        {nullptr, 0, nullptr, 0},
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", kOptions, nullptr)) != -1) {
+        switch (option) {
+        case kUrl: options.url = optarg; break;
+        case kToken: options.token = optarg; break;
+        case kVersion: options.version = atoi(optarg); break;
+        case kMqtt: options.mqtt_endpoint = optarg; break;
+        case kUsername: options.username = optarg; break;
+        case kPassword: options.password = optarg; break;
+        case kPublishTopic: options.publish_topic = optarg; break;
+        case kClientIdPrefix: options.client_id_prefix = optarg; break;
+        case kDevices: options.devices = atoi(optarg); break;
+        case kSessions: options.sessions = atoi(optarg); break;
+        case kTurns: options.turns = atoi(optarg); break;
+        case kRamp: options.ramp_seconds = atof(optarg); break;
+        case kThink: options.think_seconds = atof(optarg); break;
+        case kTurnTimeout: options.turn_timeout_seconds = atof(optarg); break;
+        case kBatch: options.batch = atoi(optarg); break;
+        case kWakeWord: options.wake_word = optarg; break;
+        case kAudio: options.audio = optarg; break;
+        default: return false;
+        }
+    }
+    return (options.url.empty() != options.mqtt_endpoint.empty()) && options.version >= 1 && options.version <= 3 &&
+        options.devices > 0 && options.batch >= 1 && options.batch <= AUDIO_BATCH_MAX_FRAMES;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    auto packets = LoadP3(options.audio, 60);
+    if (packets.empty()) {
+        fprintf(stderr, "No Opus frames in %s\n", options.audio.c_str());
+        return 1;
+    }
+
+    if (!options.url.empty()) {
+        Settings settings("websocket", true);
+        settings.SetString("url", options.url);
+        settings.SetString("token", options.token);
+        settings.SetInt("version", options.version);
+    } else {
+        Settings settings("mqtt", true);
+        settings.SetString("endpoint", options.mqtt_endpoint);
+        settings.SetString("username", options.username);
+        settings.SetString("password", options.password);
+        settings.SetString("publish_topic", options.publish_topic);
+    }
+    GetHostTransports() = HostTransports{
+        .create_websocket = []() -> WebSocket* { return new PosixWebSocket(); },
+        .create_mqtt = []() -> Mqtt* { return new PosixMqtt(); },
+        .create_udp = []() -> Udp* { return new PosixUdp(); },
+    };
+
+    printf("%d devices, %d sessions of %d turns each, %zu frames per turn from %s\n", options.devices,
+        options.sessions, options.turns, packets.size(), options.audio.c_str());
+    LoadReport report;
+    std::vector<std::unique_ptr<VirtualDevice>> devices;
+    // Every device sends from its own copy, the framing writes into the headroom
+    std::vector<std::vector<AudioStreamPacket>> device_packets(options.devices, packets);
+    for (int i = 0; i < options.devices; i++) {
+        devices.push_back(std::make_unique<VirtualDevice>(i, options, device_packets[i], report));
+    }
+
+    auto start = Clock::now();
+    std::atomic<int> running{options.devices};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.devices; i++) {
+        threads.emplace_back([&, i]() {
+            std::this_thread::sleep_for(std::chrono::duration<double>(options.ramp_seconds * i / options.devices));
+            devices[i]->Run();
+            running--;
+        });
+    }
+    // The main loop of every device, the MQTT protocol closes the channel on a server goodbye from here
+    while (running > 0) {
+        Application::GetInstance().RunScheduled();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    Application::GetInstance().RunScheduled();
+    report.Print(std::chrono::duration<double>(Clock::now() - start).count());
+    devices.clear();
+    return 0;
+}
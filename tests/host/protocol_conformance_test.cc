@@ -0,0 +1,621 @@
+#include "websocket_protocol.h"
+#include "mqtt_protocol.h"
+#include "application.h"
+#include "settings.h"
+#include "fake_transports.h"
+#include "test_support.h"
+#include "assets/lang_config.h"
+
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+/*
+ * Conformance of the real WebsocketProtocol and MqttProtocol against a scripted server on the
+ * fake transports: handshake headers, hello contents, BinaryProtocol2/3 framing both ways,
+ * batches, JSON routing and teardown. The benchmarks report per-message cost and allocations.
+ */
+
+namespace {
+
+const char* kKeyHex = "000102030405060708090a0b0c0d0e0f";
+const char* kNonceHex = "01000000aabbccdd0000000000000000";
+
+struct ServerHelloOptions {
+    const char* transport = "websocket";
+    int sample_rate = 24000;
+    int frame_duration = 60;
+    int batch_frames = 0;
+    bool udp_media = false;
+};
+
+std::string MakeServerHello(const ServerHelloOptions& options) {
+    std::string hello;
+    JsonWriter json(hello);
+    json.BeginObject()
+        .Key("type").String("hello")
+        .Key("transport").String(options.transport)
+        .Key("session_id").String("session-1");
+    json.Key("audio_params").BeginObject()
+        .Key("format").String("opus")
+        .Key("sample_rate").Int(options.sample_rate)
+        .Key("channels").Int(1)
+        .Key("frame_duration").Int(options.frame_duration);
+    if (options.batch_frames > 0) {
+        json.Key("batch_frames").Int(options.batch_frames);
+    }
+    json.EndObject();
+    if (options.udp_media || strcmp(options.transport, "udp") == 0) {
+        if (options.udp_media) {
+            json.Key("media_transport").String("udp");
+        }
+        json.Key("udp").BeginObject()
+            .Key("server").String("127.0.0.1")
+            .Key("port").Int(8888)
+            .Key("key").String(kKeyHex)
+            .Key("nonce").String(kNonceHex)
+            .EndObject();
+    }
+    json.EndObject();
+    return hello;
+}
+
+std::string MakeOpus(size_t size, uint8_t seed) {
+    std::string opus(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        opus[i] = (char)(seed + i * 7);
+    }
+    return opus;
+}
+
+AudioStreamPacket MakeUplinkPacket(const std::string& opus, uint32_t timestamp, uint16_t headroom = AUDIO_PACKET_HEADROOM) {
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = timestamp;
+    packet.headroom = headroom;
+    packet.payload.resize(headroom + opus.size());
+    memcpy(packet.payload.data() + headroom, opus.data(), opus.size());
+    return packet;
+}
+
+// The binary message of one Opus frame as the server expects it, and as it sends audio down
+std::string MakeFrame(int version, uint32_t timestamp, const std::string& opus, uint16_t type = 0) {
+    std::string frame;
+    if (version == 2) {
+        BinaryProtocol2 header;
+        header.version = htons(2);
+        header.type = htons(type);
+        header.reserved = 0;
+        header.timestamp = htonl(timestamp);
+        header.payload_size = htonl(opus.size());
+        frame.assign((const char*)&header, sizeof(header));
+    } else if (version == 3) {
+        BinaryProtocol3 header;
+        header.type = type;
+        header.reserved = 0;
+        header.payload_size = htons(opus.size());
+        frame.assign((const char*)&header, sizeof(header));
+    }
+    return frame + opus;
+}
+
+std::string MakeBatchEntry(uint32_t timestamp, const std::string& opus) {
+    uint32_t be_timestamp = htonl(timestamp);
+    uint16_t be_size = htons(opus.size());
+    std::string entry((const char*)&be_timestamp, 4);
+    entry.append((const char*)&be_size, 2);
+    return entry + opus;
+}
+
+void SetWebsocketSettings(int version) {
+    Settings settings("websocket", true);
+    settings.SetString("url", "wss://server.test/xiaozhi/v1/");
+    settings.SetString("token", "test-token");
+    settings.SetInt("version", version);
+}
+
+// A WebsocketProtocol wired to fake transports and a server that answers the hello
+class WebsocketSession {
+public:
+    explicit WebsocketSession(int version, ServerHelloOptions hello_options = {}) {
+        SetWebsocketSettings(version);
+        server_hello = MakeServerHello(hello_options);
+        GetHostTransports().create_websocket = [this]() -> WebSocket* {
+            auto websocket = new FakeWebSocket();
+            websocket->connect_result = connect_result;
+            websocket->server = [this](FakeWebSocket& websocket, std::string_view data, bool binary) {
+                OnServerReceive(websocket, data, binary);
+            };
+            this->websocket = websocket;
+            websockets_created++;
+            return websocket;
+        };
+        GetHostTransports().create_udp = [this]() -> Udp* {
+            udp = new FakeUdp();
+            return udp;
+        };
+
+        protocol = std::make_unique<WebsocketProtocol>();
+        protocol->OnIncomingAudio([this](AudioStreamPacket&& packet) {
+            // Hand the previous buffer back like the jitter buffer does
+            std::swap(received, packet);
+            received_count++;
+        });
+        protocol->OnIncomingJson([this](const JsonMessage& message) {
+            last_json_type.assign(message.type());
+            json_count++;
+        });
+        protocol->OnAudioChannelClosed([this]() {
+            closed_count++;
+        });
+        protocol->OnNetworkError([this](const std::string& message) {
+            last_error = message;
+        });
+    }
+
+    ~WebsocketSession() {
+        protocol.reset();
+        ResetHostTransports();
+        Settings("websocket", true).EraseAll();
+    }
+
+    void OnServerReceive(FakeWebSocket& websocket, std::string_view data, bool binary) {
+        if (binary) {
+            if (echo) {
+                websocket.Deliver(data.data(), data.size(), true);
+            }
+            return;
+        }
+        JsonMessage message(data.data(), data.size());
+        if (message.type() == "hello") {
+            client_hello.assign(data);
+            websocket.Receive(server_hello, false);
+        }
+    }
+
+    std::unique_ptr<WebsocketProtocol> protocol;
+    FakeWebSocket* websocket = nullptr;
+    FakeUdp* udp = nullptr;
+    bool connect_result = true;
+    bool echo = false;
+    int websockets_created = 0;
+    std::string server_hello;
+    std::string client_hello;
+    AudioStreamPacket received;
+    std::atomic<int> received_count{0};
+    std::string last_json_type;
+    std::atomic<int> json_count{0};
+    std::atomic<int> closed_count{0};
+    std::string last_error;
+};
+
+void SetMqttSettings() {
+    Settings settings("mqtt", true);
+    settings.SetString("endpoint", "mqtt.server.test:8884");
+    settings.SetString("client_id", "GID_test@@@02_00_00_00_00_01");
+    settings.SetString("username", "user");
+    settings.SetString("password", "secret");
+    settings.SetString("publish_topic", "device-server");
+    settings.SetInt("keepalive", 240);
+}
+
+class MqttSession {
+public:
+    MqttSession() {
+        SetMqttSettings();
+        server_hello = MakeServerHello({.transport = "udp"});
+        GetHostTransports().create_mqtt = [this]() -> Mqtt* {
+            auto mqtt = new FakeMqtt();
+            mqtt->server = [this](FakeMqtt& mqtt, const std::string& topic, const std::string& payload) {
+                JsonMessage message(payload.data(), payload.size());
+                if (message.type() == "hello") {
+                    client_hello = payload;
+                    mqtt.Receive("devices/p2p/02_00_00_00_00_01", server_hello);
+                }
+            };
+            this->mqtt = mqtt;
+            mqtts_created++;
+            return mqtt;
+        };
+        GetHostTransports().create_udp = [this]() -> Udp* {
+            udp = new FakeUdp();
+            return udp;
+        };
+        protocol = std::make_unique<MqttProtocol>();
+        protocol->OnAudioChannelClosed([this]() {
+            closed_count++;
+        });
+    }
+
+    ~MqttSession() {
+        protocol.reset();
+        ResetHostTransports();
+        Settings("mqtt", true).EraseAll();
+    }
+
+    std::unique_ptr<MqttProtocol> protocol;
+    std::atomic<FakeMqtt*> mqtt{nullptr};
+    FakeUdp* udp = nullptr;
+    std::atomic<int> mqtts_created{0};
+    std::string server_hello;
+    std::string client_hello;
+    std::atomic<int> closed_count{0};
+};
+
+} // namespace
+
+class WebsocketProtocolTest : public ::testing::TestWithParam<int> {};
+
+TEST_P(WebsocketProtocolTest, SendsHeadersAndHello) {
+    int version = GetParam();
+    WebsocketSession session(version);
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    EXPECT_TRUE(session.protocol->IsAudioChannelOpened());
+
+    auto websocket = session.websocket;
+    EXPECT_EQ(websocket->url, "wss://server.test/xiaozhi/v1/");
+    EXPECT_EQ(websocket->headers["Authorization"], "Bearer test-token");
+    EXPECT_EQ(websocket->headers["Protocol-Version"], std::to_string(version));
+    EXPECT_EQ(websocket->headers["Device-Id"], "02:00:00:00:00:01");
+    EXPECT_EQ(websocket->headers["Client-Id"], "00000000-0000-4000-8000-000000000000");
+
+    auto hello = cJSON_Parse(session.client_hello.c_str());
+    ASSERT_NE(hello, nullptr);
+    EXPECT_STREQ(cJSON_GetObjectItem(hello, "type")->valuestring, "hello");
+    EXPECT_EQ(cJSON_GetObjectItem(hello, "version")->valueint, version);
+    EXPECT_STREQ(cJSON_GetObjectItem(hello, "transport")->valuestring, "websocket");
+    EXPECT_TRUE(cJSON_IsTrue(cJSON_GetObjectItem(cJSON_GetObjectItem(hello, "features"), "mcp")));
+    auto media_transports = cJSON_GetObjectItem(hello, "media_transports");
+    ASSERT_EQ(cJSON_GetArraySize(media_transports), 2);
+    EXPECT_STREQ(cJSON_GetArrayItem(media_transports, 0)->valuestring, "websocket");
+    EXPECT_STREQ(cJSON_GetArrayItem(media_transports, 1)->valuestring, "udp");
+    auto audio_params = cJSON_GetObjectItem(hello, "audio_params");
+    EXPECT_STREQ(cJSON_GetObjectItem(audio_params, "format")->valuestring, "opus");
+    EXPECT_EQ(cJSON_GetObjectItem(audio_params, "sample_rate")->valueint, 16000);
+    EXPECT_EQ(cJSON_GetObjectItem(audio_params, "channels")->valueint, 1);
+    EXPECT_EQ(cJSON_GetObjectItem(audio_params, "frame_duration")->valueint, 60);
+    EXPECT_EQ(cJSON_GetObjectItem(audio_params, "batch_frames")->valueint, 4);
+    cJSON_Delete(hello);
+
+    EXPECT_EQ(session.protocol->session_id(), "session-1");
+    EXPECT_EQ(session.protocol->server_sample_rate(), 24000);
+    EXPECT_EQ(session.protocol->server_frame_duration(), 60);
+}
+
+TEST_P(WebsocketProtocolTest, FramesUplinkAudio) {
+    int version = GetParam();
+    WebsocketSession session(version);
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+
+    auto opus = MakeOpus(120, 1);
+    auto packet = MakeUplinkPacket(opus, 0x01020304);
+    ASSERT_TRUE(session.protocol->SendAudio(packet));
+    EXPECT_EQ(session.websocket->last_binary, MakeFrame(version, 0x01020304, opus));
+
+    // A packet without headroom takes the copying path and goes out the same
+    auto bare = MakeUplinkPacket(opus, 0x01020304, 0);
+    ASSERT_TRUE(session.protocol->SendAudio(bare));
+    EXPECT_EQ(session.websocket->last_binary, MakeFrame(version, 0x01020304, opus));
+    EXPECT_EQ(session.websocket->binary_sent, 2);
+}
+
+TEST_P(WebsocketProtocolTest, ParsesDownlinkAudio) {
+    int version = GetParam();
+    WebsocketSession session(version);
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+
+    for (uint32_t i = 0; i < 3; i++) {
+        auto opus = MakeOpus(80 + i, i);
+        auto frame = MakeFrame(version, 1000 + i * 60, opus);
+        session.websocket->Deliver(frame.data(), frame.size(), true);
+        ASSERT_EQ(session.received_count, (int)i + 1);
+        EXPECT_EQ(std::string(session.received.payload.begin(), session.received.payload.end()), opus);
+        EXPECT_EQ(session.received.sequence, i + 1);
+        EXPECT_EQ(session.received.timestamp, version == 2 ? 1000 + i * 60 : 0);
+        EXPECT_EQ(session.received.sample_rate, 24000);
+        EXPECT_EQ(session.received.frame_duration, 60);
+    }
+
+    if (version != 1) {
+        // Shorter than its header or than the size it announces
+        auto frame = MakeFrame(version, 0, MakeOpus(50, 0));
+        session.websocket->Deliver(frame.data(), frame.size() - 1, true);
+        session.websocket->Deliver(frame.data(), version == 2 ? 10 : 3, true);
+        EXPECT_EQ(session.received_count, 3);
+    }
+}
+
+TEST_P(WebsocketProtocolTest, BatchesUplinkAudioWhenNegotiated) {
+    int version = GetParam();
+    WebsocketSession session(version, {.batch_frames = 3});
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    if (version == 1) {
+        // Raw frames have no batch format
+        EXPECT_EQ(session.protocol->audio_batch_frames(), 1);
+        return;
+    }
+    EXPECT_EQ(session.protocol->audio_batch_frames(), 3);
+
+    std::vector<AudioStreamPacket> packets;
+    std::string entries;
+    for (uint32_t i = 0; i < 3; i++) {
+        auto opus = MakeOpus(60 + i * 10, i);
+        packets.push_back(MakeUplinkPacket(opus, 500 + i * 60));
+        entries += MakeBatchEntry(500 + i * 60, opus);
+    }
+    ASSERT_TRUE(session.protocol->SendAudioBatch(packets));
+    EXPECT_EQ(session.websocket->binary_sent, 1);
+    EXPECT_EQ(session.websocket->last_binary, MakeFrame(version, 500, entries, 2));
+}
+
+TEST_P(WebsocketProtocolTest, RoutesJsonAndKeepsHelloInside) {
+    WebsocketSession session(GetParam());
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    EXPECT_EQ(session.json_count, 0);
+
+    session.websocket->Receive(R"({"type":"tts","state":"start","session_id":"session-1"})", false);
+    session.websocket->Receive(R"({"state":"no type"})", false);
+    session.websocket->WaitIdle();
+    EXPECT_EQ(session.json_count, 1);
+    EXPECT_EQ(session.last_json_type, "tts");
+
+    session.protocol->SendStartListening(kListeningModeAutoStop);
+    EXPECT_EQ(session.websocket->last_text, R"({"session_id":"session-1","type":"listen","state":"start","mode":"auto"})");
+}
+
+TEST_P(WebsocketProtocolTest, ClosesOnServerDisconnect) {
+    WebsocketSession session(GetParam());
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    session.websocket->Disconnect();
+    session.websocket->WaitIdle();
+    EXPECT_EQ(session.closed_count, 1);
+    EXPECT_FALSE(session.protocol->IsAudioChannelOpened());
+
+    // The next conversation connects again
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    EXPECT_EQ(session.websockets_created, 2);
+    session.protocol->CloseAudioChannel();
+    EXPECT_EQ(session.closed_count, 2);
+    auto packet = MakeUplinkPacket(MakeOpus(40, 0), 0);
+    EXPECT_FALSE(session.protocol->SendAudio(packet));
+}
+
+TEST_P(WebsocketProtocolTest, SteadyStateAudioDoesNotAllocate) {
+    int version = GetParam();
+    WebsocketSession session(version);
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+
+    auto packet = MakeUplinkPacket(MakeOpus(120, 3), 0);
+    auto frame = MakeFrame(version, 0, MakeOpus(150, 4));
+    auto exchange = [&]() {
+        session.protocol->SendAudio(packet);
+        session.websocket->Deliver(frame.data(), frame.size(), true);
+    };
+    for (int i = 0; i < 3; i++) {
+        exchange();
+    }
+    AllocationScope allocations;
+    for (int i = 0; i < 100; i++) {
+        exchange();
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+}
+
+// Audio keeps flowing from another task while the main loop closes and reopens the channel
+TEST_P(WebsocketProtocolTest, SendsWhileConnectionIsReplaced) {
+    WebsocketSession session(GetParam());
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+
+    std::atomic<bool> running{true};
+    std::thread sender([&]() {
+        auto packet = MakeUplinkPacket(MakeOpus(100, 5), 0);
+        while (running) {
+            session.protocol->SendAudio(packet);
+            session.protocol->audio_message_overhead();
+            session.protocol->IsAudioChannelOpened();
+        }
+    });
+    for (int i = 0; i < 50; i++) {
+        session.protocol->CloseAudioChannel();
+        ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    }
+    running = false;
+    sender.join();
+    EXPECT_EQ(session.websockets_created, 51);
+}
+
+INSTANTIATE_TEST_SUITE_P(Versions, WebsocketProtocolTest, ::testing::Values(1, 2, 3),
+    [](const ::testing::TestParamInfo<int>& info) { return "V" + std::to_string(info.param); });
+
+TEST(WebsocketProtocol, ReportsConnectFailure) {
+    WebsocketSession session(3);
+    session.connect_result = false;
+    EXPECT_FALSE(session.protocol->OpenAudioChannel());
+    EXPECT_EQ(session.last_error, Lang::Strings::SERVER_NOT_CONNECTED);
+    EXPECT_FALSE(session.protocol->IsAudioChannelOpened());
+    auto packet = MakeUplinkPacket(MakeOpus(40, 0), 0);
+    EXPECT_FALSE(session.protocol->SendAudio(packet));
+}
+
+TEST(WebsocketProtocol, MovesAudioToUdpWhenTheServerPicksIt) {
+    WebsocketSession session(3, {.udp_media = true});
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    ASSERT_NE(session.udp, nullptr);
+    EXPECT_EQ(session.udp->host, "127.0.0.1");
+    EXPECT_EQ(session.udp->port, 8888);
+
+    auto packet = MakeUplinkPacket(MakeOpus(100, 6), 0);
+    ASSERT_TRUE(session.protocol->SendAudio(packet));
+    EXPECT_EQ(session.udp->sent, 1);
+    EXPECT_EQ(session.websocket->binary_sent, 0);
+    EXPECT_EQ(session.udp->last_datagram.size(), UDP_AUDIO_NONCE_SIZE + 100);
+
+    // Downlink on the websocket is still accepted
+    auto frame = MakeFrame(3, 0, MakeOpus(70, 1));
+    session.websocket->Deliver(frame.data(), frame.size(), true);
+    EXPECT_EQ(session.received_count, 1);
+}
+
+TEST(MqttProtocol, ConnectsHelloOverUdpAndGoodbye) {
+    MqttSession session;
+    ASSERT_TRUE(session.protocol->Start());
+    FakeMqtt* mqtt = session.mqtt;
+    EXPECT_EQ(mqtt->broker_address, "mqtt.server.test");
+    EXPECT_EQ(mqtt->broker_port, 8884);
+    EXPECT_EQ(mqtt->client_id, "GID_test@@@02_00_00_00_00_01");
+    EXPECT_EQ(mqtt->username, "user");
+    EXPECT_EQ(mqtt->password, "secret");
+    EXPECT_EQ(mqtt->keep_alive, 240);
+    EXPECT_FALSE(session.protocol->NeedsReconnect());
+
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+    EXPECT_EQ(mqtt->last_topic, "device-server");
+    auto hello = cJSON_Parse(session.client_hello.c_str());
+    ASSERT_NE(hello, nullptr);
+    EXPECT_STREQ(cJSON_GetObjectItem(hello, "type")->valuestring, "hello");
+    EXPECT_EQ(cJSON_GetObjectItem(hello, "version")->valueint, 3);
+    EXPECT_STREQ(cJSON_GetObjectItem(hello, "transport")->valuestring, "udp");
+    cJSON_Delete(hello);
+    EXPECT_EQ(session.protocol->session_id(), "session-1");
+    EXPECT_TRUE(session.protocol->IsAudioChannelOpened());
+
+    auto packet = MakeUplinkPacket(MakeOpus(90, 2), 0);
+    ASSERT_TRUE(session.protocol->SendAudio(packet));
+    ASSERT_NE(session.udp, nullptr);
+    EXPECT_EQ(session.udp->sent, 1);
+    EXPECT_EQ(session.udp->last_datagram.size(), UDP_AUDIO_NONCE_SIZE + 90);
+
+    // A goodbye for another session is ignored, ours closes the channel on the main loop
+    mqtt->Receive("devices/p2p/02_00_00_00_00_01", R"({"type":"goodbye","session_id":"other"})");
+    mqtt->Receive("devices/p2p/02_00_00_00_00_01", R"({"type":"goodbye","session_id":"session-1"})");
+    mqtt->WaitIdle();
+    EXPECT_EQ(Application::GetInstance().RunScheduled(), 1);
+    EXPECT_EQ(session.closed_count, 1);
+    EXPECT_EQ(mqtt->last_payload, R"({"session_id":"session-1","type":"goodbye"})");
+    EXPECT_FALSE(session.protocol->IsAudioChannelOpened());
+}
+
+// Control messages keep going out while the supervisor replaces a dropped client
+TEST(MqttProtocol, PublishesWhileReconnecting) {
+    MqttSession session;
+    ASSERT_TRUE(session.protocol->Start());
+
+    std::atomic<bool> running{true};
+    std::thread publisher([&]() {
+        while (running) {
+            session.protocol->SendStopListening();
+            session.protocol->NeedsReconnect();
+        }
+    });
+    // Only this thread makes the protocol delete clients, so it may touch the current one
+    for (int i = 0; i < 50; i++) {
+        session.mqtt.load()->connected = false;
+        ASSERT_TRUE(session.protocol->NeedsReconnect());
+        ASSERT_TRUE(session.protocol->Reconnect());
+    }
+    running = false;
+    publisher.join();
+    EXPECT_EQ(session.mqtts_created, 51);
+    EXPECT_FALSE(session.protocol->NeedsReconnect());
+}
+
+// Send and receive cost per message through the real protocol objects. The echo server answers
+// every uplink frame with the same bytes as a downlink frame, on the sending thread.
+TEST(ProtocolBenchmark, WebsocketEchoRoundTrip) {
+    for (int version : {1, 2, 3}) {
+        WebsocketSession session(version);
+        session.echo = true;
+        ASSERT_TRUE(session.protocol->OpenAudioChannel());
+        auto packet = MakeUplinkPacket(MakeOpus(120, 7), 0);
+        for (int i = 0; i < 10; i++) {
+            session.protocol->SendAudio(packet);
+        }
+
+        size_t allocations;
+        {
+            AllocationScope scope;
+            for (int i = 0; i < 1000; i++) {
+                session.protocol->SendAudio(packet);
+            }
+            allocations = scope.count();
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "websocket v%d echo 120 B frame", version);
+        Bench(name, 200000, [&]() {
+            packet.timestamp += 60;
+            session.protocol->SendAudio(packet);
+        });
+        printf("[ BENCH    ] %-40s %10.3f allocations per frame\n", name, allocations / 1000.0);
+        EXPECT_EQ(allocations, 0u);
+        EXPECT_GT(session.received_count, 200000);
+    }
+
+    // The framing before headroom and pooled downlink buffers: a new string per uplink frame
+    // and a new vector per downlink frame
+    FakeWebSocket websocket;
+    websocket.Connect("ws://echo");
+    auto opus = MakeOpus(120, 7);
+    AudioStreamPacket packet;
+    packet.payload.assign(opus.begin(), opus.end());
+    size_t received = 0;
+    auto copying_round_trip = [&]() {
+        std::string serialized;
+        serialized.resize(sizeof(BinaryProtocol3) + packet.payload.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(packet.payload.size());
+        memcpy(bp3->payload, packet.payload.data(), packet.payload.size());
+        websocket.Send(serialized.data(), serialized.size(), true);
+
+        auto incoming = (const BinaryProtocol3*)websocket.last_binary.data();
+        auto incoming_packet = std::make_unique<AudioStreamPacket>();
+        incoming_packet->payload.assign(incoming->payload, incoming->payload + ntohs(incoming->payload_size));
+        received += incoming_packet->payload.size();
+    };
+    size_t allocations;
+    {
+        AllocationScope scope;
+        for (int i = 0; i < 1000; i++) {
+            copying_round_trip();
+        }
+        allocations = scope.count();
+    }
+    Bench("copying v3 echo 120 B frame (reference)", 200000, copying_round_trip);
+    printf("[ BENCH    ] %-40s %10.3f allocations per frame\n", "copying v3 echo 120 B frame (reference)", allocations / 1000.0);
+    EXPECT_GT(received, 0u);
+}
+
+TEST(ProtocolBenchmark, PerMessageCost) {
+    WebsocketSession session(3, {.batch_frames = 4});
+    ASSERT_TRUE(session.protocol->OpenAudioChannel());
+
+    std::vector<AudioStreamPacket> batch;
+    for (int i = 0; i < 4; i++) {
+        batch.push_back(MakeUplinkPacket(MakeOpus(100, i), i * 60));
+    }
+    Bench("websocket v3 SendAudioBatch 4 frames", 100000, [&]() {
+        session.protocol->SendAudioBatch(batch);
+    });
+    Bench("websocket SendStartListening", 100000, [&]() {
+        session.protocol->SendStartListening(kListeningModeAutoStop);
+    });
+    std::string sentence = R"({"type":"tts","state":"sentence_start","text":"今天天气不错","session_id":"session-1"})";
+    Bench("websocket incoming tts message", 100000, [&]() {
+        session.websocket->Deliver(sentence.data(), sentence.size(), false);
+    });
+
+    MqttSession mqtt_session;
+    ASSERT_TRUE(mqtt_session.protocol->Start());
+    ASSERT_TRUE(mqtt_session.protocol->OpenAudioChannel());
+    auto packet = MakeUplinkPacket(MakeOpus(120, 8), 0);
+    Bench("mqtt UDP SendAudio 120 B frame", 100000, [&]() {
+        mqtt_session.protocol->SendAudio(packet);
+    });
+    Bench("mqtt SendStartListening", 100000, [&]() {
+        mqtt_session.protocol->SendStartListening(kListeningModeAutoStop);
+    });
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sentence_splitter.h"
+
+static std::vector<std::string> Split(const std::vector<std::string>& deltas) {
+    SentenceSplitter splitter;
+    std::vector<std::string> sentences;
+    std::string sentence;
+    for (auto& delta : deltas) {
+        splitter.Append(delta);
+        while (splitter.Next(sentence)) {
+            sentences.push_back(sentence);
+        }
+    }
+    if (splitter.Finish(sentence)) {
+        sentences.push_back(sentence);
+    }
+    return sentences;
+}
+
+TEST(SentenceSplitter, JoinsDeltasIntoSentences) {
+    EXPECT_EQ(Split({"Hel", "lo there", ". How are", " you?", " Fine"}),
+        (std::vector<std::string>{"Hello there.", "How are you?", "Fine"}));
+}
+
+TEST(SentenceSplitter, SplitsChinesePunctuation) {
+    EXPECT_EQ(Split({"你好", "。今天天气", "怎么样？很好！", "就这样…", "再见"}),
+        (std::vector<std::string>{"你好。", "今天天气怎么样？", "很好！", "就这样…", "再见"}));
+}
+
+TEST(SentenceSplitter, KeepsNumbersAndSkipsBlankLines) {
+    EXPECT_EQ(Split({"Pi is 3", ".14. ", "\n\n", "Next line\nlast."}),
+        (std::vector<std::string>{"Pi is 3.14.", "Next line", "last."}));
+}
+
+TEST(SentenceSplitter, WaitsForAPeriodAtTheEndOfADelta) {
+    SentenceSplitter splitter;
+    std::string sentence;
+    splitter.Append("Version 2.");
+    EXPECT_FALSE(splitter.Next(sentence));
+    splitter.Append("5 is out. ");
+    ASSERT_TRUE(splitter.Next(sentence));
+    EXPECT_EQ(sentence, "Version 2.5 is out.");
+    EXPECT_FALSE(splitter.Finish(sentence));
+}
+
+// A terminator split between deltas in the middle of its UTF-8 bytes is still found
+TEST(SentenceSplitter, SameSentencesOnAnySplit) {
+    const std::string text = "第一句。Second one! 第三句？Fourth; and the 5.5th… 最后";
+    auto expected = Split({text});
+    ASSERT_EQ(expected.size(), 6u);
+    std::mt19937 random(24);
+    for (int round = 0; round < 1000; round++) {
+        std::vector<std::string> deltas;
+        for (size_t offset = 0; offset < text.size();) {
+            size_t length = std::min<size_t>(text.size() - offset, 1 + random() % 6);
+            deltas.push_back(text.substr(offset, length));
+            offset += length;
+        }
+        ASSERT_EQ(Split(deltas), expected) << round;
+    }
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sse_parser.h"
+
+using Events = std::vector<std::pair<std::string, std::string>>;
+
+static Events Parse(const std::vector<std::string>& chunks, bool finish = true) {
+    SseParser parser;
+    Events events;
+    parser.OnEvent([&events](std::string_view event, std::string_view data) {
+        events.emplace_back(std::string(event), std::string(data));
+    });
+    for (auto& chunk : chunks) {
+        parser.Feed(chunk.data(), chunk.size());
+    }
+    if (finish) {
+        parser.Finish();
+    }
+    return events;
+}
+
+TEST(SseParser, ParsesEventsAndIgnoresOtherFields) {
+    auto events = Parse({
+        ": keep-alive comment\n"
+        "event: response.text.delta\n"
+        "id: 7\n"
+        "retry: 1000\n"
+        "data: {\"delta\":\"Hi\"}\n"
+        "\n"
+        "data: no event name\n"
+        "\n"
+    }, false);
+    EXPECT_EQ(events, (Events{{"response.text.delta", "{\"delta\":\"Hi\"}"}, {"", "no event name"}}));
+}
+
+TEST(SseParser, AcceptsEveryLineEnding) {
+    Events expected{{"a", "1"}, {"b", "2"}, {"c", "3"}};
+    EXPECT_EQ(Parse({"event: a\ndata: 1\n\nevent: b\ndata: 2\n\nevent: c\ndata: 3\n\n"}, false), expected);
+    EXPECT_EQ(Parse({"event: a\r\ndata: 1\r\n\r\nevent: b\r\ndata: 2\r\n\r\nevent: c\r\ndata: 3\r\n\r\n"}, false), expected);
+    EXPECT_EQ(Parse({"event: a\rdata: 1\r\revent: b\rdata: 2\r\revent: c\rdata: 3\r\r"}, false), expected);
+    EXPECT_EQ(Parse({"event: a\r\ndata: 1\n\revent: b\rdata: 2\r\n\nevent: c\ndata: 3\r\r"}, false), expected);
+}
+
+TEST(SseParser, CrLfSplitAcrossChunksIsOneLineBreak) {
+    // A '\n' read as a second line break would end the event after "a"
+    EXPECT_EQ(Parse({"data: a\r", "\ndata: b\r\n\r\n"}, false), (Events{{"", "a\nb"}}));
+    EXPECT_EQ(Parse({"data: a\r\n\r", "\n"}, false), (Events{{"", "a"}}));
+    EXPECT_EQ(Parse({"data: a\r", "\n", "\r", "\n"}, false), (Events{{"", "a"}}));
+    // A bare '\r' at the end of a chunk is still a line break of its own
+    EXPECT_EQ(Parse({"data: a\r", "data: b\r", "\r"}, false), (Events{{"", "a\nb"}}));
+}
+
+TEST(SseParser, JoinsMultiLineData) {
+    EXPECT_EQ(Parse({"data: first\ndata:second\ndata\ndata:  indented\n\n"}, false),
+        (Events{{"", "first\nsecond\n\n indented"}}));
+}
+
+TEST(SseParser, SameEventsForEverySplit) {
+    const std::string stream =
+        "event: start\r\ndata: one\r\ndata: two\r\n\r\n"
+        ": comment\n"
+        "event: delta\rdata: {\"text\":\"x\"}\r\r"
+        "data: last\n\n";
+    const Events expected{{"start", "one\ntwo"}, {"delta", "{\"text\":\"x\"}"}, {"", "last"}};
+
+    for (size_t split = 0; split <= stream.size(); split++) {
+        EXPECT_EQ(Parse({stream.substr(0, split), stream.substr(split)}, false), expected) << "split at " << split;
+    }
+
+    std::vector<std::string> bytes;
+    for (char c : stream) {
+        bytes.emplace_back(1, c);
+    }
+    EXPECT_EQ(Parse(bytes, false), expected);
+}
+
+TEST(SseParser, FinishDispatchesTheLastEvent) {
+    // Without any line break after the last line
+    EXPECT_EQ(Parse({"data: a\n\ndata: b"}), (Events{{"", "a"}, {"", "b"}}));
+    // With the line complete but no blank line
+    EXPECT_EQ(Parse({"event: done\ndata: c\r\n"}), (Events{{"done", "c"}}));
+    // Nothing pending, nothing dispatched
+    EXPECT_EQ(Parse({"data: a\n\n"}), (Events{{"", "a"}}));
+    EXPECT_EQ(Parse({""}), Events{});
+    // Not finished, the partial event is held back
+    EXPECT_EQ(Parse({"data: a\n\ndata: b"}, false), (Events{{"", "a"}}));
+}
+
+TEST(SseParser, DropsEventsWithoutData) {
+    EXPECT_EQ(Parse({"event: ping\n\nevent: real\ndata: x\n\n"}, false), (Events{{"real", "x"}}));
+}
+
+TEST(SseParser, ResetDiscardsThePartialEvent) {
+    SseParser parser;
+    Events events;
+    parser.OnEvent([&events](std::string_view event, std::string_view data) {
+        events.emplace_back(std::string(event), std::string(data));
+    });
+    std::string first = "event: old\ndata: stale\ndata: par";
+    parser.Feed(first.data(), first.size());
+    parser.Reset();
+    std::string second = "data: fresh\n\n";
+    parser.Feed(second.data(), second.size());
+    EXPECT_EQ(events, (Events{{"", "fresh"}}));
+}
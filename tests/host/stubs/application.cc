@@ -0,0 +1,24 @@
+#include "application.h"
+
+#include <deque>
+#include <mutex>
+
+static std::mutex scheduled_mutex;
+static std::deque<std::function<void()>> scheduled;
+
+void Application::Schedule(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(scheduled_mutex);
+    scheduled.push_back(std::move(callback));
+}
+
+int Application::RunScheduled() {
+    std::deque<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(scheduled_mutex);
+        callbacks.swap(scheduled);
+    }
+    for (auto& callback : callbacks) {
+        callback();
+    }
+    return callbacks.size();
+}
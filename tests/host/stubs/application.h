@@ -0,0 +1,23 @@
+#ifndef _APPLICATION_H_
+#define _APPLICATION_H_
+
+#include <functional>
+
+// Host stand-in for the main loop: Schedule() queues the callback, the test runs the queue
+// with RunScheduled() on its own thread
+class Application {
+public:
+    static Application& GetInstance() {
+        static Application instance;
+        return instance;
+    }
+
+    void Schedule(std::function<void()> callback);
+    // Runs the callbacks queued so far, returns how many ran
+    int RunScheduled();
+
+private:
+    Application() = default;
+};
+
+#endif // _APPLICATION_H_
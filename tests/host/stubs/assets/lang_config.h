@@ -0,0 +1,13 @@
+// Host stand-in for the header gen_lang.py generates, only the strings the protocols report
+#pragma once
+
+namespace Lang {
+    constexpr const char* CODE = "en-US";
+
+    namespace Strings {
+        constexpr const char* SERVER_NOT_FOUND = "Looking for available service";
+        constexpr const char* SERVER_NOT_CONNECTED = "Unable to connect to service, please try again later";
+        constexpr const char* SERVER_TIMEOUT = "Waiting for response timeout";
+        constexpr const char* SERVER_ERROR = "Sending failed, please check the network";
+    }
+}
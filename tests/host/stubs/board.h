@@ -0,0 +1,38 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <udp.h>
+#include <web_socket.h>
+#include <mqtt.h>
+#include <system_info.h>
+#include <string>
+
+class AudioCodec;
+
+// Host stand-in for boards/common/board.h, the test binary provides create_board() like DECLARE_BOARD does
+void* create_board();
+
+class Board {
+private:
+    Board(const Board&) = delete;
+    Board& operator=(const Board&) = delete;
+
+protected:
+    Board() = default;
+
+public:
+    static Board& GetInstance() {
+        static Board* instance = static_cast<Board*>(create_board());
+        return *instance;
+    }
+
+    virtual ~Board() = default;
+    virtual std::string GetBoardType() { return "host"; }
+    virtual std::string GetUuid() { return GetHostDeviceIdentity().uuid; }
+    virtual AudioCodec* GetAudioCodec() { return nullptr; }
+    virtual WebSocket* CreateWebSocket() = 0;
+    virtual Mqtt* CreateMqtt() = 0;
+    virtual Udp* CreateUdp() = 0;
+};
+
+#endif // BOARD_H
@@ -0,0 +1,443 @@
+#include "cJSON.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+cJSON_Hooks hooks = {malloc, free};
+
+char* Duplicate(const char* s, size_t length) {
+    auto copy = (char*)hooks.malloc_fn(length + 1);
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+cJSON* NewItem(int type) {
+    auto item = (cJSON*)hooks.malloc_fn(sizeof(cJSON));
+    memset(item, 0, sizeof(cJSON));
+    item->type = type;
+    return item;
+}
+
+struct Parser {
+    const char* p;
+    const char* end;
+
+    void SkipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    bool Consume(const char* literal) {
+        size_t length = strlen(literal);
+        if ((size_t)(end - p) < length || memcmp(p, literal, length) != 0) {
+            return false;
+        }
+        p += length;
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += (char)code;
+        } else if (code < 0x800) {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        } else {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool ParseHex4(unsigned& code) {
+        if (end - p < 4) {
+            return false;
+        }
+        code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p++;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool ParseString(std::string& out) {
+        if (p >= end || *p != '"') {
+            return false;
+        }
+        p++;
+        while (p < end && *p != '"') {
+            char c = *p++;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (p >= end) {
+                return false;
+            }
+            switch (*p++) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned code;
+                if (!ParseHex4(code)) {
+                    return false;
+                }
+                if (code >= 0xD800 && code < 0xDC00) {
+                    unsigned low;
+                    if (!Consume("\\u") || !ParseHex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(out, code);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (p >= end) {
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    cJSON* ParseValue(int depth) {
+        if (depth > 1000) {
+            return nullptr;
+        }
+        SkipSpace();
+        if (p >= end) {
+            return nullptr;
+        }
+        if (Consume("null")) {
+            return NewItem(cJSON_NULL);
+        }
+        if (Consume("true")) {
+            auto item = NewItem(cJSON_True);
+            item->valueint = 1;
+            return item;
+        }
+        if (Consume("false")) {
+            return NewItem(cJSON_False);
+        }
+        if (*p == '"') {
+            std::string s;
+            if (!ParseString(s)) {
+                return nullptr;
+            }
+            auto item = NewItem(cJSON_String);
+            item->valuestring = Duplicate(s.data(), s.size());
+            return item;
+        }
+        if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            std::string number;
+            while (p < end && strchr("+-0123456789.eE", *p) != nullptr) {
+                number += *p++;
+            }
+            char* number_end;
+            double value = strtod(number.c_str(), &number_end);
+            if (*number_end != '\0') {
+                return nullptr;
+            }
+            auto item = NewItem(cJSON_Number);
+            item->valuedouble = value;
+            item->valueint = value >= 2147483647.0 ? 2147483647 : value <= -2147483648.0 ? (int)-2147483648.0 : (int)value;
+            return item;
+        }
+        if (*p == '[' || *p == '{') {
+            bool object = *p == '{';
+            char close = object ? '}' : ']';
+            p++;
+            auto container = NewItem(object ? cJSON_Object : cJSON_Array);
+            SkipSpace();
+            if (p < end && *p == close) {
+                p++;
+                return container;
+            }
+            cJSON* last = nullptr;
+            while (true) {
+                std::string key;
+                if (object) {
+                    SkipSpace();
+                    if (!ParseString(key)) {
+                        break;
+                    }
+                    SkipSpace();
+                    if (p >= end || *p != ':') {
+                        break;
+                    }
+                    p++;
+                }
+                auto child = ParseValue(depth + 1);
+                if (child == nullptr) {
+                    break;
+                }
+                if (object) {
+                    child->string = Duplicate(key.data(), key.size());
+                }
+                if (last == nullptr) {
+                    container->child = child;
+                    child->prev = child;
+                } else {
+                    last->next = child;
+                    child->prev = last;
+                    container->child->prev = child;
+                }
+                last = child;
+                SkipSpace();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                if (p < end && *p == close) {
+                    p++;
+                    return container;
+                }
+                break;
+            }
+            cJSON_Delete(container);
+            return nullptr;
+        }
+        return nullptr;
+    }
+};
+
+void PrintString(std::string& out, const char* s) {
+    out += '"';
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                out += escape;
+            } else {
+                out += (char)c;
+            }
+        }
+    }
+    out += '"';
+}
+
+void PrintValue(std::string& out, const cJSON* item) {
+    switch (item->type & 0xFF) {
+    case cJSON_NULL: out += "null"; break;
+    case cJSON_True: out += "true"; break;
+    case cJSON_False: out += "false"; break;
+    case cJSON_Number: {
+        char number[32];
+        double d = item->valuedouble;
+        // Same choice as cJSON: integers print without a fraction, others with enough digits to round-trip
+        if (std::isnan(d) || std::isinf(d)) {
+            snprintf(number, sizeof(number), "null");
+        } else if (d == (double)item->valueint) {
+            snprintf(number, sizeof(number), "%d", item->valueint);
+        } else {
+            snprintf(number, sizeof(number), "%1.15g", d);
+            if (strtod(number, nullptr) != d) {
+                snprintf(number, sizeof(number), "%1.17g", d);
+            }
+        }
+        out += number;
+        break;
+    }
+    case cJSON_String: PrintString(out, item->valuestring != nullptr ? item->valuestring : ""); break;
+    case cJSON_Raw: out += item->valuestring != nullptr ? item->valuestring : ""; break;
+    case cJSON_Array:
+    case cJSON_Object: {
+        bool object = (item->type & 0xFF) == cJSON_Object;
+        out += object ? '{' : '[';
+        for (auto child = item->child; child != nullptr; child = child->next) {
+            if (child != item->child) {
+                out += ',';
+            }
+            if (object) {
+                PrintString(out, child->string != nullptr ? child->string : "");
+                out += ':';
+            }
+            PrintValue(out, child);
+        }
+        out += object ? '}' : ']';
+        break;
+    }
+    }
+}
+
+} // namespace
+
+cJSON* cJSON_ParseWithLength(const char* value, size_t buffer_length) {
+    if (value == nullptr) {
+        return nullptr;
+    }
+    Parser parser{value, value + buffer_length};
+    auto item = parser.ParseValue(0);
+    if (item == nullptr) {
+        return nullptr;
+    }
+    // Trailing text after the value is accepted like cJSON does without require_null_terminated
+    return item;
+}
+
+cJSON* cJSON_Parse(const char* value) {
+    return value != nullptr ? cJSON_ParseWithLength(value, strlen(value)) : nullptr;
+}
+
+char* cJSON_PrintUnformatted(const cJSON* item) {
+    if (item == nullptr) {
+        return nullptr;
+    }
+    std::string out;
+    PrintValue(out, item);
+    return Duplicate(out.data(), out.size());
+}
+
+void cJSON_Delete(cJSON* item) {
+    while (item != nullptr) {
+        auto next = item->next;
+        cJSON_Delete(item->child);
+        hooks.free_fn(item->valuestring);
+        hooks.free_fn(item->string);
+        hooks.free_fn(item);
+        item = next;
+    }
+}
+
+void cJSON_free(void* object) {
+    hooks.free_fn(object);
+}
+
+void cJSON_InitHooks(cJSON_Hooks* new_hooks) {
+    hooks.malloc_fn = new_hooks != nullptr && new_hooks->malloc_fn != nullptr ? new_hooks->malloc_fn : malloc;
+    hooks.free_fn = new_hooks != nullptr && new_hooks->free_fn != nullptr ? new_hooks->free_fn : free;
+}
+
+int cJSON_GetArraySize(const cJSON* array) {
+    int size = 0;
+    for (auto child = array != nullptr ? array->child : nullptr; child != nullptr; child = child->next) {
+        size++;
+    }
+    return size;
+}
+
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index) {
+    auto child = array != nullptr ? array->child : nullptr;
+    while (child != nullptr && index-- > 0) {
+        child = child->next;
+    }
+    return child;
+}
+
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* string) {
+    if (object == nullptr || string == nullptr) {
+        return nullptr;
+    }
+    for (auto child = object->child; child != nullptr; child = child->next) {
+        if (child->string != nullptr && strcasecmp(child->string, string) == 0) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+cJSON_bool cJSON_IsFalse(const cJSON* item) { return item != nullptr && (item->type & 0xFF) == cJSON_False; }
+cJSON_bool cJSON_IsTrue(const cJSON* item) { return item != nullptr && (item->type & 0xFF) == cJSON_True; }
+cJSON_bool cJSON_IsBool(const cJSON* item) { return item != nullptr && (item->type & (cJSON_True | cJSON_False)) != 0; }
+cJSON_bool cJSON_IsNull(const cJSON* item) { return item != nullptr && (item->type & 0xFF) == cJSON_NULL; }
+cJSON_bool cJSON_IsNumber(const cJSON* item) { return item != nullptr && (item->type & 0xFF) == cJSON_Number; }
+cJSON_bool cJSON_IsString(const cJSON* item) { return item != nullptr && (item->type & 0xFF) == cJSON_String; }
+cJSON_bool cJSON_IsArray(const cJSON* item) { return item != nullptr && (item->type & 0xFF) == cJSON_Array; }
+cJSON_bool cJSON_IsObject(const cJSON* item) { return item != nullptr && (item->type & 0xFF) == cJSON_Object; }
+
+cJSON* cJSON_CreateNull(void) { return NewItem(cJSON_NULL); }
+cJSON* cJSON_CreateTrue(void) { return NewItem(cJSON_True); }
+cJSON* cJSON_CreateFalse(void) { return NewItem(cJSON_False); }
+cJSON* cJSON_CreateBool(cJSON_bool boolean) { return NewItem(boolean ? cJSON_True : cJSON_False); }
+cJSON* cJSON_CreateArray(void) { return NewItem(cJSON_Array); }
+cJSON* cJSON_CreateObject(void) { return NewItem(cJSON_Object); }
+
+cJSON* cJSON_CreateNumber(double num) {
+    auto item = NewItem(cJSON_Number);
+    item->valuedouble = num;
+    item->valueint = num >= 2147483647.0 ? 2147483647 : num <= -2147483648.0 ? (int)-2147483648.0 : (int)num;
+    return item;
+}
+
+cJSON* cJSON_CreateString(const char* string) {
+    auto item = NewItem(cJSON_String);
+    item->valuestring = Duplicate(string, strlen(string));
+    return item;
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON* array, cJSON* item) {
+    if (array == nullptr || item == nullptr || array == item) {
+        return 0;
+    }
+    if (array->child == nullptr) {
+        array->child = item;
+        item->prev = item;
+        item->next = nullptr;
+    } else {
+        auto last = array->child->prev;
+        last->next = item;
+        item->prev = last;
+        array->child->prev = item;
+    }
+    return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON* object, const char* string, cJSON* item) {
+    if (object == nullptr || string == nullptr || item == nullptr) {
+        return 0;
+    }
+    hooks.free_fn(item->string);
+    item->string = Duplicate(string, strlen(string));
+    return cJSON_AddItemToArray(object, item);
+}
+
+static cJSON* AddTo(cJSON* object, const char* name, cJSON* item) {
+    if (cJSON_AddItemToObject(object, name, item)) {
+        return item;
+    }
+    cJSON_Delete(item);
+    return nullptr;
+}
+
+cJSON* cJSON_AddNullToObject(cJSON* object, const char* name) { return AddTo(object, name, cJSON_CreateNull()); }
+cJSON* cJSON_AddBoolToObject(cJSON* object, const char* name, cJSON_bool boolean) { return AddTo(object, name, cJSON_CreateBool(boolean)); }
+cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number) { return AddTo(object, name, cJSON_CreateNumber(number)); }
+cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* string) { return AddTo(object, name, cJSON_CreateString(string)); }
+cJSON* cJSON_AddObjectToObject(cJSON* object, const char* name) { return AddTo(object, name, cJSON_CreateObject()); }
+cJSON* cJSON_AddArrayToObject(cJSON* object, const char* name) { return AddTo(object, name, cJSON_CreateArray()); }
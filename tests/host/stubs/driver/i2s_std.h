@@ -0,0 +1,17 @@
+#ifndef DRIVER_I2S_STD_H
+#define DRIVER_I2S_STD_H
+
+#include <esp_err.h>
+
+// Codecs on the host never talk to I2S, the handle only has to exist
+typedef struct HostI2sChannel* i2s_chan_handle_t;
+
+inline esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+    return ESP_OK;
+}
+
+inline esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) {
+    return ESP_OK;
+}
+
+#endif // DRIVER_I2S_STD_H
@@ -0,0 +1,21 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+#include <cstdio>
+#include <cstdlib>
+
+// Host stand-in for the ESP-IDF logger: warnings and errors go to stderr, the rest only with HOST_LOG_VERBOSE set
+inline bool esp_log_host_verbose() {
+    static bool verbose = getenv("HOST_LOG_VERBOSE") != nullptr;
+    return verbose;
+}
+
+#define ESP_LOG_HOST(level, tag, format, ...) fprintf(stderr, level " (%s) " format "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_HOST("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { if (esp_log_host_verbose()) ESP_LOG_HOST("I", tag, format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, format, ...) do { if (esp_log_host_verbose()) ESP_LOG_HOST("D", tag, format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, format, ...) do { if (esp_log_host_verbose()) ESP_LOG_HOST("V", tag, format, ##__VA_ARGS__); } while (0)
+
+#endif // ESP_LOG_H
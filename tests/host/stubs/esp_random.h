@@ -0,0 +1,13 @@
+#ifndef ESP_RANDOM_H
+#define ESP_RANDOM_H
+
+#include <cstdint>
+#include <random>
+
+// Host stand-in for the hardware RNG, seeded the same way every run so jitter is reproducible
+inline uint32_t esp_random() {
+    thread_local std::mt19937 engine(12345);
+    return engine();
+}
+
+#endif // ESP_RANDOM_H
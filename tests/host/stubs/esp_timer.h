@@ -0,0 +1,13 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <chrono>
+#include <cstdint>
+
+// Host stand-in for the ESP-IDF high resolution timer. Like the device uptime it is never 0,
+// callers use 0 for "not set"
+inline int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // ESP_TIMER_H
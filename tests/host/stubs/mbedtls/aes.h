@@ -0,0 +1,58 @@
+#ifndef MBEDTLS_AES_H
+#define MBEDTLS_AES_H
+
+#include <cstddef>
+#include <cstring>
+
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/aes.h>
+
+// Host stand-in for the mbedtls AES calls the firmware makes, on top of OpenSSL's software AES.
+// Counter mode follows mbedtls exactly: the 128-bit counter is big-endian and nc_off/stream_block
+// carry a partial block over to the next call.
+
+#define MBEDTLS_AES_ENCRYPT 1
+#define MBEDTLS_AES_DECRYPT 0
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH -0x0020
+
+typedef struct mbedtls_aes_context {
+    AES_KEY key;
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+inline void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    return AES_set_encrypt_key(key, keybits, &ctx->key) == 0 ? 0 : MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+}
+
+inline int mbedtls_aes_crypt_ecb(mbedtls_aes_context* ctx, int mode, const unsigned char input[16], unsigned char output[16]) {
+    AES_encrypt(input, output, &ctx->key);
+    return 0;
+}
+
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+    size_t n = *nc_off;
+    for (size_t i = 0; i < length; i++) {
+        if (n == 0) {
+            AES_encrypt(nonce_counter, stream_block, &ctx->key);
+            for (int j = 16; j > 0; j--) {
+                if (++nonce_counter[j - 1] != 0) {
+                    break;
+                }
+            }
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) & 0x0F;
+    }
+    *nc_off = n;
+    return 0;
+}
+
+#endif // MBEDTLS_AES_H
@@ -0,0 +1,7 @@
+#ifndef ML307_MQTT_H
+#define ML307_MQTT_H
+
+// The modem client is not built on the host, the protocol only needs the interface
+#include "mqtt.h"
+
+#endif // ML307_MQTT_H
@@ -0,0 +1,37 @@
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <functional>
+#include <string>
+
+// Host stand-in for the esp-ml307 Mqtt interface, implemented by FakeMqtt in fake_transports.h.
+// Callbacks run on the client's receive task.
+class Mqtt {
+public:
+    virtual ~Mqtt() = default;
+    virtual void SetKeepAlive(int keep_alive_seconds) = 0;
+    virtual bool Connect(const std::string& broker_address, int broker_port, const std::string& client_id,
+        const std::string& username, const std::string& password) = 0;
+    virtual void Disconnect() = 0;
+    virtual bool Publish(const std::string& topic, const std::string& payload, int qos = 0) = 0;
+    virtual bool Subscribe(const std::string& topic, int qos = 0) = 0;
+    virtual bool Unsubscribe(const std::string& topic) = 0;
+    virtual bool IsConnected() = 0;
+
+    void OnConnected(std::function<void()> callback) {
+        on_connected_ = std::move(callback);
+    }
+    void OnDisconnected(std::function<void()> callback) {
+        on_disconnected_ = std::move(callback);
+    }
+    void OnMessage(std::function<void(const std::string& topic, const std::string& payload)> callback) {
+        on_message_ = std::move(callback);
+    }
+
+protected:
+    std::function<void()> on_connected_;
+    std::function<void()> on_disconnected_;
+    std::function<void(const std::string& topic, const std::string& payload)> on_message_;
+};
+
+#endif // MQTT_H
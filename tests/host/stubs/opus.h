@@ -0,0 +1,95 @@
+#ifndef OPUS_H
+#define OPUS_H
+
+#include <cstdint>
+#include <cstring>
+
+// Host stand-in for the libopus subset the firmware uses. The "codec" stores the PCM samples
+// as they are, so tests can check exactly which samples went into each frame. Frames larger
+// than the output buffer fail with OPUS_BUFFER_TOO_SMALL, as a real encoder would on overflow.
+
+typedef int16_t opus_int16;
+typedef int32_t opus_int32;
+
+#define OPUS_OK 0
+#define OPUS_BAD_ARG -1
+#define OPUS_BUFFER_TOO_SMALL -2
+#define OPUS_AUTO -1000
+#define OPUS_APPLICATION_VOIP 2048
+
+#define OPUS_RESET_STATE 4028
+#define OPUS_SET_BITRATE(x) 4002, (opus_int32)(x)
+#define OPUS_SET_COMPLEXITY(x) 4010, (opus_int32)(x)
+#define OPUS_SET_INBAND_FEC(x) 4012, (opus_int32)(x)
+#define OPUS_SET_PACKET_LOSS_PERC(x) 4014, (opus_int32)(x)
+#define OPUS_SET_DTX(x) 4016, (opus_int32)(x)
+
+struct OpusEncoder {
+    opus_int32 sample_rate;
+    int channels;
+};
+
+struct OpusDecoder {
+    opus_int32 sample_rate;
+    int channels;
+};
+
+inline bool opus_stub_valid_rate(opus_int32 sample_rate) {
+    return sample_rate == 8000 || sample_rate == 12000 || sample_rate == 16000 || sample_rate == 24000 || sample_rate == 48000;
+}
+
+inline OpusEncoder* opus_encoder_create(opus_int32 sample_rate, int channels, int application, int* error) {
+    if (!opus_stub_valid_rate(sample_rate)) {
+        *error = OPUS_BAD_ARG;
+        return nullptr;
+    }
+    *error = OPUS_OK;
+    return new OpusEncoder{sample_rate, channels};
+}
+
+inline void opus_encoder_destroy(OpusEncoder* encoder) {
+    delete encoder;
+}
+
+inline int opus_encoder_ctl(OpusEncoder* encoder, int request, ...) {
+    return OPUS_OK;
+}
+
+inline opus_int32 opus_encode(OpusEncoder* encoder, const opus_int16* pcm, int frame_size,
+    unsigned char* data, opus_int32 max_data_bytes) {
+    opus_int32 bytes = frame_size * encoder->channels * sizeof(opus_int16);
+    if (bytes > max_data_bytes) {
+        return OPUS_BUFFER_TOO_SMALL;
+    }
+    memcpy(data, pcm, bytes);
+    return bytes;
+}
+
+inline OpusDecoder* opus_decoder_create(opus_int32 sample_rate, int channels, int* error) {
+    if (!opus_stub_valid_rate(sample_rate)) {
+        *error = OPUS_BAD_ARG;
+        return nullptr;
+    }
+    *error = OPUS_OK;
+    return new OpusDecoder{sample_rate, channels};
+}
+
+inline void opus_decoder_destroy(OpusDecoder* decoder) {
+    delete decoder;
+}
+
+inline int opus_decoder_ctl(OpusDecoder* decoder, int request, ...) {
+    return OPUS_OK;
+}
+
+inline int opus_decode(OpusDecoder* decoder, const unsigned char* data, opus_int32 len, opus_int16* pcm,
+    int frame_size, int decode_fec) {
+    int samples = len / sizeof(opus_int16) / decoder->channels;
+    if (samples > frame_size) {
+        return OPUS_BUFFER_TOO_SMALL;
+    }
+    memcpy(pcm, data, samples * decoder->channels * sizeof(opus_int16));
+    return samples;
+}
+
+#endif // OPUS_H
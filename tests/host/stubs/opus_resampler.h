@@ -0,0 +1,38 @@
+#ifndef OPUS_RESAMPLER_H
+#define OPUS_RESAMPLER_H
+
+#include <cstdint>
+
+// Host stand-in for the esp-opus-encoder resampler: same interface, linear interpolation
+// instead of the SILK resampler, so results are deterministic but not bit-exact with the device
+class OpusResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate) {
+        input_sample_rate_ = input_sample_rate;
+        output_sample_rate_ = output_sample_rate;
+    }
+
+    int GetOutputSamples(int input_samples) const {
+        return (int)((int64_t)input_samples * output_sample_rate_ / input_sample_rate_);
+    }
+
+    void Process(const int16_t* input, int input_samples, int16_t* output) {
+        int output_samples = GetOutputSamples(input_samples);
+        for (int i = 0; i < output_samples; i++) {
+            int64_t position = (int64_t)i * input_sample_rate_;
+            int index = (int)(position / output_sample_rate_);
+            int fraction = (int)(position % output_sample_rate_);
+            int next = index + 1 < input_samples ? input[index + 1] : input[index];
+            output[i] = (int16_t)(input[index] + (int64_t)(next - input[index]) * fraction / output_sample_rate_);
+        }
+    }
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 16000;
+    int output_sample_rate_ = 16000;
+};
+
+#endif // OPUS_RESAMPLER_H
@@ -0,0 +1,6 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Host stand-in for the generated sdkconfig.h, options the tests need are defined on the command line
+
+#endif // SDKCONFIG_H
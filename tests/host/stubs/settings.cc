@@ -0,0 +1,41 @@
+#include "settings.h"
+
+#include <map>
+#include <mutex>
+
+static std::mutex settings_mutex;
+static std::map<std::string, std::map<std::string, std::string>> settings_values;
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns) {
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    auto& values = settings_values[ns_];
+    auto it = values.find(key);
+    return it != values.end() ? it->second : default_value;
+}
+
+void Settings::SetString(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    settings_values[ns_][key] = value;
+}
+
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    auto value = GetString(key);
+    return value.empty() ? default_value : std::stoi(value);
+}
+
+void Settings::SetInt(const std::string& key, int32_t value) {
+    SetString(key, std::to_string(value));
+}
+
+void Settings::EraseKey(const std::string& key) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    settings_values[ns_].erase(key);
+}
+
+void Settings::EraseAll() {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    settings_values[ns_].clear();
+}
@@ -0,0 +1,25 @@
+#ifndef _SYSTEM_INFO_H_
+#define _SYSTEM_INFO_H_
+
+#include <string>
+
+// Identity a host device reports. Per thread, so the load generator's virtual devices each
+// send their own Device-Id and Client-Id from one process.
+struct HostDeviceIdentity {
+    std::string mac_address = "02:00:00:00:00:01";
+    std::string uuid = "00000000-0000-4000-8000-000000000000";
+};
+
+inline HostDeviceIdentity& GetHostDeviceIdentity() {
+    static thread_local HostDeviceIdentity identity;
+    return identity;
+}
+
+// Host stand-in for the chip information the protocols report
+class SystemInfo {
+public:
+    static std::string GetMacAddress() { return GetHostDeviceIdentity().mac_address; }
+    static std::string GetChipModelName() { return "host"; }
+};
+
+#endif // _SYSTEM_INFO_H_
@@ -0,0 +1,40 @@
+#ifndef WEB_SOCKET_H
+#define WEB_SOCKET_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Host stand-in for the esp-ml307 WebSocket, implemented by FakeWebSocket in fake_transports.h.
+// Callbacks run on the transport's receive task.
+class WebSocket {
+public:
+    virtual ~WebSocket() = default;
+    virtual void SetHeader(const char* key, const char* value) = 0;
+    virtual bool Connect(const char* uri) = 0;
+    virtual bool IsConnected() const = 0;
+    virtual bool Send(const std::string& data) = 0;
+    virtual bool Send(const void* data, size_t len, bool binary = false, bool fin = true) = 0;
+    virtual void Close() = 0;
+
+    void OnConnected(std::function<void()> callback) {
+        on_connected_ = std::move(callback);
+    }
+    void OnDisconnected(std::function<void()> callback) {
+        on_disconnected_ = std::move(callback);
+    }
+    void OnData(std::function<void(const char* data, size_t len, bool binary)> callback) {
+        on_data_ = std::move(callback);
+    }
+    void OnError(std::function<void(int error)> callback) {
+        on_error_ = std::move(callback);
+    }
+
+protected:
+    std::function<void()> on_connected_;
+    std::function<void()> on_disconnected_;
+    std::function<void(const char* data, size_t len, bool binary)> on_data_;
+    std::function<void(int error)> on_error_;
+};
+
+#endif // WEB_SOCKET_H
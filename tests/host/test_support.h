@@ -0,0 +1,47 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Heap allocations made through operator new by any thread since the program started
+size_t AllocationCount();
+
+// Counts the allocations made while it is alive
+class AllocationScope {
+public:
+    AllocationScope() : start_(AllocationCount()) {}
+    size_t count() const { return AllocationCount() - start_; }
+
+private:
+    size_t start_;
+};
+
+uint64_t ReadCycleCounter();
+
+struct BenchResult {
+    double ns_per_iteration;
+    double cycles_per_iteration;
+};
+
+// Runs fn `iterations` times after a short warm-up and prints the cost per iteration
+template <typename F>
+BenchResult Bench(const char* name, size_t iterations, F&& fn) {
+    for (size_t i = 0; i < iterations / 10 + 1; i++) {
+        fn();
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = ReadCycleCounter();
+    for (size_t i = 0; i < iterations; i++) {
+        fn();
+    }
+    uint64_t cycles = ReadCycleCounter() - start_cycles;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    BenchResult result{ns / iterations, (double)cycles / iterations};
+    printf("[ BENCH    ] %-40s %10.1f ns %10.0f cycles\n", name, result.ns_per_iteration, result.cycles_per_iteration);
+    return result;
+}
+
+#endif // TEST_SUPPORT_H
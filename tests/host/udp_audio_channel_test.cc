@@ -0,0 +1,226 @@
+#include "udp_audio_channel.h"
+#include "audio_packet_ring.h"
+#include "fake_transports.h"
+#include "test_support.h"
+
+#include <gtest/gtest.h>
+#include <openssl/evp.h>
+#include <arpa/inet.h>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char* kKeyHex = "000102030405060708090a0b0c0d0e0f";
+const char* kNonceHex = "01000000aabbccdd0000000000000000";
+const uint8_t kKey[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+// Reference AES-128-CTR through OpenSSL's EVP interface, independent of the mbedtls stand-in
+std::vector<uint8_t> ReferenceCtr(const uint8_t* nonce, const uint8_t* data, size_t size) {
+    std::vector<uint8_t> output(size);
+    auto ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), nullptr, kKey, nonce);
+    int length = 0;
+    EVP_EncryptUpdate(ctx, output.data(), &length, data, size);
+    EVP_CIPHER_CTX_free(ctx);
+    return output;
+}
+
+struct Channel {
+    UdpAudioChannel channel;
+    FakeUdp* udp = nullptr;
+
+    Channel() {
+        GetHostTransports().create_udp = [this]() -> Udp* {
+            udp = new FakeUdp();
+            return udp;
+        };
+        auto config = cJSON_CreateObject();
+        cJSON_AddStringToObject(config, "server", "127.0.0.1");
+        cJSON_AddNumberToObject(config, "port", 8888);
+        cJSON_AddStringToObject(config, "key", kKeyHex);
+        cJSON_AddStringToObject(config, "nonce", kNonceHex);
+        EXPECT_TRUE(channel.Configure(config));
+        cJSON_Delete(config);
+        EXPECT_TRUE(channel.Open());
+        channel.SetServerAudioParams(24000, 60);
+    }
+
+    ~Channel() {
+        ResetHostTransports();
+    }
+};
+
+AudioStreamPacket MakeUplinkPacket(size_t opus_size, uint32_t timestamp, uint8_t seed) {
+    AudioStreamPacket packet;
+    packet.headroom = AUDIO_PACKET_HEADROOM;
+    packet.timestamp = timestamp;
+    packet.payload.resize(AUDIO_PACKET_HEADROOM + opus_size);
+    uint8_t* opus = packet.payload.data() + AUDIO_PACKET_HEADROOM;
+    for (size_t i = 0; i < opus_size; i++) {
+        opus[i] = (uint8_t)(seed + i * 3);
+    }
+    return packet;
+}
+
+uint32_t ReadBe32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return ntohl(value);
+}
+
+// What the server sends: the nonce with type, size, timestamp and sequence filled in, then the ciphertext
+std::string MakeDownlinkDatagram(uint32_t timestamp, uint32_t sequence, const std::vector<uint8_t>& opus) {
+    uint8_t nonce[UDP_AUDIO_NONCE_SIZE] = {0x01, 0, 0, 0, 0xaa, 0xbb, 0xcc, 0xdd};
+    uint16_t size = htons(opus.size());
+    memcpy(&nonce[2], &size, 2);
+    uint32_t be = htonl(timestamp);
+    memcpy(&nonce[8], &be, 4);
+    be = htonl(sequence);
+    memcpy(&nonce[12], &be, 4);
+    auto encrypted = ReferenceCtr(nonce, opus.data(), opus.size());
+    std::string datagram((const char*)nonce, sizeof(nonce));
+    datagram.append((const char*)encrypted.data(), encrypted.size());
+    return datagram;
+}
+
+TEST(UdpAudioChannel, SealsFramesWithTheNonceHeader) {
+    Channel c;
+    ASSERT_NE(c.udp, nullptr);
+    EXPECT_EQ(c.udp->host, "127.0.0.1");
+    EXPECT_EQ(c.udp->port, 8888);
+
+    for (uint32_t i = 1; i <= 3; i++) {
+        auto packet = MakeUplinkPacket(100 + i, 1000 * i, (uint8_t)i);
+        ASSERT_TRUE(c.channel.Send(packet));
+
+        auto& datagram = c.udp->last_datagram;
+        ASSERT_EQ(datagram.size(), UDP_AUDIO_NONCE_SIZE + 100 + i);
+        auto bytes = (const uint8_t*)datagram.data();
+        EXPECT_EQ(bytes[0], UDP_AUDIO_TYPE_OPUS);
+        EXPECT_EQ(bytes[1], 0);
+        EXPECT_EQ((bytes[2] << 8) | bytes[3], (int)(100 + i));
+        // The ssrc bytes come from the server nonce untouched
+        EXPECT_EQ(memcmp(bytes + 4, "\xaa\xbb\xcc\xdd", 4), 0);
+        EXPECT_EQ(ReadBe32(bytes + 8), 1000 * i);
+        EXPECT_EQ(ReadBe32(bytes + 12), i);
+
+        auto plain = ReferenceCtr(bytes, bytes + UDP_AUDIO_NONCE_SIZE, datagram.size() - UDP_AUDIO_NONCE_SIZE);
+        EXPECT_TRUE(std::equal(plain.begin(), plain.end(), packet.payload.begin() + AUDIO_PACKET_HEADROOM));
+    }
+}
+
+TEST(UdpAudioChannel, BatchCarriesFrameCountAndEntries) {
+    Channel c;
+    std::vector<AudioStreamPacket> packets;
+    for (uint32_t i = 0; i < 3; i++) {
+        packets.push_back(MakeUplinkPacket(50 + i, 60 * i, (uint8_t)(i * 17)));
+    }
+    ASSERT_TRUE(c.channel.SendBatch(packets));
+
+    auto bytes = (const uint8_t*)c.udp->last_datagram.data();
+    EXPECT_EQ(bytes[0], UDP_AUDIO_TYPE_OPUS_BATCH);
+    EXPECT_EQ(bytes[1], 3);
+    EXPECT_EQ(ReadBe32(bytes + 8), 0u);
+    EXPECT_EQ(ReadBe32(bytes + 12), 1u);
+    auto plain = ReferenceCtr(bytes, bytes + UDP_AUDIO_NONCE_SIZE, c.udp->last_datagram.size() - UDP_AUDIO_NONCE_SIZE);
+    size_t offset = 0;
+    for (auto& packet : packets) {
+        size_t opus_size = packet.payload.size() - packet.headroom;
+        ASSERT_LE(offset + AUDIO_BATCH_ENTRY_HEADER_SIZE + opus_size, plain.size());
+        EXPECT_EQ(ReadBe32(&plain[offset]), packet.timestamp);
+        EXPECT_EQ((plain[offset + 4] << 8) | plain[offset + 5], (int)opus_size);
+        EXPECT_TRUE(std::equal(packet.payload.begin() + packet.headroom, packet.payload.end(),
+            plain.begin() + offset + AUDIO_BATCH_ENTRY_HEADER_SIZE));
+        offset += AUDIO_BATCH_ENTRY_HEADER_SIZE + opus_size;
+    }
+    EXPECT_EQ(offset, plain.size());
+
+    // The next datagram continues after the last frame of the batch
+    auto packet = MakeUplinkPacket(10, 0, 0);
+    c.channel.Send(packet);
+    EXPECT_EQ(ReadBe32((const uint8_t*)c.udp->last_datagram.data() + 12), 4u);
+}
+
+TEST(UdpAudioChannel, DecryptsDownlinkDatagrams) {
+    Channel c;
+    std::vector<AudioStreamPacket> received;
+    c.channel.OnIncomingAudio([&received](AudioStreamPacket&& packet) {
+        received.push_back(packet);
+    });
+
+    std::vector<uint8_t> opus(173);
+    for (size_t i = 0; i < opus.size(); i++) {
+        opus[i] = (uint8_t)(i * 7 + 1);
+    }
+    c.udp->Receive(MakeDownlinkDatagram(4242, 9, opus));
+    // Wrong type and short datagrams are dropped
+    c.udp->Receive(std::string("\x02", 1) + std::string(40, '\0'));
+    c.udp->Receive(std::string(8, '\x01'));
+
+    ASSERT_EQ(received.size(), 1u);
+    EXPECT_EQ(received[0].timestamp, 4242u);
+    EXPECT_EQ(received[0].sequence, 9u);
+    EXPECT_EQ(received[0].sample_rate, 24000);
+    EXPECT_EQ(received[0].frame_duration, 60);
+    EXPECT_EQ(received[0].payload, opus);
+}
+
+TEST(UdpAudioChannel, SteadyStateSendAndReceiveDoNotAllocate) {
+    Channel c;
+    // Hands the payload over like AudioJitterBuffer::Put does, a spare buffer goes back
+    std::vector<uint8_t> spare;
+    spare.reserve(AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+    size_t received = 0;
+    c.channel.OnIncomingAudio([&spare, &received](AudioStreamPacket&& packet) {
+        std::swap(spare, packet.payload);
+        received++;
+    });
+    auto packet = MakeUplinkPacket(180, 0, 1);
+    std::vector<uint8_t> opus(180, 0x5a);
+    std::vector<std::string> datagrams;
+    for (uint32_t i = 0; i < 100; i++) {
+        datagrams.push_back(MakeDownlinkDatagram(i * 60, i + 1, opus));
+    }
+    for (int i = 0; i < 4; i++) {
+        c.channel.Send(packet);
+        c.udp->Receive(datagrams[i]);
+    }
+
+    AllocationScope allocations;
+    for (uint32_t i = 4; i < 100; i++) {
+        ASSERT_TRUE(c.channel.Send(packet));
+        c.udp->Receive(datagrams[i]);
+    }
+    EXPECT_EQ(allocations.count(), 0u);
+    EXPECT_EQ(received, 100u);
+}
+
+TEST(UdpAudioChannelBenchmark, PacketsPerSecond) {
+    Channel c;
+    std::vector<uint8_t> spare;
+    spare.reserve(AUDIO_PACKET_RING_PAYLOAD_RESERVE);
+    c.channel.OnIncomingAudio([&spare](AudioStreamPacket&& packet) {
+        std::swap(spare, packet.payload);
+    });
+
+    // A 60 ms frame at the usual 16 to 24 kbps is 120 to 180 bytes
+    for (size_t size : {120, 180}) {
+        auto packet = MakeUplinkPacket(size, 0, 1);
+        char name[64];
+        snprintf(name, sizeof(name), "UdpAudioChannel send %u B", (unsigned)size);
+        auto send = Bench(name, 200000, [&]() {
+            c.channel.Send(packet);
+        });
+        printf("[ BENCH    ] %-40s %10.0f packets/s\n", name, 1e9 / send.ns_per_iteration);
+
+        auto datagram = MakeDownlinkDatagram(0, 1, std::vector<uint8_t>(size, 0x5a));
+        snprintf(name, sizeof(name), "UdpAudioChannel receive %u B", (unsigned)size);
+        auto receive = Bench(name, 200000, [&]() {
+            c.udp->Receive(datagram);
+        });
+        printf("[ BENCH    ] %-40s %10.0f packets/s\n", name, 1e9 / receive.ns_per_iteration);
+    }
+}
+
+} // namespace
@@ -0,0 +1,212 @@
+#include "uplink_rate_controller.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+
+namespace {
+
+// Drives one evaluation window: `sent` good sends and `failures` failed ones, each taking
+// `send_us`, the deepest send queue seen, then the window is closed
+class Link {
+public:
+    explicit Link(int frame_duration = 60) : controller(frame_duration) {
+        controller.Update(now_us);
+    }
+
+    bool Window(int sent, int failures = 0, int64_t send_us = 1000, size_t queue_depth = 1) {
+        for (int i = 0; i < sent; i++) {
+            controller.OnSendResult(true, send_us);
+        }
+        for (int i = 0; i < failures; i++) {
+            controller.OnSendResult(false, send_us);
+        }
+        controller.OnQueueDepth(queue_depth);
+        now_us += UPLINK_RATE_WINDOW_MS * 1000;
+        return controller.Update(now_us);
+    }
+
+    bool Congested() { return Window(27, 3); }
+    bool Clean() { return Window(30); }
+
+    UplinkRateController controller;
+    int64_t now_us = 1000000;
+};
+
+} // namespace
+
+TEST(UplinkRateController, KeepsEncoderDefaultsOnACleanLink) {
+    Link link;
+    for (int i = 0; i < 10; i++) {
+        EXPECT_FALSE(link.Clean());
+    }
+    auto& params = link.controller.params();
+    EXPECT_EQ(params.bitrate, 0);
+    EXPECT_FALSE(params.fec);
+    EXPECT_EQ(params.packet_loss, 0);
+    EXPECT_EQ(params.frame_duration, 60);
+}
+
+TEST(UplinkRateController, EvaluatesOnlyFullWindowsWithTraffic) {
+    Link link;
+    link.controller.OnSendResult(false, 1000);
+    link.now_us += UPLINK_RATE_WINDOW_MS * 1000 - 1;
+    EXPECT_FALSE(link.controller.Update(link.now_us));
+    EXPECT_EQ(link.controller.params().bitrate, 0);
+
+    // The failure still counts once the window is complete
+    link.now_us += 1;
+    EXPECT_TRUE(link.controller.Update(link.now_us));
+    EXPECT_EQ(link.controller.params().bitrate, UPLINK_BITRATE_BASELINE * 3 / 4);
+
+    // A window without any traffic says nothing about the link
+    auto before = link.controller.params();
+    EXPECT_FALSE(link.Window(0));
+    EXPECT_EQ(link.controller.params().bitrate, before.bitrate);
+    EXPECT_EQ(link.controller.params().packet_loss, before.packet_loss);
+}
+
+TEST(UplinkRateController, CongestionCutsTheBitrateDownToTheFloor) {
+    Link link;
+    const int expected[] = { 12000, 9000, 8000, 8000 };
+    for (int bitrate : expected) {
+        link.Congested();
+        EXPECT_EQ(link.controller.params().bitrate, bitrate);
+    }
+}
+
+TEST(UplinkRateController, EveryCongestionSignalCounts) {
+    {
+        // Packets dropped before the send count as lost
+        Link link;
+        link.controller.OnEncoderDrop(3);
+        EXPECT_TRUE(link.Window(27));
+        EXPECT_EQ(link.controller.params().bitrate, 12000);
+        EXPECT_EQ(link.controller.params().packet_loss, 10);
+    }
+    {
+        // Sends slower than half a frame
+        Link link;
+        EXPECT_TRUE(link.Window(30, 0, 31000));
+        EXPECT_EQ(link.controller.params().bitrate, 12000);
+        EXPECT_FALSE(link.controller.params().fec);
+    }
+    {
+        // A backed up send queue
+        Link link;
+        EXPECT_TRUE(link.Window(30, 0, 1000, UPLINK_QUEUE_DEPTH_THRESHOLD + 1));
+        EXPECT_EQ(link.controller.params().bitrate, 12000);
+    }
+    {
+        // Half a frame of send time and a queue at the threshold are still fine
+        Link link;
+        EXPECT_FALSE(link.Window(30, 0, 30000, UPLINK_QUEUE_DEPTH_THRESHOLD));
+        EXPECT_EQ(link.controller.params().bitrate, 0);
+    }
+    {
+        // 1% loss only turns on FEC
+        Link link;
+        EXPECT_TRUE(link.Window(99, 1));
+        EXPECT_EQ(link.controller.params().bitrate, 0);
+        EXPECT_TRUE(link.controller.params().fec);
+        EXPECT_EQ(link.controller.params().packet_loss, 1);
+    }
+}
+
+TEST(UplinkRateController, FecFollowsLossUpAtOnceAndDecaysSlowly) {
+    Link link;
+    EXPECT_TRUE(link.Window(27, 3));
+    EXPECT_TRUE(link.controller.params().fec);
+    EXPECT_EQ(link.controller.params().packet_loss, 10);
+
+    // Loss above the estimate is taken over unchanged, capped for the encoder
+    EXPECT_TRUE(link.Window(10, 10));
+    EXPECT_EQ(link.controller.params().packet_loss, 30);
+
+    // 50 -> 37 -> 27 -> 20 -> ... -> 0, three quarters per clean window
+    int previous = 50;
+    int windows = 0;
+    while (link.controller.params().fec) {
+        link.Clean();
+        int expected = previous * 3 / 4;
+        EXPECT_EQ(link.controller.params().packet_loss, std::min(expected, 30));
+        previous = expected;
+        ASSERT_LT(++windows, 20);
+    }
+    EXPECT_EQ(link.controller.params().packet_loss, 0);
+}
+
+TEST(UplinkRateController, CleanWindowsStepTheBitrateBackToAuto) {
+    Link link;
+    link.Congested();
+    link.Congested();
+    ASSERT_EQ(link.controller.params().bitrate, 9000);
+
+    // Additive increase every UPLINK_RATE_RECOVER_WINDOWS clean windows, then back to OPUS_AUTO
+    const int expected[] = { 11000, 13000, 15000, 0 };
+    for (int bitrate : expected) {
+        for (int i = 0; i < UPLINK_RATE_RECOVER_WINDOWS - 1; i++) {
+            int before = link.controller.params().bitrate;
+            link.Clean();
+            EXPECT_EQ(link.controller.params().bitrate, before);
+        }
+        link.Clean();
+        EXPECT_EQ(link.controller.params().bitrate, bitrate);
+    }
+
+    // Congestion in between restarts the count
+    link.Congested();
+    ASSERT_EQ(link.controller.params().bitrate, 12000);
+    link.Clean();
+    link.Clean();
+    link.Congested();
+    EXPECT_EQ(link.controller.params().bitrate, 9000);
+}
+
+#if CONFIG_UPLINK_ADAPTIVE_FRAME_DURATION
+TEST(UplinkRateController, LongFramesOnlyAtTheBitrateFloor) {
+    Link link;
+    while (link.controller.params().bitrate != UPLINK_BITRATE_MIN) {
+        link.Congested();
+        EXPECT_EQ(link.controller.params().frame_duration, 60);
+    }
+
+    link.Congested();
+    EXPECT_EQ(link.controller.params().frame_duration, UPLINK_CONGESTED_FRAME_DURATION_MS);
+    EXPECT_EQ(link.controller.params().bitrate, UPLINK_BITRATE_MIN);
+
+    // Recovery restores the frame duration before the bitrate. Half of a 120 ms frame is the
+    // send time budget meanwhile, so 50 ms sends count as clean
+    for (int i = 0; i < UPLINK_RATE_RECOVER_WINDOWS; i++) {
+        EXPECT_EQ(link.controller.params().frame_duration, UPLINK_CONGESTED_FRAME_DURATION_MS);
+        link.Window(30, 0, 50000);
+    }
+    EXPECT_EQ(link.controller.params().frame_duration, 60);
+    EXPECT_EQ(link.controller.params().bitrate, UPLINK_BITRATE_MIN);
+    for (int i = 0; i < UPLINK_RATE_RECOVER_WINDOWS; i++) {
+        link.Clean();
+    }
+    EXPECT_EQ(link.controller.params().frame_duration, 60);
+    EXPECT_EQ(link.controller.params().bitrate, UPLINK_BITRATE_MIN + UPLINK_BITRATE_STEP);
+}
+#endif
+
+TEST(UplinkRateController, BatchesOnlyWhatTheLinkNeeds) {
+    UplinkRateController controller(60);
+    EXPECT_EQ(controller.NextBatchSize(0, 4, 0, true), 0u);
+    EXPECT_EQ(controller.NextBatchSize(1, 1, 1000, true), 1u);
+    EXPECT_EQ(controller.NextBatchSize(3, 4, 0, true), 3u);
+    EXPECT_EQ(controller.NextBatchSize(6, 4, 0, true), 4u);
+
+    // An idle fast link sends a lone frame right away
+    EXPECT_EQ(controller.NextBatchSize(1, 4, 50, true), 1u);
+    EXPECT_FALSE(controller.holding());
+
+    // A slow link holds it back for one round only
+    EXPECT_EQ(controller.NextBatchSize(1, 4, CONFIG_UPLINK_AUDIO_BATCH_RTT_MS, true), 0u);
+    EXPECT_TRUE(controller.holding());
+    EXPECT_EQ(controller.NextBatchSize(1, 4, CONFIG_UPLINK_AUDIO_BATCH_RTT_MS, true), 1u);
+    EXPECT_FALSE(controller.holding());
+
+    // Unless the frame has to leave now
+    EXPECT_EQ(controller.NextBatchSize(1, 4, CONFIG_UPLINK_AUDIO_BATCH_RTT_MS, false), 1u);
+}